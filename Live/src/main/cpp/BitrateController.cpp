@@ -0,0 +1,121 @@
+
+#include <algorithm>
+#include <chrono>
+#include "BitrateController.h"
+
+int64_t BitrateController::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void BitrateController::configure(int bitrate_kbps, int fps, bool allow_half) {
+    m_maxKbps    = std::max(bitrate_kbps, 1);
+    m_minKbps    = std::max(std::max(std::min(m_maxKbps / 5, 100), m_maxKbps / 8), 1);
+    m_targetKbps = m_maxKbps;
+    m_fps        = fps;
+    m_level      = ABR_LEVEL_FULL;
+    m_allowHalf  = allow_half;
+    m_stableWindows = 0;
+    m_floorWindows  = 0;
+    m_windowStart   = 0;
+}
+
+int BitrateController::levelMaxKbps(int level) const {
+    switch (level) {
+        case ABR_LEVEL_LOW_FPS:
+            return std::max(m_maxKbps * 2 / 3, m_minKbps);
+        case ABR_LEVEL_HALF:
+            return std::max(m_maxKbps / 3, m_minKbps);
+        default:
+            return m_maxKbps;
+    }
+}
+
+void BitrateController::resetWindow(int64_t now, int depth, int64_t dropped) {
+    m_windowStart  = now;
+    m_bytes        = 0;
+    m_videoBytes   = 0;
+    m_sendUs       = 0;
+    m_depthStart   = depth;
+    m_droppedStart = dropped;
+}
+
+bool BitrateController::onPacketSent(bool video, int bytes, int64_t send_us,
+                                     int queue_depth, int64_t dropped, AbrStats *stats) {
+    int64_t now = nowUs();
+    if (m_windowStart == 0) {
+        resetWindow(now, queue_depth, dropped);
+    }
+    m_bytes  += bytes;
+    m_sendUs += send_us;
+    if (video) {
+        m_videoBytes += bytes;
+    }
+    int64_t elapsed = now - m_windowStart;
+    if (elapsed < WINDOW_US) {
+        return false;
+    }
+
+    int sendKbps  = static_cast<int>(m_bytes * 8 * 1000 / elapsed);
+    int videoKbps = static_cast<int>(m_videoBytes * 8 * 1000 / elapsed);
+    int busy      = static_cast<int>(std::min<int64_t>(m_sendUs * 100 / elapsed, 100));
+    int growth    = queue_depth - m_depthStart;
+    int drops     = static_cast<int>(dropped - m_droppedStart);
+
+    // half a second of video piling up, or a second queued, means the link can't keep up
+    bool congested = drops > 0 || busy > 85
+                     || growth > std::max(m_fps / 2, 2)
+                     || queue_depth > std::max(m_fps, 4);
+    bool clear = busy < 50 && queue_depth <= 2;
+
+    int decision = ABR_HOLD;
+    if (congested) {
+        m_stableWindows = 0;
+        if (m_targetKbps <= m_minKbps) {
+            if (++m_floorWindows >= FLOOR_WINDOWS_TO_DEGRADE) {
+                int maxLevel = m_allowHalf ? ABR_LEVEL_HALF : ABR_LEVEL_LOW_FPS;
+                if (m_level < maxLevel) {
+                    m_level++;
+                    decision = ABR_DEGRADE;
+                }
+                m_floorWindows = 0;
+            }
+        } else {
+            int target = m_targetKbps * 3 / 4;
+            if (videoKbps > 0) {
+                target = std::min(target, videoKbps * 9 / 10);
+            }
+            m_targetKbps = std::max(target, m_minKbps);
+            decision = ABR_DECREASE;
+        }
+    } else if (clear) {
+        m_floorWindows = 0;
+        if (++m_stableWindows >= STABLE_WINDOWS_TO_INCREASE) {
+            m_stableWindows = 0;
+            int ceiling = levelMaxKbps(m_level);
+            if (m_targetKbps < ceiling) {
+                m_targetKbps = std::min(ceiling, m_targetKbps + std::max(m_targetKbps / 10, 50));
+                decision = ABR_INCREASE;
+            } else if (m_level > ABR_LEVEL_FULL) {
+                m_level--;
+                decision = ABR_UPGRADE;
+            }
+        }
+    } else {
+        m_stableWindows = 0;
+        m_floorWindows  = 0;
+    }
+
+    if (stats) {
+        stats->send_kbps    = sendKbps;
+        stats->video_kbps   = videoKbps;
+        stats->target_kbps  = m_targetKbps;
+        stats->busy_percent = busy;
+        stats->queue_depth  = queue_depth;
+        stats->dropped      = drops;
+        stats->level        = m_level;
+        stats->decision     = decision;
+    }
+    resetWindow(now, queue_depth, dropped);
+    return true;
+}
@@ -0,0 +1,92 @@
+
+#ifndef BITRATE_CONTROLLER_H
+#define BITRATE_CONTROLLER_H
+
+#include <cstdint>
+
+//decisions of one window, relative to Java
+const int ABR_HOLD      = 0;
+const int ABR_DECREASE  = 1;
+const int ABR_INCREASE  = 2;
+const int ABR_DEGRADE   = 3;
+const int ABR_UPGRADE   = 4;
+
+//degradation ladder: full, lower framerate, half resolution and lower framerate
+const int ABR_LEVEL_FULL    = 0;
+const int ABR_LEVEL_LOW_FPS = 1;
+const int ABR_LEVEL_HALF    = 2;
+
+struct AbrStats {
+    int send_kbps;       // measured throughput of the window, audio included
+    int video_kbps;      // video part of it
+    int target_kbps;     // bitrate asked from the encoder
+    int busy_percent;    // share of the window spent inside RTMP_SendPacket
+    int queue_depth;
+    int dropped;         // video frames dropped by the queue during the window
+    int level;
+    int decision;
+};
+
+/**
+ * Adaptive bitrate, fed by the sending thread after each RTMP_SendPacket.
+ *
+ * Once per window it compares the time spent blocked in the socket write,
+ * the growth of the packet queue and the frames dropped by it. On congestion
+ * the bitrate goes down multiplicatively, at most to the measured video
+ * throughput; after a few clear windows it goes up again by small steps.
+ * Stuck at the floor, it falls back to a lower framerate, then to half the
+ * resolution, and climbs back once the ceiling of a level is reached.
+ */
+class BitrateController {
+private:
+    static const int64_t WINDOW_US = 1000000;
+    static const int STABLE_WINDOWS_TO_INCREASE = 3;
+    static const int FLOOR_WINDOWS_TO_DEGRADE = 2;
+
+    int m_maxKbps = 0;
+    int m_minKbps = 0;
+    int m_targetKbps = 0;
+    int m_fps = 0;
+    int m_level = ABR_LEVEL_FULL;
+    bool m_allowHalf = false;
+
+    int64_t m_windowStart = 0;
+    int64_t m_bytes = 0;
+    int64_t m_videoBytes = 0;
+    int64_t m_sendUs = 0;
+    int64_t m_droppedStart = 0;
+    int m_depthStart = 0;
+
+    int m_stableWindows = 0;
+    int m_floorWindows = 0;
+
+    int levelMaxKbps(int level) const;
+
+    void resetWindow(int64_t now, int depth, int64_t dropped);
+
+public:
+    static int64_t nowUs();
+
+    /**
+     * @param bitrate_kbps the configured bitrate, also the ceiling
+     * @param allow_half whether the picture can be halved, which needs a size multiple of 4
+     */
+    void configure(int bitrate_kbps, int fps, bool allow_half);
+
+    /**
+     * Account one sent packet.
+     * @return true when a window completed, with its result in stats
+     */
+    bool onPacketSent(bool video, int bytes, int64_t send_us,
+                      int queue_depth, int64_t dropped, AbrStats *stats);
+
+    int targetKbps() const {
+        return m_targetKbps;
+    }
+
+    int level() const {
+        return m_level;
+    }
+};
+
+#endif // BITRATE_CONTROLLER_H
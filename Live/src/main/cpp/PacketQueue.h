@@ -2,72 +2,158 @@
 #ifndef PACKET_QUEUE_H
 #define PACKET_QUEUE_H
 
-#include <queue>
-#include <thread>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+/**
+ * Futex based wakeup: waiters sleep until the sequence number moves.
+ * Notifying is a single atomic increment when nobody is waiting.
+ */
+class FutexEvent {
+private:
+    std::atomic<int> m_seq;
+    std::atomic<int> m_waiters;
+
+public:
+    FutexEvent() : m_seq(0), m_waiters(0) {}
+
+    int sequence() {
+        return m_seq.load(std::memory_order_seq_cst);
+    }
+
+    void beginWait() {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    void endWait() {
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    /**
+     * Sleep while the sequence equals seq. beginWait() must be called before
+     * reading seq and re-checking the condition, so that no notify gets lost.
+     */
+    void wait(int seq, int timeout_ms) {
+        struct timespec timeout;
+        timeout.tv_sec  = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        syscall(SYS_futex, reinterpret_cast<int *>(&m_seq), FUTEX_WAIT_PRIVATE,
+                seq, timeout_ms >= 0 ? &timeout : nullptr, nullptr, 0);
+    }
+
+    void notify() {
+        m_seq.fetch_add(1, std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_seq_cst) > 0) {
+            syscall(SYS_futex, reinterpret_cast<int *>(&m_seq), FUTEX_WAKE_PRIVATE,
+                    INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+};
+
+/**
+ * Bounded lock-free ring for exactly one producer thread and one consumer thread.
+ * The capacity is rounded up to a power of two. Blocking is left to the owner,
+ * see FutexEvent.
+ */
 template<typename T>
 class PacketQueue {
-    typedef void (*ReleaseCallback)(T &);
-
 private:
-    std::mutex m_mutex;
-    std::condition_variable m_cond;
-    std::queue<T> m_queue;
-    bool m_running;
+    T *m_buffer = nullptr;
+    uint32_t m_mask = 0;
 
-    ReleaseCallback releaseCallback;
+    // written by the consumer only
+    alignas(64) std::atomic<uint32_t> m_head;
+    // written by the producer only
+    alignas(64) std::atomic<uint32_t> m_tail;
 
 public:
+    PacketQueue() : m_head(0), m_tail(0) {}
 
-    void push(T new_value) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        if (m_running) {
-            m_queue.push(new_value);
-            m_cond.notify_one();
-        }
+    ~PacketQueue() {
+        delete[] m_buffer;
     }
 
-    int pop(T &value) {
-        int ret = 0;
-        std::unique_lock<std::mutex> lock(m_mutex);
-        if (!m_running) {
-            return ret;
+    PacketQueue(const PacketQueue &) = delete;
+
+    PacketQueue &operator=(const PacketQueue &) = delete;
+
+    /**
+     * Allocate the storage, only while neither side is running.
+     */
+    void setCapacity(uint32_t capacity) {
+        uint32_t size = 2;
+        while (size < capacity && size < (1u << 30)) {
+            size <<= 1;
         }
-        if (!m_queue.empty()) {
-            value = m_queue.front();
-            m_queue.pop();
-            ret = 1;
+        if (m_buffer && size == m_mask + 1) {
+            return;
         }
-        return ret;
+        delete[] m_buffer;
+        m_buffer = new T[size];
+        m_mask = size - 1;
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t capacity() const {
+        return m_mask + 1;
     }
 
-    void clear() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        int size = m_queue.size();
-        for (int i = 0; i < size; ++i) {
-            T value = m_queue.front();
-            releaseCallback(value);
-            m_queue.pop();
+    /**
+     * Producer side.
+     * @return false when the ring is full
+     */
+    bool push(const T &value) {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+            return false;
         }
+        m_buffer[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
     }
 
-    void setRunning(bool run) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_running = run;
+    /**
+     * Consumer side: look at the oldest item without removing it.
+     */
+    bool front(T &value) {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = m_buffer[head & m_mask];
+        return true;
     }
 
-    bool empty() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        return m_queue.empty();
+    /**
+     * Consumer side.
+     */
+    bool pop(T &value) {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = m_buffer[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
     }
 
-    int size() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        return static_cast<int>(m_queue.size());
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
     }
 
-    void setReleaseCallback(ReleaseCallback callback) {
-        releaseCallback = callback;
+    /**
+     * Approximate depth when called from a third thread.
+     */
+    int size() const {
+        // head first: the tail read afterwards can never be behind it
+        uint32_t head = m_head.load(std::memory_order_acquire);
+        return static_cast<int>(m_tail.load(std::memory_order_acquire) - head);
     }
 
 };
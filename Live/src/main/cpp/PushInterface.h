@@ -23,6 +23,11 @@ const int ERROR_RTMP_CONNECT_STREAM = 0x06;
 //error code for sending packet
 const int ERROR_RTMP_SEND_PACKET = 0x07;
 
+//layout of video frames
+const int VIDEO_FORMAT_NV21 = 1;
+const int VIDEO_FORMAT_I420 = 2;
+const int VIDEO_FORMAT_NV12 = 3;
+
 /***************relative to Java**************/
 
 #endif
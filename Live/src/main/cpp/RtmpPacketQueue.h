@@ -0,0 +1,367 @@
+
+#ifndef RTMP_PACKET_QUEUE_H
+#define RTMP_PACKET_QUEUE_H
+
+#include <atomic>
+#include "PacketQueue.h"
+#include "rtmp/rtmp.h"
+
+struct PushQueueStats {
+    //video frames, sequence headers excluded
+    int video_depth;
+    int audio_depth;
+    int max_depth;
+    int64_t pushed;
+    int64_t sent;
+    int64_t dropped_video;
+    int64_t dropped_audio;
+};
+
+/**
+ * Packets on their way to the RTMP connection. The video encoder thread and the
+ * audio encoder thread each own a lock-free ring, the sending thread merges them
+ * by timestamp and blocks on a futex while both are empty.
+ *
+ * The video side is accounted in frames, each one a single packet. When the
+ * network falls behind, whole GOPs are dropped, oldest first: the consumer evicts
+ * queued GOPs as long as a newer key frame follows them, and a producer over
+ * capacity drops the new frame with the rest of its GOP. Neither producer ever
+ * blocks. Audio is dropped only when its ring is full.
+ */
+class RtmpPacketQueue {
+    typedef void (*ReleaseCallback)(RTMPPacket *&);
+
+private:
+    static const uint32_t DEFAULT_CAPACITY = 128;
+    static const int WAIT_TIMEOUT_MS = 100;
+
+    PacketQueue<RTMPPacket *> m_video;
+    PacketQueue<RTMPPacket *> m_audio;
+
+    FutexEvent m_dataEvent;
+
+    std::atomic<bool> m_running;
+    ReleaseCallback releaseCallback = nullptr;
+
+    //video frames queued at most, the ring also has room for a sequence header per frame
+    int m_frameCapacity = 0;
+    //frames and key frames in the video ring, sequence headers excluded
+    std::atomic<int> m_videoFrames;
+    std::atomic<int> m_videoKeys;
+
+    // set by the video producer over capacity, the consumer evicts the oldest GOPs
+    std::atomic<bool> m_evictRequested;
+    // owned by the producer: a frame was dropped, drop until the next key frame
+    bool m_producerSkipping = false;
+    // owned by the consumer: a frame was dropped, skip until the next key frame
+    bool m_consumerSkipping = false;
+
+    std::atomic<int> m_maxDepth;
+    std::atomic<int64_t> m_pushed;
+    std::atomic<int64_t> m_sent;
+    std::atomic<int64_t> m_droppedVideo;
+    std::atomic<int64_t> m_droppedAudio;
+
+    static bool isVideo(const RTMPPacket *packet) {
+        return packet->m_packetType == RTMP_PACKET_TYPE_VIDEO;
+    }
+
+    // m_body[1] 0x01: AVC NALU, 0x00: sequence header
+    static bool isFrame(const RTMPPacket *packet) {
+        return isVideo(packet) && packet->m_nBodySize > 1 && packet->m_body[1] == 0x01;
+    }
+
+    // 0x17: key frame or AVC sequence header
+    static bool isKeyFrame(const RTMPPacket *packet) {
+        return isFrame(packet) && (uint8_t) packet->m_body[0] == 0x17;
+    }
+
+    static bool isDroppable(const RTMPPacket *packet) {
+        return isFrame(packet) && (uint8_t) packet->m_body[0] != 0x17;
+    }
+
+    void release(RTMPPacket *packet) {
+        if (releaseCallback) {
+            releaseCallback(packet);
+        }
+    }
+
+    void dropVideo(RTMPPacket *packet) {
+        m_droppedVideo++;
+        release(packet);
+    }
+
+    void updateMaxDepth() {
+        int depth = m_videoFrames + m_audio.size();
+        int max = m_maxDepth.load(std::memory_order_relaxed);
+        while (depth > max && !m_maxDepth.compare_exchange_weak(max, depth)) {
+        }
+    }
+
+    bool overCapacity() const {
+        return m_videoFrames >= m_frameCapacity;
+    }
+
+    // the consumer starts dropping at 3/4 of the capacity
+    bool congested() const {
+        return m_videoFrames * 4 >= m_frameCapacity * 3;
+    }
+
+    // called by the consumer for each packet taken off the video ring
+    bool popVideo(RTMPPacket *&packet) {
+        if (!m_video.pop(packet)) {
+            return false;
+        }
+        if (isFrame(packet)) {
+            if (isKeyFrame(packet)) {
+                m_videoKeys--;
+            }
+            m_videoFrames--;
+        }
+        return true;
+    }
+
+    // pick the older head of the two rings
+    PacketQueue<RTMPPacket *> *nextQueue() {
+        RTMPPacket *video = nullptr;
+        RTMPPacket *audio = nullptr;
+        bool hasVideo = m_video.front(video);
+        bool hasAudio = m_audio.front(audio);
+        if (hasVideo && hasAudio) {
+            return video->m_nTimeStamp <= audio->m_nTimeStamp ? &m_video : &m_audio;
+        }
+        return hasVideo ? &m_video : (hasAudio ? &m_audio : nullptr);
+    }
+
+    // a key frame after the GOP at the head, which the stream can resume from
+    bool hasNextGop() {
+        RTMPPacket *head = nullptr;
+        if (!m_video.front(head)) {
+            return false;
+        }
+        bool headKey = !isFrame(head) || isKeyFrame(head);
+        return m_videoKeys > (headKey ? 1 : 0);
+    }
+
+    // drop the GOP at the head of the video ring: its sequence header and key frame if still queued,
+    // then its other frames, up to the header or key frame of the next GOP
+    void evictGop() {
+        RTMPPacket *packet = nullptr;
+        while (m_video.front(packet) && isVideo(packet) && !isFrame(packet)) {
+            popVideo(packet);
+            dropVideo(packet);
+        }
+        if (m_video.front(packet) && isKeyFrame(packet)) {
+            popVideo(packet);
+            dropVideo(packet);
+        }
+        while (m_video.front(packet) && isDroppable(packet)) {
+            popVideo(packet);
+            dropVideo(packet);
+        }
+    }
+
+    void evictVideo() {
+        while (congested() && hasNextGop()) {
+            evictGop();
+            // the head is the start of a GOP now
+            m_consumerSkipping = false;
+        }
+    }
+
+    bool tryPop(RTMPPacket *&packet) {
+        PacketQueue<RTMPPacket *> *queue;
+        if (m_evictRequested.exchange(false)) {
+            evictVideo();
+        }
+        while ((queue = nextQueue()) != nullptr) {
+            if (queue == &m_audio) {
+                m_audio.pop(packet);
+                m_sent++;
+                return true;
+            }
+            // sample the backlog before taking the head
+            bool backlog = congested();
+            popVideo(packet);
+            if (isDroppable(packet)) {
+                if (backlog) {
+                    m_consumerSkipping = true;
+                }
+                if (m_consumerSkipping) {
+                    dropVideo(packet);
+                    packet = nullptr;
+                    continue;
+                }
+            } else if (isKeyFrame(packet)) {
+                m_consumerSkipping = false;
+            }
+            m_sent++;
+            return true;
+        }
+        return false;
+    }
+
+public:
+    RtmpPacketQueue() : m_running(false), m_videoFrames(0), m_videoKeys(0), m_evictRequested(false),
+                        m_maxDepth(0), m_pushed(0), m_sent(0), m_droppedVideo(0), m_droppedAudio(0) {
+        setCapacity(DEFAULT_CAPACITY);
+    }
+
+    /**
+     * Video frames and audio packets queued at most, only takes effect while not pushing.
+     */
+    void setCapacity(int capacity) {
+        if (m_running || capacity <= 0) {
+            return;
+        }
+        clear();
+        m_frameCapacity = capacity;
+        m_video.setCapacity(static_cast<uint32_t>(capacity) * 2);
+        m_audio.setCapacity(static_cast<uint32_t>(capacity));
+    }
+
+    void setReleaseCallback(ReleaseCallback callback) {
+        releaseCallback = callback;
+    }
+
+    /**
+     * Called by the video encoder thread only, never blocks. Over capacity the
+     * consumer evicts the oldest GOPs, the frame pushed is dropped with the rest
+     * of its GOP unless it is a key frame, which the stream resumes from.
+     */
+    void pushVideo(RTMPPacket *packet) {
+        if (!m_running) {
+            release(packet);
+            return;
+        }
+        m_pushed++;
+        bool frame = isFrame(packet);
+        bool key   = isKeyFrame(packet);
+        if (key) {
+            m_producerSkipping = false;
+        } else if (frame && m_producerSkipping) {
+            dropVideo(packet);
+            return;
+        }
+        if (frame && overCapacity()) {
+            m_evictRequested = true;
+            m_dataEvent.notify();
+            if (!key) {
+                m_producerSkipping = true;
+                dropVideo(packet);
+                return;
+            }
+        }
+        if (frame) {
+            m_videoFrames++;
+            if (key) {
+                m_videoKeys++;
+            }
+        }
+        if (!m_video.push(packet)) {
+            // the sending thread is stuck, the GOP starting here can't be sent whole
+            if (frame) {
+                if (key) {
+                    m_videoKeys--;
+                }
+                m_videoFrames--;
+                m_producerSkipping = true;
+            }
+            dropVideo(packet);
+            return;
+        }
+        m_dataEvent.notify();
+        updateMaxDepth();
+    }
+
+    /**
+     * Called by the audio encoder thread only, never blocks: on a full ring the packet is dropped.
+     */
+    void pushAudio(RTMPPacket *packet) {
+        if (!m_running) {
+            release(packet);
+            return;
+        }
+        m_pushed++;
+        if (!m_audio.push(packet)) {
+            m_droppedAudio++;
+            release(packet);
+            return;
+        }
+        m_dataEvent.notify();
+        updateMaxDepth();
+    }
+
+    /**
+     * Called by the sending thread only, blocks until a packet arrives or the queue stops.
+     * @return 1 with a packet, 0 when stopped
+     */
+    int pop(RTMPPacket *&packet) {
+        packet = nullptr;
+        while (m_running) {
+            if (tryPop(packet)) {
+                return 1;
+            }
+            m_dataEvent.beginWait();
+            int seq = m_dataEvent.sequence();
+            bool popped = tryPop(packet);
+            if (!popped && m_running) {
+                m_dataEvent.wait(seq, WAIT_TIMEOUT_MS);
+            }
+            m_dataEvent.endWait();
+            if (popped) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Release the remaining packets, from the sending thread or while nothing is pushing.
+     */
+    void clear() {
+        RTMPPacket *packet = nullptr;
+        while (popVideo(packet)) {
+            release(packet);
+        }
+        while (m_audio.pop(packet)) {
+            release(packet);
+        }
+        m_consumerSkipping = false;
+    }
+
+    void setRunning(bool run) {
+        if (run) {
+            m_evictRequested = false;
+            m_producerSkipping = false;
+            m_consumerSkipping = false;
+            m_maxDepth = 0;
+            m_pushed = 0;
+            m_sent = 0;
+            m_droppedVideo = 0;
+            m_droppedAudio = 0;
+        }
+        m_running = run;
+        // wake up the sending thread
+        m_dataEvent.notify();
+    }
+
+    int size() const {
+        return m_videoFrames + m_audio.size();
+    }
+
+    PushQueueStats stats() const {
+        PushQueueStats stats;
+        stats.video_depth   = m_videoFrames;
+        stats.audio_depth   = m_audio.size();
+        stats.max_depth     = m_maxDepth;
+        stats.pushed        = m_pushed;
+        stats.sent          = m_sent;
+        stats.dropped_video = m_droppedVideo;
+        stats.dropped_audio = m_droppedAudio;
+        return stats;
+    }
+
+};
+
+#endif // RTMP_PACKET_QUEUE_H
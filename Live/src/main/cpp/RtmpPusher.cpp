@@ -1,22 +1,29 @@
 #include <jni.h>
 #include <string>
-#include "PacketQueue.h"
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "RtmpPacketQueue.h"
 #include "PushInterface.h"
 #include "VideoStream.h"
 #include "AudioStream.h"
+#include "BitrateController.h"
 
 #define RTMP_PUSHER_FUNC(RETURN_TYPE, FUNC_NAME, ...) \
     extern "C" \
     JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_live_LivePusherNew_ ## FUNC_NAME \
     (JNIEnv *env, jobject instance, ##__VA_ARGS__)\
 
-PacketQueue<RTMPPacket *> packets;
+RtmpPacketQueue packets;
 VideoStream *videoStream = nullptr;
 AudioStream *audioStream = nullptr;
 
 std::atomic<bool> isPushing;
 uint32_t start_time;
 
+BitrateController bitrateController;
+std::atomic<bool> adaptiveBitrate(true);
+
 //use to get thread's JNIEnv
 JavaVM *javaVM;
 //callback object
@@ -38,10 +45,53 @@ void throwErrToJava(int error_code) {
     javaVM->DetachCurrentThread();
 }
 
-void callback(RTMPPacket *packet) {
+//callback bitrate statistics to java, once per window
+void statsToJava(const AbrStats &stats) {
+    JNIEnv *env;
+    javaVM->AttachCurrentThread(&env, nullptr);
+    jclass clazz = env->GetObjectClass(jobject_error);
+    jmethodID method = env->GetMethodID(clazz, "onBitrateStatsFromNative", "(IIIIIII)V");
+    if (method) {
+        env->CallVoidMethod(jobject_error, method, stats.send_kbps, stats.video_kbps,
+                            stats.target_kbps, stats.queue_depth, stats.dropped,
+                            stats.level, stats.decision);
+    }
+    env->DeleteLocalRef(clazz);
+    javaVM->DetachCurrentThread();
+}
+
+void onPacketSent(RTMPPacket *packet, int64_t send_us) {
+    AbrStats stats;
+    PushQueueStats queueStats = packets.stats();
+    bool video = packet->m_packetType == RTMP_PACKET_TYPE_VIDEO;
+    if (!bitrateController.onPacketSent(video, packet->m_nBodySize, send_us,
+                                        queueStats.video_depth + queueStats.audio_depth,
+                                        queueStats.dropped_video, &stats)) {
+        return;
+    }
+    if (adaptiveBitrate && videoStream) {
+        if (stats.decision == ABR_DEGRADE || stats.decision == ABR_UPGRADE) {
+            videoStream->setDegradeLevel(stats.level);
+        }
+        videoStream->setTargetBitrate(stats.target_kbps);
+    } else if (videoStream) {
+        stats.target_kbps = videoStream->getBitrate();
+        stats.decision = ABR_HOLD;
+    }
+    statsToJava(stats);
+}
+
+void videoCallback(RTMPPacket *packet) {
+    if (packet) {
+        packet->m_nTimeStamp = RTMP_GetTime() - start_time;
+        packets.pushVideo(packet);
+    }
+}
+
+void audioCallback(RTMPPacket *packet) {
     if (packet) {
         packet->m_nTimeStamp = RTMP_GetTime() - start_time;
-        packets.push(packet);
+        packets.pushAudio(packet);
     }
 }
 
@@ -85,22 +135,31 @@ void *start(void *args) {
         }
         //start time
         start_time = RTMP_GetTime();
+        //send the audio sequence header before any producer runs
+        RTMPPacket *packet = audioStream->getAudioTag();
+        packet->m_nTimeStamp = 0;
+        packet->m_nInfoField2 = rtmp->m_stream_id;
+        ret = RTMP_SendPacket(rtmp, packet, 1);
+        releasePackets(packet);
+        if (!ret) {
+            LOGE("RTMP_SendPacket fail...");
+            throwErrToJava(ERROR_RTMP_SEND_PACKET);
+            break;
+        }
         //start pushing
-        isPushing = true;
+        bitrateController.configure(videoStream->getBitrate(), videoStream->getFps(),
+                                    videoStream->canHalveSize());
+        packets.clear();
         packets.setRunning(true);
-        callback(audioStream->getAudioTag());
-        RTMPPacket *packet = nullptr;
-        while (isPushing) {
-            packets.pop(packet);
-            if (!isPushing) {
-                break;
-            }
-            if (!packet) {
-                continue;
-            }
-
+        isPushing = true;
+        //block until a packet arrives, or stop wakes us up
+        while (packets.pop(packet)) {
             packet->m_nInfoField2 = rtmp->m_stream_id;
+            int64_t begin = BitrateController::nowUs();
             ret = RTMP_SendPacket(rtmp, packet, 1);
+            if (ret) {
+                onPacketSent(packet, BitrateController::nowUs() - begin);
+            }
             releasePackets(packet);
             if (!ret) {
                 LOGE("RTMP_SendPacket fail...");
@@ -109,6 +168,9 @@ void *start(void *args) {
             }
         }
         releasePackets(packet);
+        PushQueueStats stats = packets.stats();
+        LOGI("push queue: sent=%lld, dropped video=%lld, max depth=%d",
+             (long long) stats.sent, (long long) stats.dropped_video, stats.max_depth);
     } while (0);
     isPushing = false;
     packets.setRunning(false);
@@ -124,9 +186,9 @@ void *start(void *args) {
 RTMP_PUSHER_FUNC(void, native_1init) {
     LOGI("native init...");
     videoStream = new VideoStream();
-    videoStream->setVideoCallback(callback);
+    videoStream->setVideoCallback(videoCallback);
     audioStream = new AudioStream();
-    audioStream->setAudioCallback(callback);
+    audioStream->setAudioCallback(audioCallback);
     packets.setReleaseCallback(releasePackets);
     jobject_error = env->NewGlobalRef(instance);
 }
@@ -141,6 +203,30 @@ RTMP_PUSHER_FUNC(void, native_1setVideoCodecInfo,
     }
 }
 
+RTMP_PUSHER_FUNC(void, native_1setVideoEncoderParam, jstring preset, jstring tune,
+                 jstring profile, jint level, jint threads, jboolean slicedThreads, jint lookahead) {
+    if (!videoStream) {
+        return;
+    }
+    EncoderConfig config;
+    const char *value = env->GetStringUTFChars(preset, nullptr);
+    config.preset = value;
+    env->ReleaseStringUTFChars(preset, value);
+    value = env->GetStringUTFChars(tune, nullptr);
+    config.tune = value;
+    env->ReleaseStringUTFChars(tune, value);
+    value = env->GetStringUTFChars(profile, nullptr);
+    config.profile = value;
+    env->ReleaseStringUTFChars(profile, value);
+    config.level         = level;
+    config.threads       = threads;
+    config.slicedThreads = slicedThreads;
+    config.lookahead     = lookahead;
+    if (videoStream->setEncoderConfig(config) < 0) {
+        throwErrToJava(ERROR_VIDEO_ENCODER_OPEN);
+    }
+}
+
 RTMP_PUSHER_FUNC(void, native_1start, jstring path_) {
     LOGI("native start...");
     if (isPushing) {
@@ -155,13 +241,75 @@ RTMP_PUSHER_FUNC(void, native_1start, jstring path_) {
     env->ReleaseStringUTFChars(path_, path);
 }
 
-RTMP_PUSHER_FUNC(void, native_1pushVideo, jbyteArray yuv, jint camera_type) {
+RTMP_PUSHER_FUNC(void, native_1pushVideo, jbyteArray yuv, jint camera_type, jint rotation) {
     if (!videoStream || !isPushing) {
         return;
     }
-    jbyte *yuv_plane = env->GetByteArrayElements(yuv, JNI_FALSE);
-    videoStream->encodeVideo(yuv_plane, camera_type);
-    env->ReleaseByteArrayElements(yuv, yuv_plane, 0);
+    int frameLen = videoStream->getWidth() * videoStream->getHeight();
+    if (env->GetArrayLength(yuv) < frameLen * 3 / 2) {
+        return;
+    }
+    // frame arrays live in the large object space, which doesn't move:
+    // the critical section pins instead of copying, and is left as soon as
+    // the frame is in the encoder picture, before encoding and pushing
+    auto *data = static_cast<uint8_t *>(env->GetPrimitiveArrayCritical(yuv, nullptr));
+    if (!data) {
+        return;
+    }
+    bool copied = videoStream->copyVideo(data, camera_type, rotation);
+    env->ReleasePrimitiveArrayCritical(yuv, data, JNI_ABORT);
+    if (copied) {
+        videoStream->encodeCopied();
+    }
+}
+
+RTMP_PUSHER_FUNC(void, native_1pushVideoBuffer, jobject y_buffer, jint y_stride,
+                 jobject uv_buffer, jint uv_stride, jint width, jint height,
+                 jint format, jint rotation) {
+    if (!videoStream || !isPushing || format == VIDEO_FORMAT_I420) {
+        return;
+    }
+    auto *y  = static_cast<uint8_t *>(env->GetDirectBufferAddress(y_buffer));
+    auto *uv = static_cast<uint8_t *>(env->GetDirectBufferAddress(uv_buffer));
+    jlong y_capacity  = env->GetDirectBufferCapacity(y_buffer);
+    jlong uv_capacity = env->GetDirectBufferCapacity(uv_buffer);
+    if (!y || !uv || y_capacity < 0 || uv_capacity < 0) {
+        LOGE("pushVideoBuffer needs direct buffers");
+        return;
+    }
+    if (width <= 0 || height < 2 || width % 2 != 0 || height % 2 != 0
+        || y_stride < width || uv_stride < width) {
+        LOGE("pushVideoBuffer invalid %dx%d, strides %d %d", width, height, y_stride, uv_stride);
+        return;
+    }
+    jlong y_size  = (jlong) y_stride * (height - 1) + width;
+    jlong uv_size = (jlong) uv_stride * (height / 2 - 1) + width;
+    if (y_capacity < y_size || uv_capacity < uv_size - 1) {
+        LOGE("pushVideoBuffer buffers too small: %lld < %lld or %lld < %lld",
+             (long long) y_capacity, (long long) y_size, (long long) uv_capacity, (long long) uv_size);
+        return;
+    }
+    // the UV buffer of a camera2 Image ends one byte short of the last pair,
+    // whose V is the first byte of the adjacent V plane: never read past the
+    // capacity, the plane is copied and the missing byte taken from the previous pair
+    static thread_local std::vector<uint8_t> uv_copy;
+    if (uv_capacity < uv_size) {
+        uv_copy.assign(uv, uv + uv_capacity);
+        uv_copy.push_back(uv_capacity >= 2 ? uv[uv_capacity - 2] : 0);
+        uv = uv_copy.data();
+    }
+    VideoFrame frame;
+    frame.width     = width;
+    frame.height    = height;
+    frame.format    = format;
+    frame.rotation  = rotation;
+    frame.plane[0]  = y;
+    frame.stride[0] = y_stride;
+    frame.plane[1]  = uv;
+    frame.stride[1] = uv_stride;
+    frame.plane[2]  = nullptr;
+    frame.stride[2] = 0;
+    videoStream->encodeFrame(frame);
 }
 
 RTMP_PUSHER_FUNC(void, native_1setAudioCodecInfo, jint sampleRateInHz, jint channels) {
@@ -193,10 +341,47 @@ RTMP_PUSHER_FUNC(void, native_1stop) {
     LOGI("native stop...");
     isPushing = false;
     packets.setRunning(false);
+    if (videoStream) {
+        EncodeStats stats = videoStream->getEncodeStats();
+        LOGI("x264 encoded %lld frames with %d threads, avg:%lldus max:%lldus",
+             (long long) stats.frames, stats.threads,
+             (long long) stats.avg_us, (long long) stats.max_us);
+    }
+}
+
+RTMP_PUSHER_FUNC(void, native_1setQueueCapacity, jint capacity) {
+    if (!isPushing) {
+        packets.setCapacity(capacity);
+    }
+}
+
+RTMP_PUSHER_FUNC(void, native_1setAdaptiveBitrate, jboolean enable) {
+    adaptiveBitrate = enable;
+}
+
+RTMP_PUSHER_FUNC(jlongArray, native_1getQueueStats) {
+    PushQueueStats stats = packets.stats();
+    jlong values[] = {stats.video_depth, stats.audio_depth, stats.max_depth,
+                      stats.pushed, stats.sent, stats.dropped_video, stats.dropped_audio};
+    jlongArray array = env->NewLongArray(7);
+    env->SetLongArrayRegion(array, 0, 7, values);
+    return array;
+}
+
+RTMP_PUSHER_FUNC(jlongArray, native_1getEncodeStats) {
+    if (!videoStream) {
+        return nullptr;
+    }
+    EncodeStats stats = videoStream->getEncodeStats();
+    jlong values[] = {stats.frames, stats.last_us, stats.avg_us, stats.max_us, stats.threads};
+    jlongArray array = env->NewLongArray(5);
+    env->SetLongArrayRegion(array, 0, 5, values);
+    return array;
 }
 
 RTMP_PUSHER_FUNC(void, native_1release) {
     LOGI("native release...");
+    packets.clear();
     env->DeleteGlobalRef(jobject_error);
     delete videoStream;
     videoStream = nullptr;
@@ -1,18 +1,63 @@
 
+#include <chrono>
 #include <cstring>
+#include <utility>
+#include <unistd.h>
 #include "VideoStream.h"
 #include "PushInterface.h"
+#include "BitrateController.h"
+#include "YuvUtil.h"
 
 VideoStream::VideoStream():m_frameLen(0),
                            videoCodec(nullptr),
                            pic_in(nullptr),
-                           videoCallback(nullptr) {
+                           videoCallback(nullptr),
+                           m_pendingBitrate(0),
+                           m_pendingLevel(-1),
+                           m_encodeFrames(0),
+                           m_encodeLastUs(0),
+                           m_encodeTotalUs(0),
+                           m_encodeMaxUs(0) {
 
 }
 
+int VideoStream::setEncoderConfig(const EncoderConfig &config) {
+    std::lock_guard<std::mutex> l(m_mutex);
+    m_config = config;
+    if (!videoCodec) {
+        return 0;
+    }
+    return openEncoder(m_encWidth, m_encHeight, m_encFps, m_encBitrate);
+}
+
+EncodeStats VideoStream::getEncodeStats() const {
+    EncodeStats stats;
+    stats.frames  = m_encodeFrames;
+    stats.last_us = m_encodeLastUs;
+    stats.avg_us  = stats.frames > 0 ? m_encodeTotalUs / stats.frames : 0;
+    stats.max_us  = m_encodeMaxUs;
+    stats.threads = m_threads;
+    return stats;
+}
+
 int VideoStream::setVideoEncInfo(int width, int height, int fps, int bitrate) {
     std::lock_guard<std::mutex> l(m_mutex);
     m_frameLen = width * height;
+    m_width   = width;
+    m_height  = height;
+    m_fps     = fps;
+    m_bitrate = bitrate / 1024;
+    m_level   = ABR_LEVEL_FULL;
+    m_pendingBitrate = 0;
+    m_pendingLevel   = -1;
+    m_encodeFrames   = 0;
+    m_encodeLastUs   = 0;
+    m_encodeTotalUs  = 0;
+    m_encodeMaxUs    = 0;
+    return openEncoder(width, height, fps, m_bitrate);
+}
+
+int VideoStream::openEncoder(int width, int height, int fps, int bitrate) {
     if (videoCodec) {
         x264_encoder_close(videoCodec);
         videoCodec = nullptr;
@@ -22,16 +67,20 @@ int VideoStream::setVideoEncInfo(int width, int height, int fps, int bitrate) {
         delete pic_in;
         pic_in = nullptr;
     }
+    m_copied = false;
 
     //setting x264 params
     x264_param_t param;
-    int ret = x264_param_default_preset(&param, "ultrafast", "zerolatency");
+    const char *tune = m_config.tune.empty() ? nullptr : m_config.tune.c_str();
+    int ret = x264_param_default_preset(&param, m_config.preset.c_str(), tune);
     if (ret < 0) {
+        LOGE("x264 preset:%s tune:%s invalid", m_config.preset.c_str(), m_config.tune.c_str());
         return ret;
     }
-    param.i_level_idc = 32;
+    //-1: auto
+    param.i_level_idc = m_config.level > 0 ? m_config.level : -1;
     //input format
-    param.i_csp = X264_CSP_I420;
+    param.i_csp = m_csp;
     param.i_width = width;
     param.i_height = height;
     //no B frame
@@ -39,11 +88,11 @@ int VideoStream::setVideoEncInfo(int width, int height, int fps, int bitrate) {
     //i_rc_method:bitrate control, CQP(constant quality), CRF(constant bitrate), ABR(average bitrate)
     param.rc.i_rc_method = X264_RC_ABR;
     //bitrate(Kbps)
-    param.rc.i_bitrate = bitrate / 1024;
+    param.rc.i_bitrate = bitrate;
     //max bitrate
-    param.rc.i_vbv_max_bitrate = bitrate / 1024 * 1.2;
-    //unit:kbps
-    param.rc.i_vbv_buffer_size = bitrate / 1024;
+    param.rc.i_vbv_max_bitrate = bitrate * 1.2;
+    //unit:kbps, VBV has to be on for x264_encoder_reconfig to change the bitrate
+    param.rc.i_vbv_buffer_size = bitrate;
 
     //frame rate
     param.i_fps_num = fps;
@@ -57,10 +106,29 @@ int VideoStream::setVideoEncInfo(int width, int height, int fps, int bitrate) {
     //each key frame attaches sps/pps
     param.b_repeat_headers = 1;
     //thread number
-    param.i_threads = 1;
+    int threads = m_config.threads;
+    bool sliced = m_config.slicedThreads;
+    if (threads <= 0) {
+        //auto: sliced threads keep the latency of a single thread
+        threads = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+        sliced  = true;
+    }
+    //a slice needs a few macroblock rows to be worth a thread
+    int maxSlices = (height + 15) / 16 / 4;
+    if (sliced && threads > maxSlices) {
+        threads = maxSlices;
+    }
+    param.i_threads = threads > 1 ? threads : 1;
+    param.b_sliced_threads = sliced;
+    if (m_config.lookahead >= 0) {
+        param.rc.i_lookahead = m_config.lookahead;
+        //frame threads need lookahead frames of their own
+        param.i_sync_lookahead = sliced ? 0 : X264_SYNC_LOOKAHEAD_AUTO;
+    }
 
-    ret = x264_param_apply_profile(&param, "baseline");
+    ret = x264_param_apply_profile(&param, m_config.profile.c_str());
     if (ret < 0) {
+        LOGE("x264 profile:%s invalid", m_config.profile.c_str());
         return ret;
     }
     //open encoder
@@ -69,10 +137,68 @@ int VideoStream::setVideoEncInfo(int width, int height, int fps, int bitrate) {
         return -1;
     }
     pic_in = new x264_picture_t();
-    x264_picture_alloc(pic_in, X264_CSP_I420, width, height);
+    x264_picture_alloc(pic_in, m_csp, width, height);
+    m_encWidth    = width;
+    m_encHeight   = height;
+    m_encFps      = fps;
+    m_encBitrate  = bitrate;
+    m_frameCredit = 0;
+    m_threads     = param.i_threads;
+    LOGI("x264 open %dx%d@%d %dkbps, preset:%s tune:%s profile:%s level:%d threads:%d %s",
+         width, height, fps, bitrate, m_config.preset.c_str(), m_config.tune.c_str(),
+         m_config.profile.c_str(), param.i_level_idc, param.i_threads,
+         param.b_sliced_threads ? "sliced" : "frame");
     return ret;
 }
 
+void VideoStream::setTargetBitrate(int bitrate) {
+    m_pendingBitrate = bitrate;
+}
+
+void VideoStream::setDegradeLevel(int level) {
+    m_pendingLevel = level;
+}
+
+void VideoStream::applyPending() {
+    int level = m_pendingLevel.exchange(-1);
+    int bitrate = m_pendingBitrate.exchange(0);
+    if (bitrate <= 0) {
+        bitrate = m_encBitrate;
+    }
+    if (level >= 0 && level != m_level) {
+        int width  = m_width;
+        int height = m_height;
+        int fps    = m_fps;
+        if (level >= ABR_LEVEL_LOW_FPS) {
+            fps = m_fps * 2 / 3 > 0 ? m_fps * 2 / 3 : 1;
+        }
+        if (level >= ABR_LEVEL_HALF) {
+            width  = m_width / 2;
+            height = m_height / 2;
+        }
+        LOGI("video degrade level:%d, %dx%d@%d, %dkbps", level, width, height, fps, bitrate);
+        // a new size needs new SPS/PPS anyway, so the encoder starts over with a key frame
+        if (openEncoder(width, height, fps, bitrate) < 0 || !videoCodec) {
+            LOGE("reopen video encoder fail...");
+            return;
+        }
+        m_level = level;
+        return;
+    }
+    if (bitrate != m_encBitrate && videoCodec) {
+        x264_param_t param;
+        x264_encoder_parameters(videoCodec, &param);
+        param.rc.i_bitrate = bitrate;
+        param.rc.i_vbv_max_bitrate = bitrate * 1.2;
+        param.rc.i_vbv_buffer_size = bitrate;
+        if (x264_encoder_reconfig(videoCodec, &param) < 0) {
+            LOGE("x264_encoder_reconfig fail, bitrate:%d", bitrate);
+            return;
+        }
+        m_encBitrate = bitrate;
+    }
+}
+
 void VideoStream::setVideoCallback(VideoCallback callback) {
     this->videoCallback = callback;
 }
@@ -124,20 +250,24 @@ void VideoStream::sendSpsPps(uint8_t *sps, uint8_t *pps, int sps_len, int pps_le
     videoCallback(packet);
 }
 
-void VideoStream::sendFrame(int type, uint8_t *payload, int i_payload) {
-    if (payload[2] == 0x00) {
-        i_payload -= 4;
-        payload += 4;
-    } else {
-        i_payload -= 3;
-        payload += 3;
-    }
+//start code of an Annex B NAL
+static int startCodeSize(const x264_nal_t &nal) {
+    return nal.p_payload[2] == 0x00 ? 4 : 3;
+}
+
+void VideoStream::sendFrame(const x264_nal_t *nals, int count) {
+    //one video tag per picture: each slice as a length prefixed NALU
     int i = 0;
-    int bodySize = 9 + i_payload;
+    int bodySize = 5;
+    bool key = false;
+    for (int n = 0; n < count; ++n) {
+        bodySize += 4 + nals[n].i_payload - startCodeSize(nals[n]);
+        key = key || nals[n].i_type == NAL_SLICE_IDR;
+    }
     auto *packet = new RTMPPacket();
     RTMPPacket_Alloc(packet, bodySize);
 
-    if (type == NAL_SLICE_IDR) {
+    if (key) {
         packet->m_body[i++] = 0x17; // 1:Key frame  7:AVC
     } else {
         packet->m_body[i++] = 0x27; // 2:None key frame 7:AVC
@@ -148,13 +278,17 @@ void VideoStream::sendFrame(int type, uint8_t *payload, int i_payload) {
     packet->m_body[i++] = 0x00;
     packet->m_body[i++] = 0x00;
     packet->m_body[i++] = 0x00;
-    //packet len
-    packet->m_body[i++] = (i_payload >> 24) & 0xFF;
-    packet->m_body[i++] = (i_payload >> 16) & 0xFF;
-    packet->m_body[i++] = (i_payload >> 8) & 0xFF;
-    packet->m_body[i++] = (i_payload) & 0xFF;
-
-    memcpy(&packet->m_body[i], payload, static_cast<size_t>(i_payload));
+    for (int n = 0; n < count; ++n) {
+        int skip = startCodeSize(nals[n]);
+        int i_payload = nals[n].i_payload - skip;
+        //NALU len
+        packet->m_body[i++] = (i_payload >> 24) & 0xFF;
+        packet->m_body[i++] = (i_payload >> 16) & 0xFF;
+        packet->m_body[i++] = (i_payload >> 8) & 0xFF;
+        packet->m_body[i++] = (i_payload) & 0xFF;
+        memcpy(&packet->m_body[i], nals[n].p_payload + skip, static_cast<size_t>(i_payload));
+        i += i_payload;
+    }
 
     packet->m_hasAbsTimestamp = 0;
     packet->m_nBodySize       = bodySize;
@@ -164,35 +298,178 @@ void VideoStream::sendFrame(int type, uint8_t *payload, int i_payload) {
     videoCallback(packet);
 }
 
-void VideoStream::encodeVideo(int8_t *data, int camera_type) {
+//rotate the captured frame into full size planes laid out as m_csp
+void VideoStream::rotateInto(const VideoFrame &frame, uint8_t **plane, const int *stride) {
+    rotatePlane(frame.plane[0], frame.stride[0], plane[0], stride[0],
+                frame.width, frame.height, frame.rotation);
+    if (m_csp == X264_CSP_I420) {
+        rotatePlane(frame.plane[1], frame.stride[1], plane[1], stride[1],
+                    frame.width / 2, frame.height / 2, frame.rotation);
+        rotatePlane(frame.plane[2], frame.stride[2], plane[2], stride[2],
+                    frame.width / 2, frame.height / 2, frame.rotation);
+    } else {
+        rotatePlaneUV(frame.plane[1], frame.stride[1], plane[1], stride[1],
+                      frame.width / 2, frame.height / 2, frame.rotation);
+    }
+}
+
+bool VideoStream::copyVideo(const uint8_t *data, int format, int rotation) {
+    int width  = m_width;
+    int height = m_height;
+    if (rotation == 90 || rotation == 270) {
+        std::swap(width, height);
+    }
+    int frameLen = width * height;
+    VideoFrame frame;
+    frame.width     = width;
+    frame.height    = height;
+    frame.format    = format;
+    frame.rotation  = rotation;
+    frame.plane[0]  = data;
+    frame.stride[0] = width;
+    frame.plane[1]  = data + frameLen;
+    if (format == VIDEO_FORMAT_I420) {
+        frame.stride[1] = width / 2;
+        frame.plane[2]  = data + frameLen * 5 / 4;
+        frame.stride[2] = width / 2;
+    } else {
+        frame.stride[1] = width;
+        frame.plane[2]  = nullptr;
+        frame.stride[2] = 0;
+    }
     std::lock_guard<std::mutex> l(m_mutex);
-    if (!pic_in)
+    m_copied = loadFrame(frame, nullptr) != nullptr;
+    return m_copied;
+}
+
+void VideoStream::encodeCopied() {
+    std::lock_guard<std::mutex> l(m_mutex);
+    if (!m_copied || !pic_in)
         return;
+    m_copied = false;
+    encodePicture(pic_in);
+}
+
+void VideoStream::encodeFrame(const VideoFrame &frame) {
+    std::lock_guard<std::mutex> l(m_mutex);
+    x264_picture_t direct;
+    x264_picture_t *picture = loadFrame(frame, &direct);
+    if (picture)
+        encodePicture(picture);
+}
+
+x264_picture_t *VideoStream::loadFrame(const VideoFrame &frame, x264_picture_t *direct) {
+    int csp;
+    switch (frame.format) {
+        case VIDEO_FORMAT_NV21:
+            csp = X264_CSP_NV21;
+            break;
+        case VIDEO_FORMAT_NV12:
+            csp = X264_CSP_NV12;
+            break;
+        case VIDEO_FORMAT_I420:
+            csp = X264_CSP_I420;
+            break;
+        default:
+            return nullptr;
+    }
+    bool swap = frame.rotation == 90 || frame.rotation == 270;
+    if ((swap ? frame.height : frame.width) != m_width
+        || (swap ? frame.width : frame.height) != m_height) {
+        LOGE("frame size %dx%d rotation %d mismatch with %dx%d",
+             frame.width, frame.height, frame.rotation, m_width, m_height);
+        return nullptr;
+    }
+    //x264 takes the layout of the camera as is, and does the conversion it needs itself
+    if (csp != m_csp && videoCodec) {
+        m_csp = csp;
+        if (openEncoder(m_encWidth, m_encHeight, m_encFps, m_encBitrate) < 0) {
+            LOGE("reopen video encoder fail...");
+            return nullptr;
+        }
+    }
+    applyPending();
+    if (!pic_in)
+        return nullptr;
+    //lower framerate: keep m_encFps frames out of every m_fps
+    if (m_encFps < m_fps) {
+        m_frameCredit += m_encFps;
+        if (m_frameCredit < m_fps) {
+            return nullptr;
+        }
+        m_frameCredit -= m_fps;
+    }
 
-    if (camera_type == 1) {
-        memcpy(pic_in->img.plane[0], data, m_frameLen); // y
-        for (int i = 0; i < m_frameLen/4; ++i) {
-            *(pic_in->img.plane[1] + i) = *(data + m_frameLen + i * 2 + 1);  // u
-            *(pic_in->img.plane[2] + i) = *(data + m_frameLen + i * 2); // v
+    x264_picture_t *picture = pic_in;
+    int planes = m_csp == X264_CSP_I420 ? 3 : 2;
+    bool half = m_level >= ABR_LEVEL_HALF;
+    if (!half && frame.rotation == 0 && direct) {
+        //zero copy: point the picture at the caller's planes
+        x264_picture_init(direct);
+        direct->img.i_csp   = m_csp;
+        direct->img.i_plane = planes;
+        for (int i = 0; i < planes; ++i) {
+            direct->img.plane[i]    = const_cast<uint8_t *>(frame.plane[i]);
+            direct->img.i_stride[i] = frame.stride[i];
         }
-    } else if (camera_type == 2) {
-        int offset = 0;
-        memcpy(pic_in->img.plane[0], data, (size_t) m_frameLen); // y
-        offset += m_frameLen;
-        memcpy(pic_in->img.plane[1], data + offset, (size_t) m_frameLen / 4); // u
-        offset += m_frameLen / 4;
-        memcpy(pic_in->img.plane[2], data + offset, (size_t) m_frameLen / 4); // v
+        picture = direct;
+    } else if (!half) {
+        //copied as is when not rotating
+        rotateInto(frame, pic_in->img.plane, pic_in->img.i_stride);
     } else {
-        return;
+        const uint8_t *src[3];
+        int srcStride[3];
+        if (frame.rotation == 0) {
+            for (int i = 0; i < planes; ++i) {
+                src[i] = frame.plane[i];
+                srcStride[i] = frame.stride[i];
+            }
+        } else {
+            m_scratch.resize((size_t) m_frameLen * 3 / 2);
+            uint8_t *plane[3] = {m_scratch.data(),
+                                 m_scratch.data() + m_frameLen,
+                                 m_scratch.data() + m_frameLen * 5 / 4};
+            int stride[3] = {m_width, planes == 3 ? m_width / 2 : m_width, m_width / 2};
+            rotateInto(frame, plane, stride);
+            for (int i = 0; i < planes; ++i) {
+                src[i] = plane[i];
+                srcStride[i] = stride[i];
+            }
+        }
+        scaleHalfPlane(src[0], srcStride[0], pic_in->img.plane[0], pic_in->img.i_stride[0],
+                       m_encWidth, m_encHeight);
+        if (planes == 3) {
+            for (int i = 1; i < 3; ++i) {
+                scaleHalfPlane(src[i], srcStride[i], pic_in->img.plane[i], pic_in->img.i_stride[i],
+                               m_encWidth / 2, m_encHeight / 2);
+            }
+        } else {
+            scaleHalfPlaneUV(src[1], srcStride[1], pic_in->img.plane[1], pic_in->img.i_stride[1],
+                             m_encWidth / 2, m_encHeight / 2);
+        }
     }
+    return picture;
+}
 
+void VideoStream::encodePicture(x264_picture_t *picture) {
     x264_nal_t *pp_nal;
     int pi_nal;
     x264_picture_t pic_out;
-    x264_encoder_encode(videoCodec, &pp_nal, &pi_nal, pic_in, &pic_out);
+    auto begin = std::chrono::steady_clock::now();
+    x264_encoder_encode(videoCodec, &pp_nal, &pi_nal, picture, &pic_out);
+    int64_t cost = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+    m_encodeFrames++;
+    m_encodeLastUs = cost;
+    m_encodeTotalUs += cost;
+    if (cost > m_encodeMaxUs) {
+        m_encodeMaxUs = cost;
+    }
     int pps_len, sps_len = 0;
     uint8_t sps[100];
     uint8_t pps[100];
+    //the NALs of the picture after the headers, sliced threads give one per slice
+    int first = pi_nal;
     for (int i = 0; i < pi_nal; ++i) {
         x264_nal_t nal = pp_nal[i];
         if (nal.i_type == NAL_SPS) {
@@ -202,10 +479,14 @@ void VideoStream::encodeVideo(int8_t *data, int camera_type) {
             pps_len = nal.i_payload - 4;
             memcpy(pps, nal.p_payload + 4, static_cast<size_t>(pps_len));
             sendSpsPps(sps, pps, sps_len, pps_len);
-        } else {
-            sendFrame(nal.i_type, nal.p_payload, nal.i_payload);
+        } else if (first == pi_nal) {
+            first = i;
         }
     }
+    //x264 puts the headers first, SEI and slices follow
+    if (first < pi_nal) {
+        sendFrame(pp_nal + first, pi_nal - first);
+    }
 }
 
 VideoStream::~VideoStream() {
@@ -3,10 +3,53 @@
 #define VIDEOSTREAM_H
 
 #include <inttypes.h>
+#include <atomic>
 #include <mutex>
+#include <string>
+#include <vector>
 #include "rtmp/rtmp.h"
 #include "x264/x264.h"
 
+/**
+ * One captured frame, pointing into the caller's memory.
+ */
+struct VideoFrame {
+    const uint8_t *plane[3];
+    int stride[3];
+    //size as captured, before rotating
+    int width;
+    int height;
+    //VIDEO_FORMAT_*
+    int format;
+    //clockwise: 0, 90, 180 or 270
+    int rotation;
+};
+
+/**
+ * x264 settings from Java, the defaults are the low latency ones used so far.
+ */
+struct EncoderConfig {
+    std::string preset  = "ultrafast";
+    std::string tune    = "zerolatency";
+    std::string profile = "baseline";
+    //level_idc, e.g. 31 for 3.1, 0 to let x264 pick it from size and fps
+    int level = 32;
+    //0: auto, one sliced thread per core
+    int threads = 1;
+    //sliced threads split every frame and add no latency, frame threads add one frame per thread
+    bool slicedThreads = true;
+    //frames of rc lookahead, -1 to keep the value of preset and tune
+    int lookahead = -1;
+};
+
+struct EncodeStats {
+    int64_t frames;
+    int64_t last_us;
+    int64_t avg_us;
+    int64_t max_us;
+    int threads;
+};
+
 class VideoStream {
     typedef void (*VideoCallback)(RTMPPacket *packet);
 
@@ -19,9 +62,58 @@ private:
 
     VideoCallback videoCallback;
 
+    //configured by Java
+    int m_width = 0;
+    int m_height = 0;
+    int m_fps = 0;
+    int m_bitrate = 0;
+    //what the encoder currently runs at
+    int m_encWidth = 0;
+    int m_encHeight = 0;
+    int m_encFps = 0;
+    int m_encBitrate = 0;
+    int m_level = 0;
+    int m_frameCredit = 0;
+    //X264_CSP_I420, X264_CSP_NV12 or X264_CSP_NV21, following the input
+    int m_csp = X264_CSP_I420;
+    //full size rotated picture, when the encoder runs at half resolution
+    std::vector<uint8_t> m_scratch;
+    //pic_in holds a frame from copyVideo, not encoded yet
+    bool m_copied = false;
+
+    //requested by the bitrate controller, applied on the encoding thread
+    std::atomic<int> m_pendingBitrate;
+    std::atomic<int> m_pendingLevel;
+
+    EncoderConfig m_config;
+    std::atomic<int> m_threads{1};
+    //time spent in x264_encoder_encode
+    std::atomic<int64_t> m_encodeFrames;
+    std::atomic<int64_t> m_encodeLastUs;
+    std::atomic<int64_t> m_encodeTotalUs;
+    std::atomic<int64_t> m_encodeMaxUs;
+
+    int openEncoder(int width, int height, int fps, int bitrate);
+
+    void applyPending();
+
+    void rotateInto(const VideoFrame &frame, uint8_t **plane, const int *stride);
+
+    /**
+     * With m_mutex held, take the frame into the picture to encode.
+     * @param direct filled to point at the caller's planes when no conversion is needed,
+     *               nullptr to always copy into pic_in
+     * @return direct or pic_in, nullptr to skip the frame
+     */
+    x264_picture_t *loadFrame(const VideoFrame &frame, x264_picture_t *direct);
+
+    //with m_mutex held, encode and send the NALs
+    void encodePicture(x264_picture_t *picture);
+
     void sendSpsPps(uint8_t *sps, uint8_t *pps, int sps_len, int pps_len);
 
-    void sendFrame(int type, uint8_t *payload, int i_payload);
+    //all the NALs of one picture in one video tag
+    void sendFrame(const x264_nal_t *nals, int count);
 
 public:
     VideoStream();
@@ -30,10 +122,66 @@ public:
 
     int setVideoEncInfo(int width, int height, int fps, int bitrate);
 
-    void encodeVideo(int8_t *data, int camera_type);
+    /**
+     * Copy a contiguous frame of width*height*3/2 bytes into the encoder picture,
+     * so that the caller can let go of it before encodeCopied().
+     * @param format VIDEO_FORMAT_*
+     * @param rotation clockwise, the frame is height*width when rotating 90 or 270
+     * @return false when the frame is skipped
+     */
+    bool copyVideo(const uint8_t *data, int format, int rotation);
+
+    /**
+     * Encode and send the frame of copyVideo.
+     */
+    void encodeCopied();
+
+    /**
+     * Encode a frame without copying it first: x264 reads the caller's planes
+     * directly, rotating (or halving) is done in one pass into the encoder picture.
+     */
+    void encodeFrame(const VideoFrame &frame);
 
     void setVideoCallback(VideoCallback videoCallback);
 
+    /**
+     * Reopen the encoder if it is opened already, the next frame is a key frame.
+     */
+    int setEncoderConfig(const EncoderConfig &config);
+
+    EncodeStats getEncodeStats() const;
+
+    /**
+     * Change the bitrate of the running encoder, without a new GOP.
+     * @param bitrate in kbps
+     */
+    void setTargetBitrate(int bitrate);
+
+    /**
+     * Step framerate or resolution, see BitrateController, which reopens the encoder.
+     */
+    void setDegradeLevel(int level);
+
+    int getWidth() const {
+        return m_width;
+    }
+
+    int getHeight() const {
+        return m_height;
+    }
+
+    int getBitrate() const {
+        return m_bitrate;
+    }
+
+    int getFps() const {
+        return m_fps;
+    }
+
+    bool canHalveSize() const {
+        return m_width % 4 == 0 && m_height % 4 == 0;
+    }
+
 };
 
 #endif
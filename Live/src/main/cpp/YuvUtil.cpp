@@ -0,0 +1,291 @@
+
+#include <cstring>
+#include "YuvUtil.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YUV_SSE2 1
+#endif
+
+//edge of the square tiles walked by the rotations, so that source and destination stay in L1
+#define TILE_SIZE 64
+
+/******************** 8x8 blocks ********************/
+
+static void transpose8x8(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride) {
+#if defined(YUV_NEON)
+    uint8x8x2_t t01 = vtrn_u8(vld1_u8(src), vld1_u8(src + src_stride));
+    uint8x8x2_t t23 = vtrn_u8(vld1_u8(src + 2 * src_stride), vld1_u8(src + 3 * src_stride));
+    uint8x8x2_t t45 = vtrn_u8(vld1_u8(src + 4 * src_stride), vld1_u8(src + 5 * src_stride));
+    uint8x8x2_t t67 = vtrn_u8(vld1_u8(src + 6 * src_stride), vld1_u8(src + 7 * src_stride));
+    uint16x4x2_t u02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]), vreinterpret_u16_u8(t23.val[0]));
+    uint16x4x2_t u13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]), vreinterpret_u16_u8(t23.val[1]));
+    uint16x4x2_t u46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]), vreinterpret_u16_u8(t67.val[0]));
+    uint16x4x2_t u57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]), vreinterpret_u16_u8(t67.val[1]));
+    uint32x2x2_t v04 = vtrn_u32(vreinterpret_u32_u16(u02.val[0]), vreinterpret_u32_u16(u46.val[0]));
+    uint32x2x2_t v15 = vtrn_u32(vreinterpret_u32_u16(u13.val[0]), vreinterpret_u32_u16(u57.val[0]));
+    uint32x2x2_t v26 = vtrn_u32(vreinterpret_u32_u16(u02.val[1]), vreinterpret_u32_u16(u46.val[1]));
+    uint32x2x2_t v37 = vtrn_u32(vreinterpret_u32_u16(u13.val[1]), vreinterpret_u32_u16(u57.val[1]));
+    vst1_u8(dst, vreinterpret_u8_u32(v04.val[0]));
+    vst1_u8(dst + dst_stride, vreinterpret_u8_u32(v15.val[0]));
+    vst1_u8(dst + 2 * dst_stride, vreinterpret_u8_u32(v26.val[0]));
+    vst1_u8(dst + 3 * dst_stride, vreinterpret_u8_u32(v37.val[0]));
+    vst1_u8(dst + 4 * dst_stride, vreinterpret_u8_u32(v04.val[1]));
+    vst1_u8(dst + 5 * dst_stride, vreinterpret_u8_u32(v15.val[1]));
+    vst1_u8(dst + 6 * dst_stride, vreinterpret_u8_u32(v26.val[1]));
+    vst1_u8(dst + 7 * dst_stride, vreinterpret_u8_u32(v37.val[1]));
+#elif defined(YUV_SSE2)
+    __m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) src),
+                                   _mm_loadl_epi64((const __m128i *) (src + src_stride)));
+    __m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (src + 2 * src_stride)),
+                                   _mm_loadl_epi64((const __m128i *) (src + 3 * src_stride)));
+    __m128i a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (src + 4 * src_stride)),
+                                   _mm_loadl_epi64((const __m128i *) (src + 5 * src_stride)));
+    __m128i a3 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (src + 6 * src_stride)),
+                                   _mm_loadl_epi64((const __m128i *) (src + 7 * src_stride)));
+    __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+    __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+    __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+    //every register holds two output rows
+    __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+    __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+    __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+    __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+    _mm_storel_epi64((__m128i *) dst, c0);
+    _mm_storel_epi64((__m128i *) (dst + dst_stride), _mm_srli_si128(c0, 8));
+    _mm_storel_epi64((__m128i *) (dst + 2 * dst_stride), c1);
+    _mm_storel_epi64((__m128i *) (dst + 3 * dst_stride), _mm_srli_si128(c1, 8));
+    _mm_storel_epi64((__m128i *) (dst + 4 * dst_stride), c2);
+    _mm_storel_epi64((__m128i *) (dst + 5 * dst_stride), _mm_srli_si128(c2, 8));
+    _mm_storel_epi64((__m128i *) (dst + 6 * dst_stride), c3);
+    _mm_storel_epi64((__m128i *) (dst + 7 * dst_stride), _mm_srli_si128(c3, 8));
+#else
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            dst[j * dst_stride + i] = src[i * src_stride + j];
+        }
+    }
+#endif
+}
+
+//the same on pairs of bytes, strides in bytes
+static void transpose8x8UV(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride) {
+#if defined(YUV_NEON)
+    uint16x8x2_t t01 = vtrnq_u16(vld1q_u16((const uint16_t *) src),
+                                 vld1q_u16((const uint16_t *) (src + src_stride)));
+    uint16x8x2_t t23 = vtrnq_u16(vld1q_u16((const uint16_t *) (src + 2 * src_stride)),
+                                 vld1q_u16((const uint16_t *) (src + 3 * src_stride)));
+    uint16x8x2_t t45 = vtrnq_u16(vld1q_u16((const uint16_t *) (src + 4 * src_stride)),
+                                 vld1q_u16((const uint16_t *) (src + 5 * src_stride)));
+    uint16x8x2_t t67 = vtrnq_u16(vld1q_u16((const uint16_t *) (src + 6 * src_stride)),
+                                 vld1q_u16((const uint16_t *) (src + 7 * src_stride)));
+    uint32x4x2_t u02 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[0]), vreinterpretq_u32_u16(t23.val[0]));
+    uint32x4x2_t u13 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[1]), vreinterpretq_u32_u16(t23.val[1]));
+    uint32x4x2_t u46 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[0]), vreinterpretq_u32_u16(t67.val[0]));
+    uint32x4x2_t u57 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[1]), vreinterpretq_u32_u16(t67.val[1]));
+    vst1q_u32((uint32_t *) dst, vcombine_u32(vget_low_u32(u02.val[0]), vget_low_u32(u46.val[0])));
+    vst1q_u32((uint32_t *) (dst + dst_stride), vcombine_u32(vget_low_u32(u13.val[0]), vget_low_u32(u57.val[0])));
+    vst1q_u32((uint32_t *) (dst + 2 * dst_stride), vcombine_u32(vget_low_u32(u02.val[1]), vget_low_u32(u46.val[1])));
+    vst1q_u32((uint32_t *) (dst + 3 * dst_stride), vcombine_u32(vget_low_u32(u13.val[1]), vget_low_u32(u57.val[1])));
+    vst1q_u32((uint32_t *) (dst + 4 * dst_stride), vcombine_u32(vget_high_u32(u02.val[0]), vget_high_u32(u46.val[0])));
+    vst1q_u32((uint32_t *) (dst + 5 * dst_stride), vcombine_u32(vget_high_u32(u13.val[0]), vget_high_u32(u57.val[0])));
+    vst1q_u32((uint32_t *) (dst + 6 * dst_stride), vcombine_u32(vget_high_u32(u02.val[1]), vget_high_u32(u46.val[1])));
+    vst1q_u32((uint32_t *) (dst + 7 * dst_stride), vcombine_u32(vget_high_u32(u13.val[1]), vget_high_u32(u57.val[1])));
+#elif defined(YUV_SSE2)
+    __m128i r[8];
+    for (int i = 0; i < 8; i++) {
+        r[i] = _mm_loadu_si128((const __m128i *) (src + i * src_stride));
+    }
+    __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+    __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+    __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+    _mm_storeu_si128((__m128i *) dst, _mm_unpacklo_epi64(b0, b4));
+    _mm_storeu_si128((__m128i *) (dst + dst_stride), _mm_unpackhi_epi64(b0, b4));
+    _mm_storeu_si128((__m128i *) (dst + 2 * dst_stride), _mm_unpacklo_epi64(b1, b5));
+    _mm_storeu_si128((__m128i *) (dst + 3 * dst_stride), _mm_unpackhi_epi64(b1, b5));
+    _mm_storeu_si128((__m128i *) (dst + 4 * dst_stride), _mm_unpacklo_epi64(b2, b6));
+    _mm_storeu_si128((__m128i *) (dst + 5 * dst_stride), _mm_unpackhi_epi64(b2, b6));
+    _mm_storeu_si128((__m128i *) (dst + 6 * dst_stride), _mm_unpacklo_epi64(b3, b7));
+    _mm_storeu_si128((__m128i *) (dst + 7 * dst_stride), _mm_unpackhi_epi64(b3, b7));
+#else
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            memcpy(dst + j * dst_stride + i * 2, src + i * src_stride + j * 2, 2);
+        }
+    }
+#endif
+}
+
+/******************** rows ********************/
+
+static void reverseRow(const uint8_t *src, uint8_t *dst, int count) {
+    int i = 0;
+#if defined(YUV_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t q = vrev64q_u8(vld1q_u8(src + count - 16 - i));
+        vst1q_u8(dst + i, vcombine_u8(vget_high_u8(q), vget_low_u8(q)));
+    }
+#elif defined(YUV_SSE2)
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + count - 16 - i));
+        x = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128((__m128i *) (dst + i), x);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = src[count - 1 - i];
+    }
+}
+
+//count pairs
+static void reverseRowUV(const uint8_t *src, uint8_t *dst, int count) {
+    int i = 0;
+#if defined(YUV_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t q = vrev64q_u16(vld1q_u16((const uint16_t *) (src + (count - 8 - i) * 2)));
+        vst1q_u16((uint16_t *) (dst + i * 2), vcombine_u16(vget_high_u16(q), vget_low_u16(q)));
+    }
+#elif defined(YUV_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + (count - 8 - i) * 2));
+        x = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i *) (dst + i * 2), x);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i * 2]     = src[(count - 1 - i) * 2];
+        dst[i * 2 + 1] = src[(count - 1 - i) * 2 + 1];
+    }
+}
+
+/******************** planes ********************/
+
+typedef void (*Transpose8x8)(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride);
+
+//dst(height*width) = transpose of src(width*height), negative strides flip rows
+static void transposePlane(const uint8_t *src, int src_stride,
+                           uint8_t *dst, int dst_stride,
+                           int width, int height, int bytes, Transpose8x8 kernel) {
+    int w8 = width & ~7;
+    int h8 = height & ~7;
+    for (int ty = 0; ty < h8; ty += TILE_SIZE) {
+        int y_end = ty + TILE_SIZE < h8 ? ty + TILE_SIZE : h8;
+        for (int tx = 0; tx < w8; tx += TILE_SIZE) {
+            int x_end = tx + TILE_SIZE < w8 ? tx + TILE_SIZE : w8;
+            for (int y = ty; y < y_end; y += 8) {
+                for (int x = tx; x < x_end; x += 8) {
+                    kernel(src + y * src_stride + x * bytes, src_stride,
+                           dst + x * dst_stride + y * bytes, dst_stride);
+                }
+            }
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = (y < h8 ? w8 : 0); x < width; x++) {
+            memcpy(dst + x * dst_stride + y * bytes, src + y * src_stride + x * bytes, bytes);
+        }
+    }
+}
+
+static void rotate(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride,
+                   int width, int height, int degree, int bytes) {
+    Transpose8x8 kernel = bytes == 1 ? transpose8x8 : transpose8x8UV;
+    switch (degree) {
+        case 90:
+            //dst[r][c] = src[h - 1 - c][r]
+            transposePlane(src + (height - 1) * src_stride, -src_stride,
+                           dst, dst_stride, width, height, bytes, kernel);
+            break;
+        case 270:
+            //dst[r][c] = src[c][w - 1 - r]
+            transposePlane(src, src_stride, dst + (width - 1) * dst_stride, -dst_stride,
+                           width, height, bytes, kernel);
+            break;
+        case 180:
+            for (int j = 0; j < height; j++) {
+                const uint8_t *row = src + (height - 1 - j) * src_stride;
+                if (bytes == 1) {
+                    reverseRow(row, dst + j * dst_stride, width);
+                } else {
+                    reverseRowUV(row, dst + j * dst_stride, width);
+                }
+            }
+            break;
+        default:
+            for (int j = 0; j < height; j++) {
+                memcpy(dst + j * dst_stride, src + j * src_stride, (size_t) width * bytes);
+            }
+            break;
+    }
+}
+
+void rotatePlane(const uint8_t *src, int src_stride,
+                 uint8_t *dst, int dst_stride,
+                 int width, int height, int degree) {
+    rotate(src, src_stride, dst, dst_stride, width, height, degree, 1);
+}
+
+void rotatePlaneUV(const uint8_t *src, int src_stride,
+                   uint8_t *dst, int dst_stride,
+                   int width, int height, int degree) {
+    rotate(src, src_stride, dst, dst_stride, width, height, degree, 2);
+}
+
+void scaleHalfPlane(const uint8_t *src, int src_stride,
+                    uint8_t *dst, int dst_stride,
+                    int dst_width, int dst_height) {
+    for (int y = 0; y < dst_height; ++y) {
+        const uint8_t *row0 = src + 2 * y * src_stride;
+        const uint8_t *row1 = row0 + src_stride;
+        uint8_t *out = dst + y * dst_stride;
+        int x = 0;
+#if defined(YUV_NEON)
+        for (; x + 8 <= dst_width; x += 8) {
+            uint16x8_t sum = vpaddlq_u8(vld1q_u8(row0 + 2 * x));
+            sum = vpadalq_u8(sum, vld1q_u8(row1 + 2 * x));
+            vst1_u8(out + x, vrshrn_n_u16(sum, 2));
+        }
+#endif
+        for (; x < dst_width; ++x) {
+            out[x] = (uint8_t) ((row0[2 * x] + row0[2 * x + 1]
+                                 + row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+        }
+    }
+}
+
+void scaleHalfPlaneUV(const uint8_t *src, int src_stride,
+                      uint8_t *dst, int dst_stride,
+                      int dst_width, int dst_height) {
+    for (int y = 0; y < dst_height; ++y) {
+        const uint8_t *row0 = src + 2 * y * src_stride;
+        const uint8_t *row1 = row0 + src_stride;
+        uint8_t *out = dst + y * dst_stride;
+        for (int x = 0; x < dst_width * 2; ++x) {
+            //the same component of the neighbour pair is 2 bytes away
+            int s = (x & ~1) * 2 + (x & 1);
+            out[x] = (uint8_t) ((row0[s] + row0[s + 2] + row1[s] + row1[s + 2] + 2) >> 2);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+
+#ifndef YUV_UTIL_H
+#define YUV_UTIL_H
+
+#include <cstdint>
+
+/**
+ * Rotate a plane of bytes clockwise, e.g. Y or the planes of I420.
+ * Strides may be larger than the width, the size of dst is height*width for 90 and 270.
+ */
+void rotatePlane(const uint8_t *src, int src_stride,
+                 uint8_t *dst, int dst_stride,
+                 int width, int height, int degree);
+
+/**
+ * Rotate an interleaved chroma plane (UV of NV12, VU of NV21) clockwise,
+ * moving each pair as one unit.
+ * @param width number of pairs per row
+ */
+void rotatePlaneUV(const uint8_t *src, int src_stride,
+                   uint8_t *dst, int dst_stride,
+                   int width, int height, int degree);
+
+/**
+ * Halve a plane of bytes with a 2x2 box filter.
+ */
+void scaleHalfPlane(const uint8_t *src, int src_stride,
+                    uint8_t *dst, int dst_stride,
+                    int dst_width, int dst_height);
+
+/**
+ * Halve an interleaved chroma plane with a 2x2 box filter on each component.
+ * @param dst_width number of pairs per row of dst
+ */
+void scaleHalfPlaneUV(const uint8_t *src, int src_stride,
+                      uint8_t *dst, int dst_stride,
+                      int dst_width, int dst_height);
+
+#endif // YUV_UTIL_H
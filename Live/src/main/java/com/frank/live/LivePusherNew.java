@@ -5,8 +5,10 @@ import android.view.SurfaceHolder;
 import android.view.View;
 
 import com.frank.live.listener.LiveStateChangeListener;
+import com.frank.live.listener.OnBitrateStatsListener;
 import com.frank.live.listener.OnFrameDataCallback;
 import com.frank.live.param.AudioParam;
+import com.frank.live.param.EncoderParam;
 import com.frank.live.param.VideoParam;
 import com.frank.live.stream.AudioStream;
 import com.frank.live.camera.CameraType;
@@ -14,6 +16,8 @@ import com.frank.live.stream.VideoStream;
 import com.frank.live.stream.VideoStreamBase;
 import com.frank.live.stream.VideoStreamNew;
 
+import java.nio.ByteBuffer;
+
 public class LivePusherNew implements OnFrameDataCallback {
 
     private final static int ERROR_VIDEO_ENCODER_OPEN   = 0x01;
@@ -33,6 +37,8 @@ public class LivePusherNew implements OnFrameDataCallback {
 
     private LiveStateChangeListener liveStateChangeListener;
 
+    private OnBitrateStatsListener bitrateStatsListener;
+
     private final Activity activity;
 
     public LivePusherNew(Activity activity,
@@ -71,6 +77,64 @@ public class LivePusherNew implements OnFrameDataCallback {
         audioStream.setMute(isMute);
     }
 
+    /**
+     * Set the capacity of the packet queues between the encoders and the network,
+     * which takes effect before pushing starts
+     *
+     * @param capacity max video frames and audio packets queued
+     */
+    public void setQueueCapacity(int capacity) {
+        native_setQueueCapacity(capacity);
+    }
+
+    /**
+     * Get the state of the packet queue
+     *
+     * @return video depth in frames, audio depth, max depth, pushed count,
+     * sent count, dropped video frames and dropped audio packets, in order
+     */
+    public long[] getQueueStats() {
+        return native_getQueueStats();
+    }
+
+    /**
+     * Adapt the video bitrate to the network, and as a last resort the framerate
+     * and resolution. Enabled by default.
+     *
+     * @param enable enable or not
+     */
+    public void setAdaptiveBitrate(boolean enable) {
+        native_setAdaptiveBitrate(enable);
+    }
+
+    /**
+     * Set the profile of x264, the encoder is reopened if it is running.
+     *
+     * @param param preset, tune, profile, level, threads and lookahead
+     */
+    public void setEncoderParam(EncoderParam param) {
+        if (param == null || param.getPreset() == null || param.getProfile() == null) {
+            return;
+        }
+        String tune = param.getTune() != null ? param.getTune() : "";
+        native_setVideoEncoderParam(param.getPreset(), tune, param.getProfile(), param.getLevel(),
+                param.getThreads(), param.isSlicedThreads(), param.getLookahead());
+    }
+
+    /**
+     * Get the time spent by x264 per frame
+     *
+     * @return encoded frames, last frame(us), average(us), max(us)
+     * and encoder threads, in order
+     */
+    public long[] getEncodeStats() {
+        return native_getEncodeStats();
+    }
+
+    public void setBitrateStatsListener(OnBitrateStatsListener listener) {
+        this.bitrateStatsListener = listener;
+    }
+
     public void startPush(String path, LiveStateChangeListener stateChangeListener) {
         this.liveStateChangeListener = stateChangeListener;
         native_start(path);
@@ -129,6 +193,17 @@ public class LivePusherNew implements OnFrameDataCallback {
         }
     }
 
+    /**
+     * Callback this method from native, once per measuring window
+     */
+    public void onBitrateStatsFromNative(int sendKbps, int videoKbps, int targetKbps,
+                                         int queueDepth, int dropped, int level, int decision) {
+        if (bitrateStatsListener != null) {
+            bitrateStatsListener.onBitrateStats(sendKbps, videoKbps, targetKbps,
+                    queueDepth, dropped, level, decision);
+        }
+    }
+
     private int getInputSamplesFromNative() {
         return native_getInputSamples();
     }
@@ -145,8 +220,8 @@ public class LivePusherNew implements OnFrameDataCallback {
         native_pushAudio(data);
     }
 
-    private void pushVideo(byte[] data, int cameraType) {
-        native_pushVideo(data, cameraType);
+    private void pushVideo(byte[] data, int format, int rotation) {
+        native_pushVideo(data, format, rotation);
     }
 
     @Override
@@ -172,9 +247,17 @@ public class LivePusherNew implements OnFrameDataCallback {
     }
 
     @Override
-    public void onVideoFrame(byte[] yuv, int cameraType) {
+    public void onVideoFrame(byte[] yuv, int format, int rotation) {
         if (yuv != null) {
-            pushVideo(yuv, cameraType);
+            pushVideo(yuv, format, rotation);
+        }
+    }
+
+    @Override
+    public void onVideoFrame(ByteBuffer y, int yStride, ByteBuffer uv, int uvStride,
+                             int width, int height, int format, int rotation) {
+        if (y != null && uv != null && y.isDirect() && uv.isDirect()) {
+            native_pushVideoBuffer(y, yStride, uv, uvStride, width, height, format, rotation);
         }
     }
 
@@ -190,7 +273,21 @@ public class LivePusherNew implements OnFrameDataCallback {
 
     private native void native_pushAudio(byte[] data);
 
-    private native void native_pushVideo(byte[] yuv, int cameraType);
+    private native void native_pushVideo(byte[] yuv, int format, int rotation);
+
+    private native void native_pushVideoBuffer(ByteBuffer y, int yStride, ByteBuffer uv, int uvStride,
+                                               int width, int height, int format, int rotation);
+
+    private native void native_setVideoEncoderParam(String preset, String tune, String profile, int level,
+                                                    int threads, boolean slicedThreads, int lookahead);
+
+    private native long[] native_getEncodeStats();
+
+    private native void native_setQueueCapacity(int capacity);
+
+    private native long[] native_getQueueStats();
+
+    private native void native_setAdaptiveBitrate(boolean enable);
 
     private native void native_stop();
 
@@ -554,6 +554,14 @@ public class Camera2Helper {
                 int offset = 0;
                 int width  = image.getWidth();
                 int height = image.getHeight();
+                // U and V planes interleaved: the U plane is NV12 already, hand it over in place
+                if (planes[1].getPixelStride() == 2 && planes[0].getPixelStride() == 1) {
+                    camera2Listener.onPreviewFrame(planes[0].getBuffer(), planes[0].getRowStride(),
+                            planes[1].getBuffer(), planes[1].getRowStride(), width, height, rotateDegree);
+                    lock.unlock();
+                    image.close();
+                    return;
+                }
                 int len    = width * height;
                 if (yuvData == null) {
                     yuvData = new byte[len * 3 / 2];
@@ -3,12 +3,22 @@ package com.frank.live.camera;
 
 import android.util.Size;
 
+import java.nio.ByteBuffer;
+
 public interface Camera2Listener {
 
     void onCameraOpened(Size previewSize, int displayOrientation);
 
     void onPreviewFrame(byte[] yuvData);
 
+    /**
+     * Semi-planar frame straight from the Image, only valid during the call
+     *
+     * @param rotation clockwise rotation to apply before encoding
+     */
+    void onPreviewFrame(ByteBuffer y, int yStride, ByteBuffer uv, int uvStride,
+                        int width, int height, int rotation);
+
     void onCameraClosed();
 
     void onCameraError(Exception e);
@@ -20,7 +20,6 @@ public class CameraHelper implements SurfaceHolder.Callback, Camera.PreviewCallb
     private Camera.PreviewCallback mPreviewCallback;
     private int mRotation;
     private OnChangedSizeListener mOnChangedSizeListener;
-    private byte[] bytes;
 
     public CameraHelper(Activity activity, int cameraId, int width, int height) {
         mActivity = activity;
@@ -57,7 +56,6 @@ public class CameraHelper implements SurfaceHolder.Callback, Camera.PreviewCallb
             setPreviewOrientation(parameters);
             mCamera.setParameters(parameters);
             buffer = new byte[mWidth * mHeight * 3 / 2];
-            bytes = new byte[buffer.length];
             mCamera.addCallbackBuffer(buffer);
             mCamera.setPreviewCallbackWithBuffer(this);
             mCamera.setPreviewDisplay(mSurfaceHolder);
@@ -142,61 +140,24 @@ public class CameraHelper implements SurfaceHolder.Callback, Camera.PreviewCallb
 
     @Override
     public void onPreviewFrame(byte[] data, Camera camera) {
-        switch (mRotation) {
-            case Surface.ROTATION_0:
-                rotation90(data);
-                break;
-            case Surface.ROTATION_90:
-            case Surface.ROTATION_270:
-            default:
-                break;
-        }
-        mPreviewCallback.onPreviewFrame(bytes, camera);
+        // NV21 goes out as captured, see getRotateDegree()
+        mPreviewCallback.onPreviewFrame(data, camera);
         camera.addCallbackBuffer(buffer);
     }
 
-    private void rotation90(byte[] data) {
-        int index = 0;
-        int ySize = mWidth * mHeight;
-        int uvHeight = mHeight / 2;
-        //back camera
-        if (mCameraId == Camera.CameraInfo.CAMERA_FACING_BACK) {
-
-            for (int i = 0; i < mWidth; i++) {
-                for (int j = mHeight - 1; j >= 0; j--) {
-                    bytes[index++] = data[mWidth * j + i];
-                }
-            }
-
-            for (int i = 0; i < mWidth; i += 2) {
-                for (int j = uvHeight - 1; j >= 0; j--) {
-                    // v
-                    bytes[index++] = data[ySize + mWidth * j + i];
-                    // u
-                    bytes[index++] = data[ySize + mWidth * j + i + 1];
-                }
-            }
-        } else { // front camera
-            for (int i = 0; i < mWidth; i++) {
-                int nPos = mWidth - 1;
-                for (int j = 0; j < mHeight; j++) {
-                    bytes[index++] = data[nPos - i];
-                    nPos += mWidth;
-                }
-            }
-            //u v
-            for (int i = 0; i < mWidth; i += 2) {
-                int nPos = ySize + mWidth - 1;
-                for (int j = 0; j < uvHeight; j++) {
-                    bytes[index++] = data[nPos - i - 1];
-                    bytes[index++] = data[nPos - i];
-                    nPos += mWidth;
-                }
-            }
+    /**
+     * The clockwise rotation to apply to the preview frames before encoding,
+     * which the encoder fuses with its input conversion
+     *
+     * @return 90 for back camera and 270 for front camera in portrait, otherwise 0
+     */
+    public int getRotateDegree() {
+        if (mRotation != Surface.ROTATION_0) {
+            return 0;
         }
+        return mCameraId == Camera.CameraInfo.CAMERA_FACING_BACK ? 90 : 270;
     }
 
-
     public void setOnChangedSizeListener(OnChangedSizeListener listener) {
         mOnChangedSizeListener = listener;
     }
@@ -0,0 +1,26 @@
+package com.frank.live.listener;
+
+/**
+ * Statistics of adaptive bitrate, called about once per second from the pushing thread
+ */
+
+public interface OnBitrateStatsListener {
+
+    int DECISION_HOLD     = 0;
+    int DECISION_DECREASE = 1;
+    int DECISION_INCREASE = 2;
+    int DECISION_DEGRADE  = 3;
+    int DECISION_UPGRADE  = 4;
+
+    /**
+     * @param sendKbps    measured throughput, audio and video
+     * @param videoKbps   measured video throughput
+     * @param targetKbps  bitrate of the video encoder
+     * @param queueDepth  packets waiting to be sent
+     * @param dropped     video frames dropped during the last window
+     * @param level       0: full, 1: lower framerate, 2: half resolution and lower framerate
+     * @param decision    one of DECISION_*
+     */
+    void onBitrateStats(int sendKbps, int videoKbps, int targetKbps,
+                        int queueDepth, int dropped, int level, int decision);
+}
@@ -1,5 +1,7 @@
 package com.frank.live.listener;
 
+import java.nio.ByteBuffer;
+
 /**
  * Video/Audio frame callback
  * Created by frank on 2022/01/25.
@@ -7,13 +9,31 @@ package com.frank.live.listener;
 
 public interface OnFrameDataCallback {
 
+    int FORMAT_NV21 = 1;
+    int FORMAT_I420 = 2;
+    int FORMAT_NV12 = 3;
+
     int getInputSamples();
 
     void onAudioFrame(byte[] pcm);
 
     void onAudioCodecInfo(int sampleRate, int channelCount);
 
-    void onVideoFrame(byte[] yuv, int cameraType);
+    /**
+     * @param yuv      data of a frame, width*height*3/2
+     * @param format   FORMAT_NV21 or FORMAT_I420
+     * @param rotation clockwise rotation to apply before encoding
+     */
+    void onVideoFrame(byte[] yuv, int format, int rotation);
+
+    /**
+     * Semi-planar frame in direct buffers, e.g. the planes of a camera2 Image,
+     * which the encoder reads in place
+     *
+     * @param format FORMAT_NV21 or FORMAT_NV12
+     */
+    void onVideoFrame(ByteBuffer y, int yStride, ByteBuffer uv, int uvStride,
+                      int width, int height, int format, int rotation);
 
     void onVideoCodecInfo(int width, int height, int frameRate, int bitrate);
 }
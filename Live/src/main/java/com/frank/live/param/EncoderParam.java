@@ -0,0 +1,118 @@
+package com.frank.live.param;
+
+/**
+ * x264 encoder param Entity
+ */
+
+public class EncoderParam {
+    /**
+     * Pick the thread count according to the cores, using sliced threads
+     */
+    public static final int THREADS_AUTO = 0;
+    /**
+     * Keep the lookahead of the preset and tune
+     */
+    public static final int LOOKAHEAD_DEFAULT = -1;
+    /**
+     * Let x264 pick the level according to size, fps and bitrate
+     */
+    public static final int LEVEL_AUTO = 0;
+
+    private String preset  = "ultrafast";
+    private String tune    = "zerolatency";
+    private String profile = "baseline";
+    private int level = 32;
+    private int threads = 1;
+    private boolean slicedThreads = true;
+    private int lookahead = LOOKAHEAD_DEFAULT;
+
+    public EncoderParam() {
+    }
+
+    public EncoderParam(String preset, String tune, String profile, int level,
+                        int threads, boolean slicedThreads, int lookahead) {
+        this.preset        = preset;
+        this.tune          = tune;
+        this.profile       = profile;
+        this.level         = level;
+        this.threads       = threads;
+        this.slicedThreads = slicedThreads;
+        this.lookahead     = lookahead;
+    }
+
+    /**
+     * Low latency with sliced threads, one per core
+     */
+    public static EncoderParam autoParam() {
+        EncoderParam param = new EncoderParam();
+        param.setThreads(THREADS_AUTO);
+        param.setLevel(LEVEL_AUTO);
+        return param;
+    }
+
+    public String getPreset() {
+        return preset;
+    }
+
+    public void setPreset(String preset) {
+        this.preset = preset;
+    }
+
+    public String getTune() {
+        return tune;
+    }
+
+    /**
+     * @param tune e.g. "zerolatency", "film", empty for none
+     */
+    public void setTune(String tune) {
+        this.tune = tune;
+    }
+
+    public String getProfile() {
+        return profile;
+    }
+
+    public void setProfile(String profile) {
+        this.profile = profile;
+    }
+
+    public int getLevel() {
+        return level;
+    }
+
+    /**
+     * @param level level_idc, e.g. 31 for level 3.1
+     */
+    public void setLevel(int level) {
+        this.level = level;
+    }
+
+    public int getThreads() {
+        return threads;
+    }
+
+    public void setThreads(int threads) {
+        this.threads = threads;
+    }
+
+    public boolean isSlicedThreads() {
+        return slicedThreads;
+    }
+
+    /**
+     * @param slicedThreads sliced threads split each frame without latency,
+     *                      frame threads delay the output by a frame per thread
+     */
+    public void setSlicedThreads(boolean slicedThreads) {
+        this.slicedThreads = slicedThreads;
+    }
+
+    public int getLookahead() {
+        return lookahead;
+    }
+
+    public void setLookahead(int lookahead) {
+        this.lookahead = lookahead;
+    }
+}
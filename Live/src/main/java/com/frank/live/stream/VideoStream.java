@@ -65,7 +65,7 @@ public class VideoStream extends VideoStreamBase implements Camera.PreviewCallba
     @Override
     public void onPreviewFrame(byte[] data, Camera camera) {
         if (isLiving && mCallback != null) {
-            mCallback.onVideoFrame(data, 1);
+            mCallback.onVideoFrame(data, OnFrameDataCallback.FORMAT_NV21, cameraHelper.getRotateDegree());
         }
     }
 
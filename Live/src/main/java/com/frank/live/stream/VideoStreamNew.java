@@ -16,6 +16,8 @@ import com.frank.live.camera.Camera2Listener;
 import com.frank.live.listener.OnFrameDataCallback;
 import com.frank.live.param.VideoParam;
 
+import java.nio.ByteBuffer;
+
 /**
  * Pushing video stream: using Camera2
  * Created by frank on 2020/02/12.
@@ -136,7 +138,16 @@ public class VideoStreamNew extends VideoStreamBase
     @Override
     public void onPreviewFrame(byte[] yuvData) {
         if (isLiving && mCallback != null) {
-            mCallback.onVideoFrame(yuvData, 2);
+            mCallback.onVideoFrame(yuvData, OnFrameDataCallback.FORMAT_I420, 0);
+        }
+    }
+
+    @Override
+    public void onPreviewFrame(ByteBuffer y, int yStride, ByteBuffer uv, int uvStride,
+                               int width, int height, int rotation) {
+        if (isLiving && mCallback != null) {
+            mCallback.onVideoFrame(y, yStride, uv, uvStride, width, height,
+                    OnFrameDataCallback.FORMAT_NV12, rotation);
         }
     }
 
@@ -4,9 +4,6 @@
 
 #include "ff_audio_player.h"
 #include <jni.h>
-#include <unistd.h>
-
-#define SLEEP_TIME (16000)
 
 void fftCallback(JNIEnv *env, jobject thiz, jmethodID fft_method, int8_t *data, int size) {
     jbyteArray dataArray = env->NewByteArray(size);
@@ -17,69 +14,87 @@ void fftCallback(JNIEnv *env, jobject thiz, jmethodID fft_method, int8_t *data,
 
 AUDIO_PLAYER_FUNC(long, native_1init) {
     auto *audioPlayer = new FFAudioPlayer();
+    // native_1play always follows, native_1release waits for it
+    audioPlayer->setPlaying(true);
     return (long)audioPlayer;
 }
 
-AUDIO_PLAYER_FUNC(void, native_1play, long context, jstring path, jstring filter) {
-    if (path == nullptr)
+AUDIO_PLAYER_FUNC(void, native_1play, long context, jstring path, jstring filter,
+                  jint output, jstring wavPath) {
+    auto *audioPlayer = (FFAudioPlayer*) context;
+    if (path == nullptr) {
+        audioPlayer->setPlaying(false);
         return;
+    }
 
-    int result = 0;
+    int result;
     const char* native_path = env->GetStringUTFChars(path, JNI_FALSE);
-    auto *audioPlayer = (FFAudioPlayer*) context;
-    // open stream, and init work
-    audioPlayer->open(native_path);
-    // init AudioTrack
+    const char* wav_path    = wavPath ? env->GetStringUTFChars(wavPath, JNI_FALSE) : nullptr;
     jclass audio_class = env->GetObjectClass(thiz);
-    jmethodID audio_track_method = env->GetMethodID(audio_class,
-                                                    "createAudioTrack", "(II)Landroid/media/AudioTrack;");
-    jobject audio_track = env->CallObjectMethod(thiz, audio_track_method,
-                                                audioPlayer->getSampleRate(), audioPlayer->getChannel());
-    // play function
-    jclass audio_track_class = env->GetObjectClass(audio_track);
-    jmethodID play_method = env->GetMethodID(audio_track_class, "play", "()V");
-    env->CallVoidMethod(audio_track, play_method);
-    jmethodID write_method     = env->GetMethodID(audio_track_class, "write", "([BII)I");
     jmethodID play_info_method = env->GetMethodID(audio_class, "playInfoFromJNI", "(I)V");
-    env->CallVoidMethod(thiz, play_info_method, 1);
-
-    // demux decode and play
-    while (result >= 0) {
-        result = audioPlayer->decodeAudio();
-        if (result == 0) {
-            continue;
-        } else if (result < 0) {
-            break;
+    // open stream, and init work
+    result = audioPlayer->open(native_path);
+    if (result >= 0) {
+        env->CallVoidMethod(thiz, play_info_method, 1);
+        // decode on its own thread, and play with native output until the end
+        result = audioPlayer->play(output, wav_path);
+        if (result == AVERROR_EOF) {
+            env->CallVoidMethod(thiz, play_info_method, 2);
         }
-        int size = result;
-        // call AudioTrack to play(should be reused array)
-        jbyteArray audio_array = env->NewByteArray(size);
-        jbyte *data_address = env->GetByteArrayElements(audio_array, JNI_FALSE);
-        memcpy(data_address, audioPlayer->getDecodeFrame(), size);
-        env->ReleaseByteArrayElements(audio_array, data_address, 0);
-        env->CallIntMethod(audio_track, write_method, audio_array, 0, size);
-        env->DeleteLocalRef(audio_array);
-
-        // audio sync
-        usleep(SLEEP_TIME);
     }
 
-    if (result == AVERROR_EOF) {
-        env->CallVoidMethod(thiz, play_info_method, 2);
-    }
     env->ReleaseStringUTFChars(path, native_path);
-    jmethodID release_method = env->GetMethodID(audio_class, "releaseAudioTrack", "()V");
-    env->CallVoidMethod(thiz, release_method);
+    if (wav_path) {
+        env->ReleaseStringUTFChars(wavPath, wav_path);
+    }
+    // deleted by native_1release, the handle stays valid for the Java side until then
     audioPlayer->close();
-    delete audioPlayer;
+    audioPlayer->setPlaying(false);
 }
 
 AUDIO_PLAYER_FUNC(void, native_1again, long context, jstring filter_jstr) {
     if (!filter_jstr) return;
     auto *audioPlayer = (FFAudioPlayer*) context;
-    audioPlayer->setFilterAgain(true);
     const char *desc = env->GetStringUTFChars(filter_jstr, nullptr);
-    audioPlayer->setFilterDesc(desc);
+    // copied, the decode thread picks it up on its next frame
+    audioPlayer->setFilter(desc);
+    env->ReleaseStringUTFChars(filter_jstr, desc);
+}
+
+AUDIO_PLAYER_FUNC(jlongArray, native_1get_1effect_1stats, long context) {
+    auto *audioPlayer = (FFAudioPlayer*) context;
+    if (!audioPlayer)
+        return nullptr;
+    AudioEffectStats stats = audioPlayer->getEffectStats();
+    jlong values[] = {stats.commands, stats.rebuilds, stats.last_build_us,
+                      stats.last_swap_us, stats.max_swap_us};
+    jlongArray result = env->NewLongArray(5);
+    env->SetLongArrayRegion(result, 0, 5, values);
+    return result;
+}
+
+AUDIO_PLAYER_FUNC(void, native_1set_1speed, long context, jfloat speed) {
+    auto *audioPlayer = (FFAudioPlayer*) context;
+    if (!audioPlayer)
+        return;
+    audioPlayer->setSpeed(speed);
+}
+
+AUDIO_PLAYER_FUNC(int, native_1attach_1visualizer, long context, jobject visualizer) {
+    auto *audioPlayer = (FFAudioPlayer*) context;
+    if (!audioPlayer || !visualizer)
+        return -1;
+    jclass visual_class = env->GetObjectClass(visualizer);
+    jfieldID native_field = env->GetFieldID(visual_class, "mNativeVisualizer", "J");
+    auto *frankVisualizer = (FrankVisualizer *) env->GetLongField(visualizer, native_field);
+    if (!frankVisualizer)
+        return -2;
+    // read by the visualizer in place, no JNI on the way
+    std::shared_ptr<PcmTapReader> tap = audioPlayer->attachTap(TAP_SAMPLE_RATE, 1, TAP_FRAMES);
+    if (!tap)
+        return -1;
+    frankVisualizer->setTap(tap);
+    return 0;
 }
 
 AUDIO_PLAYER_FUNC(long, native_1get_1position, long context) {
@@ -101,5 +116,7 @@ AUDIO_PLAYER_FUNC(void, native_1release, long context) {
     if (!audioPlayer)
         return;
     audioPlayer->setExit(true);
+    audioPlayer->waitPlayed();
+    delete audioPlayer;
 }
 
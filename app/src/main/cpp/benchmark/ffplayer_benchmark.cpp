@@ -0,0 +1,59 @@
+//
+// ffplayer: plays a file into the null sinks, then seeks around it, and reports the player stats.
+//
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "ffplayer/ff_player.h"
+
+static void printStats(const char *label, FFPlayer &player) {
+    PlayerStats stats = player.getStats();
+    printf("%-8s rendered:%" PRId64 " dropped:%" PRId64 " dropped_decode:%" PRId64
+           " underruns:%" PRId64 " first_frame:%" PRId64 "us seek_first_frame:%" PRId64 "us"
+           " drift avg:%" PRId64 "us max:%" PRId64 "us\n",
+           label, stats.frames_rendered, stats.frames_dropped, stats.frames_dropped_decode,
+           stats.audio_underruns, stats.first_frame_us, stats.seek_first_frame_us,
+           stats.avg_drift_us, stats.max_drift_us);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <media> [seconds] [seeks]\n", argv[0]);
+        return 1;
+    }
+    // the null audio sink is paced in real time, like the device
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    int seeks   = argc > 3 ? atoi(argv[3]) : 5;
+    FFPlayer player;
+    player.setAudioOutput(AUDIO_SINK_NULL, nullptr);
+    if (player.open(argv[1], -1, 0, 0, nullptr) < 0) {
+        fprintf(stderr, "fail to open %s\n", argv[1]);
+        return 1;
+    }
+    int64_t duration = player.getDuration();
+    printf("%s: %" PRId64 "ms\n", argv[1], duration);
+    if (player.start() < 0) {
+        fprintf(stderr, "fail to start\n");
+        return 1;
+    }
+    for (int i = 0; i < seconds * 10 && !player.isCompleted(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    printStats("play", player);
+
+    // spread over the file, each one given a second to show its first frame
+    for (int i = 0; i < seeks && duration > 0; i++) {
+        int64_t position = duration * (seeks - i) / (seeks + 1);
+        player.seekTo(position);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        char label[16];
+        snprintf(label, sizeof(label), "seek %d", i);
+        printStats(label, player);
+    }
+    player.close();
+    return 0;
+}
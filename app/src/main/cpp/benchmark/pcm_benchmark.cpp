@@ -0,0 +1,31 @@
+//
+// pcm_kernels: throughput of the SIMD kernels against the C ones, and whether they give the same output.
+//
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "pcm/pcm_kernels.h"
+
+#define MAX_RESULTS 32
+
+int main(int argc, char **argv) {
+    // input of each kernel, larger than the caches
+    size_t bytes = argc > 1 ? (size_t) atol(argv[1]) : 16 * 1024 * 1024;
+    PcmBenchmark results[MAX_RESULTS];
+    int failures = 0;
+
+    printf("kernels: %s, %zu bytes\n", pcm_kernels(), bytes);
+    // each result is logged by pcm_kernels_benchmark as it goes
+    int count = pcm_kernels_benchmark(results, MAX_RESULTS, bytes);
+    for (int i = 0; i < count; i++) {
+        if (!results[i].identical) {
+            failures++;
+        }
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d kernels differ from the C reference\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+//
+// yuv_converter: SIMD kernels against the C ones, same output and time of each, from 480p to 4K.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "yuv/yuv_converter.h"
+
+struct Resolution {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const Resolution resolutions[] = {
+        {"480p",  854,  480},
+        {"720p",  1280, 720},
+        {"1080p", 1920, 1080},
+        {"1440p", 2560, 1440},
+        {"4K",    3840, 2160},
+};
+
+// converts src into dst, dst holds the output compared between the kernel sets
+struct Case {
+    const char *name;
+    void (*run)(const Resolution &res, std::vector<int8_t> &yuv, std::vector<int> &argb,
+                std::vector<int8_t> &dst, std::vector<int> &dst_argb);
+};
+
+static void run_rgba_to_yuv(const Resolution &res, std::vector<int8_t> &, std::vector<int> &argb,
+                            std::vector<int8_t> &dst, std::vector<int> &) {
+    rgba_to_yuv420p(argb.data(), dst.data(), res.width, res.height);
+}
+
+static void run_yuv_to_argb(const Resolution &res, std::vector<int8_t> &yuv, std::vector<int> &,
+                            std::vector<int8_t> &, std::vector<int> &dst_argb) {
+    yuv420p_to_argb(yuv.data(), dst_argb.data(), res.width, res.height);
+}
+
+static void run_nv21(const Resolution &res, std::vector<int8_t> &yuv, std::vector<int> &,
+                     std::vector<int8_t> &dst, std::vector<int> &) {
+    nv21_to_yuv420p(dst.data(), yuv.data(), res.width * res.height);
+}
+
+static void run_nv12(const Resolution &res, std::vector<int8_t> &yuv, std::vector<int> &,
+                     std::vector<int8_t> &dst, std::vector<int> &) {
+    nv12_to_yuv420p(dst.data(), yuv.data(), res.width * res.height);
+}
+
+template<int degree>
+static void run_rotate(const Resolution &res, std::vector<int8_t> &yuv, std::vector<int> &,
+                       std::vector<int8_t> &dst, std::vector<int> &) {
+    yuv420p_rotate(dst.data(), yuv.data(), res.width, res.height, degree);
+}
+
+static const Case cases[] = {
+        {"rgba_to_yuv420p", run_rgba_to_yuv},
+        {"yuv420p_to_argb", run_yuv_to_argb},
+        {"nv21_to_yuv420p", run_nv21},
+        {"nv12_to_yuv420p", run_nv12},
+        {"rotate90",        run_rotate<90>},
+        {"rotate180",       run_rotate<180>},
+        {"rotate270",       run_rotate<270>},
+};
+
+static double time_us(const Case &c, const Resolution &res, int rounds, std::vector<int8_t> &yuv,
+                      std::vector<int> &argb, std::vector<int8_t> &dst, std::vector<int> &dst_argb) {
+    c.run(res, yuv, argb, dst, dst_argb); // warm up
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        c.run(res, yuv, argb, dst, dst_argb);
+    }
+    auto cost = std::chrono::steady_clock::now() - begin;
+    return std::chrono::duration<double, std::micro>(cost).count() / rounds;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    if (rounds <= 0) {
+        rounds = 20;
+    }
+    int failures = 0;
+
+    printf("kernels: %s, %d rounds\n", yuv_converter_kernels(), rounds);
+    printf("%-7s %-16s %10s %10s %8s\n", "size", "kernel", "simd ms", "c ms", "speedup");
+    srand(1);
+    for (const Resolution &res : resolutions) {
+        size_t pixels = (size_t) res.width * res.height;
+        std::vector<int8_t> yuv(pixels * 3 / 2);
+        std::vector<int> argb(pixels);
+        for (auto &v : yuv) {
+            v = (int8_t) rand();
+        }
+        for (auto &v : argb) {
+            v = rand() | (int) 0xff000000;
+        }
+
+        for (const Case &c : cases) {
+            std::vector<int8_t> simd_dst(pixels * 3 / 2), c_dst(pixels * 3 / 2);
+            std::vector<int> simd_argb(pixels), c_argb(pixels);
+
+            yuv_converter_set_simd(true);
+            double simd_us = time_us(c, res, rounds, yuv, argb, simd_dst, simd_argb);
+            yuv_converter_set_simd(false);
+            double c_us = time_us(c, res, rounds, yuv, argb, c_dst, c_argb);
+
+            bool identical = simd_dst == c_dst && simd_argb == c_argb;
+            printf("%-7s %-16s %10.3f %10.3f %7.2fx%s\n", res.name, c.name, simd_us / 1000, c_us / 1000,
+                   simd_us > 0 ? c_us / simd_us : 0, identical ? "" : "  MISMATCH");
+            if (!identical) {
+                failures++;
+            }
+        }
+    }
+    yuv_converter_set_simd(true);
+    if (failures > 0) {
+        fprintf(stderr, "%d kernels differ from the C reference\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -3,8 +3,29 @@
 //
 
 #include <jni.h>
+#include <chrono>
+#include <cmath>
+#include <vector>
 
+#include "ff_audio_effect.h"
 #include "ff_audio_resample.h"
+#include "keyframe_index.h"
+#include "pcm/pcm_kernels.h"
+#include "pcm/pcm_process.h"
+#include "video_cutting.h"
+#include "yuv/yuv_converter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavutil/channel_layout.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define BENCHMARK_SAMPLE_RATE 44100
+#define BENCHMARK_BLOCK 1024
+#define BENCHMARK_KERNELS 32
 
 COMMON_MEDIA_FUNC(int, audioResample, jstring srcFile, jstring dstFile, int sampleRate) {
     const char *src_file = env->GetStringUTFChars(srcFile, JNI_FALSE);
@@ -17,4 +38,209 @@ COMMON_MEDIA_FUNC(int, audioResample, jstring srcFile, jstring dstFile, int samp
     env->ReleaseStringUTFChars(dstFile, dst_file);
     env->ReleaseStringUTFChars(srcFile, src_file);
     return ret;
-}
\ No newline at end of file
+}
+
+COMMON_MEDIA_FUNC(jlongArray, audioResampleBatch, jobjectArray srcFiles, jobjectArray dstFiles,
+                  int sampleRate, int threads) {
+    int count = FFMIN(env->GetArrayLength(srcFiles), env->GetArrayLength(dstFiles));
+    std::vector<std::string> src_files;
+    std::vector<std::string> dst_files;
+    for (int i = 0; i < count; i++) {
+        auto srcFile = (jstring) env->GetObjectArrayElement(srcFiles, i);
+        auto dstFile = (jstring) env->GetObjectArrayElement(dstFiles, i);
+        const char *src_file = env->GetStringUTFChars(srcFile, JNI_FALSE);
+        const char *dst_file = env->GetStringUTFChars(dstFile, JNI_FALSE);
+        src_files.emplace_back(src_file);
+        dst_files.emplace_back(dst_file);
+        env->ReleaseStringUTFChars(dstFile, dst_file);
+        env->ReleaseStringUTFChars(srcFile, src_file);
+        env->DeleteLocalRef(dstFile);
+        env->DeleteLocalRef(srcFile);
+    }
+
+    std::vector<ResampleResult> results;
+    int64_t cost = FFAudioResample::resamplingBatch(src_files, dst_files, sampleRate, threads, results);
+
+    // {ret, samples, elapsed us} of each file, then the samples per second and the wall time of the batch
+    std::vector<jlong> values;
+    int64_t samples = 0;
+    for (const ResampleResult &result : results) {
+        values.push_back(result.ret);
+        values.push_back(result.samples);
+        values.push_back(result.elapsed_us);
+        samples += result.samples;
+    }
+    values.push_back(cost > 0 ? samples * 1000000 / cost : 0);
+    values.push_back(cost);
+    jlongArray array = env->NewLongArray((jsize) values.size());
+    env->SetLongArrayRegion(array, 0, (jsize) values.size(), values.data());
+    return array;
+}
+
+COMMON_MEDIA_FUNC(void, setKeyFrameIndexDir, jstring dir) {
+    if (!dir) {
+        keyframe_index_set_cache_dir(nullptr);
+        return;
+    }
+    const char *index_dir = env->GetStringUTFChars(dir, JNI_FALSE);
+    keyframe_index_set_cache_dir(index_dir);
+    env->ReleaseStringUTFChars(dir, index_dir);
+}
+
+COMMON_MEDIA_FUNC(int, cutVideo, jstring srcFile, jstring dstFile, jlong startTime, jlong duration) {
+    const char *src_file = env->GetStringUTFChars(srcFile, JNI_FALSE);
+    const char *dst_file = env->GetStringUTFChars(dstFile, JNI_FALSE);
+
+    auto *cutVideo = new CutVideo();
+    cutVideo->setParam(startTime, duration);
+    int ret = cutVideo->cut(src_file, dst_file);
+
+    delete cutVideo;
+    env->ReleaseStringUTFChars(dstFile, dst_file);
+    env->ReleaseStringUTFChars(srcFile, src_file);
+    return ret;
+}
+
+COMMON_MEDIA_FUNC(int, cutVideos, jstring srcFile, jlongArray startTimes, jlongArray durations, jobjectArray dstFiles) {
+    int count = env->GetArrayLength(dstFiles);
+    if (env->GetArrayLength(startTimes) < count || env->GetArrayLength(durations) < count)
+        return -1;
+    const char *src_file = env->GetStringUTFChars(srcFile, JNI_FALSE);
+    jlong *start = env->GetLongArrayElements(startTimes, nullptr);
+    jlong *duration = env->GetLongArrayElements(durations, nullptr);
+
+    std::vector<CutRange> ranges;
+    for (int i = 0; i < count; i++) {
+        auto dstFile = (jstring) env->GetObjectArrayElement(dstFiles, i);
+        const char *dst_file = env->GetStringUTFChars(dstFile, JNI_FALSE);
+        ranges.push_back({start[i], duration[i], dst_file});
+        env->ReleaseStringUTFChars(dstFile, dst_file);
+        env->DeleteLocalRef(dstFile);
+    }
+    env->ReleaseLongArrayElements(durations, duration, JNI_ABORT);
+    env->ReleaseLongArrayElements(startTimes, start, JNI_ABORT);
+
+    auto *cutVideo = new CutVideo();
+    int ret = cutVideo->cut(src_file, ranges);
+
+    delete cutVideo;
+    env->ReleaseStringUTFChars(srcFile, src_file);
+    return ret;
+}
+
+COMMON_MEDIA_FUNC(int, pcmChangeSpeed, jstring srcFile, jstring dstFile, int sampleRate, int channels, jfloat speed) {
+    const char *src_file = env->GetStringUTFChars(srcFile, JNI_FALSE);
+    const char *dst_file = env->GetStringUTFChars(dstFile, JNI_FALSE);
+
+    PcmFormat format = {PCM_S16, channels, false};
+    int ret = pcm_change_speed(src_file, dst_file, format, sampleRate, speed);
+
+    env->ReleaseStringUTFChars(dstFile, dst_file);
+    env->ReleaseStringUTFChars(srcFile, src_file);
+    return ret;
+}
+
+/**
+ * The same as pcm_stretch_benchmark(), through the atempo filter.
+ * @return microseconds per second of input audio
+ */
+static int64_t atempoBenchmark(float speed, int seconds) {
+    AudioEffectParams params;
+    params.time_base          = {1, BENCHMARK_SAMPLE_RATE};
+    params.sample_rate        = BENCHMARK_SAMPLE_RATE;
+    params.sample_fmt         = AV_SAMPLE_FMT_S16;
+    params.channel_layout     = AV_CH_LAYOUT_STEREO;
+    params.out_sample_rate    = BENCHMARK_SAMPLE_RATE;
+    params.out_channel_layout = AV_CH_LAYOUT_STEREO;
+    params.out_sample_fmt     = AV_SAMPLE_FMT_S16;
+    char desc[32];
+    snprintf(desc, sizeof(desc), "atempo=%.2f", speed);
+    AudioEffectChain chain;
+    if (seconds <= 0 || chain.init(params, desc) < 0)
+        return -1;
+
+    int total = BENCHMARK_SAMPLE_RATE * seconds;
+    std::vector<int16_t> input(static_cast<size_t>(total) * 2);
+    uint32_t seed = 1;
+    for (int i = 0; i < total; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        double t = static_cast<double>(i) / BENCHMARK_SAMPLE_RATE;
+        double v = 0.4 * sin(2 * M_PI * 220 * t) + 0.2 * sin(2 * M_PI * 1330 * t)
+                + 0.05 * (static_cast<int32_t>(seed) / 2147483648.0);
+        input[i * 2]     = static_cast<int16_t>(v * 32767);
+        input[i * 2 + 1] = static_cast<int16_t>(v * 0.8 * 32767);
+    }
+    std::vector<uint8_t> output(BENCHMARK_BLOCK * 4 * 8);
+    AVFrame *frame = av_frame_alloc();
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int done = 0; done < total; done += BENCHMARK_BLOCK) {
+        frame->nb_samples     = FFMIN(BENCHMARK_BLOCK, total - done);
+        frame->format         = AV_SAMPLE_FMT_S16;
+        frame->channel_layout = AV_CH_LAYOUT_STEREO;
+        frame->sample_rate    = BENCHMARK_SAMPLE_RATE;
+        frame->pts            = done;
+        if (av_frame_get_buffer(frame, 0) < 0)
+            break;
+        memcpy(frame->data[0], input.data() + done * 2, static_cast<size_t>(frame->nb_samples) * 4);
+        chain.process(frame, output.data(), static_cast<int>(output.size()));
+    }
+    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+    av_frame_free(&frame);
+    chain.release();
+    return cost / seconds;
+}
+
+COMMON_MEDIA_FUNC(jlongArray, audioSpeedBenchmark, jfloat speed, int seconds) {
+    // microseconds per second of audio, of the native time-stretch then of atempo
+    jlong values[] = {pcm_stretch_benchmark(BENCHMARK_SAMPLE_RATE, speed, seconds),
+                      atempoBenchmark(speed, seconds)};
+    jlongArray result = env->NewLongArray(2);
+    env->SetLongArrayRegion(result, 0, 2, values);
+    return result;
+}
+
+COMMON_MEDIA_FUNC(jdoubleArray, pcmKernelsBenchmark, jint bytes) {
+    // {simd GB/s, c GB/s, identical} of each kernel, their names are logged
+    PcmBenchmark results[BENCHMARK_KERNELS];
+    int count = pcm_kernels_benchmark(results, BENCHMARK_KERNELS, bytes > 0 ? (size_t) bytes : 16 * 1024 * 1024);
+    jdouble values[BENCHMARK_KERNELS * 3];
+    for (int i = 0; i < count; i++) {
+        values[i * 3]     = results[i].simd_gbps;
+        values[i * 3 + 1] = results[i].c_gbps;
+        values[i * 3 + 2] = results[i].identical ? 1 : 0;
+    }
+    jdoubleArray array = env->NewDoubleArray(count * 3);
+    env->SetDoubleArrayRegion(array, 0, count * 3, values);
+    return array;
+}
+
+COMMON_MEDIA_FUNC(int, nv21ToArgb, jbyteArray nv21, jintArray argb, jint width, jint height) {
+    if (!nv21 || !argb || width <= 0 || height <= 0 || width % 2 != 0 || height % 2 != 0
+            || env->GetArrayLength(nv21) < width * height * 3 / 2 || env->GetArrayLength(argb) < width * height) {
+        return -1;
+    }
+    std::vector<int8_t> yuv((size_t) width * height * 3 / 2);
+    auto *src = static_cast<int8_t *>(env->GetPrimitiveArrayCritical(nv21, nullptr));
+    nv21_to_yuv420p(yuv.data(), src, width * height);
+    env->ReleasePrimitiveArrayCritical(nv21, src, JNI_ABORT);
+
+    auto *dst = static_cast<int *>(env->GetPrimitiveArrayCritical(argb, nullptr));
+    yuv420p_to_argb(yuv.data(), dst, width, height);
+    env->ReleasePrimitiveArrayCritical(argb, dst, 0);
+    return 0;
+}
+
+COMMON_MEDIA_FUNC(int, argbToYuv420p, jintArray argb, jbyteArray yuv, jint width, jint height) {
+    if (!argb || !yuv || width <= 0 || height <= 0 || width % 2 != 0 || height % 2 != 0
+            || env->GetArrayLength(argb) < width * height || env->GetArrayLength(yuv) < width * height * 3 / 2) {
+        return -1;
+    }
+    auto *src = static_cast<int *>(env->GetPrimitiveArrayCritical(argb, nullptr));
+    auto *dst = static_cast<int8_t *>(env->GetPrimitiveArrayCritical(yuv, nullptr));
+    rgba_to_yuv420p(src, dst, width, height);
+    env->ReleasePrimitiveArrayCritical(yuv, dst, 0);
+    env->ReleasePrimitiveArrayCritical(argb, src, JNI_ABORT);
+    return 0;
+}
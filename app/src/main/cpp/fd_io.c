@@ -0,0 +1,222 @@
+//
+// Seekable AVIOContext over a file descriptor, for content uri and asset sources.
+//
+
+#include "fd_io.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGI(FORMAT, ...) __android_log_print(ANDROID_LOG_INFO, "FdIO", FORMAT, ##__VA_ARGS__)
+#else
+#include <stdio.h>
+#define LOGI(FORMAT, ...) printf(FORMAT, ##__VA_ARGS__)
+#endif
+
+typedef struct FdBlock {
+    int64_t  index;     // block number in the window, -1 if empty
+    int      size;      // valid bytes, less than block_size for the last one
+    uint64_t last_used;
+    uint8_t  *data;
+} FdBlock;
+
+typedef struct FdIO {
+    int      fd;
+    int64_t  offset;
+    int64_t  length;
+    int64_t  pos;
+    int      block_size;
+    int      nb_blocks;
+    FdBlock  *blocks;
+    uint64_t clock;
+    int64_t  hits;
+    int64_t  misses;
+} FdIO;
+
+static FdBlock *get_block(FdIO *io, int64_t index) {
+    int i;
+    ssize_t got;
+    int64_t start;
+    int size;
+    FdBlock *victim = &io->blocks[0];
+
+    for (i = 0; i < io->nb_blocks; i++) {
+        FdBlock *block = &io->blocks[i];
+        if (block->index == index) {
+            block->last_used = ++io->clock;
+            io->hits++;
+            return block;
+        }
+        if (block->last_used < victim->last_used) {
+            victim = block;
+        }
+    }
+
+    io->misses++;
+    start = index * io->block_size;
+    size  = (int) FFMIN((int64_t) io->block_size, io->length - start);
+    victim->index = -1;
+    victim->size  = 0;
+    while (victim->size < size) {
+        got = pread(io->fd, victim->data + victim->size, size - victim->size,
+                    io->offset + start + victim->size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break;
+        }
+        victim->size += (int) got;
+    }
+    if (victim->size <= 0) {
+        return NULL;
+    }
+    victim->index     = index;
+    victim->last_used = ++io->clock;
+    return victim;
+}
+
+static int fd_io_read(void *opaque, uint8_t *buf, int buf_size) {
+    FdIO *io = opaque;
+    int total = 0;
+
+    while (total < buf_size && io->pos < io->length) {
+        int64_t index = io->pos / io->block_size;
+        int in_block  = (int) (io->pos - index * io->block_size);
+        int count;
+        FdBlock *block = get_block(io, index);
+        if (!block || in_block >= block->size) {
+            break;
+        }
+        count = FFMIN(buf_size - total, block->size - in_block);
+        memcpy(buf + total, block->data + in_block, count);
+        total   += count;
+        io->pos += count;
+    }
+    if (total == 0) {
+        return io->pos >= io->length ? AVERROR_EOF : AVERROR(EIO);
+    }
+    return total;
+}
+
+static int64_t fd_io_seek(void *opaque, int64_t offset, int whence) {
+    FdIO *io = opaque;
+    int64_t pos;
+
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return io->length;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = io->pos + offset;
+            break;
+        case SEEK_END:
+            pos = io->length + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+    io->pos = pos;
+    return pos;
+}
+
+static void free_io(FdIO *io) {
+    int i;
+
+    if (!io) {
+        return;
+    }
+    if (io->blocks) {
+        for (i = 0; i < io->nb_blocks; i++) {
+            av_free(io->blocks[i].data);
+        }
+        av_free(io->blocks);
+    }
+    av_free(io);
+}
+
+AVIOContext *fd_io_open(int fd, int64_t offset, int64_t length, int block_size, int blocks) {
+    int i;
+    struct stat st;
+    uint8_t *buffer;
+    AVIOContext *pb;
+    FdIO *io;
+
+    if (fd < 0 || offset < 0 || fstat(fd, &st) != 0) {
+        return NULL;
+    }
+    // content providers may hand out pipes, which can't be read at an offset
+    if (!S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+    if (length <= 0 || length > st.st_size - offset) {
+        length = st.st_size - offset;
+    }
+    if (length <= 0) {
+        return NULL;
+    }
+
+    io = av_mallocz(sizeof(FdIO));
+    if (!io) {
+        return NULL;
+    }
+    io->fd         = fd;
+    io->offset     = offset;
+    io->length     = length;
+    io->block_size = block_size > 0 ? block_size : FD_IO_BLOCK_SIZE;
+    io->nb_blocks  = blocks > 0 ? blocks : FD_IO_CACHE_BLOCKS;
+    io->blocks     = av_mallocz_array(io->nb_blocks, sizeof(FdBlock));
+    if (!io->blocks) {
+        free_io(io);
+        return NULL;
+    }
+    for (i = 0; i < io->nb_blocks; i++) {
+        io->blocks[i].index = -1;
+        io->blocks[i].data  = av_malloc(io->block_size);
+        if (!io->blocks[i].data) {
+            free_io(io);
+            return NULL;
+        }
+    }
+
+    // the blocks do the read-ahead, a small buffer is enough for avio
+    buffer = av_malloc(4096);
+    if (!buffer) {
+        free_io(io);
+        return NULL;
+    }
+    pb = avio_alloc_context(buffer, 4096, 0, io, fd_io_read, NULL, fd_io_seek);
+    if (!pb) {
+        av_free(buffer);
+        free_io(io);
+        return NULL;
+    }
+    return pb;
+}
+
+void fd_io_close(AVIOContext **pb) {
+    FdIO *io;
+
+    if (!pb || !*pb) {
+        return;
+    }
+    io = (*pb)->opaque;
+    if (io) {
+        LOGI("fd io, cache hits:%lld misses:%lld\n", (long long) io->hits, (long long) io->misses);
+    }
+    free_io(io);
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
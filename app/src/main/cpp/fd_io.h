@@ -0,0 +1,39 @@
+//
+// Seekable AVIOContext over a file descriptor, for content uri and asset sources.
+//
+
+#ifndef FD_IO_H
+#define FD_IO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "libavformat/avio.h"
+
+#define FD_IO_BLOCK_SIZE   (64 * 1024)
+#define FD_IO_CACHE_BLOCKS 16
+
+/**
+ * Read [offset, offset + length) of fd with pread, so the descriptor can be shared
+ * and the window may start inside a file, e.g. an asset of the apk.
+ * Reads go through an LRU cache of blocks, each miss reading a whole block ahead.
+ * Set it as AVFormatContext.pb with AVFMT_FLAG_CUSTOM_IO before avformat_open_input.
+ * @param length     size of the window, <= 0 or too large for the rest of the file
+ * @param block_size bytes read ahead per miss, 0 for FD_IO_BLOCK_SIZE
+ * @param blocks     blocks cached, 0 for FD_IO_CACHE_BLOCKS
+ * @return NULL on failure, the descriptor stays owned by the caller
+ */
+AVIOContext *fd_io_open(int fd, int64_t offset, int64_t length, int block_size, int blocks);
+
+/**
+ * Free the context opened by fd_io_open, after avformat_close_input.
+ */
+void fd_io_close(AVIOContext **pb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FD_IO_H
@@ -0,0 +1,460 @@
+//
+// Audio filter chain which can be changed while playing, without clicks.
+//
+
+#include "ff_audio_effect.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include "ffmpeg_jni_define.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/opt.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define EFFECT_TAG "AudioEffect"
+// old and new graph are mixed for this long after a swap
+#define CROSSFADE_MS 30
+
+struct EffectGraph {
+    std::string desc;
+    AVFilterGraph *graph  = nullptr;
+    AVFilterContext *src  = nullptr;
+    AVFilterContext *sink = nullptr;
+    // input of swr, following the output of the graph
+    SwrContext *swr = nullptr;
+    int swrFormat   = AV_SAMPLE_FMT_NONE;
+    int swrRate     = 0;
+    uint64_t swrLayout = 0;
+    int64_t requestUs  = 0;
+
+    ~EffectGraph() {
+        swr_free(&swr);
+        avfilter_graph_free(&graph);
+    }
+};
+
+struct FilterSpec {
+    std::string name;
+    // key is empty for positional options
+    std::vector<std::pair<std::string, std::string>> options;
+};
+
+static int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::vector<std::string> split(const std::string &str, char separator) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (true) {
+        size_t end = str.find(separator, begin);
+        items.push_back(str.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+        if (end == std::string::npos)
+            return items;
+        begin = end + 1;
+    }
+}
+
+/**
+ * Only a plain chain "a=k=v:k=v,b=v" is understood, labels and escaping mean a rebuild.
+ */
+static bool parseChain(const std::string &desc, std::vector<FilterSpec> &chain) {
+    if (desc.find_first_of("[];'\\") != std::string::npos)
+        return false;
+    for (const std::string &item : split(desc, ',')) {
+        FilterSpec spec;
+        size_t equal = item.find('=');
+        spec.name = item.substr(0, equal);
+        spec.name.erase(0, spec.name.find_first_not_of(' '));
+        spec.name.erase(spec.name.find_last_not_of(' ') + 1);
+        if (spec.name.empty())
+            return false;
+        if (equal != std::string::npos) {
+            for (const std::string &option : split(item.substr(equal + 1), ':')) {
+                size_t pos = option.find('=');
+                if (pos == std::string::npos) {
+                    spec.options.emplace_back("", option);
+                } else {
+                    spec.options.emplace_back(option.substr(0, pos), option.substr(pos + 1));
+                }
+            }
+        }
+        chain.push_back(spec);
+    }
+    return true;
+}
+
+static const std::string *findOption(const FilterSpec &spec, const std::string &key) {
+    for (const auto &option : spec.options) {
+        if (option.first == key)
+            return &option.second;
+    }
+    return nullptr;
+}
+
+/**
+ * The commands turning from into to, false if the topology or the positional options differ,
+ * or if an option is removed (its default is unknown here).
+ */
+template <typename Command>
+static bool diffChain(const std::string &from, const std::string &to, std::vector<Command> &commands) {
+    std::vector<FilterSpec> oldChain, newChain;
+    if (!parseChain(from, oldChain) || !parseChain(to, newChain) || oldChain.size() != newChain.size())
+        return false;
+    for (size_t i = 0; i < newChain.size(); i++) {
+        const FilterSpec &oldSpec = oldChain[i];
+        const FilterSpec &newSpec = newChain[i];
+        if (oldSpec.name != newSpec.name)
+            return false;
+        std::vector<std::string> oldPositional, newPositional;
+        for (const auto &option : oldSpec.options) {
+            if (option.first.empty()) {
+                oldPositional.push_back(option.second);
+            } else if (!findOption(newSpec, option.first)) {
+                return false;
+            }
+        }
+        for (const auto &option : newSpec.options) {
+            if (option.first.empty()) {
+                newPositional.push_back(option.second);
+                continue;
+            }
+            const std::string *value = findOption(oldSpec, option.first);
+            if (!value || *value != option.second) {
+                // the name given to the filters of a parsed chain
+                std::string target = "Parsed_" + newSpec.name + "_" + std::to_string(i);
+                commands.push_back({target, option.first, option.second});
+            }
+        }
+        if (oldPositional != newPositional)
+            return false;
+    }
+    return true;
+}
+
+AudioEffectChain::~AudioEffectChain() {
+    release();
+}
+
+EffectGraph *AudioEffectChain::build(const std::string &desc) {
+    int ret;
+    char args[512];
+    auto *graph = new EffectGraph();
+    AVFilterInOut *inputs      = avfilter_inout_alloc();
+    AVFilterInOut *outputs     = avfilter_inout_alloc();
+    const AVFilter *buffersrc  = avfilter_get_by_name("abuffer");
+    const AVFilter *buffersink = avfilter_get_by_name("abuffersink");
+
+    graph->desc  = desc;
+    graph->graph = avfilter_graph_alloc();
+    if (!outputs || !inputs || !graph->graph) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    /* buffer audio source: the decoded frames from the decoder will be inserted here. */
+    snprintf(args, sizeof(args),
+             "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64 "",
+             m_params.time_base.num, m_params.time_base.den, m_params.sample_rate,
+             av_get_sample_fmt_name(m_params.sample_fmt), m_params.channel_layout);
+    ret = avfilter_graph_create_filter(&graph->src, buffersrc, "in",
+                                       args, nullptr, graph->graph);
+    if (ret < 0) {
+        LOGE(EFFECT_TAG, "Cannot create buffer source:%d", ret);
+        goto end;
+    }
+    /* buffer audio sink: to terminate the filter chain. */
+    ret = avfilter_graph_create_filter(&graph->sink, buffersink, "out",
+                                       nullptr, nullptr, graph->graph);
+    if (ret < 0) {
+        LOGE(EFFECT_TAG, "Cannot create buffer sink:%d", ret);
+        goto end;
+    }
+
+    outputs->name       = av_strdup("in");
+    outputs->filter_ctx = graph->src;
+    outputs->pad_idx    = 0;
+    outputs->next       = nullptr;
+    inputs->name        = av_strdup("out");
+    inputs->filter_ctx  = graph->sink;
+    inputs->pad_idx     = 0;
+    inputs->next        = nullptr;
+
+    if ((ret = avfilter_graph_parse_ptr(graph->graph, desc.c_str(),
+                                        &inputs, &outputs, nullptr)) < 0) {
+        LOGE(EFFECT_TAG, "avfilter_graph_parse_ptr error:%d", ret);
+        goto end;
+    }
+    if ((ret = avfilter_graph_config(graph->graph, nullptr)) < 0) {
+        LOGE(EFFECT_TAG, "avfilter_graph_config error:%d", ret);
+        goto end;
+    }
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret < 0) {
+        delete graph;
+        return nullptr;
+    }
+    return graph;
+}
+
+int AudioEffectChain::init(const AudioEffectParams &params, const char *desc) {
+    release();
+    if (av_sample_fmt_is_planar(params.out_sample_fmt)) {
+        LOGE(EFFECT_TAG, "planar output %s unsupported", av_get_sample_fmt_name(params.out_sample_fmt));
+        return -1;
+    }
+    m_params = params;
+    m_frameSize = av_get_channel_layout_nb_channels(params.out_channel_layout)
+            * av_get_bytes_per_sample(params.out_sample_fmt);
+    m_crossfade = params.out_sample_fmt == AV_SAMPLE_FMT_S16 || params.out_sample_fmt == AV_SAMPLE_FMT_FLT;
+    m_fadeLen = params.out_sample_rate * CROSSFADE_MS / 1000;
+    m_filterFrame = av_frame_alloc();
+    m_graph = build(desc);
+    if (!m_graph)
+        return -1;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastDesc = desc;
+    m_exit     = false;
+    return 0;
+}
+
+void AudioEffectChain::requestBuild(const std::string &desc) {
+    // called with m_mutex held, the latest request wins
+    m_requestDesc = desc;
+    m_request     = true;
+    m_requestUs   = nowUs();
+    m_commands.clear();
+    if (!m_builder.joinable()) {
+        m_builder = std::thread(&AudioEffectChain::builderLoop, this);
+    }
+    m_cond.notify_one();
+}
+
+void AudioEffectChain::update(const char *desc) {
+    if (!desc)
+        return;
+    std::string next(desc);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (next == m_lastDesc)
+        return;
+    std::vector<Command> commands;
+    // while a graph is being built, changes go into the next build
+    bool building = m_request || m_building || m_ready;
+    if (!building && diffChain(m_lastDesc, next, commands)) {
+        m_commands.insert(m_commands.end(), commands.begin(), commands.end());
+    } else {
+        requestBuild(next);
+    }
+    m_lastDesc = next;
+}
+
+void AudioEffectChain::builderLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cond.wait(lock, [this] { return m_request || m_exit; });
+        if (m_exit)
+            break;
+        std::string desc  = m_requestDesc;
+        int64_t requestUs = m_requestUs;
+        m_request  = false;
+        m_building = true;
+        lock.unlock();
+
+        int64_t begin = nowUs();
+        EffectGraph *graph = build(desc);
+        int64_t cost = nowUs() - begin;
+
+        lock.lock();
+        m_building = false;
+        if (!graph)
+            continue;
+        graph->requestUs = requestUs;
+        m_stats.rebuilds++;
+        m_stats.last_build_us = cost;
+        // superseded before the decode thread took it
+        delete m_ready;
+        m_ready = graph;
+        LOGI(EFFECT_TAG, "graph built in %" PRId64 "us: %s", cost, desc.c_str());
+    }
+}
+
+void AudioEffectChain::applyPending() {
+    std::vector<Command> commands;
+    EffectGraph *ready;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        commands.swap(m_commands);
+        ready   = m_ready;
+        m_ready = nullptr;
+    }
+
+    for (const Command &command : commands) {
+        char result[64] = {0};
+        int ret = avfilter_graph_send_command(m_graph->graph, command.target.c_str(), command.cmd.c_str(),
+                                              command.arg.c_str(), result, sizeof(result), 0);
+        if (ret < 0) {
+            // the filter has no such command, rebuild with the latest description instead
+            LOGI(EFFECT_TAG, "%s %s unsupported, rebuilding", command.target.c_str(), command.cmd.c_str());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_request && !m_building && !m_ready) {
+                requestBuild(m_lastDesc);
+            }
+            break;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.commands++;
+    }
+
+    if (ready) {
+        // a second swap within the crossfade drops the oldest graph
+        delete m_fading;
+        m_fading  = m_crossfade ? m_graph : nullptr;
+        if (!m_crossfade)
+            delete m_graph;
+        m_graph   = ready;
+        m_fadePos = 0;
+        int64_t cost = nowUs() - ready->requestUs;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.last_swap_us = cost;
+        if (cost > m_stats.max_swap_us) {
+            m_stats.max_swap_us = cost;
+        }
+    }
+}
+
+int AudioEffectChain::convert(EffectGraph *graph, AVFrame *frame, uint8_t *out, int size) {
+    uint64_t layout = frame->channel_layout ? frame->channel_layout
+            : static_cast<uint64_t>(av_get_default_channel_layout(frame->channels));
+    if (frame->format != graph->swrFormat || frame->sample_rate != graph->swrRate
+            || layout != graph->swrLayout) {
+        swr_free(&graph->swr);
+        graph->swr = swr_alloc_set_opts(nullptr, static_cast<int64_t>(m_params.out_channel_layout),
+                                        m_params.out_sample_fmt, m_params.out_sample_rate,
+                                        static_cast<int64_t>(layout),
+                                        static_cast<AVSampleFormat>(frame->format),
+                                        frame->sample_rate, 0, nullptr);
+        if (!graph->swr || swr_init(graph->swr) < 0) {
+            LOGE(EFFECT_TAG, "swr_init error");
+            swr_free(&graph->swr);
+            graph->swrFormat = AV_SAMPLE_FMT_NONE;
+            return -1;
+        }
+        graph->swrFormat = frame->format;
+        graph->swrRate   = frame->sample_rate;
+        graph->swrLayout = layout;
+    }
+    int samples = swr_convert(graph->swr, &out, size / m_frameSize,
+                              (const uint8_t **)(frame->data), frame->nb_samples);
+    return samples > 0 ? samples * m_frameSize : samples;
+}
+
+int AudioEffectChain::filter(EffectGraph *graph, AVFrame *frame, uint8_t *out, int size) {
+    int ret = av_buffersrc_add_frame(graph->src, frame);
+    if (ret < 0) {
+        LOGE(EFFECT_TAG, "av_buffersrc_add_frame error=%d", ret);
+        av_frame_unref(frame);
+    }
+    int total = 0;
+    while ((ret = av_buffersink_get_frame(graph->sink, m_filterFrame)) == 0) {
+        ret = convert(graph, m_filterFrame, out + total, size - total);
+        if (ret > 0) {
+            total += ret;
+        }
+        av_frame_unref(m_filterFrame);
+    }
+    if (ret != AVERROR(EAGAIN)) {
+        LOGE(EFFECT_TAG, "av_buffersink_get_frame error=%d", ret);
+        return ret;
+    }
+    return total;
+}
+
+int AudioEffectChain::process(AVFrame *frame, uint8_t *out, int size) {
+    if (!m_graph) {
+        av_frame_unref(frame);
+        return -1;
+    }
+    applyPending();
+    if (!m_fading)
+        return filter(m_graph, frame, out, size);
+
+    // crossfade: the same input goes through both graphs
+    AVFrame *copy = av_frame_clone(frame);
+    int newSize = filter(m_graph, frame, out, size);
+    if (m_fadeBuffer.size() < static_cast<size_t>(size)) {
+        m_fadeBuffer.resize(static_cast<size_t>(size));
+    }
+    int oldSize = copy ? filter(m_fading, copy, m_fadeBuffer.data(), size) : 0;
+    av_frame_free(&copy);
+    if (newSize < 0)
+        return newSize;
+
+    // interleaved, gain ramping from the old graph to the new one: Q15 for s16
+    int channels = m_frameSize / av_get_bytes_per_sample(m_params.out_sample_fmt);
+    int frames   = (oldSize > 0 ? std::min(newSize, oldSize) : 0) / m_frameSize;
+    if (m_params.out_sample_fmt == AV_SAMPLE_FMT_S16) {
+        auto *dst = reinterpret_cast<int16_t *>(out);
+        auto *old = reinterpret_cast<const int16_t *>(m_fadeBuffer.data());
+        for (int i = 0; i < frames && m_fadePos + i < m_fadeLen; i++) {
+            int32_t gain = (m_fadePos + i) * 32768 / m_fadeLen;
+            for (int c = 0; c < channels; c++) {
+                int index = i * channels + c;
+                dst[index] = static_cast<int16_t>((dst[index] * gain + old[index] * (32768 - gain)) >> 15);
+            }
+        }
+    } else {
+        auto *dst = reinterpret_cast<float *>(out);
+        auto *old = reinterpret_cast<const float *>(m_fadeBuffer.data());
+        for (int i = 0; i < frames && m_fadePos + i < m_fadeLen; i++) {
+            float gain = static_cast<float>(m_fadePos + i) / m_fadeLen;
+            for (int c = 0; c < channels; c++) {
+                int index = i * channels + c;
+                dst[index] = dst[index] * gain + old[index] * (1.0f - gain);
+            }
+        }
+    }
+    m_fadePos += newSize / m_frameSize;
+    if (m_fadePos >= m_fadeLen) {
+        delete m_fading;
+        m_fading = nullptr;
+    }
+    return newSize;
+}
+
+AudioEffectStats AudioEffectChain::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void AudioEffectChain::release() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit = true;
+        m_cond.notify_all();
+    }
+    if (m_builder.joinable()) {
+        m_builder.join();
+    }
+    delete m_ready;
+    m_ready = nullptr;
+    delete m_fading;
+    m_fading = nullptr;
+    delete m_graph;
+    m_graph = nullptr;
+    av_frame_free(&m_filterFrame);
+    m_request  = false;
+    m_building = false;
+    m_commands.clear();
+}
@@ -0,0 +1,127 @@
+//
+// Audio filter chain which can be changed while playing, without clicks.
+//
+
+#ifndef FF_AUDIO_EFFECT_H
+#define FF_AUDIO_EFFECT_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavfilter/avfilter.h"
+#include "libavutil/frame.h"
+#include "libswresample/swresample.h"
+#ifdef __cplusplus
+}
+#endif
+
+struct AudioEffectParams {
+    // input, as decoded
+    AVRational time_base;
+    int sample_rate;
+    enum AVSampleFormat sample_fmt;
+    uint64_t channel_layout;
+    // output, interleaved: a planar out_sample_fmt is refused
+    int out_sample_rate;
+    uint64_t out_channel_layout;
+    enum AVSampleFormat out_sample_fmt;
+};
+
+struct AudioEffectStats {
+    int64_t commands;       // parameter changes sent to the running graph
+    int64_t rebuilds;       // graphs built for a new topology
+    int64_t last_build_us;  // parsing and configuring, off the decode thread
+    int64_t last_swap_us;   // from the request to the new graph taking over
+    int64_t max_swap_us;
+};
+
+struct EffectGraph;
+
+/**
+ * Owned by the decode thread, except update() and stats() which may be called from any thread.
+ * A change of option values only is sent as commands to the running graph, keeping its state.
+ * Otherwise (or when the filter has no such command) a new graph is built on a worker thread,
+ * then swapped in by the decode thread with a short crossfade.
+ */
+class AudioEffectChain {
+private:
+
+    AudioEffectParams m_params;
+    int m_frameSize = 0;
+    // the output is s16 or float, which the crossfade mixes, otherwise graphs are swapped as is
+    bool m_crossfade = false;
+
+    // decode thread only
+    EffectGraph *m_graph  = nullptr;
+    EffectGraph *m_fading = nullptr;
+    AVFrame *m_filterFrame = nullptr;
+    int m_fadePos = 0;
+    int m_fadeLen = 0;
+    std::vector<uint8_t> m_fadeBuffer;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_builder;
+    bool m_exit      = false;
+    bool m_request   = false;
+    bool m_building  = false;
+    std::string m_requestDesc;
+    int64_t m_requestUs = 0;
+    // built, waiting for the decode thread
+    EffectGraph *m_ready = nullptr;
+    // latest description asked for, commands are computed against it
+    std::string m_lastDesc;
+    struct Command {
+        std::string target;
+        std::string cmd;
+        std::string arg;
+    };
+    std::vector<Command> m_commands;
+    AudioEffectStats m_stats = {0, 0, 0, 0, 0};
+
+    EffectGraph *build(const std::string &desc);
+
+    void requestBuild(const std::string &desc);
+
+    void builderLoop();
+
+    void applyPending();
+
+    int filter(EffectGraph *graph, AVFrame *frame, uint8_t *out, int size);
+
+    int convert(EffectGraph *graph, AVFrame *frame, uint8_t *out, int size);
+
+public:
+
+    AudioEffectChain() = default;
+
+    ~AudioEffectChain();
+
+    /**
+     * Build the first graph on the calling thread.
+     */
+    int init(const AudioEffectParams &params, const char *desc);
+
+    /**
+     * Change the chain, e.g. "superequalizer=6b=4:8b=5", returns at once.
+     */
+    void update(const char *desc);
+
+    /**
+     * Filter and convert a decoded frame, which is unreferenced.
+     * @return bytes written into out
+     */
+    int process(AVFrame *frame, uint8_t *out, int size);
+
+    AudioEffectStats stats();
+
+    void release();
+};
+
+#endif //FF_AUDIO_EFFECT_H
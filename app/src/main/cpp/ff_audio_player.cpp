@@ -6,77 +6,13 @@
 
 #define AUDIO_TAG "AudioPlayer"
 #define BUFFER_SIZE (48000 * 10)
+// buffered between the decode thread and the output
+#define RING_MS    500
+// buffered before the output starts
+#define PREFILL_MS 100
 
 const char *FILTER_DESC = "superequalizer=6b=4:8b=5:10b=5";
 
-int initFilter(const char *filterDesc, AVCodecContext *codecCtx, AVFilterGraph **graph,
-                          AVFilterContext **src, AVFilterContext **sink) {
-    int ret;
-    char args[512];
-    AVFilterContext *buffersrc_ctx;
-    AVFilterContext *buffersink_ctx;
-    AVRational time_base       = codecCtx->time_base;
-    AVFilterInOut *inputs      = avfilter_inout_alloc();
-    AVFilterInOut *outputs     = avfilter_inout_alloc();
-    const AVFilter *buffersrc  = avfilter_get_by_name("abuffer");
-    const AVFilter *buffersink = avfilter_get_by_name("abuffersink");
-
-    AVFilterGraph *filter_graph = avfilter_graph_alloc();
-    if (!outputs || !inputs || !filter_graph) {
-        ret = AVERROR(ENOMEM);
-        goto end;
-    }
-
-    /* buffer audio source: the decoded frames from the decoder will be inserted here. */
-    if (!codecCtx->channel_layout)
-        codecCtx->channel_layout = static_cast<uint64_t>(av_get_default_channel_layout(
-                codecCtx->channels));
-    snprintf(args, sizeof(args),
-             "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64 "",
-             time_base.num, time_base.den, codecCtx->sample_rate,
-             av_get_sample_fmt_name(codecCtx->sample_fmt), codecCtx->channel_layout);
-
-    ret = avfilter_graph_create_filter(&buffersrc_ctx, buffersrc, "in",
-                                       args, nullptr, filter_graph);
-    if (ret < 0) {
-        LOGE(AUDIO_TAG, "Cannot create buffer source:%d", ret);
-        goto end;
-    }
-    /* buffer audio sink: to terminate the filter chain. */
-    ret = avfilter_graph_create_filter(&buffersink_ctx, buffersink, "out",
-                                       nullptr, nullptr, filter_graph);
-    if (ret < 0) {
-        LOGE(AUDIO_TAG, "Cannot create buffer sink:%d", ret);
-        goto end;
-    }
-
-    outputs->name       = av_strdup("in");
-    outputs->filter_ctx = buffersrc_ctx;
-    outputs->pad_idx    = 0;
-    outputs->next       = nullptr;
-    inputs->name        = av_strdup("out");
-    inputs->filter_ctx  = buffersink_ctx;
-    inputs->pad_idx     = 0;
-    inputs->next        = nullptr;
-
-    if ((ret = avfilter_graph_parse_ptr(filter_graph, filterDesc,
-                                        &inputs, &outputs, nullptr)) < 0) {
-        LOGE(AUDIO_TAG, "avfilter_graph_parse_ptr error:%d", ret);
-        goto end;
-    }
-    if ((ret = avfilter_graph_config(filter_graph, nullptr)) < 0) {
-        LOGE(AUDIO_TAG, "avfilter_graph_config error:%d", ret);
-        goto end;
-    }
-    *graph = filter_graph;
-    *src   = buffersrc_ctx;
-    *sink  = buffersink_ctx;
-end:
-    avfilter_inout_free(&inputs);
-    avfilter_inout_free(&outputs);
-    return ret;
-}
-
 FFAudioPlayer::FFAudioPlayer() {
     m_state = new AudioPlayerState();
 }
@@ -94,6 +30,7 @@ int FFAudioPlayer::open(const char *path) {
     m_state->inputFrame = av_frame_alloc();
     m_state->packet     = av_packet_alloc();
     m_state->outBuffer  = new uint8_t [BUFFER_SIZE];
+    m_state->stretchBuffer = new uint8_t [BUFFER_SIZE];
 
     // open input stream
     ret = avformat_open_input(&m_state->formatContext, path, nullptr, nullptr);
@@ -126,20 +63,32 @@ int FFAudioPlayer::open(const char *path) {
     // input and output params
     int in_sample_rate       = m_state->codecContext->sample_rate;
     auto in_sample_fmt       = m_state->codecContext->sample_fmt;
-    int in_ch_layout         = (int)m_state->codecContext->channel_layout;
     m_state->out_sample_rate = in_sample_rate;
     m_state->out_sample_fmt  = AV_SAMPLE_FMT_S16;
     m_state->out_ch_layout   = AV_CH_LAYOUT_STEREO;
-    m_state->out_channel     = m_state->codecContext->channels;
-    // init resample context
-    m_state->swrContext = swr_alloc();
-    swr_alloc_set_opts(m_state->swrContext, m_state->out_ch_layout, m_state->out_sample_fmt, m_state->out_sample_rate,
-                       in_ch_layout, in_sample_fmt, in_sample_rate, 0, nullptr);
-    swr_init(m_state->swrContext);
-    // init filter graph
-    m_state->filterFrame = av_frame_alloc();
-    initFilter(FILTER_DESC, m_state->codecContext, &m_state->audioFilterGraph,
-                   &m_state->audioSrcContext, &m_state->audioSinkContext);
+    m_state->out_channel     = av_get_channel_layout_nb_channels(AV_CH_LAYOUT_STEREO);
+    // init filter graph, the resample context follows its output
+    if (!m_state->codecContext->channel_layout)
+        m_state->codecContext->channel_layout = static_cast<uint64_t>(av_get_default_channel_layout(
+                m_state->codecContext->channels));
+    AudioEffectParams params;
+    params.time_base          = m_state->codecContext->time_base;
+    params.sample_rate        = in_sample_rate;
+    params.sample_fmt         = in_sample_fmt;
+    params.channel_layout     = m_state->codecContext->channel_layout;
+    params.out_sample_rate    = m_state->out_sample_rate;
+    params.out_channel_layout = static_cast<uint64_t>(m_state->out_ch_layout);
+    params.out_sample_fmt     = m_state->out_sample_fmt;
+    if ((ret = m_state->effect.init(params, FILTER_DESC)) < 0) {
+        LOGE(AUDIO_TAG, "init filter error=%d", ret);
+        return ret;
+    }
+    PcmFormat format = {PCM_S16, m_state->out_channel, false};
+    if ((ret = m_state->stretch.init(m_state->out_sample_rate, format)) < 0) {
+        LOGE(AUDIO_TAG, "init stretch error=%d", ret);
+        return ret;
+    }
+    m_state->tap.init(m_state->out_sample_rate, m_state->out_channel);
 
     return 0;
 }
@@ -160,93 +109,197 @@ int FFAudioPlayer::decodeAudio() {
     if (exit) {
         return -1;
     }
-    // demux: read a frame(should be demux thread)
+    // demux: read a frame
     ret = av_read_frame(m_state->formatContext, m_state->packet);
     if (ret < 0) {
         return ret;
     }
     // see if audio packet
     if (m_state->packet->stream_index != m_state->audioIndex) {
+        av_packet_unref(m_state->packet);
         return 0;
     }
-    // decode audio frame(should be decode thread)
+    // decode audio frame
     ret = avcodec_send_packet(m_state->codecContext, m_state->packet);
+    av_packet_unref(m_state->packet);
     if (ret < 0) {
         LOGE(AUDIO_TAG, "avcodec_send_packet=%s", av_err2str(ret));
     }
-    ret = avcodec_receive_frame(m_state->codecContext, m_state->inputFrame);
-    if (ret < 0) {
-        if (ret == AVERROR(EAGAIN)) {
-            return 0;
-        } else {
+
+    // a packet may hold several frames, all of them go into outBuffer
+    int size = 0;
+    while (avcodec_receive_frame(m_state->codecContext, m_state->inputFrame) == 0) {
+        // filter and convert audio format and sample_rate
+        ret = m_state->effect.process(m_state->inputFrame, m_state->outBuffer + size, BUFFER_SIZE - size);
+        if (ret < 0) {
+            LOGE(AUDIO_TAG, "filter error=%d", ret);
             return ret;
         }
+        size += ret;
     }
+    return size;
+}
 
-    // change filter
-    if (m_state->filterAgain) {
-        m_state->filterAgain = false;
-        avfilter_graph_free(&m_state->audioFilterGraph);
-        if ((ret = initFilter(m_state->filterDesc, m_state->codecContext, &m_state->audioFilterGraph,
-                              &m_state->audioSrcContext, &m_state->audioSinkContext)) < 0) {
-            LOGE(AUDIO_TAG, "init_filter error, ret=%d\n", ret);
-            return ret;
+bool FFAudioPlayer::writePcm(const uint8_t *data, int size) {
+    int frameSize = m_state->out_channel * av_get_bytes_per_sample(m_state->out_sample_fmt);
+    if (!m_state->stretching) {
+        if (!data)
+            return true;
+        if (m_state->stretch.getSpeed() == 1.0f) {
+            // blocks while the ring is full, paced by the output
+            if (!m_state->pcmRing.write(data, static_cast<size_t>(size)))
+                return false;
+            m_state->mediaFrames   += size / frameSize;
+            m_state->writtenFrames += size / frameSize;
+            return true;
         }
+        // from now on, as going back to 1.0 later is seamless
+        m_state->stretching   = true;
+        m_state->stretchStart = m_state->mediaFrames;
+        m_state->stretch.reset();
     }
 
-    // put into filter
-    ret = av_buffersrc_add_frame(m_state->audioSrcContext, m_state->inputFrame);
-    if (ret < 0) {
-        LOGE(AUDIO_TAG, "av_buffersrc_add_frame error=%s", av_err2str(ret));
+    if (data) {
+        m_state->stretch.push(data, static_cast<size_t>(size / frameSize));
+    } else {
+        m_state->stretch.flush();
     }
-    // drain from filter
-    ret = av_buffersink_get_frame(m_state->audioSinkContext, m_state->filterFrame);
-    if (ret == AVERROR(EAGAIN)) {
-        return 0;
-    } else if (ret == AVERROR_EOF) {
-        LOGE(AUDIO_TAG, "enf of stream...");
-        return ret;
-    } else if (ret < 0) {
-        LOGE(AUDIO_TAG, "av_buffersink_get_frame error:%s", av_err2str(ret));
-        return ret;
+    size_t frames;
+    while ((frames = m_state->stretch.pull(m_state->stretchBuffer, BUFFER_SIZE / frameSize)) > 0) {
+        if (!m_state->pcmRing.write(m_state->stretchBuffer, frames * frameSize))
+            return false;
+        m_state->mediaFrames    = m_state->stretchStart + m_state->stretch.inputPosition();
+        m_state->writtenFrames += frames;
     }
+    return true;
+}
 
-    // convert audio format and sample_rate
-    swr_convert(m_state->swrContext, &m_state->outBuffer, BUFFER_SIZE,
-            (const uint8_t **)(m_state->filterFrame->data), m_state->filterFrame->nb_samples);
-    // get buffer size after converting
-    int buffer_size = av_samples_get_buffer_size(nullptr, m_state->out_channel,
-                                                 m_state->filterFrame->nb_samples, m_state->out_sample_fmt, 1);
-    // update position
-    AVRational time_base = m_state->formatContext->streams[m_state->audioIndex]->time_base;
-    m_state->m_position  = (int64_t)(m_state->filterFrame->pts * av_q2d(time_base) * 1000);
-
-    av_frame_unref(m_state->inputFrame);
-    av_frame_unref(m_state->filterFrame);
-    av_packet_unref(m_state->packet);
-    return buffer_size;
+void FFAudioPlayer::decodeLoop() {
+    int ret;
+    while ((ret = decodeAudio()) >= 0) {
+        if (ret == 0)
+            continue;
+        if (!writePcm(m_state->outBuffer, ret))
+            break;
+    }
+    if (ret == AVERROR_EOF) {
+        writePcm(nullptr, 0);
+    }
+    m_state->decodeResult = ret;
+    m_state->decodeEnd    = true;
+    checkDone();
+}
+
+void FFAudioPlayer::checkDone() {
+    if (!m_state->decodeEnd || m_state->renderedFrames < m_state->writtenFrames)
+        return;
+    std::lock_guard<std::mutex> lock(m_state->m_playMutex);
+    m_state->playDone = true;
+    m_state->playCond.notify_all();
+}
+
+int FFAudioPlayer::readPcm(uint8_t *buffer, int size) {
+    auto count = static_cast<int>(m_state->pcmRing.read(buffer, static_cast<size_t>(size)));
+    // lock free, fit for the audio callback
+    int frameSize = m_state->out_channel * av_get_bytes_per_sample(m_state->out_sample_fmt);
+    m_state->tap.write(reinterpret_cast<const int16_t *>(buffer), static_cast<size_t>(count / frameSize));
+    return count;
+}
+
+void FFAudioPlayer::onRendered(int frames) {
+    m_state->renderedFrames += frames;
+    checkDone();
+}
+
+int FFAudioPlayer::play(int sinkType, const char *wavPath) {
+    int frameSize = m_state->out_channel * av_get_bytes_per_sample(m_state->out_sample_fmt);
+    int bytesPerMs = m_state->out_sample_rate * frameSize / 1000;
+    m_state->pcmRing.init(static_cast<size_t>(bytesPerMs * RING_MS));
+    m_state->decodeEnd      = false;
+    m_state->decodeResult   = 0;
+    m_state->writtenFrames  = 0;
+    m_state->renderedFrames = 0;
+    m_state->mediaFrames    = 0;
+    m_state->stretching     = false;
+    m_state->playDone       = false;
+
+    AudioSink *sink = AudioSink::create(sinkType, wavPath);
+    if (sink->open(m_state->out_sample_rate, m_state->out_channel, this) < 0) {
+        delete sink;
+        return -1;
+    }
+    m_state->audioSink    = sink;
+    m_state->decodeThread = std::thread(&FFAudioPlayer::decodeLoop, this);
+
+    std::unique_lock<std::mutex> lock(m_state->m_playMutex);
+    // start with some data, or the first callbacks underrun
+    while (!m_state->exitPlaying && !m_state->decodeEnd
+            && m_state->pcmRing.available() < static_cast<size_t>(bytesPerMs * PREFILL_MS)) {
+        m_state->playCond.wait_for(lock, std::chrono::milliseconds(5));
+    }
+    if (!m_state->exitPlaying) {
+        sink->start();
+        m_state->playCond.wait(lock, [this] { return m_state->playDone || m_state->exitPlaying; });
+    }
+    lock.unlock();
+
+    sink->stop();
+    m_state->pcmRing.abort();
+    m_state->decodeThread.join();
+    m_state->audioSink = nullptr;
+    delete sink;
+    return m_state->playDone ? m_state->decodeResult : 0;
 }
 
 uint8_t *FFAudioPlayer::getDecodeFrame() const {
     return m_state->outBuffer;
 }
 
-void FFAudioPlayer::setFilterAgain(bool again) {
-    m_state->filterAgain = again;
+void FFAudioPlayer::setFilter(const char *filterDescription) {
+    m_state->effect.update(filterDescription);
+}
+
+AudioEffectStats FFAudioPlayer::getEffectStats() {
+    return m_state->effect.stats();
+}
+
+std::shared_ptr<PcmTapReader> FFAudioPlayer::attachTap(int sampleRate, int channels, size_t frames) {
+    return m_state->tap.attach(sampleRate, channels, frames);
+}
+
+void FFAudioPlayer::setSpeed(float speed) {
+    m_state->stretch.setSpeed(speed);
 }
 
-void FFAudioPlayer::setFilterDesc(const char *filterDescription) {
-    m_state->filterDesc = filterDescription;
+float FFAudioPlayer::getSpeed() const {
+    return m_state->stretch.getSpeed();
 }
 
 void FFAudioPlayer::setExit(bool exit) {
     std::unique_lock<std::mutex> lock(m_state->m_playMutex);
     m_state->exitPlaying = exit;
+    m_state->playCond.notify_all();
     lock.unlock();
 }
 
+void FFAudioPlayer::setPlaying(bool playing) {
+    std::lock_guard<std::mutex> lock(m_state->m_playMutex);
+    m_state->playing = playing;
+    m_state->playCond.notify_all();
+}
+
+void FFAudioPlayer::waitPlayed() {
+    std::unique_lock<std::mutex> lock(m_state->m_playMutex);
+    m_state->playCond.wait(lock, [this] { return !m_state->playing; });
+}
+
 int64_t FFAudioPlayer::getCurrentPosition() {
-    return m_state->m_position;
+    // what has been heard, not what has been decoded: the frames still in the ring are taken off
+    if (m_state->out_sample_rate <= 0)
+        return 0;
+    int64_t pending = m_state->writtenFrames - m_state->renderedFrames;
+    auto frames = m_state->mediaFrames - static_cast<int64_t>(pending * m_state->stretch.getSpeed());
+    return FFMAX(frames, 0) * 1000 / m_state->out_sample_rate;
 }
 
 int64_t FFAudioPlayer::getDuration() {
@@ -270,13 +323,9 @@ void FFAudioPlayer::close() {
     if (m_state->inputFrame) {
         av_frame_free(&m_state->inputFrame);
     }
-    if (m_state->swrContext) {
-        swr_close(m_state->swrContext);
-    }
-    avfilter_free(m_state->audioSrcContext);
-    avfilter_free(m_state->audioSinkContext);
-    if (m_state->audioFilterGraph) {
-        avfilter_graph_free(&m_state->audioFilterGraph);
-    }
+    m_state->effect.release();
     delete[] m_state->outBuffer;
+    delete[] m_state->stretchBuffer;
+    m_state->outBuffer     = nullptr;
+    m_state->stretchBuffer = nullptr;
 }
\ No newline at end of file
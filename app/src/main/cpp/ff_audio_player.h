@@ -6,7 +6,15 @@
 #define FF_AUDIO_PLAYER_H
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "ffmpeg_jni_define.h"
+#include "ff_audio_effect.h"
+#include "ff_audio_sink.h"
+#include "ff_pcm_ring.h"
+#include "ff_pcm_tap.h"
+#include "pcm/pcm_stretch.h"
 #include "visualizer/frank_visualizer.h"
 
 #ifdef __cplusplus
@@ -15,10 +23,6 @@ extern "C" {
 #include "libavformat/avformat.h"
 #include "libavcodec/avcodec.h"
 #include "libswresample/swresample.h"
-
-#include "libavfilter/buffersink.h"
-#include "libavfilter/buffersrc.h"
-#include "libavfilter/avfiltergraph.h"
 #ifdef __cplusplus
 }
 #endif
@@ -28,38 +32,66 @@ struct AudioPlayerState {
     int out_ch_layout;
     int out_sample_rate;
     enum AVSampleFormat out_sample_fmt;
-    int64_t m_position;
 
     AVPacket *packet;
     AVFrame *inputFrame;
-    AVFrame *filterFrame;
     int audioIndex = -1;
     uint8_t *outBuffer;
-    SwrContext *swrContext;
 
     AVFormatContext *formatContext;
     AVCodecContext *codecContext;
 
-    const char *filterDesc;
-    std::atomic<bool> filterAgain;
     bool exitPlaying;
     std::mutex m_playMutex;
 
-    AVFilterGraph *audioFilterGraph;
-    AVFilterContext *audioSrcContext;
-    AVFilterContext *audioSinkContext;
+    // filter and resample, updated live
+    AudioEffectChain effect;
+
+    // decode thread -> ring -> audio callback
+    PcmRing pcmRing;
+    AudioSink *audioSink;
+    std::thread decodeThread;
+    std::atomic<bool> decodeEnd;
+    int decodeResult;
+    std::atomic<int64_t> writtenFrames;
+    std::atomic<int64_t> renderedFrames;
+    // frames of the media up to what has been written, not the same at another speed
+    std::atomic<int64_t> mediaFrames;
+
+    // playback speed, the pitch kept. Bypassed until the speed first leaves 1.0
+    PcmTimeStretch stretch;
+    bool stretching;
+    int64_t stretchStart;
+    uint8_t *stretchBuffer;
+    // what goes to the output, to the visualizer and other consumers
+    PcmTap tap;
+    // all written frames rendered, guarded by m_playMutex
+    bool playDone;
+    // from init until the JNI play returns, guarded by m_playMutex
+    bool playing;
+    std::condition_variable playCond;
 };
 
-class FFAudioPlayer {
+class FFAudioPlayer : public AudioSinkSource {
 private:
 
     AudioPlayerState *m_state;
 
+    void decodeLoop();
+
+    /**
+     * Into the ring, through the time-stretch when the speed isn't 1.0, data null at the end.
+     * @return false if aborted
+     */
+    bool writePcm(const uint8_t *data, int size);
+
+    void checkDone();
+
 public:
 
     FFAudioPlayer();
 
-    ~FFAudioPlayer();
+    ~FFAudioPlayer() override;
 
     int open(const char* path);
 
@@ -69,14 +101,55 @@ public:
 
     int decodeAudio();
 
+    /**
+     * Decode on a thread into a PCM ring, played by the sink, until the end or setExit.
+     * @param sinkType AUDIO_SINK_OPENSL, AUDIO_SINK_NULL or AUDIO_SINK_WAV
+     * @return AVERROR_EOF when played to the end
+     */
+    int play(int sinkType, const char *wavPath);
+
+    int readPcm(uint8_t *buffer, int size) override;
+
+    void onRendered(int frames) override;
+
     uint8_t *getDecodeFrame() const;
 
-    void setFilterAgain(bool again);
+    /**
+     * Change the filter while playing, option values only are applied at once.
+     */
+    void setFilter(const char *filterDescription);
+
+    AudioEffectStats getEffectStats();
+
+    /**
+     * Get the PCM as it goes to the output, after the filter and the speed, in process.
+     * May be called before open(), the reader learns the rate at the first samples.
+     * @param sampleRate lowest rate wanted
+     * @param channels   1 for a downmix, 0 for those of the output
+     * @param frames     capacity of the reader ring
+     * @return nullptr if too many readers
+     */
+    std::shared_ptr<PcmTapReader> attachTap(int sampleRate, int channels, size_t frames);
 
-    void setFilterDesc(const char *filterDescription);
+    /**
+     * Change the speed while playing, from 0.5 to 4.0, the pitch is kept.
+     */
+    void setSpeed(float speed);
+
+    float getSpeed() const;
 
     void setExit(bool exit);
 
+    /**
+     * Set from creation until play and close are over, the player may only be deleted then.
+     */
+    void setPlaying(bool playing);
+
+    /**
+     * Block until setPlaying(false).
+     */
+    void waitPlayed();
+
     int64_t getCurrentPosition();
 
     int64_t getDuration();
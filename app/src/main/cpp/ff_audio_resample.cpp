@@ -4,20 +4,59 @@
 
 #include "ff_audio_resample.h"
 
+#include <atomic>
+#include <cinttypes>
+#include <thread>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavutil/time.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define ALOGI(Format, ...) LOGI("audio_resample", Format, ##__VA_ARGS__)
 #define ALOGE(Format, ...) LOGE("audio_resample", Format, ##__VA_ARGS__)
 
+// the converted buffer grows by this many samples at least, to settle after a few frames
+#define CONVERTED_SAMPLES_ALIGN 1024
+
+static void freeConvertedSamples(AudioResample *ar) {
+    if (ar->convertedSamples) {
+        av_freep(&ar->convertedSamples[0]);
+        free(ar->convertedSamples);
+        ar->convertedSamples = nullptr;
+    }
+    ar->convertedCapacity = 0;
+}
 
 FFAudioResample::FFAudioResample() {
     resample = new AudioResample();
 }
 
 FFAudioResample::~FFAudioResample() {
+    freeConvertedSamples(resample);
+    if (resample->outFrame)
+        av_frame_free(&(resample->outFrame));
     delete resample;
 }
 
+/**
+ * Kept while the encoder of the next file takes the same frames.
+ */
 static int initOutputFrame(AudioResample **pResample) {
     AudioResample *ar = *pResample;
 
+    AVFrame *old = ar->outFrame;
+    if (old && old->format == ar->outCodecCtx->sample_fmt
+            && old->sample_rate == ar->outCodecCtx->sample_rate
+            && old->channel_layout == ar->outCodecCtx->channel_layout
+            && old->nb_samples == ar->outCodecCtx->frame_size) {
+        return 0;
+    }
+    av_frame_free(&(ar->outFrame));
+
     AVFrame *frame        = av_frame_alloc();
     frame->format         = ar->outCodecCtx->sample_fmt;
     frame->nb_samples     = ar->outCodecCtx->frame_size;
@@ -46,20 +85,36 @@ static int initResample(AudioResample **pResample) {
     return ret;
 }
 
-static int initConvertedSamples(AudioResample **pResample, uint8_t ***converted_input_samples, int frame_size) {
+/**
+ * Make room for frame_size converted samples, only allocating when the buffer is too small.
+ */
+static int initConvertedSamples(AudioResample **pResample, int frame_size) {
     int ret;
     AudioResample *ar = *pResample;
-    *converted_input_samples = (uint8_t **) calloc(ar->outCodecCtx->channels, sizeof(**converted_input_samples));
+    if (ar->convertedSamples && frame_size <= ar->convertedCapacity
+            && ar->convertedChannels == ar->outCodecCtx->channels
+            && ar->convertedFormat == ar->outCodecCtx->sample_fmt) {
+        return 0;
+    }
+    int capacity = FFALIGN(frame_size, CONVERTED_SAMPLES_ALIGN);
+    freeConvertedSamples(ar);
+    ar->convertedSamples = (uint8_t **) calloc(ar->outCodecCtx->channels, sizeof(*ar->convertedSamples));
+    if (!ar->convertedSamples)
+        return AVERROR(ENOMEM);
 
-    if ((ret = av_samples_alloc(*converted_input_samples, nullptr,
+    if ((ret = av_samples_alloc(ar->convertedSamples, nullptr,
                                 ar->outCodecCtx->channels,
-                                frame_size,
+                                capacity,
                                 ar->outCodecCtx->sample_fmt, 0)) < 0) {
         ALOGE("av_samples_alloc error:%s", av_err2str(ret));
-        av_freep(&(*converted_input_samples)[0]);
-        free(*converted_input_samples);
+        free(ar->convertedSamples);
+        ar->convertedSamples = nullptr;
         return ret;
     }
+    ar->convertedCapacity = capacity;
+    ar->convertedChannels = ar->outCodecCtx->channels;
+    ar->convertedFormat   = ar->outCodecCtx->sample_fmt;
+    ar->allocations++;
     return 0;
 }
 
@@ -79,6 +134,10 @@ int FFAudioResample::openInputFile(const char *filename) {
             audio_stream = resample->inFormatCtx->streams[i];
         }
     }
+    if (!audio_stream) {
+        ALOGE("Could not find audio stream\n");
+        return -1;
+    }
     if (!(input_codec = avcodec_find_decoder(audio_stream->codecpar->codec_id))) {
         ALOGE("Could not find input codec:%s\n", avcodec_get_name(audio_stream->codecpar->codec_id));
         return -1;
@@ -203,7 +262,6 @@ cleanup:
  *
  */
 int FFAudioResample::decodeAndConvert(int *finished) {
-    uint8_t **converted_dst_samples = nullptr;
     int data_present = 0;
     int ret = AVERROR_EXIT;
 
@@ -219,26 +277,21 @@ int FFAudioResample::decodeAndConvert(int *finished) {
         int dst_nb_samples = (int) av_rescale_rnd(resample->inFrame->nb_samples, resample->outCodecCtx->sample_rate,
                                             resample->inCodecCtx->sample_rate, AV_ROUND_UP);
 
-        if (initConvertedSamples(&resample, &converted_dst_samples, dst_nb_samples))
+        if (initConvertedSamples(&resample, dst_nb_samples))
             goto cleanup;
 
-        ret = swr_convert(resample->resampleCtx, converted_dst_samples, dst_nb_samples,
+        ret = swr_convert(resample->resampleCtx, resample->convertedSamples, dst_nb_samples,
                           (const uint8_t**)resample->inFrame->extended_data, resample->inFrame->nb_samples);
         if (ret < 0) {
             ALOGE("Could not convert input samples (error:%s)\n", av_err2str(ret));
             goto cleanup;
         }
 
-        av_audio_fifo_write(resample->fifo, (void **)converted_dst_samples, ret);
+        av_audio_fifo_write(resample->fifo, (void **)resample->convertedSamples, ret);
     }
     ret = 0;
 
 cleanup:
-    if (converted_dst_samples) {
-        av_freep(&converted_dst_samples[0]);
-        free(converted_dst_samples);
-    }
-
     return ret;
 }
 
@@ -249,6 +302,7 @@ int FFAudioResample::encodeAudioFrame(AVFrame *frame, int *data_present) {
     if (frame) {
         frame->pts = resample->pts;
         resample->pts += frame->nb_samples;
+        resample->samples += frame->nb_samples;
     }
 
     ret = avcodec_send_frame(resample->outCodecCtx, frame);
@@ -292,6 +346,12 @@ int FFAudioResample::encodeAndWrite() {
     const int frame_size = FFMIN(av_audio_fifo_size(resample->fifo),
                                  resample->outCodecCtx->frame_size);
 
+    /* The encoder may still hold the last one, av_frame_make_writable() copies only then. */
+    resample->outFrame->nb_samples = resample->outCodecCtx->frame_size;
+    if (av_frame_make_writable(resample->outFrame) < 0) {
+        ALOGE("Could not make output frame writable\n");
+        return AVERROR_EXIT;
+    }
     resample->outFrame->nb_samples = frame_size;
     if (av_audio_fifo_read(resample->fifo, (void **)resample->outFrame->data, frame_size) < frame_size) {
         ALOGE("Could not read data from FIFO\n");
@@ -306,6 +366,10 @@ int FFAudioResample::encodeAndWrite() {
 
 int FFAudioResample::resampling(const char *src_file, const char *dst_file, int sampleRate) {
     int ret = AVERROR_EXIT;
+    int64_t begin = av_gettime_relative();
+    int allocations = resample->allocations;
+    resample->pts     = 0;
+    resample->samples = 0;
 
     /* Open the input file for reading. */
     if (openInputFile(src_file))
@@ -364,14 +428,17 @@ int FFAudioResample::resampling(const char *src_file, const char *dst_file, int
     ret = 0;
 
 cleanup:
-    if (resample->fifo)
+    if (resample->fifo) {
         av_audio_fifo_free(resample->fifo);
+        resample->fifo = nullptr;
+    }
     swr_free(&(resample->resampleCtx));
     if (resample->outCodecCtx)
         avcodec_free_context(&(resample->outCodecCtx));
     if (resample->outFormatCtx) {
         avio_closep(&(resample->outFormatCtx->pb));
         avformat_free_context(resample->outFormatCtx);
+        resample->outFormatCtx = nullptr;
     }
     if (resample->inCodecCtx)
         avcodec_free_context(&(resample->inCodecCtx));
@@ -379,8 +446,55 @@ cleanup:
         avformat_close_input(&(resample->inFormatCtx));
     if (resample->inFrame)
         av_frame_free(&(resample->inFrame));
-    if (resample->outFrame)
-        av_frame_free(&(resample->outFrame));
 
+    int64_t cost = av_gettime_relative() - begin;
+    ALOGI("resampling ret=%d, samples=%" PRId64 ", cost=%" PRId64 "us, %" PRId64 " samples/s, buffer allocations=%d\n",
+          ret, resample->samples, cost, cost > 0 ? resample->samples * 1000000 / cost : 0,
+          resample->allocations - allocations);
     return ret;
+}
+
+int64_t FFAudioResample::getSamples() {
+    return resample->samples;
+}
+
+int64_t FFAudioResample::resamplingBatch(const std::vector<std::string> &srcFiles,
+                                         const std::vector<std::string> &dstFiles,
+                                         int sampleRate, int threads,
+                                         std::vector<ResampleResult> &results) {
+    size_t count = FFMIN(srcFiles.size(), dstFiles.size());
+    results.assign(count, {AVERROR_EXIT, 0, 0});
+    if (threads <= 0)
+        threads = (int) std::thread::hardware_concurrency();
+    threads = FFMAX(1, FFMIN(threads, (int) count));
+
+    int64_t begin = av_gettime_relative();
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        FFAudioResample audioResample;
+        size_t i;
+        while ((i = next++) < count) {
+            int64_t start = av_gettime_relative();
+            results[i].ret        = audioResample.resampling(srcFiles[i].c_str(), dstFiles[i].c_str(), sampleRate);
+            results[i].samples    = audioResample.getSamples();
+            results[i].elapsed_us = av_gettime_relative() - start;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+
+    int64_t cost    = av_gettime_relative() - begin;
+    int64_t samples = 0;
+    for (const ResampleResult &result : results) {
+        samples += result.samples;
+    }
+    ALOGI("resampling batch: files=%zu, threads=%d, samples=%" PRId64 ", cost=%" PRId64 "us, %" PRId64 " samples/s\n",
+          count, threads, samples, cost, cost > 0 ? samples * 1000000 / cost : 0);
+    return cost;
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
 #ifndef FFMPEGANDROID_FF_AUDIO_RESAMPLE_H
 #define FFMPEGANDROID_FF_AUDIO_RESAMPLE_H
 
+#include <string>
+#include <vector>
 #include "ffmpeg_jni_define.h"
 
 #ifdef __cplusplus
@@ -41,6 +43,21 @@ struct AudioResample {
     AVCodecContext  *inCodecCtx;
     AVFormatContext *outFormatCtx;
     AVCodecContext  *outCodecCtx;
+
+    // grow-only, kept from frame to frame and from file to file
+    uint8_t **convertedSamples = nullptr;
+    int convertedCapacity = 0;
+    int convertedChannels = 0;
+    enum AVSampleFormat convertedFormat = AV_SAMPLE_FMT_NONE;
+    int allocations = 0;
+    // per channel, written to the output
+    int64_t samples = 0;
+};
+
+struct ResampleResult {
+    int ret;
+    int64_t samples;    // per channel, written to the output
+    int64_t elapsed_us;
 };
 
 class FFAudioResample {
@@ -67,5 +84,21 @@ public:
 
     int resampling(const char *src_file, const char *dst_file, int sampleRate);
 
+    /**
+     * Samples per channel written by the last resampling().
+     */
+    int64_t getSamples();
+
+    /**
+     * Resample independent files on a pool of threads, each keeping its buffers from file to file.
+     * @param threads  0 for one per core
+     * @param results  one per file, in the order of srcFiles
+     * @return wall clock time of the batch, microseconds
+     */
+    static int64_t resamplingBatch(const std::vector<std::string> &srcFiles,
+                                   const std::vector<std::string> &dstFiles,
+                                   int sampleRate, int threads,
+                                   std::vector<ResampleResult> &results);
+
 };
 #endif //FFMPEGANDROID_FF_AUDIO_RESAMPLE_H
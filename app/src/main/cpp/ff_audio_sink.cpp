@@ -0,0 +1,330 @@
+//
+// Audio outputs pulling interleaved s16 PCM: OpenSL ES on device, null and WAV for testing.
+//
+
+#include "ff_audio_sink.h"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifdef __ANDROID__
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include "ffmpeg_jni_define.h"
+#else
+#define LOGE(TAG, FORMAT, ...) fprintf(stderr, FORMAT "\n", ##__VA_ARGS__)
+#endif
+
+#define SINK_TAG "AudioSink"
+// size of each buffer, the latency is twice as much
+#define BUFFER_MS 20
+
+#ifdef __ANDROID__
+
+#define NUM_BUFFERS 2
+
+/**
+ * A process may only have one OpenSL ES engine: created by the first sink
+ * and kept for the lifetime of the process, the sinks only own their output mix and player.
+ */
+static SLEngineItf getSharedEngine() {
+    static std::mutex engineMutex;
+    static SLObjectItf engineObject = nullptr;
+    static SLEngineItf engine       = nullptr;
+
+    std::lock_guard<std::mutex> lock(engineMutex);
+    if (engine) {
+        return engine;
+    }
+    SLresult result = slCreateEngine(&engineObject, 0, nullptr, 0, nullptr, nullptr);
+    if (result == SL_RESULT_SUCCESS)
+        result = (*engineObject)->Realize(engineObject, SL_BOOLEAN_FALSE);
+    if (result == SL_RESULT_SUCCESS)
+        result = (*engineObject)->GetInterface(engineObject, SL_IID_ENGINE, &engine);
+    if (result != SL_RESULT_SUCCESS) {
+        LOGE(SINK_TAG, "OpenSL ES engine error=%d", (int) result);
+        if (engineObject) {
+            (*engineObject)->Destroy(engineObject);
+        }
+        engineObject = nullptr;
+        engine       = nullptr;
+    }
+    return engine;
+}
+
+/**
+ * Paced by the buffer queue callbacks of OpenSL ES.
+ */
+class OpenSLAudioSink : public AudioSink {
+private:
+
+    SLEngineItf m_engine       = nullptr;
+    SLObjectItf m_mixObject    = nullptr;
+    SLObjectItf m_playerObject = nullptr;
+    SLPlayItf m_play           = nullptr;
+    SLAndroidSimpleBufferQueueItf m_queue = nullptr;
+
+    AudioSinkSource *m_source = nullptr;
+    int m_frameSize  = 0;
+    int m_bufferSize = 0;
+    std::vector<uint8_t> m_buffers[NUM_BUFFERS];
+    // frames of the source in each enqueued buffer, silence excluded
+    int m_frames[NUM_BUFFERS] = {0};
+    int m_head = 0;
+
+    static void bufferCallback(SLAndroidSimpleBufferQueueItf queue, void *context) {
+        static_cast<OpenSLAudioSink *>(context)->onBufferDone();
+    }
+
+    void enqueue(int index) {
+        uint8_t *buffer = m_buffers[index].data();
+        int size = m_source->readPcm(buffer, m_bufferSize);
+        if (size < m_bufferSize) {
+            memset(buffer + size, 0, static_cast<size_t>(m_bufferSize - size));
+        }
+        m_frames[index] = size / m_frameSize;
+        (*m_queue)->Enqueue(m_queue, buffer, static_cast<SLuint32>(m_bufferSize));
+    }
+
+    void onBufferDone() {
+        // buffers complete in the order they were enqueued
+        if (m_frames[m_head] > 0) {
+            m_source->onRendered(m_frames[m_head]);
+        }
+        enqueue(m_head);
+        m_head = (m_head + 1) % NUM_BUFFERS;
+    }
+
+    void release() {
+        if (m_playerObject) {
+            (*m_playerObject)->Destroy(m_playerObject);
+            m_playerObject = nullptr;
+            m_play  = nullptr;
+            m_queue = nullptr;
+        }
+        if (m_mixObject) {
+            (*m_mixObject)->Destroy(m_mixObject);
+            m_mixObject = nullptr;
+        }
+        m_engine = nullptr;
+    }
+
+public:
+
+    ~OpenSLAudioSink() override {
+        release();
+    }
+
+    int open(int sampleRate, int channels, AudioSinkSource *source) override {
+        SLresult result = SL_RESULT_RESOURCE_ERROR;
+        m_engine = getSharedEngine();
+        if (!m_engine)
+            goto fail;
+        result = (*m_engine)->CreateOutputMix(m_engine, &m_mixObject, 0, nullptr, nullptr);
+        if (result != SL_RESULT_SUCCESS)
+            goto fail;
+        result = (*m_mixObject)->Realize(m_mixObject, SL_BOOLEAN_FALSE);
+        if (result != SL_RESULT_SUCCESS)
+            goto fail;
+
+        {
+            SLDataLocator_AndroidSimpleBufferQueue locatorQueue = {
+                    SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, NUM_BUFFERS};
+            SLDataFormat_PCM format = {
+                    SL_DATAFORMAT_PCM,
+                    static_cast<SLuint32>(channels),
+                    static_cast<SLuint32>(sampleRate * 1000), // milliHz
+                    SL_PCMSAMPLEFORMAT_FIXED_16,
+                    SL_PCMSAMPLEFORMAT_FIXED_16,
+                    channels == 1 ? SL_SPEAKER_FRONT_CENTER
+                                  : SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT,
+                    SL_BYTEORDER_LITTLEENDIAN};
+            SLDataSource dataSource = {&locatorQueue, &format};
+            SLDataLocator_OutputMix locatorMix = {SL_DATALOCATOR_OUTPUTMIX, m_mixObject};
+            SLDataSink dataSink = {&locatorMix, nullptr};
+            const SLInterfaceID ids[] = {SL_IID_BUFFERQUEUE};
+            const SLboolean required[] = {SL_BOOLEAN_TRUE};
+            result = (*m_engine)->CreateAudioPlayer(m_engine, &m_playerObject, &dataSource,
+                                                    &dataSink, 1, ids, required);
+        }
+        if (result != SL_RESULT_SUCCESS)
+            goto fail;
+        result = (*m_playerObject)->Realize(m_playerObject, SL_BOOLEAN_FALSE);
+        if (result != SL_RESULT_SUCCESS)
+            goto fail;
+        result = (*m_playerObject)->GetInterface(m_playerObject, SL_IID_PLAY, &m_play);
+        if (result != SL_RESULT_SUCCESS)
+            goto fail;
+        result = (*m_playerObject)->GetInterface(m_playerObject, SL_IID_BUFFERQUEUE, &m_queue);
+        if (result != SL_RESULT_SUCCESS)
+            goto fail;
+        result = (*m_queue)->RegisterCallback(m_queue, bufferCallback, this);
+        if (result != SL_RESULT_SUCCESS)
+            goto fail;
+
+        m_source     = source;
+        m_frameSize  = channels * 2;
+        m_bufferSize = sampleRate * BUFFER_MS / 1000 * m_frameSize;
+        for (auto &buffer : m_buffers) {
+            buffer.resize(static_cast<size_t>(m_bufferSize));
+        }
+        return 0;
+    fail:
+        LOGE(SINK_TAG, "OpenSL ES init error=%d", (int) result);
+        release();
+        return -1;
+    }
+
+    int start() override {
+        if (!m_play)
+            return -1;
+        SLuint32 state = SL_PLAYSTATE_STOPPED;
+        (*m_play)->GetPlayState(m_play, &state);
+        if (state == SL_PLAYSTATE_STOPPED) {
+            m_head = 0;
+            for (int i = 0; i < NUM_BUFFERS; i++) {
+                enqueue(i);
+            }
+        }
+        return (*m_play)->SetPlayState(m_play, SL_PLAYSTATE_PLAYING) == SL_RESULT_SUCCESS ? 0 : -1;
+    }
+
+    void pause() override {
+        if (m_play) {
+            (*m_play)->SetPlayState(m_play, SL_PLAYSTATE_PAUSED);
+        }
+    }
+
+    void stop() override {
+        if (m_play) {
+            (*m_play)->SetPlayState(m_play, SL_PLAYSTATE_STOPPED);
+            (*m_queue)->Clear(m_queue);
+        }
+    }
+};
+
+#endif
+
+AudioSink *AudioSink::create(int type, const char *wavPath) {
+    switch (type) {
+#ifdef __ANDROID__
+        case AUDIO_SINK_OPENSL:
+            return new OpenSLAudioSink();
+#endif
+        case AUDIO_SINK_WAV:
+            return new ThreadAudioSink(false, wavPath);
+        default:
+            return new ThreadAudioSink(true, nullptr);
+    }
+}
+
+ThreadAudioSink::ThreadAudioSink(bool realtime, const char *wavPath)
+        : m_realtime(realtime),
+          m_wavPath(wavPath),
+          m_running(false),
+          m_paused(false) {
+}
+
+ThreadAudioSink::~ThreadAudioSink() {
+    stop();
+}
+
+static void putLE(uint8_t *p, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void ThreadAudioSink::writeWavHeader() {
+    uint8_t header[44];
+    uint32_t dataSize = static_cast<uint32_t>(m_dataSize);
+    memcpy(header, "RIFF", 4);
+    putLE(header + 4, 36 + dataSize, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLE(header + 16, 16, 4);
+    putLE(header + 20, 1, 2); // PCM
+    putLE(header + 22, static_cast<uint32_t>(m_channels), 2);
+    putLE(header + 24, static_cast<uint32_t>(m_sampleRate), 4);
+    putLE(header + 28, static_cast<uint32_t>(m_sampleRate * m_channels * 2), 4);
+    putLE(header + 32, static_cast<uint32_t>(m_channels * 2), 2);
+    putLE(header + 34, 16, 2);
+    memcpy(header + 36, "data", 4);
+    putLE(header + 40, dataSize, 4);
+    fseek(m_wavFile, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), m_wavFile);
+    fseek(m_wavFile, 0, SEEK_END);
+}
+
+int ThreadAudioSink::open(int sampleRate, int channels, AudioSinkSource *source) {
+    m_sampleRate = sampleRate;
+    m_channels   = channels;
+    m_source     = source;
+    if (m_wavPath) {
+        m_wavFile = fopen(m_wavPath, "wb");
+        if (!m_wavFile) {
+            LOGE(SINK_TAG, "open %s error", m_wavPath);
+            return -1;
+        }
+        m_dataSize = 0;
+        writeWavHeader();
+    }
+    return 0;
+}
+
+void ThreadAudioSink::run() {
+    int frameSize  = m_channels * 2;
+    int frames     = m_sampleRate * BUFFER_MS / 1000;
+    std::vector<uint8_t> buffer(static_cast<size_t>(frames * frameSize));
+    auto period    = std::chrono::microseconds(static_cast<int64_t>(frames) * 1000000 / m_sampleRate);
+    auto deadline  = std::chrono::steady_clock::now();
+
+    while (m_running) {
+        if (m_paused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(BUFFER_MS));
+            deadline = std::chrono::steady_clock::now();
+            continue;
+        }
+        int size = m_source->readPcm(buffer.data(), static_cast<int>(buffer.size()));
+        if (m_wavFile && size > 0) {
+            fwrite(buffer.data(), 1, static_cast<size_t>(size), m_wavFile);
+            m_dataSize += size;
+        }
+        if (size >= frameSize) {
+            m_source->onRendered(size / frameSize);
+        }
+        if (m_realtime) {
+            deadline += period;
+            std::this_thread::sleep_until(deadline);
+        } else if (size == 0) {
+            // as fast as the source, just don't spin when it is empty
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+int ThreadAudioSink::start() {
+    m_paused = false;
+    if (m_running)
+        return 0;
+    m_running = true;
+    m_thread  = std::thread(&ThreadAudioSink::run, this);
+    return 0;
+}
+
+void ThreadAudioSink::pause() {
+    m_paused = true;
+}
+
+void ThreadAudioSink::stop() {
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_wavFile) {
+        writeWavHeader();
+        fclose(m_wavFile);
+        m_wavFile = nullptr;
+    }
+}
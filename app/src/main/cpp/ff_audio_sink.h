@@ -0,0 +1,91 @@
+//
+// Audio outputs pulling interleaved s16 PCM: OpenSL ES on device, null and WAV for testing.
+//
+
+#ifndef FF_AUDIO_SINK_H
+#define FF_AUDIO_SINK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#define AUDIO_SINK_OPENSL 0
+// paced in real time, nothing is output
+#define AUDIO_SINK_NULL   1
+// written into a WAV file as fast as the source goes
+#define AUDIO_SINK_WAV    2
+
+/**
+ * Feeds a sink, called on the audio thread: no locking or blocking.
+ */
+class AudioSinkSource {
+public:
+    virtual ~AudioSinkSource() = default;
+
+    /**
+     * @return bytes copied into buffer, the rest is played as silence
+     */
+    virtual int readPcm(uint8_t *buffer, int size) = 0;
+
+    /**
+     * frames of the source have been played out
+     */
+    virtual void onRendered(int frames) = 0;
+};
+
+class AudioSink {
+public:
+
+    static AudioSink *create(int type, const char *wavPath);
+
+    virtual ~AudioSink() = default;
+
+    virtual int open(int sampleRate, int channels, AudioSinkSource *source) = 0;
+
+    virtual int start() = 0;
+
+    virtual void pause() = 0;
+
+    virtual void stop() = 0;
+};
+
+/**
+ * Pulls buffers of 20ms from a thread, for host testing.
+ */
+class ThreadAudioSink : public AudioSink {
+private:
+
+    bool m_realtime;
+    const char *m_wavPath;
+    FILE *m_wavFile = nullptr;
+    int64_t m_dataSize = 0;
+
+    int m_sampleRate = 0;
+    int m_channels   = 0;
+    AudioSinkSource *m_source = nullptr;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_paused;
+
+    void run();
+
+    void writeWavHeader();
+
+public:
+
+    ThreadAudioSink(bool realtime, const char *wavPath);
+
+    ~ThreadAudioSink() override;
+
+    int open(int sampleRate, int channels, AudioSinkSource *source) override;
+
+    int start() override;
+
+    void pause() override;
+
+    void stop() override;
+};
+
+#endif //FF_AUDIO_SINK_H
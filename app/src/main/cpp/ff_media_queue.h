@@ -0,0 +1,146 @@
+//
+// Bounded blocking queue between the stages of a media pipeline.
+//
+
+#ifndef FF_MEDIA_QUEUE_H
+#define FF_MEDIA_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+struct MediaQueueStats {
+    size_t   max_depth;
+    double   avg_depth;      // sampled at every push
+    uint64_t push_count;
+    int64_t  push_stall_us;  // producer blocked on a full queue: the consumer is slower
+    int64_t  pop_stall_us;   // consumer blocked on an empty queue: the producer is slower
+};
+
+/**
+ * Queue with backpressure: push() blocks while the queue is full,
+ * pop() blocks while it is empty. finish() marks the end of stream,
+ * abort() wakes up and releases both sides at once.
+ */
+template <typename T>
+class MediaQueue {
+private:
+
+    std::deque<T> m_queue;
+    size_t m_capacity;
+    bool m_finished = false;
+    bool m_abort    = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+
+    size_t   m_maxDepth    = 0;
+    uint64_t m_depthSum    = 0;
+    uint64_t m_pushCount   = 0;
+    int64_t  m_pushStallUs = 0;
+    int64_t  m_popStallUs  = 0;
+
+    static int64_t nowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+
+    explicit MediaQueue(size_t capacity) : m_capacity(capacity > 0 ? capacity : 1) {}
+
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= m_capacity && !m_abort) {
+            int64_t begin = nowUs();
+            m_notFull.wait(lock, [this] { return m_queue.size() < m_capacity || m_abort; });
+            m_pushStallUs += nowUs() - begin;
+        }
+        if (m_abort)
+            return false;
+        m_queue.push_back(item);
+        m_pushCount++;
+        m_depthSum += m_queue.size();
+        if (m_queue.size() > m_maxDepth)
+            m_maxDepth = m_queue.size();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @return false when aborted, or when finished and drained
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_queue.empty() && !m_finished && !m_abort) {
+            int64_t begin = nowUs();
+            m_notEmpty.wait(lock, [this] { return !m_queue.empty() || m_finished || m_abort; });
+            m_popStallUs += nowUs() - begin;
+        }
+        if (m_abort || m_queue.empty())
+            return false;
+        item = m_queue.front();
+        m_queue.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Take the remaining items without blocking, used to release them after abort.
+     */
+    bool drain(T &item) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.empty())
+            return false;
+        item = m_queue.front();
+        m_queue.pop_front();
+        return true;
+    }
+
+    /**
+     * Release the queued items and accept new ones after finish(), e.g. when seeking.
+     */
+    template <typename Release>
+    void flush(Release release) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (T &item : m_queue)
+            release(item);
+        m_queue.clear();
+        m_finished = false;
+        m_notFull.notify_all();
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished = true;
+        m_notEmpty.notify_all();
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_abort = true;
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.size();
+    }
+
+    MediaQueueStats stats() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        MediaQueueStats stats;
+        stats.max_depth     = m_maxDepth;
+        stats.avg_depth     = m_pushCount ? (double) m_depthSum / m_pushCount : 0;
+        stats.push_count    = m_pushCount;
+        stats.push_stall_us = m_pushStallUs;
+        stats.pop_stall_us  = m_popStallUs;
+        return stats;
+    }
+};
+
+#endif //FF_MEDIA_QUEUE_H
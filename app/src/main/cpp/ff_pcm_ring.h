@@ -0,0 +1,202 @@
+//
+// Lock-free ring of PCM bytes between a decoding thread and an audio callback.
+//
+
+#ifndef FF_PCM_RING_H
+#define FF_PCM_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+/**
+ * Single producer, single consumer. read() never blocks nor locks, so it is safe
+ * in a real-time audio callback. write() blocks while the ring is full, woken up
+ * by the consumer (with a timeout, as the wakeup is sent without the lock).
+ */
+class PcmRing {
+private:
+
+    uint8_t *m_buffer = nullptr;
+    size_t m_capacity = 0; // power of two
+    std::atomic<uint64_t> m_head; // total bytes read
+    std::atomic<uint64_t> m_tail; // total bytes written
+    std::atomic<bool> m_abort;
+
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+
+public:
+
+    PcmRing() : m_head(0), m_tail(0), m_abort(false) {}
+
+    ~PcmRing() {
+        delete[] m_buffer;
+    }
+
+    PcmRing(const PcmRing&) = delete;
+    PcmRing& operator=(const PcmRing&) = delete;
+
+    /**
+     * Not thread safe, before the producer and consumer start.
+     */
+    void init(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        delete[] m_buffer;
+        m_buffer   = new uint8_t[size];
+        m_capacity = size;
+        m_head     = 0;
+        m_tail     = 0;
+        m_abort    = false;
+    }
+
+    size_t capacity() const {
+        return m_capacity;
+    }
+
+    size_t available() const {
+        return static_cast<size_t>(m_tail.load(std::memory_order_acquire)
+                                   - m_head.load(std::memory_order_acquire));
+    }
+
+    /**
+     * Copy what fits without waiting.
+     * @return bytes copied
+     */
+    size_t tryWrite(const uint8_t *data, size_t size) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        size_t room   = m_capacity - static_cast<size_t>(tail - head);
+        size_t count  = size < room ? size : room;
+        if (count == 0)
+            return 0;
+        size_t offset = static_cast<size_t>(tail & (m_capacity - 1));
+        size_t first  = count < m_capacity - offset ? count : m_capacity - offset;
+        memcpy(m_buffer + offset, data, first);
+        memcpy(m_buffer, data + first, count - first);
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Wait until the consumer makes room, at most timeout.
+     * @return false if aborted
+     */
+    bool waitForRoom(std::chrono::milliseconds timeout) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait_for(lock, timeout, [this, tail] {
+            return m_abort || m_capacity - (tail - m_head.load(std::memory_order_acquire)) > 0;
+        });
+        return !m_abort;
+    }
+
+    /**
+     * Copy everything, waiting for room as needed.
+     * @return false if aborted
+     */
+    bool write(const uint8_t *data, size_t size) {
+        while (size > 0) {
+            size_t count = tryWrite(data, size);
+            if (count == 0) {
+                // timed out, as the wakeup is sent without the lock
+                if (!waitForRoom(std::chrono::milliseconds(10)))
+                    return false;
+                continue;
+            }
+            data += count;
+            size -= count;
+        }
+        return !m_abort;
+    }
+
+    /**
+     * Total bytes written, the position of the next write.
+     */
+    uint64_t written() const {
+        return m_tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @return bytes copied, may be less than size
+     */
+    size_t read(uint8_t *data, size_t size) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        size_t count  = static_cast<size_t>(tail - head);
+        if (count > size)
+            count = size;
+        if (count == 0)
+            return 0;
+        size_t offset = static_cast<size_t>(head & (m_capacity - 1));
+        size_t first  = count < m_capacity - offset ? count : m_capacity - offset;
+        memcpy(data, m_buffer + offset, first);
+        memcpy(data + first, m_buffer, count - first);
+        m_head.store(head + count, std::memory_order_release);
+        m_notFull.notify_one();
+        return count;
+    }
+
+    /**
+     * Read in place, without copying: what is buffered starts at first, and goes on
+     * at second when it wraps around the end of the buffer. Valid until consumed.
+     * @return bytes buffered, firstSize of them at first
+     */
+    size_t peek(const uint8_t **first, size_t *firstSize, const uint8_t **second) const {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        size_t offset = static_cast<size_t>(head & (m_capacity - 1));
+        size_t count  = static_cast<size_t>(tail - head);
+        *first     = m_buffer + offset;
+        *firstSize = count < m_capacity - offset ? count : m_capacity - offset;
+        *second    = m_buffer;
+        return count;
+    }
+
+    /**
+     * Release size bytes after peek(), at most what it returned.
+     */
+    void consume(size_t size) {
+        m_head.store(m_head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        m_notFull.notify_one();
+    }
+
+    /**
+     * Drop what is buffered, from the consumer side.
+     */
+    void clear() {
+        m_head.store(m_tail.load(std::memory_order_acquire), std::memory_order_release);
+        m_notFull.notify_one();
+    }
+
+    /**
+     * Drop what was written before position, from the consumer side.
+     * @return bytes dropped
+     */
+    size_t skipTo(uint64_t position) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        if (position > tail)
+            position = tail;
+        if (position <= head)
+            return 0;
+        m_head.store(position, std::memory_order_release);
+        m_notFull.notify_one();
+        return static_cast<size_t>(position - head);
+    }
+
+    void abort() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_abort = true;
+        }
+        m_notFull.notify_all();
+    }
+};
+
+#endif //FF_PCM_RING_H
@@ -0,0 +1,213 @@
+//
+// Tap on the PCM of a player: consumers get it in process, decimated, without locks.
+//
+
+#include "ff_pcm_tap.h"
+
+#include <thread>
+
+// frames decimated on the stack before going into a ring
+#define TAP_CHUNK 256
+
+/******************** PcmTapReader ********************/
+
+PcmTapReader::PcmTapReader(int sampleRate, int channels, size_t frames)
+        : m_rate(sampleRate), m_channels(channels), m_outRate(0), m_outChannels(channels == 1 ? 1 : 0),
+          m_dropped(0), m_detached(false), m_closed(false) {
+    // room for stereo, a frame never straddles the end of the ring
+    m_ring.init(frames * 2 * sizeof(int16_t));
+}
+
+void PcmTapReader::setSource(int sampleRate, int channels) {
+    m_sourceRate     = sampleRate;
+    m_sourceChannels = channels;
+    m_factor = m_rate > 0 && sampleRate > m_rate ? sampleRate / m_rate : 1;
+    m_count  = 0;
+    m_sum[0] = m_sum[1] = 0;
+    m_outChannels.store(m_channels == 1 ? 1 : channels, std::memory_order_release);
+    m_outRate.store(sampleRate / m_factor, std::memory_order_release);
+}
+
+void PcmTapReader::write(const int16_t *data, size_t frames) {
+    int channels = m_outChannels.load(std::memory_order_relaxed);
+    size_t frameSize = channels * sizeof(int16_t);
+    if (m_factor == 1 && channels == m_sourceChannels) {
+        // as it is, the only copy is into the ring
+        size_t size  = frames * frameSize;
+        size_t count = m_ring.tryWrite(reinterpret_cast<const uint8_t *>(data), size);
+        if (count < size)
+            m_dropped.fetch_add((size - count) / frameSize, std::memory_order_relaxed);
+        return;
+    }
+
+    int16_t chunk[TAP_CHUNK * 2];
+    size_t used = 0;
+    int divisor = m_factor * (channels == 1 ? m_sourceChannels : 1);
+    for (size_t i = 0; i < frames; i++) {
+        const int16_t *frame = data + i * m_sourceChannels;
+        if (channels == 1) {
+            for (int c = 0; c < m_sourceChannels; c++) {
+                m_sum[0] += frame[c];
+            }
+        } else {
+            for (int c = 0; c < channels; c++) {
+                m_sum[c] += frame[c];
+            }
+        }
+        if (++m_count < m_factor)
+            continue;
+        for (int c = 0; c < channels; c++) {
+            chunk[used * channels + c] = static_cast<int16_t>(m_sum[c] / divisor);
+            m_sum[c] = 0;
+        }
+        m_count = 0;
+        if (++used == TAP_CHUNK) {
+            size_t size  = used * frameSize;
+            size_t count = m_ring.tryWrite(reinterpret_cast<const uint8_t *>(chunk), size);
+            if (count < size)
+                m_dropped.fetch_add((size - count) / frameSize, std::memory_order_relaxed);
+            used = 0;
+        }
+    }
+    if (used > 0) {
+        size_t size  = used * frameSize;
+        size_t count = m_ring.tryWrite(reinterpret_cast<const uint8_t *>(chunk), size);
+        if (count < size)
+            m_dropped.fetch_add((size - count) / frameSize, std::memory_order_relaxed);
+    }
+}
+
+int PcmTapReader::sampleRate() const {
+    return m_outRate.load(std::memory_order_acquire);
+}
+
+int PcmTapReader::channels() const {
+    return m_outChannels.load(std::memory_order_acquire);
+}
+
+size_t PcmTapReader::available() const {
+    int channels = m_outChannels.load(std::memory_order_acquire);
+    return channels > 0 ? m_ring.available() / (channels * sizeof(int16_t)) : 0;
+}
+
+size_t PcmTapReader::peek(const int16_t **first, size_t *firstFrames, const int16_t **second) const {
+    size_t frameSize = channels() * sizeof(int16_t);
+    if (frameSize == 0) {
+        *firstFrames = 0;
+        return 0;
+    }
+    const uint8_t *a;
+    const uint8_t *b;
+    size_t firstSize;
+    size_t size  = m_ring.peek(&a, &firstSize, &b);
+    *first       = reinterpret_cast<const int16_t *>(a);
+    *second      = reinterpret_cast<const int16_t *>(b);
+    *firstFrames = firstSize / frameSize;
+    return size / frameSize;
+}
+
+void PcmTapReader::consume(size_t frames) {
+    m_ring.consume(frames * channels() * sizeof(int16_t));
+}
+
+size_t PcmTapReader::read(int16_t *data, size_t max) {
+    size_t frameSize = channels() * sizeof(int16_t);
+    if (frameSize == 0)
+        return 0;
+    return m_ring.read(reinterpret_cast<uint8_t *>(data), max * frameSize) / frameSize;
+}
+
+void PcmTapReader::keepLast(size_t frames) {
+    size_t keep = frames * channels() * sizeof(int16_t);
+    uint64_t written = m_ring.written();
+    if (written > keep)
+        m_ring.skipTo(written - keep);
+}
+
+uint64_t PcmTapReader::written() const {
+    size_t frameSize = channels() * sizeof(int16_t);
+    return frameSize > 0 ? m_ring.written() / frameSize : 0;
+}
+
+uint64_t PcmTapReader::dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void PcmTapReader::detach() {
+    m_detached = true;
+}
+
+bool PcmTapReader::closed() const {
+    return m_closed;
+}
+
+/******************** PcmTap ********************/
+
+PcmTap::PcmTap() : m_writing(false), m_sampleRate(0), m_channels(0) {
+    for (auto &slot : m_slots) {
+        slot = nullptr;
+    }
+}
+
+PcmTap::~PcmTap() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int i = 0; i < PCM_TAP_MAX_READERS; i++) {
+        if (m_owners[i]) {
+            m_owners[i]->m_closed = true;
+            release(i);
+        }
+    }
+}
+
+void PcmTap::init(int sampleRate, int channels) {
+    m_sampleRate = sampleRate;
+    m_channels   = channels;
+}
+
+// with m_mutex held
+void PcmTap::release(int slot) {
+    m_slots[slot] = nullptr;
+    // a write() that took the reader before is still using it
+    while (m_writing) {
+        std::this_thread::yield();
+    }
+    m_owners[slot].reset();
+}
+
+std::shared_ptr<PcmTapReader> PcmTap::attach(int sampleRate, int channels, size_t frames) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int free = -1;
+    for (int i = 0; i < PCM_TAP_MAX_READERS; i++) {
+        if (m_owners[i] && m_owners[i]->m_detached)
+            release(i);
+        if (!m_owners[i] && free < 0)
+            free = i;
+    }
+    if (free < 0)
+        return nullptr;
+    auto reader = std::make_shared<PcmTapReader>(sampleRate, channels, frames);
+    if (m_sampleRate > 0)
+        reader->setSource(m_sampleRate, m_channels);
+    m_owners[free] = reader;
+    m_slots[free]  = reader.get();
+    return reader;
+}
+
+void PcmTap::write(const int16_t *data, size_t frames) {
+    if (frames == 0)
+        return;
+    int sampleRate = m_sampleRate.load(std::memory_order_relaxed);
+    int channels   = m_channels.load(std::memory_order_relaxed);
+    if (sampleRate <= 0 || channels < 1 || channels > 2)
+        return;
+    m_writing = true;
+    for (auto &slot : m_slots) {
+        PcmTapReader *reader = slot;
+        if (!reader || reader->m_detached.load(std::memory_order_relaxed))
+            continue;
+        if (reader->m_sourceRate != sampleRate || reader->m_sourceChannels != channels)
+            reader->setSource(sampleRate, channels);
+        reader->write(data, frames);
+    }
+    m_writing = false;
+}
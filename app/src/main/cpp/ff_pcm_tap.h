@@ -0,0 +1,144 @@
+//
+// Tap on the PCM of a player: consumers get it in process, decimated, without locks.
+//
+
+#ifndef FF_PCM_TAP_H
+#define FF_PCM_TAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "ff_pcm_ring.h"
+
+#define PCM_TAP_MAX_READERS 8
+
+/**
+ * What one consumer gets: s16 interleaved, 1 channel (downmix) or the channels of the source,
+ * at the source rate divided by an integer, averaged over each step.
+ * Written by the tap, read by a single consumer thread. When the consumer lags
+ * the ring fills up and new samples are dropped, counted by dropped().
+ */
+class PcmTapReader {
+private:
+
+    friend class PcmTap;
+
+    PcmRing m_ring;
+    int m_rate;     // asked for
+    int m_channels; // asked for, 0 for those of the source
+    std::atomic<int> m_outRate;
+    std::atomic<int> m_outChannels;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_detached;
+    std::atomic<bool> m_closed;
+
+    // on the tap side only
+    int m_sourceRate = 0;
+    int m_sourceChannels = 0;
+    int m_factor = 1;
+    int m_count  = 0;
+    int32_t m_sum[2] = {0, 0};
+
+    void setSource(int sampleRate, int channels);
+
+    void write(const int16_t *data, size_t frames);
+
+public:
+
+    /**
+     * @param frames capacity of the ring, rounded up to a power of two
+     */
+    PcmTapReader(int sampleRate, int channels, size_t frames);
+
+    PcmTapReader(const PcmTapReader&) = delete;
+    PcmTapReader& operator=(const PcmTapReader&) = delete;
+
+    /**
+     * 0 until the source is known, at its first samples
+     */
+    int sampleRate() const;
+
+    int channels() const;
+
+    size_t available() const;
+
+    /**
+     * Read in place, see PcmRing::peek()
+     * @return frames buffered, firstFrames of them at first, the others at second
+     */
+    size_t peek(const int16_t **first, size_t *firstFrames, const int16_t **second) const;
+
+    void consume(size_t frames);
+
+    /**
+     * @return frames copied, at most max
+     */
+    size_t read(int16_t *data, size_t max);
+
+    /**
+     * Keep only the last frames, for consumers wanting the latest samples.
+     */
+    void keepLast(size_t frames);
+
+    /**
+     * frames written so far, to tell whether new ones came
+     */
+    uint64_t written() const;
+
+    uint64_t dropped() const;
+
+    /**
+     * Stop receiving, the tap lets it go at the next attach or when closed.
+     */
+    void detach();
+
+    /**
+     * The source is gone, nothing more comes.
+     */
+    bool closed() const;
+};
+
+/**
+ * Fan-out of the s16 interleaved PCM of a player to its readers. write() is lock and
+ * wait free, fit for an audio callback; attach() and detach() may come from any thread.
+ */
+class PcmTap {
+private:
+
+    std::atomic<PcmTapReader *> m_slots[PCM_TAP_MAX_READERS];
+    std::shared_ptr<PcmTapReader> m_owners[PCM_TAP_MAX_READERS];
+    std::mutex m_mutex;
+    // write() running, a reader taken out of its slot is let go once it is false
+    std::atomic<bool> m_writing;
+    std::atomic<int> m_sampleRate;
+    std::atomic<int> m_channels;
+
+    void release(int slot);
+
+public:
+
+    PcmTap();
+
+    ~PcmTap();
+
+    PcmTap(const PcmTap&) = delete;
+    PcmTap& operator=(const PcmTap&) = delete;
+
+    /**
+     * Format of what is written, 1 or 2 channels
+     */
+    void init(int sampleRate, int channels);
+
+    /**
+     * @param sampleRate wanted, the closest above by an integer step
+     * @param channels   1 for a downmix, 0 for the channels of the source
+     * @param frames     capacity of the ring
+     * @return nullptr if too many readers
+     */
+    std::shared_ptr<PcmTapReader> attach(int sampleRate, int channels, size_t frames);
+
+    void write(const int16_t *data, size_t frames);
+};
+
+#endif //FF_PCM_TAP_H
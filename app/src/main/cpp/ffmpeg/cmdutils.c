@@ -66,13 +66,18 @@
 
 static int init_report(const char *env);
 
-AVDictionary *sws_dict;
-AVDictionary *swr_opts;
-AVDictionary *format_opts, *codec_opts, *resample_opts;
+FF_THREAD_LOCAL AVDictionary *sws_dict;
+FF_THREAD_LOCAL AVDictionary *swr_opts;
+FF_THREAD_LOCAL AVDictionary *format_opts, *codec_opts, *resample_opts;
 
 static FILE *report_file;
 static int report_file_level = AV_LOG_DEBUG;
-int hide_banner = 0;
+FF_THREAD_LOCAL int hide_banner = 0;
+
+void *hide_banner_ptr(void)
+{
+    return &hide_banner;
+}
 
 enum show_muxdemuxers {
     SHOW_DEFAULT,
@@ -124,7 +129,7 @@ void init_dynload(void)
 #endif
 }
 
-static void (*program_exit)(int ret);
+static FF_THREAD_LOCAL void (*program_exit)(int ret);
 
 void register_exit(void (*cb)(int ret))
 {
@@ -293,10 +298,11 @@ static inline void prepare_app_arguments(int *argc_ptr, char ***argv_ptr)
 static int write_option(void *optctx, const OptionDef *po, const char *opt,
                         const char *arg)
 {
-    /* new-style options contain an offset into optctx, old-style address of
-     * a global var*/
+    /* new-style options contain an offset into optctx, session options the
+     * accessor of a thread-local var, old-style address of a global var*/
     void *dst = po->flags & (OPT_OFFSET | OPT_SPEC) ?
-                (uint8_t *)optctx + po->u.off : po->u.dst_ptr;
+                (uint8_t *)optctx + po->u.off :
+                po->flags & OPT_SESSION ? po->u.var_ptr() : po->u.dst_ptr;
     int *dstcount;
 
     if (po->flags & OPT_SPEC) {
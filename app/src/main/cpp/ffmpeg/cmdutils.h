@@ -36,7 +36,13 @@
 
 #include <setjmp.h>
 
-extern jmp_buf jump_buf;
+/**
+ * Storage class of the per-run state. Every FFmpegSession runs on its own
+ * thread, so what used to be process globals is kept thread-local.
+ */
+#define FF_THREAD_LOCAL __thread
+
+extern FF_THREAD_LOCAL jmp_buf jump_buf;
 
 /**
  * program name, defined by the program for show_version().
@@ -50,10 +56,15 @@ extern const int program_birth_year;
 
 extern AVCodecContext *avcodec_opts[AVMEDIA_TYPE_NB];
 extern AVFormatContext *avformat_opts;
-extern AVDictionary *sws_dict;
-extern AVDictionary *swr_opts;
-extern AVDictionary *format_opts, *codec_opts, *resample_opts;
-extern int hide_banner;
+extern FF_THREAD_LOCAL AVDictionary *sws_dict;
+extern FF_THREAD_LOCAL AVDictionary *swr_opts;
+extern FF_THREAD_LOCAL AVDictionary *format_opts, *codec_opts, *resample_opts;
+extern FF_THREAD_LOCAL int hide_banner;
+
+/**
+ * Return the address of hide_banner for the calling session.
+ */
+void *hide_banner_ptr(void);
 
 /**
  * Register a program-specific cleanup routine.
@@ -184,10 +195,13 @@ typedef struct OptionDef {
 #define OPT_DOUBLE 0x20000
 #define OPT_INPUT  0x40000
 #define OPT_OUTPUT 0x80000
+#define OPT_SESSION 0x100000    /* the option is a thread-local global of the running
+                                   session, its address is returned by u.var_ptr */
      union {
         void *dst_ptr;
         int (*func_arg)(void *, const char *, const char *);
         size_t off;
+        void *(*var_ptr)(void);
     } u;
     const char *help;
     const char *argname;
@@ -243,7 +257,7 @@ void show_help_options(const OptionDef *options, const char *msg, int req_flags,
     { "report",      0,                    { (void*)opt_report },            "generate a report" },                     \
     { "max_alloc",   HAS_ARG,              { .func_arg = opt_max_alloc },    "set maximum size of a single allocated block", "bytes" }, \
     { "cpuflags",    HAS_ARG | OPT_EXPERT, { .func_arg = opt_cpuflags },     "force specific cpu flags", "flags" },     \
-    { "hide_banner", OPT_BOOL | OPT_EXPERT, {&hide_banner},     "do not show program banner", "hide_banner" },          \
+    { "hide_banner", OPT_BOOL | OPT_EXPERT | OPT_SESSION, { .var_ptr = hide_banner_ptr }, "do not show program banner", "hide_banner" }, \
     CMDUTILS_COMMON_OPTIONS_AVDEVICE                                                                                    \
 
 /**
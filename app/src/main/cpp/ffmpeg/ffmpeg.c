@@ -106,12 +106,12 @@
 #include "libavutil/avassert.h"
 #include <setjmp.h>
 
-jmp_buf jump_buf;
+FF_THREAD_LOCAL jmp_buf jump_buf;
 
 const char program_name[] = "ffmpeg";
 const int program_birth_year = 2000;
 
-static FILE *vstats_file;
+static FF_THREAD_LOCAL FILE *vstats_file;
 
 const char *const forced_keyframes_const_names[] = {
     "n",
@@ -133,33 +133,38 @@ static BenchmarkTimeStamps get_benchmark_time_stamps(void);
 static int64_t getmaxrss(void);
 static int ifilter_has_all_input_formats(FilterGraph *fg);
 
-static int run_as_daemon  = 0;
-static int nb_frames_dup = 0;
-static unsigned dup_warning = 1000;
-static int nb_frames_drop = 0;
-static int64_t decode_error_stat[2];
+static FF_THREAD_LOCAL int run_as_daemon  = 0;
+static FF_THREAD_LOCAL int nb_frames_dup = 0;
+static FF_THREAD_LOCAL unsigned dup_warning = 1000;
+static FF_THREAD_LOCAL int nb_frames_drop = 0;
+static FF_THREAD_LOCAL int64_t decode_error_stat[2];
 
-static int want_sdp = 1;
+static FF_THREAD_LOCAL int want_sdp = 1;
 
-static BenchmarkTimeStamps current_time;
-AVIOContext *progress_avio = NULL;
+static FF_THREAD_LOCAL BenchmarkTimeStamps current_time;
+FF_THREAD_LOCAL AVIOContext *progress_avio = NULL;
 
-static uint8_t *subtitle_out;
+static FF_THREAD_LOCAL uint8_t *subtitle_out;
 
-InputStream **input_streams = NULL;
-int        nb_input_streams = 0;
-InputFile   **input_files   = NULL;
-int        nb_input_files   = 0;
+FF_THREAD_LOCAL InputStream **input_streams = NULL;
+FF_THREAD_LOCAL int        nb_input_streams = 0;
+FF_THREAD_LOCAL InputFile   **input_files   = NULL;
+FF_THREAD_LOCAL int        nb_input_files   = 0;
 
-OutputStream **output_streams = NULL;
-int         nb_output_streams = 0;
-OutputFile   **output_files   = NULL;
-int         nb_output_files   = 0;
+FF_THREAD_LOCAL OutputStream **output_streams = NULL;
+FF_THREAD_LOCAL int         nb_output_streams = 0;
+FF_THREAD_LOCAL OutputFile   **output_files   = NULL;
+FF_THREAD_LOCAL int         nb_output_files   = 0;
 
-FilterGraph **filtergraphs;
-int        nb_filtergraphs;
+FF_THREAD_LOCAL FilterGraph **filtergraphs;
+FF_THREAD_LOCAL int        nb_filtergraphs;
 
-int cancel_execute = 0;
+/* session bound to the calling thread */
+static FF_THREAD_LOCAL FFmpegSession *current_session;
+
+/* sessions inside ffmpeg_session_run(), walked by cancel_task() */
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+static FFmpegSession *running_sessions;
 #if HAVE_TERMIOS_H
 
 /* init terminal so that we can grab keys */
@@ -336,9 +341,9 @@ void term_exit(void)
 
 static volatile int received_sigterm = 0;
 static volatile int received_nb_signals = 0;
-static atomic_int transcode_init_done = ATOMIC_VAR_INIT(0);
-static volatile int ffmpeg_exited = 0;
-static int main_return_code = 0;
+static FF_THREAD_LOCAL atomic_int transcode_init_done = ATOMIC_VAR_INIT(0);
+static FF_THREAD_LOCAL volatile int ffmpeg_exited = 0;
+static FF_THREAD_LOCAL int main_return_code = 0;
 
 static void
 sigterm_handler(int sig)
@@ -478,10 +483,13 @@ static int read_key(void)
 
 static int decode_interrupt_cb(void *ctx)
 {
+    FFmpegSession *session = ctx;
+    if (session && session->cancel)
+        return 1;
     return received_nb_signals > atomic_load(&transcode_init_done);
 }
 
-const AVIOInterruptCB int_cb = { decode_interrupt_cb, NULL };
+FF_THREAD_LOCAL AVIOInterruptCB int_cb = { decode_interrupt_cb, NULL };
 
 static void ffmpeg_cleanup(int ret)
 {
@@ -1666,8 +1674,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     double bitrate;
     double speed;
     int64_t pts = INT64_MIN + 1;
-    static int64_t last_time = -1;
-    static int qp_histogram[52];
+    static FF_THREAD_LOCAL int64_t last_time = -1;
+    static FF_THREAD_LOCAL int qp_histogram[52];
     int hours, mins, secs, us;
     const char *hours_sign;
     int ret;
@@ -1855,7 +1863,9 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     if(input_files) {
         report_duration = input_files[0]->ctx->duration / AV_TIME_BASE;
     }
-    progress_callback((int) report_position, (int) report_duration, STATE_RUNNING);
+    if (current_session && current_session->progress_cb)
+        current_session->progress_cb(current_session->opaque, (int) report_position,
+                                     (int) report_duration, STATE_RUNNING);
 
     if (is_last_report)
         print_final_stats(total_size);
@@ -3926,7 +3936,7 @@ static void set_tty_echo(int on)
 static int check_keyboard_interaction(int64_t cur_time)
 {
     int i, ret, key;
-    static int64_t last_time;
+    static FF_THREAD_LOCAL int64_t last_time;
     if (received_nb_signals)
         return AVERROR_EXIT;
     /* read_key() returns 0 on EOF */
@@ -4047,6 +4057,9 @@ static void *input_thread(void *arg)
     unsigned flags = f->non_blocking ? AV_THREAD_MESSAGE_NONBLOCK : 0;
     int ret = 0;
 
+    /* route the logs of this reader to the session it works for */
+    current_session = f->session;
+
     while (1) {
         AVPacket pkt;
         ret = av_read_frame(f->ctx, &pkt);
@@ -4122,6 +4135,7 @@ static int init_input_thread(int i)
     if (ret < 0)
         return ret;
 
+    f->session = current_session;
     if ((ret = pthread_create(&f->thread, NULL, input_thread, f))) {
         av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
         av_thread_message_queue_free(&f->in_thread_queue);
@@ -4710,8 +4724,8 @@ static int transcode(void)
             break;
         }
 
-        if (cancel_execute) {
-            cancel_execute = 0;
+        if (current_session && current_session->cancel) {
+            current_session->cancel = 0;
             av_log(NULL, AV_LOG_ERROR, "cancel task by user...");
             break;
         }
@@ -4863,15 +4877,91 @@ static int64_t getmaxrss(void)
 #endif
 }
 
-static void log_callback_null(void *ptr, int level, const char *fmt, va_list vl)
+static void log_callback_null(void *opaque, int level, const char *fmt, va_list vl)
+{
+}
+
+FFmpegSession *ffmpeg_session_alloc(void)
+{
+    return av_mallocz(sizeof(FFmpegSession));
+}
+
+void ffmpeg_session_free(FFmpegSession **session)
+{
+    if (!session || !*session)
+        return;
+    av_assert0(!(*session)->running);
+    av_freep(session);
+}
+
+void ffmpeg_session_cancel(FFmpegSession *session, int cancel)
+{
+    if (session)
+        session->cancel = cancel;
+}
+
+FFmpegSession *ffmpeg_session_current(void)
+{
+    return current_session;
+}
+
+static void session_attach(FFmpegSession *session)
 {
+    pthread_mutex_lock(&session_lock);
+    session->running = 1;
+    session->next    = running_sessions;
+    running_sessions = session;
+    pthread_mutex_unlock(&session_lock);
+    current_session  = session;
 }
 
-int run(int argc, char **argv)
+static void session_detach(FFmpegSession *session)
+{
+    FFmpegSession **p;
+
+    current_session = NULL;
+    pthread_mutex_lock(&session_lock);
+    for (p = &running_sessions; *p; p = &(*p)->next) {
+        if (*p == session) {
+            *p = session->next;
+            break;
+        }
+    }
+    session->next    = NULL;
+    session->running = 0;
+    pthread_mutex_unlock(&session_lock);
+}
+
+/* the state of a run lives in thread-locals, start each run from defaults */
+static void session_reset_state(FFmpegSession *session)
+{
+    run_as_daemon     = 0;
+    nb_frames_dup     = 0;
+    dup_warning       = 1000;
+    nb_frames_drop    = 0;
+    decode_error_stat[0] = decode_error_stat[1] = 0;
+    want_sdp          = 1;
+    main_return_code  = 0;
+    ffmpeg_exited     = 0;
+    atomic_store(&transcode_init_done, 0);
+    int_cb.opaque     = session;
+    ffmpeg_reset_options();
+}
+
+int ffmpeg_session_run(FFmpegSession *session, int argc, char **argv)
 {
     int i, ret;
     BenchmarkTimeStamps ti;
-    main_return_code = 0;
+    /* -d silences this run only */
+    void (*log_cb)(void *, int, const char *, va_list);
+
+    if (!session || session->running || current_session)
+        return AVERROR(EBUSY);
+    log_cb = session->log_cb;
+    /* a cancel asked for while idle doesn't abort the next run */
+    session->cancel = 0;
+    session_attach(session);
+    session_reset_state(session);
     init_dynload();
 
     register_exit(ffmpeg_cleanup);
@@ -4888,7 +4978,7 @@ int run(int argc, char **argv)
 
     if(argc>1 && !strcmp(argv[1], "-d")){
         run_as_daemon=1;
-        av_log_set_callback(log_callback_null);
+        session->log_cb = log_callback_null;
         argc--;
         argv++;
     }
@@ -4943,11 +5033,22 @@ int run(int argc, char **argv)
 //    exit_program(received_nb_signals ? 255 : main_return_code);
 end:
     av_log(NULL, AV_LOG_INFO, "FFmpeg result=%d\n", main_return_code);
-    progress_callback(100, 100, main_return_code == 0 ? STATE_FINISH : STATE_ERROR);
+    if (session->progress_cb)
+        session->progress_cb(session->opaque, 100, 100,
+                             main_return_code == 0 ? STATE_FINISH : STATE_ERROR);
     ffmpeg_cleanup(0);
+    session->cancel = 0;
+    session->log_cb = log_cb;
+    session->result = main_return_code;
+    session_detach(session);
     return main_return_code;
 }
 
 void cancel_task(int cancel) {
-    cancel_execute = cancel;
+    FFmpegSession *session;
+
+    pthread_mutex_lock(&session_lock);
+    for (session = running_sessions; session; session = session->next)
+        session->cancel = cancel;
+    pthread_mutex_unlock(&session_lock);
 }
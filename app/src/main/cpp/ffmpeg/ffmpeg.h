@@ -418,6 +418,7 @@ typedef struct InputFile {
     int non_blocking;           /* reading packets from the thread should not block */
     int joined;                 /* the thread has been joined */
     int thread_queue_size;      /* maximum number of queued packets */
+    struct FFmpegSession *session; /* session the reading thread works for */
 #endif
 } InputFile;
 
@@ -564,62 +565,62 @@ typedef struct OutputFile {
     int header_written;
 } OutputFile;
 
-extern InputStream **input_streams;
-extern int        nb_input_streams;
-extern InputFile   **input_files;
-extern int        nb_input_files;
-
-extern OutputStream **output_streams;
-extern int         nb_output_streams;
-extern OutputFile   **output_files;
-extern int         nb_output_files;
-
-extern FilterGraph **filtergraphs;
-extern int        nb_filtergraphs;
-
-extern char *vstats_filename;
-extern char *sdp_filename;
-
-extern float audio_drift_threshold;
-extern float dts_delta_threshold;
-extern float dts_error_threshold;
-
-extern int audio_volume;
-extern int audio_sync_method;
-extern int video_sync_method;
-extern float frame_drop_threshold;
-extern int do_benchmark;
-extern int do_benchmark_all;
-extern int do_deinterlace;
-extern int do_hex_dump;
-extern int do_pkt_dump;
-extern int copy_ts;
-extern int start_at_zero;
-extern int copy_tb;
-extern int debug_ts;
-extern int exit_on_error;
-extern int abort_on_flags;
-extern int print_stats;
-extern int qp_hist;
-extern int stdin_interaction;
-extern int frame_bits_per_raw_sample;
-extern AVIOContext *progress_avio;
-extern float max_error_rate;
+extern FF_THREAD_LOCAL InputStream **input_streams;
+extern FF_THREAD_LOCAL int        nb_input_streams;
+extern FF_THREAD_LOCAL InputFile   **input_files;
+extern FF_THREAD_LOCAL int        nb_input_files;
+
+extern FF_THREAD_LOCAL OutputStream **output_streams;
+extern FF_THREAD_LOCAL int         nb_output_streams;
+extern FF_THREAD_LOCAL OutputFile   **output_files;
+extern FF_THREAD_LOCAL int         nb_output_files;
+
+extern FF_THREAD_LOCAL FilterGraph **filtergraphs;
+extern FF_THREAD_LOCAL int        nb_filtergraphs;
+
+extern FF_THREAD_LOCAL char *vstats_filename;
+extern FF_THREAD_LOCAL char *sdp_filename;
+
+extern FF_THREAD_LOCAL float audio_drift_threshold;
+extern FF_THREAD_LOCAL float dts_delta_threshold;
+extern FF_THREAD_LOCAL float dts_error_threshold;
+
+extern FF_THREAD_LOCAL int audio_volume;
+extern FF_THREAD_LOCAL int audio_sync_method;
+extern FF_THREAD_LOCAL int video_sync_method;
+extern FF_THREAD_LOCAL float frame_drop_threshold;
+extern FF_THREAD_LOCAL int do_benchmark;
+extern FF_THREAD_LOCAL int do_benchmark_all;
+extern FF_THREAD_LOCAL int do_deinterlace;
+extern FF_THREAD_LOCAL int do_hex_dump;
+extern FF_THREAD_LOCAL int do_pkt_dump;
+extern FF_THREAD_LOCAL int copy_ts;
+extern FF_THREAD_LOCAL int start_at_zero;
+extern FF_THREAD_LOCAL int copy_tb;
+extern FF_THREAD_LOCAL int debug_ts;
+extern FF_THREAD_LOCAL int exit_on_error;
+extern FF_THREAD_LOCAL int abort_on_flags;
+extern FF_THREAD_LOCAL int print_stats;
+extern FF_THREAD_LOCAL int qp_hist;
+extern FF_THREAD_LOCAL int stdin_interaction;
+extern FF_THREAD_LOCAL int frame_bits_per_raw_sample;
+extern FF_THREAD_LOCAL AVIOContext *progress_avio;
+extern FF_THREAD_LOCAL float max_error_rate;
 extern char *videotoolbox_pixfmt;
 
-extern int filter_nbthreads;
-extern int filter_complex_nbthreads;
-extern int vstats_version;
+extern FF_THREAD_LOCAL int filter_nbthreads;
+extern FF_THREAD_LOCAL int filter_complex_nbthreads;
+extern FF_THREAD_LOCAL int vstats_version;
 
-extern const AVIOInterruptCB int_cb;
+extern FF_THREAD_LOCAL AVIOInterruptCB int_cb;
 
 extern const OptionDef options[];
 extern const HWAccel hwaccels[];
-extern AVBufferRef *hw_device_ctx;
+extern FF_THREAD_LOCAL AVBufferRef *hw_device_ctx;
 #if CONFIG_QSV
 extern char *qsv_device;
 #endif
-extern HWDevice *filter_hw_device;
+extern FF_THREAD_LOCAL HWDevice *filter_hw_device;
 
 
 void term_init(void);
@@ -665,7 +666,7 @@ int hw_device_setup_for_encode(OutputStream *ost);
 
 int hwaccel_decode_init(AVCodecContext *avctx);
 
-int run(int argc, char **argv);
+void ffmpeg_reset_options(void);
 
 enum ProgressState {
     STATE_INIT,
@@ -674,7 +675,42 @@ enum ProgressState {
     STATE_ERROR,
 };
 
-void progress_callback(int position, int duration, int state);
+/**
+ * One ffmpeg command line engine. All the state of a run is bound to the
+ * thread executing ffmpeg_session_run(), so independent sessions can run
+ * concurrently on separate threads.
+ */
+typedef struct FFmpegSession {
+    volatile int cancel;        /* set from any thread to abort the running command */
+    int running;                /* the session is inside ffmpeg_session_run() */
+    int result;                 /* return code of the last run */
+
+    void *opaque;               /* user data handed back to the callbacks */
+    void (*progress_cb)(void *opaque, int position, int duration, int state);
+    void (*log_cb)(void *opaque, int level, const char *fmt, va_list vl);
+
+    struct FFmpegSession *next; /* link in the list of running sessions */
+} FFmpegSession;
+
+FFmpegSession *ffmpeg_session_alloc(void);
+void ffmpeg_session_free(FFmpegSession **session);
+
+/**
+ * Execute a command line on the calling thread, blocking until it is done.
+ * @return 0 on success, the ffmpeg exit code otherwise
+ */
+int ffmpeg_session_run(FFmpegSession *session, int argc, char **argv);
+
+void ffmpeg_session_cancel(FFmpegSession *session, int cancel);
+
+/**
+ * Return the session bound to the calling thread, NULL if there is none.
+ */
+FFmpegSession *ffmpeg_session_current(void);
+
+/**
+ * Cancel every running session.
+ */
 void cancel_task(int cancel);
 
 #endif /* FFTOOLS_FFMPEG_H */
@@ -22,8 +22,8 @@
 
 #include "ffmpeg.h"
 
-static int nb_hw_devices;
-static HWDevice **hw_devices;
+static FF_THREAD_LOCAL int nb_hw_devices;
+static FF_THREAD_LOCAL HWDevice **hw_devices;
 
 static HWDevice *hw_device_get_by_type(enum AVHWDeviceType type)
 {
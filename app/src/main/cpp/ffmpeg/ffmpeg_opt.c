@@ -77,50 +77,131 @@ const HWAccel hwaccels[] = {
 #endif
     { 0 },
 };
-AVBufferRef *hw_device_ctx;
-HWDevice *filter_hw_device;
-
-char *vstats_filename;
-char *sdp_filename;
-
-float audio_drift_threshold = 0.1;
-float dts_delta_threshold   = 10;
-float dts_error_threshold   = 3600*30;
-
-int audio_volume      = 256;
-int audio_sync_method = 0;
-int video_sync_method = VSYNC_AUTO;
-float frame_drop_threshold = 0;
-int do_deinterlace    = 0;
-int do_benchmark      = 0;
-int do_benchmark_all  = 0;
-int do_hex_dump       = 0;
-int do_pkt_dump       = 0;
-int copy_ts           = 0;
-int start_at_zero     = 0;
-int copy_tb           = -1;
-int debug_ts          = 0;
-int exit_on_error     = 0;
-int abort_on_flags    = 0;
-int print_stats       = -1;
-int qp_hist           = 0;
-int stdin_interaction = 1;
-int frame_bits_per_raw_sample = 0;
-float max_error_rate  = 2.0/3;
-int filter_nbthreads = 0;
-int filter_complex_nbthreads = 0;
-int vstats_version = 2;
-
-
-static int intra_only         = 0;
-static int file_overwrite     = 0;
-static int no_file_overwrite  = 0;
-static int do_psnr            = 0;
-static int input_sync;
-static int input_stream_potentially_available = 0;
-static int ignore_unknown_streams = 0;
-static int copy_unknown_streams = 0;
-static int find_stream_info = 1;
+FF_THREAD_LOCAL AVBufferRef *hw_device_ctx;
+FF_THREAD_LOCAL HWDevice *filter_hw_device;
+
+FF_THREAD_LOCAL char *vstats_filename;
+FF_THREAD_LOCAL char *sdp_filename;
+
+FF_THREAD_LOCAL float audio_drift_threshold = 0.1;
+FF_THREAD_LOCAL float dts_delta_threshold   = 10;
+FF_THREAD_LOCAL float dts_error_threshold   = 3600*30;
+
+FF_THREAD_LOCAL int audio_volume      = 256;
+FF_THREAD_LOCAL int audio_sync_method = 0;
+FF_THREAD_LOCAL int video_sync_method = VSYNC_AUTO;
+FF_THREAD_LOCAL float frame_drop_threshold = 0;
+FF_THREAD_LOCAL int do_deinterlace    = 0;
+FF_THREAD_LOCAL int do_benchmark      = 0;
+FF_THREAD_LOCAL int do_benchmark_all  = 0;
+FF_THREAD_LOCAL int do_hex_dump       = 0;
+FF_THREAD_LOCAL int do_pkt_dump       = 0;
+FF_THREAD_LOCAL int copy_ts           = 0;
+FF_THREAD_LOCAL int start_at_zero     = 0;
+FF_THREAD_LOCAL int copy_tb           = -1;
+FF_THREAD_LOCAL int debug_ts          = 0;
+FF_THREAD_LOCAL int exit_on_error     = 0;
+FF_THREAD_LOCAL int abort_on_flags    = 0;
+FF_THREAD_LOCAL int print_stats       = -1;
+FF_THREAD_LOCAL int qp_hist           = 0;
+FF_THREAD_LOCAL int stdin_interaction = 1;
+FF_THREAD_LOCAL int frame_bits_per_raw_sample = 0;
+FF_THREAD_LOCAL float max_error_rate  = 2.0/3;
+FF_THREAD_LOCAL int filter_nbthreads = 0;
+FF_THREAD_LOCAL int filter_complex_nbthreads = 0;
+FF_THREAD_LOCAL int vstats_version = 2;
+
+
+static FF_THREAD_LOCAL int intra_only         = 0;
+static FF_THREAD_LOCAL int file_overwrite     = 0;
+static FF_THREAD_LOCAL int no_file_overwrite  = 0;
+static FF_THREAD_LOCAL int do_psnr            = 0;
+static FF_THREAD_LOCAL int input_sync;
+static FF_THREAD_LOCAL int input_stream_potentially_available = 0;
+static FF_THREAD_LOCAL int ignore_unknown_streams = 0;
+static FF_THREAD_LOCAL int copy_unknown_streams = 0;
+static FF_THREAD_LOCAL int find_stream_info = 1;
+
+/* accessors of the thread-local globals referenced by the options table */
+#define SESSION_OPT(name)                 \
+static void *name ## _ptr(void)           \
+{                                         \
+    return &name;                         \
+}
+
+SESSION_OPT(file_overwrite)
+SESSION_OPT(no_file_overwrite)
+SESSION_OPT(ignore_unknown_streams)
+SESSION_OPT(copy_unknown_streams)
+SESSION_OPT(do_benchmark)
+SESSION_OPT(do_benchmark_all)
+SESSION_OPT(stdin_interaction)
+SESSION_OPT(do_pkt_dump)
+SESSION_OPT(do_hex_dump)
+SESSION_OPT(frame_drop_threshold)
+SESSION_OPT(audio_sync_method)
+SESSION_OPT(audio_drift_threshold)
+SESSION_OPT(copy_ts)
+SESSION_OPT(start_at_zero)
+SESSION_OPT(copy_tb)
+SESSION_OPT(dts_delta_threshold)
+SESSION_OPT(dts_error_threshold)
+SESSION_OPT(exit_on_error)
+SESSION_OPT(filter_nbthreads)
+SESSION_OPT(filter_complex_nbthreads)
+SESSION_OPT(print_stats)
+SESSION_OPT(debug_ts)
+SESSION_OPT(max_error_rate)
+SESSION_OPT(find_stream_info)
+SESSION_OPT(frame_bits_per_raw_sample)
+SESSION_OPT(intra_only)
+SESSION_OPT(do_deinterlace)
+SESSION_OPT(do_psnr)
+SESSION_OPT(vstats_version)
+SESSION_OPT(qp_hist)
+SESSION_OPT(audio_volume)
+SESSION_OPT(input_sync)
+
+void ffmpeg_reset_options(void)
+{
+    audio_drift_threshold     = 0.1;
+    dts_delta_threshold       = 10;
+    dts_error_threshold       = 3600*30;
+
+    audio_volume              = 256;
+    audio_sync_method         = 0;
+    video_sync_method         = VSYNC_AUTO;
+    frame_drop_threshold      = 0;
+    do_deinterlace            = 0;
+    do_benchmark              = 0;
+    do_benchmark_all          = 0;
+    do_hex_dump               = 0;
+    do_pkt_dump               = 0;
+    copy_ts                   = 0;
+    start_at_zero             = 0;
+    copy_tb                   = -1;
+    debug_ts                  = 0;
+    exit_on_error             = 0;
+    abort_on_flags            = 0;
+    print_stats               = -1;
+    qp_hist                   = 0;
+    stdin_interaction         = 1;
+    frame_bits_per_raw_sample = 0;
+    max_error_rate            = 2.0/3;
+    filter_nbthreads          = 0;
+    filter_complex_nbthreads  = 0;
+    vstats_version            = 2;
+
+    intra_only                = 0;
+    file_overwrite            = 0;
+    no_file_overwrite         = 0;
+    do_psnr                   = 0;
+    input_stream_potentially_available = 0;
+    ignore_unknown_streams    = 0;
+    copy_unknown_streams      = 0;
+    find_stream_info          = 1;
+    hide_banner               = 0;
+}
 
 static void uninit_options(OptionsContext *o)
 {
@@ -3367,13 +3448,13 @@ const OptionDef options[] = {
     { "f",              HAS_ARG | OPT_STRING | OPT_OFFSET |
                         OPT_INPUT | OPT_OUTPUT,                      { .off       = OFFSET(format) },
         "force format", "fmt" },
-    { "y",              OPT_BOOL,                                    {              &file_overwrite },
+    { "y",              OPT_BOOL | OPT_SESSION,                      { .var_ptr = file_overwrite_ptr },
         "overwrite output files" },
-    { "n",              OPT_BOOL,                                    {              &no_file_overwrite },
+    { "n",              OPT_BOOL | OPT_SESSION,                      { .var_ptr = no_file_overwrite_ptr },
         "never overwrite output files" },
-    { "ignore_unknown", OPT_BOOL,                                    {              &ignore_unknown_streams },
+    { "ignore_unknown", OPT_BOOL | OPT_SESSION,                      { .var_ptr = ignore_unknown_streams_ptr },
         "Ignore unknown stream types" },
-    { "copy_unknown",   OPT_BOOL | OPT_EXPERT,                       {              &copy_unknown_streams },
+    { "copy_unknown",   OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = copy_unknown_streams_ptr },
         "Copy unknown stream types" },
     { "c",              HAS_ARG | OPT_STRING | OPT_SPEC |
                         OPT_INPUT | OPT_OUTPUT,                      { .off       = OFFSET(codec_names) },
@@ -3432,19 +3513,19 @@ const OptionDef options[] = {
     { "dframes",        HAS_ARG | OPT_PERFILE | OPT_EXPERT |
                         OPT_OUTPUT,                                  { .func_arg = opt_data_frames },
         "set the number of data frames to output", "number" },
-    { "benchmark",      OPT_BOOL | OPT_EXPERT,                       { &do_benchmark },
+    { "benchmark",      OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = do_benchmark_ptr },
         "add timings for benchmarking" },
-    { "benchmark_all",  OPT_BOOL | OPT_EXPERT,                       { &do_benchmark_all },
+    { "benchmark_all",  OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = do_benchmark_all_ptr },
       "add timings for each task" },
     { "progress",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
-    { "stdin",          OPT_BOOL | OPT_EXPERT,                       { &stdin_interaction },
+    { "stdin",          OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = stdin_interaction_ptr },
       "enable or disable interaction on standard input" },
     { "timelimit",      HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_timelimit },
         "set max runtime in seconds", "limit" },
-    { "dump",           OPT_BOOL | OPT_EXPERT,                       { &do_pkt_dump },
+    { "dump",           OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = do_pkt_dump_ptr },
         "dump each input packet" },
-    { "hex",            OPT_BOOL | OPT_EXPERT,                       { &do_hex_dump },
+    { "hex",            OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = do_hex_dump_ptr },
         "when dumping packets, also dump the payload" },
     { "re",             OPT_BOOL | OPT_EXPERT | OPT_OFFSET |
                         OPT_INPUT,                                   { .off = OFFSET(rate_emu) },
@@ -3454,17 +3535,17 @@ const OptionDef options[] = {
         "with optional prefixes \"pal-\", \"ntsc-\" or \"film-\")", "type" },
     { "vsync",          HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_vsync },
         "video sync method", "" },
-    { "frame_drop_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT,      { &frame_drop_threshold },
+    { "frame_drop_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT | OPT_SESSION, { .var_ptr = frame_drop_threshold_ptr },
         "frame drop threshold", "" },
-    { "async",          HAS_ARG | OPT_INT | OPT_EXPERT,              { &audio_sync_method },
+    { "async",          HAS_ARG | OPT_INT | OPT_EXPERT | OPT_SESSION, { .var_ptr = audio_sync_method_ptr },
         "audio sync method", "" },
-    { "adrift_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT,          { &audio_drift_threshold },
+    { "adrift_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT | OPT_SESSION, { .var_ptr = audio_drift_threshold_ptr },
         "audio drift threshold", "threshold" },
-    { "copyts",         OPT_BOOL | OPT_EXPERT,                       { &copy_ts },
+    { "copyts",         OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = copy_ts_ptr },
         "copy timestamps" },
-    { "start_at_zero",  OPT_BOOL | OPT_EXPERT,                       { &start_at_zero },
+    { "start_at_zero",  OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = start_at_zero_ptr },
         "shift input timestamps to start at 0 when using copyts" },
-    { "copytb",         HAS_ARG | OPT_INT | OPT_EXPERT,              { &copy_tb },
+    { "copytb",         HAS_ARG | OPT_INT | OPT_EXPERT | OPT_SESSION, { .var_ptr = copy_tb_ptr },
         "copy input stream time base when stream copying", "mode" },
     { "shortest",       OPT_BOOL | OPT_EXPERT | OPT_OFFSET |
                         OPT_OUTPUT,                                  { .off = OFFSET(shortest) },
@@ -3475,11 +3556,11 @@ const OptionDef options[] = {
     { "apad",           OPT_STRING | HAS_ARG | OPT_SPEC |
                         OPT_OUTPUT,                                  { .off = OFFSET(apad) },
         "audio pad", "" },
-    { "dts_delta_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT,       { &dts_delta_threshold },
+    { "dts_delta_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT | OPT_SESSION, { .var_ptr = dts_delta_threshold_ptr },
         "timestamp discontinuity delta threshold", "threshold" },
-    { "dts_error_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT,       { &dts_error_threshold },
+    { "dts_error_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT | OPT_SESSION, { .var_ptr = dts_error_threshold_ptr },
         "timestamp error delta threshold", "threshold" },
-    { "xerror",         OPT_BOOL | OPT_EXPERT,                       { &exit_on_error },
+    { "xerror",         OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = exit_on_error_ptr },
         "exit on error", "error" },
     { "abort_on",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_abort_on },
         "abort on the specified condition flags", "flags" },
@@ -3503,7 +3584,7 @@ const OptionDef options[] = {
         "set profile", "profile" },
     { "filter",         HAS_ARG | OPT_STRING | OPT_SPEC | OPT_OUTPUT, { .off = OFFSET(filters) },
         "set stream filtergraph", "filter_graph" },
-    { "filter_threads",  HAS_ARG | OPT_INT,                          { &filter_nbthreads },
+    { "filter_threads",  HAS_ARG | OPT_INT | OPT_SESSION,            { .var_ptr = filter_nbthreads_ptr },
         "number of non-complex filter threads" },
     { "filter_script",  HAS_ARG | OPT_STRING | OPT_SPEC | OPT_OUTPUT, { .off = OFFSET(filter_scripts) },
         "read stream filtergraph description from a file", "filename" },
@@ -3511,13 +3592,13 @@ const OptionDef options[] = {
         "reinit filtergraph on input parameter changes", "" },
     { "filter_complex", HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
-    { "filter_complex_threads", HAS_ARG | OPT_INT,                   { &filter_complex_nbthreads },
+    { "filter_complex_threads", HAS_ARG | OPT_INT | OPT_SESSION,     { .var_ptr = filter_complex_nbthreads_ptr },
         "number of threads for -filter_complex" },
     { "lavfi",          HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
     { "filter_complex_script", HAS_ARG | OPT_EXPERT,                 { .func_arg = opt_filter_complex_script },
         "read complex filtergraph description from a file", "filename" },
-    { "stats",          OPT_BOOL,                                    { &print_stats },
+    { "stats",          OPT_BOOL | OPT_SESSION,                      { .var_ptr = print_stats_ptr },
         "print progress report during encoding", },
     { "attach",         HAS_ARG | OPT_PERFILE | OPT_EXPERT |
                         OPT_OUTPUT,                                  { .func_arg = opt_attach },
@@ -3527,9 +3608,9 @@ const OptionDef options[] = {
         "extract an attachment into a file", "filename" },
     { "stream_loop", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_INPUT |
                         OPT_OFFSET,                                  { .off = OFFSET(loop) }, "set number of times input stream shall be looped", "loop count" },
-    { "debug_ts",       OPT_BOOL | OPT_EXPERT,                       { &debug_ts },
+    { "debug_ts",       OPT_BOOL | OPT_EXPERT | OPT_SESSION,         { .var_ptr = debug_ts_ptr },
         "print timestamp debugging info" },
-    { "max_error_rate",  HAS_ARG | OPT_FLOAT,                        { &max_error_rate },
+    { "max_error_rate",  HAS_ARG | OPT_FLOAT | OPT_SESSION,          { .var_ptr = max_error_rate_ptr },
         "ratio of errors (0.0: no errors, 1.0: 100% errors) above which ffmpeg returns an error instead of success.", "maximum error rate" },
     { "discard",        OPT_STRING | HAS_ARG | OPT_SPEC |
                         OPT_INPUT,                                   { .off = OFFSET(discard) },
@@ -3540,7 +3621,7 @@ const OptionDef options[] = {
     { "thread_queue_size", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
                                                                      { .off = OFFSET(thread_queue_size) },
         "set the maximum number of queued packets from the demuxer" },
-    { "find_stream_info", OPT_BOOL | OPT_PERFILE | OPT_INPUT | OPT_EXPERT, { &find_stream_info },
+    { "find_stream_info", OPT_BOOL | OPT_PERFILE | OPT_INPUT | OPT_EXPERT | OPT_SESSION, { .var_ptr = find_stream_info_ptr },
         "read and decode the streams to fill missing information with heuristics" },
 
     /* video options */
@@ -3558,9 +3639,9 @@ const OptionDef options[] = {
     { "pix_fmt",      OPT_VIDEO | HAS_ARG | OPT_EXPERT  | OPT_STRING | OPT_SPEC |
                       OPT_INPUT | OPT_OUTPUT,                                    { .off = OFFSET(frame_pix_fmts) },
         "set pixel format", "format" },
-    { "bits_per_raw_sample", OPT_VIDEO | OPT_INT | HAS_ARG,                      { &frame_bits_per_raw_sample },
+    { "bits_per_raw_sample", OPT_VIDEO | OPT_INT | HAS_ARG | OPT_SESSION,        { .var_ptr = frame_bits_per_raw_sample_ptr },
         "set the number of bits per raw sample", "number" },
-    { "intra",        OPT_VIDEO | OPT_BOOL | OPT_EXPERT,                         { &intra_only },
+    { "intra",        OPT_VIDEO | OPT_BOOL | OPT_EXPERT | OPT_SESSION,           { .var_ptr = intra_only_ptr },
         "deprecated use -g 1" },
     { "vn",           OPT_VIDEO | OPT_BOOL  | OPT_OFFSET | OPT_INPUT | OPT_OUTPUT,{ .off = OFFSET(video_disable) },
         "disable video" },
@@ -3581,15 +3662,15 @@ const OptionDef options[] = {
     { "passlogfile",  OPT_VIDEO | HAS_ARG | OPT_STRING | OPT_EXPERT | OPT_SPEC |
                       OPT_OUTPUT,                                                { .off = OFFSET(passlogfiles) },
         "select two pass log file name prefix", "prefix" },
-    { "deinterlace",  OPT_VIDEO | OPT_BOOL | OPT_EXPERT,                         { &do_deinterlace },
+    { "deinterlace",  OPT_VIDEO | OPT_BOOL | OPT_EXPERT | OPT_SESSION,           { .var_ptr = do_deinterlace_ptr },
         "this option is deprecated, use the yadif filter instead" },
-    { "psnr",         OPT_VIDEO | OPT_BOOL | OPT_EXPERT,                         { &do_psnr },
+    { "psnr",         OPT_VIDEO | OPT_BOOL | OPT_EXPERT | OPT_SESSION,           { .var_ptr = do_psnr_ptr },
         "calculate PSNR of compressed frames" },
     { "vstats",       OPT_VIDEO | OPT_EXPERT ,                                   { .func_arg = opt_vstats },
         "dump video coding statistics to file" },
     { "vstats_file",  OPT_VIDEO | HAS_ARG | OPT_EXPERT ,                         { .func_arg = opt_vstats_file },
         "dump video coding statistics to file", "file" },
-    { "vstats_version",  OPT_VIDEO | OPT_INT | HAS_ARG | OPT_EXPERT ,            { &vstats_version },
+    { "vstats_version",  OPT_VIDEO | OPT_INT | HAS_ARG | OPT_EXPERT | OPT_SESSION, { .var_ptr = vstats_version_ptr },
         "Version of the vstats format to use."},
     { "vf",           OPT_VIDEO | HAS_ARG  | OPT_PERFILE | OPT_OUTPUT,           { .func_arg = opt_video_filters },
         "set video filters", "filter_graph" },
@@ -3608,7 +3689,7 @@ const OptionDef options[] = {
     { "vtag",         OPT_VIDEO | HAS_ARG | OPT_EXPERT  | OPT_PERFILE |
                       OPT_INPUT | OPT_OUTPUT,                                    { .func_arg = opt_old2new },
         "force video tag/fourcc", "fourcc/tag" },
-    { "qphist",       OPT_VIDEO | OPT_BOOL | OPT_EXPERT ,                        { &qp_hist },
+    { "qphist",       OPT_VIDEO | OPT_BOOL | OPT_EXPERT | OPT_SESSION,           { .var_ptr = qp_hist_ptr },
         "show QP histogram" },
     { "force_fps",    OPT_VIDEO | OPT_BOOL | OPT_EXPERT  | OPT_SPEC |
                       OPT_OUTPUT,                                                { .off = OFFSET(force_fps) },
@@ -3660,7 +3741,7 @@ const OptionDef options[] = {
     { "atag",           OPT_AUDIO | HAS_ARG  | OPT_EXPERT | OPT_PERFILE |
                         OPT_OUTPUT,                                                { .func_arg = opt_old2new },
         "force audio tag/fourcc", "fourcc/tag" },
-    { "vol",            OPT_AUDIO | HAS_ARG  | OPT_INT,                            { &audio_volume },
+    { "vol",            OPT_AUDIO | HAS_ARG  | OPT_INT | OPT_SESSION,              { .var_ptr = audio_volume_ptr },
         "change audio volume (256=normal)" , "volume" },
     { "sample_fmt",     OPT_AUDIO | HAS_ARG  | OPT_EXPERT | OPT_SPEC |
                         OPT_STRING | OPT_INPUT | OPT_OUTPUT,                       { .off = OFFSET(sample_fmts) },
@@ -3690,7 +3771,7 @@ const OptionDef options[] = {
         "deprecated, use -channel", "channel" },
     { "tvstd", HAS_ARG | OPT_EXPERT | OPT_VIDEO, { .func_arg = opt_video_standard },
         "deprecated, use -standard", "standard" },
-    { "isync", OPT_BOOL | OPT_EXPERT, { &input_sync }, "this option is deprecated and does nothing", "" },
+    { "isync", OPT_BOOL | OPT_EXPERT | OPT_SESSION, { .var_ptr = input_sync_ptr }, "this option is deprecated and does nothing", "" },
 
     /* muxer options */
     { "muxdelay",   OPT_FLOAT | HAS_ARG | OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT, { .off = OFFSET(mux_max_delay) },
@@ -8,24 +8,126 @@
 #define ALOGI(TAG, FORMAT, ...) __android_log_vprint(ANDROID_LOG_INFO, TAG, FORMAT, ##__VA_ARGS__)
 #define ALOGE(TAG, FORMAT, ...) __android_log_vprint(ANDROID_LOG_ERROR, TAG, FORMAT, ##__VA_ARGS__)
 
-int err_count;
-JNIEnv *ff_env;
-jclass ff_class;
-jmethodID ff_method;
-jmethodID msg_method;
+/**
+ * The Java side of one session: FFmpegCmd's static callbacks,
+ * or the instance callbacks of a com.frank.ffmpeg.FFmpegSession.
+ */
+typedef struct SessionContext {
+    JavaVM *vm;
+    jclass clazz;
+    jobject target;
+    jmethodID progress_method;
+    jmethodID msg_method;
+    int err_count;
+} SessionContext;
 
 void log_callback(void *, int, const char *, va_list);
 
-void init(JNIEnv *env) {
-    ff_env = env;
-    err_count = 0;
-    ff_class = (*env)->FindClass(env, "com/frank/ffmpeg/FFmpegCmd");
-    ff_method = (*env)->GetStaticMethodID(env, ff_class, "onProgressCallback", "(III)V");
-    msg_method = (*env)->GetStaticMethodID(env, ff_class, "onMsgCallback", "(Ljava/lang/String;I)V");
+static JNIEnv *get_env(SessionContext *ctx) {
+    JNIEnv *env = NULL;
+    if (!ctx || !ctx->vm)
+        return NULL;
+    // only the threads attached by Java may call back, e.g. not the input threads
+    if ((*ctx->vm)->GetEnv(ctx->vm, (void **) &env, JNI_VERSION_1_6) != JNI_OK)
+        return NULL;
+    return env;
 }
 
-FFMPEG_FUNC(jint, handle, jobjectArray commands) {
-    init(env);
+static void msg_callback(SessionContext *ctx, const char *format, va_list args, int level) {
+    JNIEnv *env = get_env(ctx);
+    if (!env || !ctx->msg_method)
+        return;
+    char *ff_msg = (char *) malloc(sizeof(char) * INPUT_SIZE);
+    if (!ff_msg)
+        return;
+    vsnprintf(ff_msg, INPUT_SIZE, format, args);
+    jstring jstr = (*env)->NewStringUTF(env, ff_msg);
+    if (jstr) {
+        if (ctx->target)
+            (*env)->CallVoidMethod(env, ctx->target, ctx->msg_method, jstr, level);
+        else
+            (*env)->CallStaticVoidMethod(env, ctx->clazz, ctx->msg_method, jstr, level);
+        (*env)->DeleteLocalRef(env, jstr);
+    }
+    free(ff_msg);
+}
+
+static void session_log_callback(void *opaque, int level, const char *format, va_list args) {
+    SessionContext *ctx = opaque;
+    va_list msg_args;
+    switch (level) {
+        case AV_LOG_INFO:
+            va_copy(msg_args, args);
+            ALOGI(FFMPEG_TAG, format, args);
+            if (format && strncmp("silence", format, 7) == 0) {
+                msg_callback(ctx, format, msg_args, 3);
+            }
+            va_end(msg_args);
+            break;
+        case AV_LOG_ERROR:
+            va_copy(msg_args, args);
+            ALOGE(FFMPEG_TAG, format, args);
+            if (ctx->err_count < 10) {
+                ctx->err_count++;
+                msg_callback(ctx, format, msg_args, 6);
+            }
+            va_end(msg_args);
+            break;
+        default:
+            break;
+    }
+}
+
+static void session_progress_callback(void *opaque, int position, int duration, int state) {
+    SessionContext *ctx = opaque;
+    JNIEnv *env = get_env(ctx);
+    if (!env || !ctx->progress_method)
+        return;
+    if (ctx->target)
+        (*env)->CallVoidMethod(env, ctx->target, ctx->progress_method, position, duration, state);
+    else
+        (*env)->CallStaticVoidMethod(env, ctx->clazz, ctx->progress_method, position, duration, state);
+}
+
+static FFmpegSession *create_session(JNIEnv *env, jclass clazz, jobject target,
+                                     const char *progress_name, const char *msg_name) {
+    FFmpegSession *session = ffmpeg_session_alloc();
+    SessionContext *ctx = (SessionContext *) calloc(1, sizeof(SessionContext));
+    if (!session || !ctx) {
+        ffmpeg_session_free(&session);
+        free(ctx);
+        return NULL;
+    }
+    (*env)->GetJavaVM(env, &ctx->vm);
+    ctx->clazz  = (*env)->NewGlobalRef(env, clazz);
+    ctx->target = target ? (*env)->NewGlobalRef(env, target) : NULL;
+    if (target) {
+        ctx->progress_method = (*env)->GetMethodID(env, clazz, progress_name, "(III)V");
+        ctx->msg_method = (*env)->GetMethodID(env, clazz, msg_name, "(Ljava/lang/String;I)V");
+    } else {
+        ctx->progress_method = (*env)->GetStaticMethodID(env, clazz, progress_name, "(III)V");
+        ctx->msg_method = (*env)->GetStaticMethodID(env, clazz, msg_name, "(Ljava/lang/String;I)V");
+    }
+    session->opaque      = ctx;
+    session->progress_cb = session_progress_callback;
+    session->log_cb      = session_log_callback;
+    return session;
+}
+
+static void release_session(JNIEnv *env, FFmpegSession *session) {
+    if (!session)
+        return;
+    SessionContext *ctx = session->opaque;
+    if (ctx) {
+        (*env)->DeleteGlobalRef(env, ctx->clazz);
+        if (ctx->target)
+            (*env)->DeleteGlobalRef(env, ctx->target);
+        free(ctx);
+    }
+    ffmpeg_session_free(&session);
+}
+
+static int run_session(JNIEnv *env, FFmpegSession *session, jobjectArray commands) {
     // set the level of log
     av_log_set_level(AV_LOG_INFO);
     // set the callback of log, and redirect to print android log
@@ -41,9 +143,11 @@ FFMPEG_FUNC(jint, handle, jobjectArray commands) {
         argv[i] = malloc(INPUT_SIZE);
         strcpy(argv[i], temp);
         (*env)->ReleaseStringUTFChars(env, jstr, temp);
+        (*env)->DeleteLocalRef(env, jstr);
     }
+    ((SessionContext *) session->opaque)->err_count = 0;
     //execute ffmpeg cmd
-    result = run(argc, argv);
+    result = ffmpeg_session_run(session, argc, argv);
     //release memory
     for (i = 0; i < argc; i++) {
         free(argv[i]);
@@ -52,45 +156,56 @@ FFMPEG_FUNC(jint, handle, jobjectArray commands) {
     return result;
 }
 
+FFMPEG_FUNC(jint, handle, jobjectArray commands) {
+    FFmpegSession *session = create_session(env, thiz, NULL, "onProgressCallback", "onMsgCallback");
+    if (!session)
+        return -1;
+    int result = run_session(env, session, commands);
+    release_session(env, session);
+    return result;
+}
+
 FFMPEG_FUNC(void, cancelTaskJni, jint cancel) {
     cancel_task(cancel);
 }
 
-void msg_callback(const char *format, va_list args, int level) {
-    if (ff_env && msg_method) {
-        char *ff_msg = (char *) malloc(sizeof(char) * INPUT_SIZE);
-        if (!ff_msg)
-            return;
-        vsprintf(ff_msg, format, args);
-        jstring jstr = (*ff_env)->NewStringUTF(ff_env, ff_msg);
-        if (jstr)
-            (*ff_env)->CallStaticVoidMethod(ff_env, ff_class, msg_method, jstr, level);
-        free(ff_msg);
-    }
+FFMPEG_SESSION_FUNC(jlong, nativeCreate) {
+    jclass clazz = (*env)->GetObjectClass(env, thiz);
+    FFmpegSession *session = create_session(env, clazz, thiz, "onProgress", "onMsg");
+    (*env)->DeleteLocalRef(env, clazz);
+    return (jlong) (intptr_t) session;
+}
+
+FFMPEG_SESSION_FUNC(jint, nativeExecute, jlong handle, jobjectArray commands) {
+    FFmpegSession *session = (FFmpegSession *) (intptr_t) handle;
+    if (!session)
+        return -1;
+    return run_session(env, session, commands);
+}
+
+FFMPEG_SESSION_FUNC(void, nativeCancel, jlong handle, jint cancel) {
+    ffmpeg_session_cancel((FFmpegSession *) (intptr_t) handle, cancel);
+}
+
+FFMPEG_SESSION_FUNC(void, nativeRelease, jlong handle) {
+    release_session(env, (FFmpegSession *) (intptr_t) handle);
 }
 
 void log_callback(void *ptr, int level, const char *format, va_list args) {
+    FFmpegSession *session = ffmpeg_session_current();
+    if (session && session->log_cb) {
+        session->log_cb(session->opaque, level, format, args);
+        return;
+    }
+    // threads without session, e.g. codec or filter workers
     switch (level) {
         case AV_LOG_INFO:
             ALOGI(FFMPEG_TAG, format, args);
-            if (format && strncmp("silence", format, 7) == 0) {
-                msg_callback(format, args, 3);
-            }
             break;
         case AV_LOG_ERROR:
             ALOGE(FFMPEG_TAG, format, args);
-            if (err_count < 10) {
-                err_count++;
-                msg_callback(format, args, 6);
-            }
             break;
         default:
             break;
     }
 }
-
-void progress_callback(int position, int duration, int state) {
-    if (ff_env && ff_class && ff_method) {
-        (*ff_env)->CallStaticVoidMethod(ff_env, ff_class, ff_method, position, duration, state);
-    }
-}
\ No newline at end of file
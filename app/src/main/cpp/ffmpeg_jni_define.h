@@ -22,6 +22,10 @@ extern "C" { \
     JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_ffmpeg_FFmpegCmd_ ## FUNC_NAME \
     (JNIEnv *env, jclass thiz, ##__VA_ARGS__)\
 
+#define FFMPEG_SESSION_FUNC(RETURN_TYPE, FUNC_NAME, ...) \
+    JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_ffmpeg_FFmpegSession_ ## FUNC_NAME \
+    (JNIEnv *env, jobject thiz, ##__VA_ARGS__)\
+
 #define FFPROBE_FUNC(RETURN_TYPE, FUNC_NAME, ...) \
 extern "C" { \
     JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_ffmpeg_FFmpegCmd_ ## FUNC_NAME \
@@ -34,6 +38,14 @@ extern "C" { \
     JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_ffmpeg_VideoPlayer_ ## FUNC_NAME \
     (JNIEnv *env, jobject thiz, ##__VA_ARGS__)\
 
+#define FF_PLAYER_FUNC(RETURN_TYPE, FUNC_NAME, ...) \
+extern "C" { \
+    JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_ffmpeg_FFPlayer_ ## FUNC_NAME \
+    (JNIEnv *env, jobject thiz, ##__VA_ARGS__);\
+}\
+    JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_ffmpeg_FFPlayer_ ## FUNC_NAME \
+    (JNIEnv *env, jobject thiz, ##__VA_ARGS__)\
+
 #define PUSHER_FUNC(RETURN_TYPE, FUNC_NAME, ...) \
 extern "C" { \
     JNIEXPORT RETURN_TYPE JNICALL Java_com_frank_ffmpeg_FFmpegPusher_ ## FUNC_NAME \
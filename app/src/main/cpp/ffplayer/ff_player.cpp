@@ -0,0 +1,768 @@
+//
+// Multi-threaded audio and video player engine, synchronized to the audio clock.
+//
+
+#include "ff_player.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include "fd_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavutil/channel_layout.h"
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __ANDROID__
+#include "ffmpeg_jni_define.h"
+#else
+#include <cstdio>
+#define LOGI(TAG, FORMAT, ...) printf(FORMAT "\n", ##__VA_ARGS__)
+#define LOGE(TAG, FORMAT, ...) fprintf(stderr, FORMAT "\n", ##__VA_ARGS__)
+#endif
+
+#define PLAYER_TAG "FFPlayer"
+
+// the demuxer stops reading once every stream has as many packets queued
+#define AUDIO_PACKETS_MIN 64
+#define VIDEO_PACKETS_MIN 32
+// hard limit of a packet queue, in case the streams are badly interleaved
+#define PACKET_QUEUE_SIZE 1024
+#define VIDEO_FRAME_QUEUE_SIZE 3
+// decoded audio waiting for the output
+#define AUDIO_RING_MS 200
+// frames later than this are dropped when another one is ready
+#define SYNC_THRESHOLD_US 40000
+// frames later than this are dropped before being queued
+#define DECODE_DROP_US 100000
+// the audio clock moves on between two buffers of the output, at most by one buffer
+#define CLOCK_EXTRAPOLATE_US 20000
+// polling period of the waits which have no notification
+#define WAIT_MS 10
+
+static int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void releasePacket(PlayerPacket &item) {
+    av_packet_free(&item.packet);
+}
+
+static void releaseFrame(PlayerFrame &item) {
+    av_frame_free(&item.frame);
+}
+
+FFPlayer::FFPlayer()
+        : m_audioPackets(PACKET_QUEUE_SIZE),
+          m_videoPackets(PACKET_QUEUE_SIZE),
+          m_videoFrames(VIDEO_FRAME_QUEUE_SIZE),
+          m_renderedFrames(0),
+          m_skippedFrames(0),
+          m_renderTimeUs(0),
+          m_audioSkipTo(0),
+          m_underruns(0),
+          m_audioActive(false) {
+}
+
+FFPlayer::~FFPlayer() {
+    close();
+}
+
+void FFPlayer::setAudioOutput(int type, const char *wavPath) {
+    m_audioSinkType = type;
+    av_freep(&m_wavPath);
+    if (wavPath) {
+        m_wavPath = av_strdup(wavPath);
+    }
+}
+
+int FFPlayer::openCodec(AVStream *stream, AVCodecContext **codecCtx) {
+    AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        LOGE(PLAYER_TAG, "no decoder of stream #%d", stream->index);
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+    *codecCtx = avcodec_alloc_context3(codec);
+    if (!*codecCtx)
+        return AVERROR(ENOMEM);
+    avcodec_parameters_to_context(*codecCtx, stream->codecpar);
+    (*codecCtx)->pkt_timebase = stream->time_base;
+    // frame threads add latency but are what keeps up with 1080p60
+    (*codecCtx)->thread_count = 0;
+    (*codecCtx)->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    int ret = avcodec_open2(*codecCtx, codec, nullptr);
+    if (ret < 0) {
+        LOGE(PLAYER_TAG, "open decoder of stream #%d error=%d", stream->index, ret);
+    }
+    return ret;
+}
+
+int FFPlayer::open(const char *path, int fd, int64_t offset, int64_t length, void *window) {
+    int ret;
+    m_videoSink = VideoSink::create(window);
+    m_formatCtx = avformat_alloc_context();
+    if (!m_formatCtx)
+        return AVERROR(ENOMEM);
+    if (fd >= 0) {
+        m_ioCtx = fd_io_open(fd, offset, length, 0, 0);
+        if (!m_ioCtx) {
+            LOGE(PLAYER_TAG, "fd_io_open error, fd=%d", fd);
+            return -1;
+        }
+        m_formatCtx->pb     = m_ioCtx;
+        m_formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        m_fd     = fd;
+        m_offset = offset;
+    } else if (!path) {
+        return -1;
+    }
+    if (path) {
+        m_path = av_strdup(path);
+    }
+
+    if ((ret = avformat_open_input(&m_formatCtx, path ? path : "", nullptr, nullptr)) < 0) {
+        LOGE(PLAYER_TAG, "avformat_open_input error=%d", ret);
+        return ret;
+    }
+    if ((ret = avformat_find_stream_info(m_formatCtx, nullptr)) < 0) {
+        LOGE(PLAYER_TAG, "avformat_find_stream_info error=%d", ret);
+        return ret;
+    }
+    m_startTime  = m_formatCtx->start_time != AV_NOPTS_VALUE ? m_formatCtx->start_time : 0;
+    m_videoIndex = av_find_best_stream(m_formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    m_audioIndex = av_find_best_stream(m_formatCtx, AVMEDIA_TYPE_AUDIO, -1, m_videoIndex, nullptr, 0);
+    if (m_videoIndex < 0 && m_audioIndex < 0) {
+        LOGE(PLAYER_TAG, "neither audio nor video");
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+
+    if (m_videoIndex >= 0) {
+        if (openCodec(m_formatCtx->streams[m_videoIndex], &m_videoCodecCtx) < 0
+                || m_videoSink->open(m_videoCodecCtx->width, m_videoCodecCtx->height) < 0) {
+            // play the audio only
+            avcodec_free_context(&m_videoCodecCtx);
+            m_videoIndex = -1;
+        }
+    }
+    if (m_audioIndex >= 0) {
+        m_sampleRate = m_formatCtx->streams[m_audioIndex]->codecpar->sample_rate;
+        m_audioSink  = AudioSink::create(m_audioSinkType, m_wavPath);
+        if (m_sampleRate <= 0
+                || openCodec(m_formatCtx->streams[m_audioIndex], &m_audioCodecCtx) < 0
+                || m_audioSink->open(m_sampleRate, m_channels, this) < 0) {
+            // play the video only, on the wall clock
+            avcodec_free_context(&m_audioCodecCtx);
+            delete m_audioSink;
+            m_audioSink  = nullptr;
+            m_audioIndex = -1;
+        }
+    }
+    if (m_videoIndex < 0 && m_audioIndex < 0)
+        return -1;
+    m_frameSize = m_channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
+    LOGI(PLAYER_TAG, "open video #%d, audio #%d, duration=%" PRId64 "ms",
+         m_videoIndex, m_audioIndex, getDuration());
+    return 0;
+}
+
+int FFPlayer::start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_started || !m_formatCtx)
+        return -1;
+    m_started     = true;
+    m_startTimeUs = nowUs();
+    m_audioEnd    = m_audioIndex < 0;
+    m_videoEnd    = m_videoIndex < 0;
+    if (m_audioIndex >= 0) {
+        m_pcmRing.init(static_cast<size_t>(m_sampleRate * m_frameSize / 1000 * AUDIO_RING_MS));
+        m_audioThread = std::thread(&FFPlayer::decodeLoop, this, false);
+    }
+    if (m_videoIndex >= 0) {
+        m_videoThread = std::thread(&FFPlayer::decodeLoop, this, true);
+    }
+    m_demuxThread  = std::thread(&FFPlayer::demuxLoop, this);
+    m_renderThread = std::thread(&FFPlayer::renderLoop, this);
+    if (m_audioSink && !m_paused) {
+        m_audioSink->start();
+    }
+    return 0;
+}
+
+int64_t FFPlayer::framePts(const AVFrame *frame, AVRational timeBase) const {
+    if (frame->best_effort_timestamp == AV_NOPTS_VALUE)
+        return AV_NOPTS_VALUE;
+    return av_rescale_q(frame->best_effort_timestamp, timeBase, AV_TIME_BASE_Q) - m_startTime;
+}
+
+int FFPlayer::currentSerial() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_serial;
+}
+
+void FFPlayer::flushQueues() {
+    m_audioPackets.flush(releasePacket);
+    m_videoPackets.flush(releasePacket);
+    m_videoFrames.flush(releaseFrame);
+}
+
+void FFPlayer::doSeek(int64_t target) {
+    int ret = -1;
+    int64_t timestamp = target + m_startTime;
+    if (m_videoIndex >= 0) {
+        // without container index the file is scanned in the background,
+        // the seeks meanwhile go through avformat_seek_file
+        if (!m_keyIndex) {
+            m_keyIndex = keyframe_index_open(m_formatCtx, m_videoIndex, m_path, m_fd, m_offset,
+                                             KEYFRAME_INDEX_SCAN);
+        }
+        if (m_keyIndex) {
+            AVRational timeBase = m_formatCtx->streams[m_videoIndex]->time_base;
+            int entry = keyframe_index_find(m_keyIndex, av_rescale_q(timestamp, AV_TIME_BASE_Q, timeBase),
+                                            AVSEEK_FLAG_BACKWARD);
+            ret = keyframe_index_seek(m_formatCtx, m_keyIndex, entry >= 0 ? entry : 0);
+        }
+    }
+    if (ret < 0) {
+        ret = avformat_seek_file(m_formatCtx, -1, INT64_MIN, timestamp, timestamp, 0);
+    }
+    if (ret < 0) {
+        LOGE(PLAYER_TAG, "seek to %" PRId64 "us error=%d", target, ret);
+    }
+}
+
+void FFPlayer::demuxLoop() {
+    int ret;
+    AVPacket *packet = av_packet_alloc();
+    while (true) {
+        int serial;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_abort)
+                break;
+            if (m_seekRequest) {
+                int64_t target = m_seekTarget;
+                m_seekRequest  = false;
+                lock.unlock();
+                doSeek(target);
+                continue;
+            }
+            // enough of every stream, don't buffer more
+            if ((m_videoIndex < 0 || m_videoPackets.size() >= VIDEO_PACKETS_MIN)
+                    && (m_audioIndex < 0 || m_audioPackets.size() >= AUDIO_PACKETS_MIN)) {
+                m_cond.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+                continue;
+            }
+            serial = m_serial;
+        }
+
+        ret = av_read_frame(m_formatCtx, packet);
+        if (ret == AVERROR(EAGAIN)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_MS));
+            continue;
+        }
+        if (ret < 0) {
+            // the end, or an error of the source: play out what was read, until a seek
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_serial == serial && !m_seekRequest) {
+                if (ret != AVERROR_EOF) {
+                    LOGE(PLAYER_TAG, "av_read_frame error=%d", ret);
+                }
+                m_demuxEnd = true;
+                m_audioPackets.finish();
+                m_videoPackets.finish();
+                m_cond.wait(lock, [this, serial] { return m_abort || m_serial != serial; });
+            }
+            continue;
+        }
+
+        MediaQueue<PlayerPacket> *queue = nullptr;
+        if (packet->stream_index == m_audioIndex) {
+            queue = &m_audioPackets;
+        } else if (packet->stream_index == m_videoIndex) {
+            queue = &m_videoPackets;
+        }
+        if (!queue) {
+            av_packet_unref(packet);
+            continue;
+        }
+        PlayerPacket item = {av_packet_alloc(), serial};
+        av_packet_move_ref(item.packet, packet);
+        if (!queue->push(item)) {
+            av_packet_free(&item.packet);
+        }
+    }
+    av_packet_free(&packet);
+}
+
+void FFPlayer::decodeLoop(bool video) {
+    int ret;
+    AVCodecContext *codecCtx = video ? m_videoCodecCtx : m_audioCodecCtx;
+    MediaQueue<PlayerPacket> &packets = video ? m_videoPackets : m_audioPackets;
+    AVRational timeBase = m_formatCtx->streams[video ? m_videoIndex : m_audioIndex]->time_base;
+    AVFrame *frame      = av_frame_alloc();
+    int decoderSerial   = -1;
+    int64_t target      = 0;
+
+    while (true) {
+        int serial;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_abort)
+                break;
+            serial = m_serial;
+        }
+        PlayerPacket item = {nullptr, serial};
+        bool end = !packets.pop(item);
+        if (!end) {
+            // queued before a seek
+            if (item.serial < currentSerial()) {
+                av_packet_free(&item.packet);
+                continue;
+            }
+            if (item.serial != decoderSerial) {
+                avcodec_flush_buffers(codecCtx);
+                decoderSerial = item.serial;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                target = m_seekTarget;
+            }
+            ret = avcodec_send_packet(codecCtx, item.packet);
+            av_packet_free(&item.packet);
+            if (ret < 0) {
+                LOGE(PLAYER_TAG, "avcodec_send_packet error=%d", ret);
+            }
+        } else {
+            {
+                // aborted, or sought while waiting
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_abort)
+                    break;
+                if (m_serial != serial)
+                    continue;
+            }
+            if (decoderSerial == serial) {
+                // drain the frames held by the decoder
+                avcodec_send_packet(codecCtx, nullptr);
+            } else {
+                avcodec_flush_buffers(codecCtx);
+                decoderSerial = serial;
+            }
+        }
+
+        while ((ret = avcodec_receive_frame(codecCtx, frame)) == 0) {
+            int64_t pts = framePts(frame, timeBase);
+            if (video) {
+                queueVideo(frame, pts, decoderSerial, target);
+            } else {
+                writeAudio(frame, pts, decoderSerial, target);
+            }
+            av_frame_unref(frame);
+        }
+
+        if (end) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_serial == serial) {
+                if (video) {
+                    m_videoFrames.finish();
+                } else {
+                    m_audioEnd    = true;
+                    m_audioActive = false;
+                }
+                m_cond.notify_all();
+                m_cond.wait(lock, [this, serial] { return m_abort || m_serial != serial; });
+            }
+        }
+    }
+    av_frame_free(&frame);
+}
+
+void FFPlayer::queueVideo(AVFrame *frame, int64_t pts, int serial, int64_t target) {
+    if (pts != AV_NOPTS_VALUE) {
+        // accurate seek: decoded from the key frame, shown from the target
+        if (pts < target)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (serial != m_serial)
+            return;
+        int64_t clock = masterClockLocked(nowUs());
+        if (!m_firstFrame && clock != AV_NOPTS_VALUE && pts < clock - DECODE_DROP_US) {
+            m_stats.frames_dropped_decode++;
+            return;
+        }
+    }
+    PlayerFrame item = {av_frame_alloc(), serial, pts};
+    av_frame_move_ref(item.frame, frame);
+    if (!m_videoFrames.push(item)) {
+        av_frame_free(&item.frame);
+    }
+}
+
+int FFPlayer::writeAudio(AVFrame *frame, int64_t pts, int serial, int64_t target) {
+    uint64_t layout = frame->channel_layout ? frame->channel_layout
+            : static_cast<uint64_t>(av_get_default_channel_layout(frame->channels));
+    if (frame->format != m_swrFormat || frame->sample_rate != m_swrRate || layout != m_swrLayout) {
+        swr_free(&m_swrCtx);
+        m_swrCtx = swr_alloc_set_opts(nullptr, av_get_default_channel_layout(m_channels),
+                                      AV_SAMPLE_FMT_S16, m_sampleRate,
+                                      static_cast<int64_t>(layout),
+                                      static_cast<AVSampleFormat>(frame->format),
+                                      frame->sample_rate, 0, nullptr);
+        if (!m_swrCtx || swr_init(m_swrCtx) < 0) {
+            LOGE(PLAYER_TAG, "swr_init error");
+            swr_free(&m_swrCtx);
+            m_swrFormat = AV_SAMPLE_FMT_NONE;
+            return -1;
+        }
+        m_swrFormat = frame->format;
+        m_swrRate   = frame->sample_rate;
+        m_swrLayout = layout;
+    }
+    int maxSamples = swr_get_out_samples(m_swrCtx, frame->nb_samples);
+    if (m_audioBuffer.size() < static_cast<size_t>(maxSamples * m_frameSize)) {
+        m_audioBuffer.resize(static_cast<size_t>(maxSamples * m_frameSize));
+    }
+    uint8_t *out = m_audioBuffer.data();
+    int samples  = swr_convert(m_swrCtx, &out, maxSamples,
+                               (const uint8_t **) frame->extended_data, frame->nb_samples);
+    if (samples <= 0)
+        return samples;
+
+    // accurate seek: cut what is before the target
+    int skip = 0;
+    if (pts != AV_NOPTS_VALUE && pts < target) {
+        int64_t skipSamples = (target - pts) * m_sampleRate / AV_TIME_BASE;
+        if (skipSamples >= samples)
+            return 0;
+        skip = static_cast<int>(skipSamples);
+    }
+    {
+        // the first audio of a serial anchors the clock, and drops what the ring holds before it
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (serial != m_serial)
+            return 0;
+        if (m_audioSerial != serial) {
+            uint64_t position = m_pcmRing.written();
+            m_audioSerial  = serial;
+            m_audioBasePts = pts != AV_NOPTS_VALUE
+                    ? pts + static_cast<int64_t>(skip) * AV_TIME_BASE / m_sampleRate : target;
+            m_audioBasePos = static_cast<int64_t>(position / m_frameSize);
+            m_audioSkipTo  = position;
+            m_audioActive  = true;
+        }
+    }
+
+    const uint8_t *data = out + skip * m_frameSize;
+    size_t size = static_cast<size_t>((samples - skip) * m_frameSize);
+    while (size > 0) {
+        size_t count = m_pcmRing.tryWrite(data, size);
+        if (count == 0) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_abort || serial != m_serial)
+                    return 0;
+            }
+            if (!m_pcmRing.waitForRoom(std::chrono::milliseconds(WAIT_MS)))
+                return 0;
+            continue;
+        }
+        data += count;
+        size -= count;
+    }
+    return samples - skip;
+}
+
+int FFPlayer::readPcm(uint8_t *buffer, int size) {
+    size_t skipped = m_pcmRing.skipTo(m_audioSkipTo);
+    if (skipped > 0) {
+        m_skippedFrames += skipped / m_frameSize;
+    }
+    int count = static_cast<int>(m_pcmRing.read(buffer, static_cast<size_t>(size)));
+    if (count < size && m_audioActive) {
+        m_underruns++;
+    }
+    return count;
+}
+
+void FFPlayer::onRendered(int frames) {
+    m_renderedFrames += frames;
+    m_renderTimeUs = nowUs();
+}
+
+int64_t FFPlayer::audioClockLocked(int64_t now) {
+    if (m_audioIndex < 0 || m_audioSerial != m_serial)
+        return AV_NOPTS_VALUE;
+    int64_t position = m_renderedFrames + m_skippedFrames;
+    // nothing of this serial heard yet
+    if (position <= m_audioBasePos)
+        return AV_NOPTS_VALUE;
+    int64_t clock = m_audioBasePts + (position - m_audioBasePos) * AV_TIME_BASE / m_sampleRate;
+    if (!m_paused) {
+        clock += std::min(std::max(now - m_renderTimeUs.load(), (int64_t) 0),
+                          (int64_t) CLOCK_EXTRAPOLATE_US);
+    }
+    return clock;
+}
+
+bool FFPlayer::audioDrainedLocked() {
+    if (m_audioIndex < 0)
+        return true;
+    return m_audioEnd && m_renderedFrames + m_skippedFrames
+            >= static_cast<int64_t>(m_pcmRing.written() / m_frameSize);
+}
+
+int64_t FFPlayer::masterClockLocked(int64_t now) {
+    int64_t audio = audioClockLocked(now);
+    if (audio != AV_NOPTS_VALUE && !audioDrainedLocked()) {
+        m_extClock.set(audio, now);
+        return audio;
+    }
+    // wait for the audio to start, unless there is none (left)
+    if (m_audioIndex >= 0 && !m_audioEnd)
+        return AV_NOPTS_VALUE;
+    return m_extClock.get(now);
+}
+
+void FFPlayer::waitCompletionLocked(std::unique_lock<std::mutex> &lock, int serial) {
+    while (!m_abort && m_serial == serial && !m_completed) {
+        if (m_videoEnd && audioDrainedLocked()) {
+            m_completed = true;
+            LOGI(PLAYER_TAG, "completed: rendered=%" PRId64 ", dropped=%" PRId64 "+%" PRId64
+                 ", underruns=%" PRId64, m_stats.frames_rendered, m_stats.frames_dropped,
+                 m_stats.frames_dropped_decode, m_underruns.load());
+            break;
+        }
+        m_cond.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+    }
+    m_cond.wait(lock, [this, serial] { return m_abort || m_serial != serial; });
+}
+
+void FFPlayer::renderLoop() {
+    PlayerFrame item = {nullptr, -1, AV_NOPTS_VALUE};
+    while (true) {
+        int serial;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_abort || !m_paused || m_step; });
+            if (m_abort)
+                break;
+            serial = m_serial;
+            if (m_videoIndex < 0) {
+                waitCompletionLocked(lock, serial);
+                continue;
+            }
+        }
+        if (!item.frame && !m_videoFrames.pop(item)) {
+            // aborted, or all frames shown
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_abort && m_serial == serial) {
+                m_videoEnd = true;
+                waitCompletionLocked(lock, serial);
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (item.serial != m_serial) {
+            lock.unlock();
+            releaseFrame(item);
+            continue;
+        }
+        int64_t now   = nowUs();
+        bool first    = m_firstFrame || m_step;
+        if (first && m_extClock.pts == AV_NOPTS_VALUE && item.pts != AV_NOPTS_VALUE) {
+            // nothing to follow without audio, the clock starts at the first frame
+            m_extClock.set(item.pts, now);
+        }
+        int64_t clock = masterClockLocked(now);
+        int64_t diff  = (clock != AV_NOPTS_VALUE && item.pts != AV_NOPTS_VALUE) ? item.pts - clock : 0;
+        if (!first) {
+            if (clock == AV_NOPTS_VALUE || diff > 0) {
+                // early, or the audio has not started: woken up by seek, pause and release
+                int64_t waitUs = clock == AV_NOPTS_VALUE ? WAIT_MS * 1000 : std::min(diff, (int64_t) WAIT_MS * 1000);
+                m_cond.wait_for(lock, std::chrono::microseconds(waitUs));
+                continue;
+            }
+            if (diff < -SYNC_THRESHOLD_US && m_videoFrames.size() > 0) {
+                m_stats.frames_dropped++;
+                lock.unlock();
+                releaseFrame(item);
+                continue;
+            }
+        }
+        lock.unlock();
+
+        m_videoSink->render(item.frame);
+
+        lock.lock();
+        now = nowUs();
+        m_stats.frames_rendered++;
+        if (clock != AV_NOPTS_VALUE && item.pts != AV_NOPTS_VALUE) {
+            int64_t drift = std::llabs(diff);
+            m_driftSum += drift;
+            m_driftCount++;
+            if (drift > m_stats.max_drift_us) {
+                m_stats.max_drift_us = drift;
+            }
+        }
+        if (m_firstFrame) {
+            if (m_stats.first_frame_us == 0) {
+                m_stats.first_frame_us = now - m_startTimeUs;
+                LOGI(PLAYER_TAG, "first frame in %" PRId64 "us", m_stats.first_frame_us);
+            } else {
+                m_stats.seek_first_frame_us = now - m_seekTimeUs;
+            }
+            m_firstFrame = false;
+        }
+        m_step = false;
+        if (item.pts != AV_NOPTS_VALUE) {
+            m_lastPosition = item.pts;
+        }
+        lock.unlock();
+        releaseFrame(item);
+    }
+    if (item.frame) {
+        releaseFrame(item);
+    }
+}
+
+void FFPlayer::pause() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_paused)
+            return;
+        int64_t now = nowUs();
+        m_extClock.set(m_extClock.get(now), now);
+        m_extClock.paused = true;
+        m_paused = true;
+        m_cond.notify_all();
+    }
+    if (m_audioSink) {
+        m_audioSink->pause();
+    }
+}
+
+void FFPlayer::resume() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_paused)
+            return;
+        int64_t now = nowUs();
+        m_extClock.time   = now;
+        m_extClock.paused = false;
+        m_renderTimeUs    = now;
+        m_paused = false;
+        m_cond.notify_all();
+        if (!m_started)
+            return;
+    }
+    if (m_audioSink) {
+        m_audioSink->start();
+    }
+}
+
+void FFPlayer::seekTo(int64_t positionMs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int64_t target = std::max(positionMs, (int64_t) 0) * 1000;
+    m_serial++;
+    m_seekRequest  = true;
+    m_seekTarget   = target;
+    m_seekTimeUs   = nowUs();
+    m_demuxEnd     = false;
+    m_audioEnd     = m_audioIndex < 0;
+    m_videoEnd     = m_videoIndex < 0;
+    m_completed    = false;
+    m_firstFrame   = true;
+    m_step         = m_paused;
+    m_lastPosition = target;
+    m_extClock.set(AV_NOPTS_VALUE, m_seekTimeUs);
+    m_audioActive  = false;
+    // wakes up the threads blocked on full queues, what they hold is dropped by serial
+    flushQueues();
+    m_cond.notify_all();
+}
+
+int64_t FFPlayer::getCurrentPosition() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int64_t clock = m_started && !m_firstFrame ? masterClockLocked(nowUs()) : AV_NOPTS_VALUE;
+    if (clock == AV_NOPTS_VALUE)
+        return m_lastPosition / 1000;
+    return std::max(clock, (int64_t) 0) / 1000;
+}
+
+int64_t FFPlayer::getDuration() {
+    if (!m_formatCtx || m_formatCtx->duration == AV_NOPTS_VALUE)
+        return 0;
+    return m_formatCtx->duration / 1000;
+}
+
+bool FFPlayer::isCompleted() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completed;
+}
+
+PlayerStats FFPlayer::getStats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PlayerStats stats     = m_stats;
+    stats.audio_underruns = m_underruns;
+    stats.avg_drift_us    = m_driftCount > 0 ? m_driftSum / m_driftCount : 0;
+    return stats;
+}
+
+void FFPlayer::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_abort = true;
+        m_cond.notify_all();
+    }
+    m_audioPackets.abort();
+    m_videoPackets.abort();
+    m_videoFrames.abort();
+    m_pcmRing.abort();
+    if (m_audioSink) {
+        m_audioSink->stop();
+    }
+    for (std::thread *thread : {&m_demuxThread, &m_audioThread, &m_videoThread, &m_renderThread}) {
+        if (thread->joinable()) {
+            thread->join();
+        }
+    }
+    PlayerPacket packet;
+    while (m_audioPackets.drain(packet) || m_videoPackets.drain(packet)) {
+        releasePacket(packet);
+    }
+    PlayerFrame frame;
+    while (m_videoFrames.drain(frame)) {
+        releaseFrame(frame);
+    }
+
+    if (m_started) {
+        PlayerStats stats = getStats();
+        MediaQueueStats packetStats = m_videoPackets.stats();
+        LOGI(PLAYER_TAG, "rendered=%" PRId64 ", dropped=%" PRId64 "+%" PRId64 ", underruns=%" PRId64
+             ", first frame=%" PRId64 "us, seek=%" PRId64 "us, drift avg=%" PRId64 "us max=%" PRId64 "us",
+             stats.frames_rendered, stats.frames_dropped, stats.frames_dropped_decode,
+             stats.audio_underruns, stats.first_frame_us, stats.seek_first_frame_us,
+             stats.avg_drift_us, stats.max_drift_us);
+        LOGI(PLAYER_TAG, "video packets: depth max=%zu avg=%.1f, stall push=%" PRId64 "us pop=%" PRId64 "us",
+             packetStats.max_depth, packetStats.avg_depth, packetStats.push_stall_us, packetStats.pop_stall_us);
+        m_started = false;
+    }
+
+    delete m_audioSink;
+    m_audioSink = nullptr;
+    delete m_videoSink;
+    m_videoSink = nullptr;
+    swr_free(&m_swrCtx);
+    avcodec_free_context(&m_audioCodecCtx);
+    avcodec_free_context(&m_videoCodecCtx);
+    keyframe_index_close(&m_keyIndex);
+    avformat_close_input(&m_formatCtx);
+    fd_io_close(&m_ioCtx);
+    av_freep(&m_path);
+    av_freep(&m_wavPath);
+}
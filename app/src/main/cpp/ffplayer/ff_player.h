@@ -0,0 +1,230 @@
+//
+// Multi-threaded audio and video player engine, synchronized to the audio clock.
+//
+
+#ifndef FF_PLAYER_H
+#define FF_PLAYER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ff_audio_sink.h"
+#include "ff_media_queue.h"
+#include "ff_pcm_ring.h"
+#include "ff_video_sink.h"
+#include "keyframe_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libswresample/swresample.h"
+#ifdef __cplusplus
+}
+#endif
+
+struct PlayerStats {
+    int64_t frames_rendered;
+    int64_t frames_dropped;        // too late to show, dropped by the render thread
+    int64_t frames_dropped_decode; // far behind the clock, dropped right after decoding
+    int64_t audio_underruns;       // the output asked for more than the decoder had ready
+    int64_t first_frame_us;        // from start() to the first frame shown
+    int64_t seek_first_frame_us;   // from the last seekTo() to its first frame shown
+    int64_t avg_drift_us;          // |video - audio| when frames are shown
+    int64_t max_drift_us;
+};
+
+/**
+ * Tagged with the serial of the seek it was demuxed after,
+ * so that what was queued before a seek can be told apart and dropped.
+ */
+struct PlayerPacket {
+    AVPacket *packet;
+    int serial;
+};
+
+struct PlayerFrame {
+    AVFrame *frame;
+    int serial;
+    int64_t pts; // microseconds from the start of the media
+};
+
+/**
+ * Wall clock which can be paused, used when there is no audio to follow.
+ */
+struct PlayerClock {
+    int64_t pts  = AV_NOPTS_VALUE;
+    int64_t time = 0;
+    bool paused  = false;
+
+    void set(int64_t value, int64_t now) {
+        pts  = value;
+        time = now;
+    }
+
+    int64_t get(int64_t now) const {
+        if (pts == AV_NOPTS_VALUE)
+            return AV_NOPTS_VALUE;
+        return paused ? pts : pts + now - time;
+    }
+};
+
+/**
+ * demux thread -> packet queues -> audio decode thread -> PCM ring -> audio sink
+ *                               -> video decode thread -> frame queue -> render thread -> video sink
+ * The render thread shows each frame when the audio clock reaches it, and drops the late ones.
+ * Seeking bumps the serial and flushes the queues, stale packets and frames are dropped on the way.
+ */
+class FFPlayer : public AudioSinkSource {
+private:
+
+    AVFormatContext *m_formatCtx = nullptr;
+    AVIOContext *m_ioCtx         = nullptr;
+    AVCodecContext *m_audioCodecCtx = nullptr;
+    AVCodecContext *m_videoCodecCtx = nullptr;
+    int m_audioIndex = -1;
+    int m_videoIndex = -1;
+    int64_t m_startTime = 0;
+    char *m_path = nullptr;
+    int m_fd     = -1;
+    int64_t m_offset = 0;
+    KeyFrameIndex *m_keyIndex = nullptr;
+
+    MediaQueue<PlayerPacket> m_audioPackets;
+    MediaQueue<PlayerPacket> m_videoPackets;
+    MediaQueue<PlayerFrame> m_videoFrames;
+
+    // audio output, s16 interleaved at the rate of the source
+    int m_sampleRate = 0;
+    int m_channels   = 2;
+    int m_frameSize  = 4;
+    SwrContext *m_swrCtx = nullptr;
+    // input of m_swrCtx, following the decoded frames
+    int m_swrFormat   = AV_SAMPLE_FMT_NONE;
+    int m_swrRate     = 0;
+    uint64_t m_swrLayout = 0;
+    std::vector<uint8_t> m_audioBuffer;
+    PcmRing m_pcmRing;
+    AudioSink *m_audioSink = nullptr;
+    int m_audioSinkType    = AUDIO_SINK_OPENSL;
+    char *m_wavPath        = nullptr;
+    std::atomic<int64_t> m_renderedFrames;
+    std::atomic<int64_t> m_skippedFrames;
+    std::atomic<int64_t> m_renderTimeUs;
+    std::atomic<uint64_t> m_audioSkipTo;
+    std::atomic<int64_t> m_underruns;
+    // audio of the current serial is flowing, a short read is an underrun
+    std::atomic<bool> m_audioActive;
+
+    VideoSink *m_videoSink = nullptr;
+
+    std::thread m_demuxThread;
+    std::thread m_audioThread;
+    std::thread m_videoThread;
+    std::thread m_renderThread;
+
+    // all below guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_started   = false;
+    bool m_abort     = false;
+    bool m_paused    = false;
+    bool m_step      = false; // show one frame while paused, after seeking
+    int m_serial     = 0;
+    bool m_seekRequest = false;
+    int64_t m_seekTarget = 0;
+    int64_t m_seekTimeUs = 0;
+    bool m_demuxEnd  = false;
+    bool m_audioEnd  = false;
+    bool m_videoEnd  = false;
+    bool m_completed = false;
+    // where the audio of m_audioSerial starts in the ring, in frames
+    int m_audioSerial    = -1;
+    int64_t m_audioBasePts = 0;
+    int64_t m_audioBasePos = 0;
+    PlayerClock m_extClock;
+    int64_t m_lastPosition = 0;
+    int64_t m_startTimeUs  = 0;
+    bool m_firstFrame      = true;
+    int64_t m_driftSum   = 0;
+    int64_t m_driftCount = 0;
+    PlayerStats m_stats  = {0, 0, 0, 0, 0, 0, 0, 0};
+
+    static int openCodec(AVStream *stream, AVCodecContext **codecCtx);
+
+    int64_t framePts(const AVFrame *frame, AVRational timeBase) const;
+
+    int currentSerial();
+
+    int64_t masterClockLocked(int64_t now);
+
+    int64_t audioClockLocked(int64_t now);
+
+    bool audioDrainedLocked();
+
+    void waitCompletionLocked(std::unique_lock<std::mutex> &lock, int serial);
+
+    void doSeek(int64_t target);
+
+    void demuxLoop();
+
+    void decodeLoop(bool video);
+
+    void renderLoop();
+
+    void queueVideo(AVFrame *frame, int64_t pts, int serial, int64_t target);
+
+    int writeAudio(AVFrame *frame, int64_t pts, int serial, int64_t target);
+
+    void flushQueues();
+
+public:
+
+    FFPlayer();
+
+    ~FFPlayer() override;
+
+    /**
+     * Select the output before open(): AUDIO_SINK_OPENSL, AUDIO_SINK_NULL or AUDIO_SINK_WAV.
+     */
+    void setAudioOutput(int type, const char *wavPath);
+
+    /**
+     * @param fd     read [offset, offset + length) of fd when >= 0, otherwise path is opened
+     * @param window an ANativeWindow owned by the player from now on, null for no video output
+     */
+    int open(const char *path, int fd, int64_t offset, int64_t length, void *window);
+
+    int start();
+
+    void pause();
+
+    void resume();
+
+    /**
+     * Accurate: the frames before position are decoded but not shown.
+     */
+    void seekTo(int64_t positionMs);
+
+    int64_t getCurrentPosition();
+
+    int64_t getDuration();
+
+    /**
+     * Played to the end of every stream.
+     */
+    bool isCompleted();
+
+    PlayerStats getStats();
+
+    int readPcm(uint8_t *buffer, int size) override;
+
+    void onRendered(int frames) override;
+
+    void close();
+};
+
+#endif //FF_PLAYER_H
@@ -0,0 +1,100 @@
+//
+// JNI of FFPlayer.
+//
+
+#include <jni.h>
+#include <android/native_window_jni.h>
+#include "ff_player.h"
+#include "ffmpeg_jni_define.h"
+
+FF_PLAYER_FUNC(long, native_1init) {
+    auto *player = new FFPlayer();
+    return (long) player;
+}
+
+FF_PLAYER_FUNC(jint, native_1open, long context, jstring path, jint fd, jlong offset, jlong length,
+               jobject surface, jint output, jstring wavPath) {
+    auto *player = (FFPlayer *) context;
+    if (!player)
+        return -1;
+    const char *native_path = path ? env->GetStringUTFChars(path, JNI_FALSE) : nullptr;
+    const char *wav_path    = wavPath ? env->GetStringUTFChars(wavPath, JNI_FALSE) : nullptr;
+    ANativeWindow *window   = surface ? ANativeWindow_fromSurface(env, surface) : nullptr;
+    player->setAudioOutput(output, wav_path);
+    int ret = player->open(native_path, fd, offset, length, window);
+    if (native_path) {
+        env->ReleaseStringUTFChars(path, native_path);
+    }
+    if (wav_path) {
+        env->ReleaseStringUTFChars(wavPath, wav_path);
+    }
+    return ret;
+}
+
+FF_PLAYER_FUNC(jint, native_1start, long context) {
+    auto *player = (FFPlayer *) context;
+    if (!player)
+        return -1;
+    return player->start();
+}
+
+FF_PLAYER_FUNC(void, native_1pause, long context) {
+    auto *player = (FFPlayer *) context;
+    if (player) {
+        player->pause();
+    }
+}
+
+FF_PLAYER_FUNC(void, native_1resume, long context) {
+    auto *player = (FFPlayer *) context;
+    if (player) {
+        player->resume();
+    }
+}
+
+FF_PLAYER_FUNC(void, native_1seek, long context, jlong position) {
+    auto *player = (FFPlayer *) context;
+    if (player) {
+        player->seekTo(position);
+    }
+}
+
+FF_PLAYER_FUNC(long, native_1get_1position, long context) {
+    auto *player = (FFPlayer *) context;
+    if (!player)
+        return 0;
+    return player->getCurrentPosition();
+}
+
+FF_PLAYER_FUNC(long, native_1get_1duration, long context) {
+    auto *player = (FFPlayer *) context;
+    if (!player)
+        return 0;
+    return player->getDuration();
+}
+
+FF_PLAYER_FUNC(jboolean, native_1is_1completed, long context) {
+    auto *player = (FFPlayer *) context;
+    return static_cast<jboolean>(player && player->isCompleted());
+}
+
+FF_PLAYER_FUNC(jlongArray, native_1get_1stats, long context) {
+    auto *player = (FFPlayer *) context;
+    if (!player)
+        return nullptr;
+    PlayerStats stats = player->getStats();
+    jlong values[] = {stats.frames_rendered, stats.frames_dropped, stats.frames_dropped_decode,
+                      stats.audio_underruns, stats.first_frame_us, stats.seek_first_frame_us,
+                      stats.avg_drift_us, stats.max_drift_us};
+    jlongArray result = env->NewLongArray(8);
+    env->SetLongArrayRegion(result, 0, 8, values);
+    return result;
+}
+
+FF_PLAYER_FUNC(void, native_1release, long context) {
+    auto *player = (FFPlayer *) context;
+    if (!player)
+        return;
+    player->close();
+    delete player;
+}
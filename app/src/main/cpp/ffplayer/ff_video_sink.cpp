@@ -0,0 +1,91 @@
+//
+// Video outputs of FFPlayer: ANativeWindow on device, null for benchmarks.
+//
+
+#include "ff_video_sink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libswscale/swscale.h"
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __ANDROID__
+#include <android/native_window.h>
+#include "ffmpeg_jni_define.h"
+
+#define SINK_TAG "VideoSink"
+
+/**
+ * Converted into RGBA straight in the buffer of the window.
+ */
+class WindowVideoSink : public VideoSink {
+private:
+
+    ANativeWindow *m_window;
+    SwsContext *m_swsCtx = nullptr;
+    int m_width  = 0;
+    int m_height = 0;
+
+public:
+
+    explicit WindowVideoSink(ANativeWindow *window) : m_window(window) {}
+
+    ~WindowVideoSink() override {
+        sws_freeContext(m_swsCtx);
+        ANativeWindow_release(m_window);
+    }
+
+    int open(int width, int height) override {
+        m_width  = width;
+        m_height = height;
+        return ANativeWindow_setBuffersGeometry(m_window, width, height, WINDOW_FORMAT_RGBA_8888);
+    }
+
+    int render(const AVFrame *frame) override {
+        m_swsCtx = sws_getCachedContext(m_swsCtx, frame->width, frame->height,
+                                        static_cast<AVPixelFormat>(frame->format),
+                                        m_width, m_height, AV_PIX_FMT_RGBA,
+                                        SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (!m_swsCtx)
+            return -1;
+        ANativeWindow_Buffer buffer;
+        if (ANativeWindow_lock(m_window, &buffer, nullptr) < 0) {
+            LOGE(SINK_TAG, "ANativeWindow_lock error");
+            return -1;
+        }
+        uint8_t *dst[4]   = {static_cast<uint8_t *>(buffer.bits), nullptr, nullptr, nullptr};
+        int dstStride[4]  = {buffer.stride * 4, 0, 0, 0};
+        sws_scale(m_swsCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+        return ANativeWindow_unlockAndPost(m_window);
+    }
+};
+
+#endif
+
+/**
+ * Drops the frames, so the engine can be measured without a display.
+ */
+class NullVideoSink : public VideoSink {
+public:
+
+    int open(int /* width */, int /* height */) override {
+        return 0;
+    }
+
+    int render(const AVFrame * /* frame */) override {
+        return 0;
+    }
+};
+
+VideoSink *VideoSink::create(void *window) {
+#ifdef __ANDROID__
+    if (window)
+        return new WindowVideoSink(static_cast<ANativeWindow *>(window));
+#else
+    (void) window;
+#endif
+    return new NullVideoSink();
+}
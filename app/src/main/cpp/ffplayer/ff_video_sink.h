@@ -0,0 +1,36 @@
+//
+// Video outputs of FFPlayer: ANativeWindow on device, null for benchmarks.
+//
+
+#ifndef FF_VIDEO_SINK_H
+#define FF_VIDEO_SINK_H
+
+#include <cstdint>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavutil/frame.h"
+#ifdef __cplusplus
+}
+#endif
+
+class VideoSink {
+public:
+
+    /**
+     * @param window an ANativeWindow, which is released with the sink, or null for no output
+     */
+    static VideoSink *create(void *window);
+
+    virtual ~VideoSink() = default;
+
+    virtual int open(int width, int height) = 0;
+
+    /**
+     * Show a decoded frame, called on the render thread.
+     */
+    virtual int render(const AVFrame *frame) = 0;
+};
+
+#endif //FF_VIDEO_SINK_H
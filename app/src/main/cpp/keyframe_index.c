@@ -0,0 +1,487 @@
+//
+// Persisted key frame index, shared by the retriever, CutVideo and the players.
+//
+
+#include "keyframe_index.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fd_io.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGE(FORMAT, ...) __android_log_print(ANDROID_LOG_ERROR, "KeyFrameIndex", FORMAT, ##__VA_ARGS__)
+#else
+#define LOGE(FORMAT, ...) fprintf(stderr, FORMAT, ##__VA_ARGS__)
+#endif
+
+#define INDEX_MAGIC   0x3149464b // "KFI1"
+#define INDEX_VERSION 1
+#define INDEX_NAME_SIZE 256
+// sidecars scanned by this process, each source is scanned once
+#define MAX_SCANS 64
+
+typedef struct KeyFrameIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    int64_t  file_size;
+    int64_t  file_mtime;
+    int32_t  stream_index;
+    int32_t  time_base_num;
+    int32_t  time_base_den;
+    int32_t  count;
+    char     name[INDEX_NAME_SIZE];
+} KeyFrameIndexHeader;
+
+typedef struct SourceId {
+    char    name[INDEX_NAME_SIZE];
+    int64_t size;
+    int64_t mtime;
+} SourceId;
+
+/* a scan in the background, which only persists its result */
+typedef struct ScanTask {
+    char    *path; // NULL for fd
+    int      fd;   // a dup of the caller's, -1 for path
+    int64_t  offset;
+    int      stream_index;
+    SourceId id;
+    char     file[PATH_MAX + 32];
+} ScanTask;
+
+static char cache_dir[PATH_MAX];
+
+static pthread_mutex_t scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t scanned[MAX_SCANS];
+static int scanned_next;
+
+void keyframe_index_set_cache_dir(const char *dir) {
+    if (!dir) {
+        cache_dir[0] = '\0';
+        return;
+    }
+    snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
+}
+
+static int get_source_id(const char *path, int fd, int64_t offset, SourceId *id) {
+    struct stat st;
+
+    memset(id, 0, sizeof(SourceId));
+    if (fd >= 0) {
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return -1;
+        }
+        // the path of a descriptor is unknown, the inode identifies the file
+        snprintf(id->name, sizeof(id->name), "inode:%llu:%llu:%lld",
+                 (unsigned long long) st.st_dev, (unsigned long long) st.st_ino, (long long) offset);
+    } else {
+        if (!path || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return -1;
+        }
+        snprintf(id->name, sizeof(id->name), "%s:%lld", path, (long long) offset);
+    }
+    id->size  = st.st_size;
+    id->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+// FNV-1a
+static uint64_t hash_string(const char *str) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const char *p;
+    for (p = str; *p; p++) {
+        hash ^= (uint8_t) *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void get_sidecar_path(const SourceId *id, int stream_index, char *out, size_t size) {
+    snprintf(out, size, "%s/%016llx_%d.kfi", cache_dir, (unsigned long long) hash_string(id->name), stream_index);
+}
+
+static int compare_entry(const void *a, const void *b) {
+    int64_t pts_a = ((const KeyFrameEntry *) a)->pts;
+    int64_t pts_b = ((const KeyFrameEntry *) b)->pts;
+    return pts_a < pts_b ? -1 : (pts_a > pts_b ? 1 : 0);
+}
+
+static KeyFrameIndex *load_sidecar(const char *file, const SourceId *id, int stream_index) {
+    struct stat st;
+    const KeyFrameIndexHeader *header;
+    KeyFrameIndex *index;
+    void *map;
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(KeyFrameIndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    header = (const KeyFrameIndexHeader *) map;
+    if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION
+        || header->file_size != id->size || header->file_mtime != id->mtime
+        || header->stream_index != stream_index || header->count <= 0
+        || strncmp(header->name, id->name, INDEX_NAME_SIZE) != 0
+        || (size_t) st.st_size != sizeof(KeyFrameIndexHeader) + header->count * sizeof(KeyFrameEntry)) {
+        munmap(map, (size_t) st.st_size);
+        return NULL;
+    }
+
+    index = av_mallocz(sizeof(KeyFrameIndex));
+    if (!index) {
+        munmap(map, (size_t) st.st_size);
+        return NULL;
+    }
+    index->stream_index  = stream_index;
+    index->time_base.num = header->time_base_num;
+    index->time_base.den = header->time_base_den;
+    index->count    = header->count;
+    index->entries  = (const KeyFrameEntry *) ((const uint8_t *) map + sizeof(KeyFrameIndexHeader));
+    index->map      = map;
+    index->map_size = (size_t) st.st_size;
+    return index;
+}
+
+static void save_sidecar(const char *file, const SourceId *id, const KeyFrameIndex *index) {
+    char tmp[PATH_MAX + 48];
+    KeyFrameIndexHeader header;
+    size_t size = index->count * sizeof(KeyFrameEntry);
+    FILE *fp;
+    int fd;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    header.magic         = INDEX_MAGIC;
+    header.version       = INDEX_VERSION;
+    header.file_size     = id->size;
+    header.file_mtime    = id->mtime;
+    header.stream_index  = index->stream_index;
+    header.time_base_num = index->time_base.num;
+    header.time_base_den = index->time_base.den;
+    header.count         = index->count;
+    memcpy(header.name, id->name, INDEX_NAME_SIZE);
+
+    // write aside and rename, so that readers never map a partial file,
+    // the temporary name is unique to each writer
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", file);
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        LOGE("fail to create %s\n", tmp);
+        return;
+    }
+    fp = fdopen(fd, "wb");
+    if (!fp) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1
+         && fwrite(index->entries, 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, file) != 0) {
+        unlink(tmp);
+    }
+}
+
+static int append_entry(KeyFrameEntry **entries, int *count, int *capacity, const KeyFrameEntry *entry) {
+    if (*count == *capacity) {
+        int new_capacity = *capacity > 0 ? *capacity * 2 : 256;
+        KeyFrameEntry *grown = av_realloc_array(*entries, new_capacity, sizeof(KeyFrameEntry));
+        if (!grown) {
+            return AVERROR(ENOMEM);
+        }
+        *entries  = grown;
+        *capacity = new_capacity;
+    }
+    (*entries)[(*count)++] = *entry;
+    return 0;
+}
+
+/* mp4 and alike index every sample, which gives the key frames without reading packets */
+static int build_from_container(AVStream *st, KeyFrameEntry **entries, int *capacity) {
+    int i;
+    int count = 0;
+    int full = 0;
+    int64_t shift = 0;
+
+    for (i = 0; i < st->nb_index_entries; i++) {
+        if (!(st->index_entries[i].flags & AVINDEX_KEYFRAME)) {
+            full = 1;
+            break;
+        }
+    }
+    if (!full) {
+        return 0;
+    }
+    // index timestamps are dts, key frames are delayed as much as the first one
+    if (st->start_time != AV_NOPTS_VALUE) {
+        shift = st->start_time - st->index_entries[0].timestamp;
+    }
+    for (i = 0; i < st->nb_index_entries; i++) {
+        const AVIndexEntry *ie = &st->index_entries[i];
+        if (ie->flags & AVINDEX_KEYFRAME) {
+            KeyFrameEntry entry = {ie->timestamp + shift, ie->timestamp, ie->pos, 1, 0};
+            if (append_entry(entries, &count, capacity, &entry) < 0) {
+                return AVERROR(ENOMEM);
+            }
+        } else if (count > 0) {
+            (*entries)[count - 1].gop_size++;
+        }
+    }
+    return count;
+}
+
+/* reads every packet, fmt_ctx is the scan's own */
+static int build_from_scan(AVFormatContext *fmt_ctx, int stream_index, KeyFrameEntry **entries, int *capacity) {
+    unsigned int i;
+    int count = 0;
+    int ret = 0;
+    AVPacket *pkt;
+
+    pkt = av_packet_alloc();
+    if (!pkt) {
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < fmt_ctx->nb_streams; i++) {
+        if ((int) i != stream_index) {
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    while (ret >= 0 && av_read_frame(fmt_ctx, pkt) >= 0) {
+        if (pkt->stream_index == stream_index) {
+            if (pkt->flags & AV_PKT_FLAG_KEY) {
+                KeyFrameEntry entry;
+                entry.pts      = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                entry.dts      = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+                entry.pos      = pkt->pos;
+                entry.gop_size = 1;
+                entry.reserved = 0;
+                if (entry.pts != AV_NOPTS_VALUE) {
+                    ret = append_entry(entries, &count, capacity, &entry);
+                }
+            } else if (count > 0) {
+                (*entries)[count - 1].gop_size++;
+            }
+        }
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    return ret < 0 ? ret : count;
+}
+
+static void *scan_thread(void *arg) {
+    ScanTask *task = arg;
+    AVFormatContext *fmt_ctx = avformat_alloc_context();
+    AVIOContext *pb = NULL;
+    KeyFrameEntry *entries = NULL;
+    KeyFrameIndex index;
+    int capacity = 0;
+    int count = 0;
+
+    if (fmt_ctx && task->fd >= 0) {
+        pb = fd_io_open(task->fd, task->offset, 0, 0, 0);
+        if (pb) {
+            fmt_ctx->pb     = pb;
+            fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+    } else if (fmt_ctx) {
+        fmt_ctx->skip_initial_bytes = task->offset;
+    }
+    if (fmt_ctx && (task->fd < 0 || pb)
+        && avformat_open_input(&fmt_ctx, task->path ? task->path : "", NULL, NULL) == 0) {
+        if (avformat_find_stream_info(fmt_ctx, NULL) >= 0
+            && task->stream_index < (int) fmt_ctx->nb_streams) {
+            count = build_from_scan(fmt_ctx, task->stream_index, &entries, &capacity);
+        }
+        if (count > 0) {
+            qsort(entries, count, sizeof(KeyFrameEntry), compare_entry);
+            memset(&index, 0, sizeof(index));
+            index.stream_index = task->stream_index;
+            index.time_base    = fmt_ctx->streams[task->stream_index]->time_base;
+            index.count        = count;
+            index.entries      = entries;
+            save_sidecar(task->file, &task->id, &index);
+        }
+        avformat_close_input(&fmt_ctx);
+    }
+    avformat_free_context(fmt_ctx);
+    fd_io_close(&pb);
+    if (task->fd >= 0) {
+        close(task->fd);
+    }
+    av_free(entries);
+    av_free(task->path);
+    av_free(task);
+    return NULL;
+}
+
+/* scan the source on a thread of its own, once per process, the next open maps the sidecar */
+static void start_scan(const char *path, int fd, int64_t offset, int stream_index,
+                       const SourceId *id, const char *file) {
+    uint64_t hash = hash_string(file);
+    pthread_attr_t attr;
+    pthread_t thread;
+    ScanTask *task;
+    int i;
+
+    pthread_mutex_lock(&scan_lock);
+    for (i = 0; i < MAX_SCANS; i++) {
+        if (scanned[i] == hash) {
+            pthread_mutex_unlock(&scan_lock);
+            return;
+        }
+    }
+    scanned[scanned_next] = hash;
+    scanned_next = (scanned_next + 1) % MAX_SCANS;
+    pthread_mutex_unlock(&scan_lock);
+
+    task = av_mallocz(sizeof(ScanTask));
+    if (!task) {
+        return;
+    }
+    task->fd           = fd >= 0 ? dup(fd) : -1;
+    task->path         = fd < 0 ? av_strdup(path) : NULL;
+    task->offset       = offset;
+    task->stream_index = stream_index;
+    task->id           = *id;
+    snprintf(task->file, sizeof(task->file), "%s", file);
+    if ((fd >= 0 && task->fd < 0) || (fd < 0 && !task->path)) {
+        av_free(task->path);
+        av_free(task);
+        return;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, scan_thread, task) != 0) {
+        LOGE("fail to start the scan of %s\n", id->name);
+        if (task->fd >= 0) {
+            close(task->fd);
+        }
+        av_free(task->path);
+        av_free(task);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+KeyFrameIndex *keyframe_index_open(AVFormatContext *fmt_ctx, int stream_index,
+                                   const char *path, int fd, int64_t offset, int flags) {
+    SourceId id;
+    char file[PATH_MAX + 32];
+    KeyFrameIndex *index;
+    KeyFrameEntry *entries = NULL;
+    int capacity = 0;
+    int count;
+    AVStream *st;
+
+    if (!fmt_ctx || stream_index < 0 || stream_index >= (int) fmt_ctx->nb_streams) {
+        return NULL;
+    }
+    if (get_source_id(path, fd, offset, &id) < 0) {
+        return NULL;
+    }
+    if (cache_dir[0]) {
+        get_sidecar_path(&id, stream_index, file, sizeof(file));
+        index = load_sidecar(file, &id, stream_index);
+        if (index) {
+            return index;
+        }
+    }
+
+    st = fmt_ctx->streams[stream_index];
+    count = build_from_container(st, &entries, &capacity);
+    if (count == 0 && (flags & KEYFRAME_INDEX_SCAN) && cache_dir[0]
+        && fmt_ctx->pb && (fmt_ctx->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+        start_scan(path, fd, offset, stream_index, &id, file);
+    }
+    if (count <= 0) {
+        av_free(entries);
+        return NULL;
+    }
+    qsort(entries, count, sizeof(KeyFrameEntry), compare_entry);
+
+    index = av_mallocz(sizeof(KeyFrameIndex));
+    if (!index) {
+        av_free(entries);
+        return NULL;
+    }
+    index->stream_index = stream_index;
+    index->time_base    = st->time_base;
+    index->count        = count;
+    index->entries      = entries;
+    index->heap         = entries;
+    if (cache_dir[0]) {
+        save_sidecar(file, &id, index);
+    }
+    return index;
+}
+
+int keyframe_index_find(const KeyFrameIndex *index, int64_t pts, int flags) {
+    int low = 0;
+    int high;
+
+    if (!index || index->count <= 0) {
+        return -1;
+    }
+    // first entry after pts
+    high = index->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (index->entries[mid].pts <= pts) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (flags & AVSEEK_FLAG_BACKWARD) {
+        return low - 1;
+    }
+    if (low > 0 && index->entries[low - 1].pts == pts) {
+        return low - 1;
+    }
+    return low < index->count ? low : -1;
+}
+
+int keyframe_index_seek(AVFormatContext *fmt_ctx, const KeyFrameIndex *index, int entry) {
+    const KeyFrameEntry *key;
+    int ret;
+
+    if (!index || entry < 0 || entry >= index->count) {
+        return AVERROR(EINVAL);
+    }
+    key = &index->entries[entry];
+    // demuxers index by dts
+    ret = av_seek_frame(fmt_ctx, index->stream_index, key->dts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0 && key->pos >= 0) {
+        ret = av_seek_frame(fmt_ctx, index->stream_index, key->pos, AVSEEK_FLAG_BYTE);
+    }
+    return ret;
+}
+
+void keyframe_index_close(KeyFrameIndex **index) {
+    if (!index || !*index) {
+        return;
+    }
+    if ((*index)->map) {
+        munmap((*index)->map, (*index)->map_size);
+    }
+    av_free((*index)->heap);
+    av_freep(index);
+}
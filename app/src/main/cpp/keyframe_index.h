@@ -0,0 +1,79 @@
+//
+// Persisted key frame index, shared by the retriever, CutVideo and the players.
+//
+
+#ifndef KEYFRAME_INDEX_H
+#define KEYFRAME_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "libavformat/avformat.h"
+
+/**
+ * One key frame, timestamps in the time_base of the stream.
+ * The layout is written to the sidecar file as is.
+ */
+typedef struct KeyFrameEntry {
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;      // byte offset, -1 if unknown
+    int32_t gop_size; // packets until the next key frame
+    int32_t reserved;
+} KeyFrameEntry;
+
+/* without an index, scan the packets in the background for the next open */
+#define KEYFRAME_INDEX_SCAN 1
+
+typedef struct KeyFrameIndex {
+    int stream_index;
+    AVRational time_base;
+    int count;
+    const KeyFrameEntry *entries; // sorted by pts
+
+    void *map;
+    size_t map_size;
+    KeyFrameEntry *heap;
+} KeyFrameIndex;
+
+/**
+ * Directory of the sidecar files, e.g. Context#getCacheDir().
+ * Without it indexes are built but not persisted.
+ */
+void keyframe_index_set_cache_dir(const char *dir);
+
+/**
+ * Map the sidecar of the source if it matches path (or fd), size and mtime,
+ * otherwise build the index from the container and persist it. Never reads packets:
+ * without either the caller seeks with av_seek_frame, and KEYFRAME_INDEX_SCAN
+ * writes the sidecar from a scan on another thread, found by a later open.
+ * @param path   path of the source, used when fd < 0
+ * @param fd     descriptor of the source, or -1
+ * @param offset start of the media inside the file, e.g. an asset of the apk
+ * @param flags  KEYFRAME_INDEX_SCAN or 0, scanning needs the cache dir
+ * @return NULL for sources which are not local files, or without index yet
+ */
+KeyFrameIndex *keyframe_index_open(AVFormatContext *fmt_ctx, int stream_index,
+                                   const char *path, int fd, int64_t offset, int flags);
+
+/**
+ * @param flags AVSEEK_FLAG_BACKWARD for the last key frame at or before pts,
+ *              otherwise the first one at or after pts
+ * @return position in entries, -1 if none
+ */
+int keyframe_index_find(const KeyFrameIndex *index, int64_t pts, int flags);
+
+/**
+ * Seek fmt_ctx straight to the key frame of entries[entry], the decoders need flushing.
+ */
+int keyframe_index_seek(AVFormatContext *fmt_ctx, const KeyFrameIndex *index, int entry);
+
+void keyframe_index_close(KeyFrameIndex **index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //KEYFRAME_INDEX_H
@@ -3,6 +3,9 @@
 //
 
 #include <jni.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,205 +16,179 @@ extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
 #ifdef __cplusplus
 }
 #endif
 
 #include "ffmpeg_jni_define.h"
+#include "ff_media_queue.h"
 
 #define ALOGE(Format, ...) LOGE("Transcode", Format, ##__VA_ARGS__)
+#define ALOGI(Format, ...) LOGI("Transcode", Format, ##__VA_ARGS__)
+
+/* capacity of the queues between the stages of one stream */
+#define PACKET_QUEUE_SIZE 64
+#define FRAME_QUEUE_SIZE  8
+#define MUX_QUEUE_SIZE    128
+
+/* encoder and filter settings of the video or audio streams, unset fields keep the input's */
+typedef struct StreamOptions {
+    const char *codec_name;     /* encoder name, "copy" forces stream copy */
+    int64_t bit_rate;           /* <= 0: unset */
+    int crf;                    /* < 0: unset */
+    const char *preset;
+    const char *filter_spec;    /* filter graph description */
+} StreamOptions;
+
+typedef struct TranscodeOptions {
+    StreamOptions video;
+    StreamOptions audio;
+    int thread_count;           /* 0: auto */
+} TranscodeOptions;
 
-static AVFormatContext *ifmt_ctx;
-static AVFormatContext *ofmt_ctx;
 typedef struct FilteringContext {
     AVFilterContext *buffersink_ctx;
     AVFilterContext *buffersrc_ctx;
     AVFilterGraph *filter_graph;
-    AVPacket *enc_pkt;
-    AVFrame *filter_frame;
 } FilteringContext;
-static FilteringContext *filter_ctx;
 
 typedef struct StreamContext {
     AVCodecContext *dec_ctx;
     AVCodecContext *enc_ctx;
-    AVFrame *dec_frame;
+    MediaQueue<AVPacket *> *packet_queue;   /* demux  -> decode */
+    MediaQueue<AVFrame *>  *decoded_queue;  /* decode -> filter */
+    MediaQueue<AVFrame *>  *filtered_queue; /* filter -> encode */
 } StreamContext;
-static StreamContext *stream_ctx;
 
-static int open_input_file(const char *filename)
+typedef struct TranscodeContext {
+    AVFormatContext *ifmt_ctx;
+    AVFormatContext *ofmt_ctx;
+    FilteringContext *filter_ctx;
+    StreamContext *stream_ctx;
+
+    /* encoded and remuxed packets of all streams -> mux */
+    MediaQueue<AVPacket *> *mux_queue;
+    std::atomic<int> mux_producers;
+    std::atomic<int> error;
+} TranscodeContext;
+
+static int open_input_file(TranscodeContext *ctx, const char *filename)
 {
     int ret;
-    ifmt_ctx = nullptr;
+    AVFormatContext *ifmt_ctx = nullptr;
 
     if ((ret = avformat_open_input(&ifmt_ctx, filename, nullptr, nullptr)) < 0) {
         ALOGE("Cannot open input file\n");
         return ret;
     }
+    ctx->ifmt_ctx = ifmt_ctx;
 
     if ((ret = avformat_find_stream_info(ifmt_ctx, nullptr)) < 0) {
         ALOGE("Cannot find stream information\n");
         return ret;
     }
 
-    stream_ctx = static_cast<StreamContext *>(av_mallocz_array(ifmt_ctx->nb_streams,
-                                                               sizeof(*stream_ctx)));
+    StreamContext *stream_ctx = static_cast<StreamContext *>(av_mallocz_array(ifmt_ctx->nb_streams,
+                                                                              sizeof(*stream_ctx)));
     if (!stream_ctx)
         return AVERROR(ENOMEM);
+    ctx->stream_ctx = stream_ctx;
 
     for (int i = 0; i < ifmt_ctx->nb_streams; i++) {
-        AVStream *stream = ifmt_ctx->streams[i];
-        const AVCodec *dec = avcodec_find_decoder(stream->codecpar->codec_id);
-        AVCodecContext *codec_ctx;
-        if (!dec) {
-            ALOGE("Failed to find decoder for stream #%u\n", i);
-            return AVERROR_DECODER_NOT_FOUND;
-        }
-        codec_ctx = avcodec_alloc_context3(dec);
-        if (!codec_ctx) {
-            ALOGE("Failed to allocate the decoder context for stream #%u\n", i);
-            return AVERROR(ENOMEM);
-        }
-        ret = avcodec_parameters_to_context(codec_ctx, stream->codecpar);
-        if (ret < 0) {
-            ALOGE("Failed to copy decoder parameters to input decoder context "
-                                       "for stream #%u\n", i);
-            return ret;
-        }
-        /* encode video & audio and remux subtitles etc. */
-        if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO
-            || codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-            if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
-                codec_ctx->framerate = av_guess_frame_rate(ifmt_ctx, stream, nullptr);
-            /* Open decoder */
-            ret = avcodec_open2(codec_ctx, dec, nullptr);
-            if (ret < 0) {
-                ALOGE("Failed to open decoder for stream #%u\n", i);
-                return ret;
-            }
+        if (ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_UNKNOWN) {
+            ALOGE("Elementary stream #%d is of unknown type, cannot proceed\n", i);
+            return AVERROR_INVALIDDATA;
         }
-        stream_ctx[i].dec_ctx = codec_ctx;
-        stream_ctx[i].dec_frame = av_frame_alloc();
     }
 
     av_dump_format(ifmt_ctx, 0, filename, 0);
     return 0;
 }
 
-static int open_output_file(const char *filename)
+static const StreamOptions *get_stream_options(const TranscodeOptions *options,
+                                               enum AVMediaType type)
 {
-    AVStream *out_stream;
-    AVStream *in_stream;
-    AVCodecContext *dec_ctx, *enc_ctx;
-    const AVCodec *encoder;
-    int ret;
-
-    ofmt_ctx = nullptr;
-    avformat_alloc_output_context2(&ofmt_ctx, nullptr, nullptr, filename);
-    if (!ofmt_ctx) {
-        ALOGE("Could not create output context\n");
-        return AVERROR_UNKNOWN;
-    }
-
-    for (int i = 0; i < ifmt_ctx->nb_streams; i++) {
-        out_stream = avformat_new_stream(ofmt_ctx, nullptr);
-        if (!out_stream) {
-            ALOGE("Failed allocating output stream\n");
-            return AVERROR_UNKNOWN;
-        }
-
-        in_stream = ifmt_ctx->streams[i];
-        dec_ctx = stream_ctx[i].dec_ctx;
-
-        if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO
-            || dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-            /* in this example, we choose transcoding to same codec */
-            encoder = avcodec_find_encoder(dec_ctx->codec_id);
-            if (!encoder) {
-                ALOGE("Necessary encoder not found\n");
-                return AVERROR_INVALIDDATA;
-            }
-            enc_ctx = avcodec_alloc_context3(encoder);
-            if (!enc_ctx) {
-                ALOGE("Failed to allocate the encoder context\n");
-                return AVERROR(ENOMEM);
-            }
-
-            /* we transcode to same properties (picture size, sample rate etc.).
-             * These properties can be changed for output streams using filters */
-            if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-                enc_ctx->height = dec_ctx->height;
-                enc_ctx->width = dec_ctx->width;
-                enc_ctx->sample_aspect_ratio = dec_ctx->sample_aspect_ratio;
-                /* take first format from list of supported formats */
-                if (encoder->pix_fmts)
-                    enc_ctx->pix_fmt = encoder->pix_fmts[0];
-                else
-                    enc_ctx->pix_fmt = dec_ctx->pix_fmt;
-                /* video time_base can be set to whatever is handy and supported by encoder */
-//                enc_ctx->time_base = av_inv_q(dec_ctx->framerate);
-                enc_ctx->time_base = dec_ctx->time_base;
-            } else {
-                enc_ctx->sample_rate = dec_ctx->sample_rate;
-                enc_ctx->channel_layout = dec_ctx->channel_layout;
-                enc_ctx->channels = av_get_channel_layout_nb_channels(enc_ctx->channel_layout);
-                /* take first format from list of supported formats */
-                enc_ctx->sample_fmt = encoder->sample_fmts[0];
-                enc_ctx->time_base = (AVRational){1, enc_ctx->sample_rate};
-            }
-
-            if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
-                enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (!options)
+        return nullptr;
+    if (type == AVMEDIA_TYPE_VIDEO)
+        return &options->video;
+    if (type == AVMEDIA_TYPE_AUDIO)
+        return &options->audio;
+    return nullptr;
+}
 
-            /* Third parameter can be used to pass settings to encoder */
-            ret = avcodec_open2(enc_ctx, encoder, nullptr);
-            if (ret < 0) {
-                ALOGE("Cannot open video encoder for stream #%u\n", i);
-                return ret;
-            }
-            ret = avcodec_parameters_from_context(out_stream->codecpar, enc_ctx);
-            if (ret < 0) {
-                ALOGE("Failed to copy encoder parameters to output stream #%u\n", i);
-                return ret;
-            }
+static bool is_null_filter(const char *filter_spec)
+{
+    return !filter_spec || !*filter_spec
+           || !strcmp(filter_spec, "null") || !strcmp(filter_spec, "anull");
+}
 
-            out_stream->time_base = enc_ctx->time_base;
-            stream_ctx[i].enc_ctx = enc_ctx;
-        } else if (dec_ctx->codec_type == AVMEDIA_TYPE_UNKNOWN) {
-            ALOGE("Elementary stream #%d is of unknown type, cannot proceed\n", i);
-            return AVERROR_INVALIDDATA;
-        } else {
-            ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
-            if (ret < 0) {
-                ALOGE("Copying parameters for stream #%u failed\n", i);
-                return ret;
-            }
-            out_stream->time_base = in_stream->time_base;
+/**
+ * A stream is copied as-is when nothing asks for re-encoding:
+ * no target codec other than its own, no rate control, no filter,
+ * and the output container accepts its codec.
+ */
+static bool need_transcode(AVStream *in_stream, const StreamOptions *opts,
+                           AVOutputFormat *oformat)
+{
+    AVCodecParameters *par = in_stream->codecpar;
+    if (par->codec_type != AVMEDIA_TYPE_VIDEO && par->codec_type != AVMEDIA_TYPE_AUDIO)
+        return false;
+    if (opts && opts->codec_name && !strcmp(opts->codec_name, "copy"))
+        return false;
+    if (opts) {
+        if (opts->codec_name) {
+            const AVCodec *encoder = avcodec_find_encoder_by_name(opts->codec_name);
+            if (!encoder || encoder->id != par->codec_id)
+                return true;
         }
-
+        if (opts->bit_rate > 0 || opts->crf >= 0 || opts->preset)
+            return true;
+        if (!is_null_filter(opts->filter_spec))
+            return true;
     }
-    av_dump_format(ofmt_ctx, 0, filename, 1);
+    return avformat_query_codec(oformat, par->codec_id, FF_COMPLIANCE_NORMAL) != 1;
+}
 
-    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&ofmt_ctx->pb, filename, AVIO_FLAG_WRITE);
-        if (ret < 0) {
-            ALOGE("Could not open output file '%s'", filename);
-            return ret;
-        }
+static int open_decoder(TranscodeContext *ctx, int stream_index, int thread_count)
+{
+    int ret;
+    AVStream *stream = ctx->ifmt_ctx->streams[stream_index];
+    const AVCodec *dec = avcodec_find_decoder(stream->codecpar->codec_id);
+    AVCodecContext *codec_ctx;
+    if (!dec) {
+        ALOGE("Failed to find decoder for stream #%u\n", stream_index);
+        return AVERROR_DECODER_NOT_FOUND;
     }
-
-    /* init muxer, write output file header */
-    ret = avformat_write_header(ofmt_ctx, nullptr);
+    codec_ctx = avcodec_alloc_context3(dec);
+    if (!codec_ctx) {
+        ALOGE("Failed to allocate the decoder context for stream #%u\n", stream_index);
+        return AVERROR(ENOMEM);
+    }
+    ctx->stream_ctx[stream_index].dec_ctx = codec_ctx;
+    ret = avcodec_parameters_to_context(codec_ctx, stream->codecpar);
     if (ret < 0) {
-        ALOGE("Error occurred when opening output file\n");
+        ALOGE("Failed to copy decoder parameters to input decoder context "
+              "for stream #%u\n", stream_index);
+        return ret;
+    }
+    if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
+        codec_ctx->framerate = av_guess_frame_rate(ctx->ifmt_ctx, stream, nullptr);
+    /* let the decoder run frame and slice threads */
+    codec_ctx->thread_count = thread_count;
+    codec_ctx->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    /* Open decoder */
+    ret = avcodec_open2(codec_ctx, dec, nullptr);
+    if (ret < 0) {
+        ALOGE("Failed to open decoder for stream #%u\n", stream_index);
         return ret;
     }
-
     return 0;
 }
 
 static int init_filter(FilteringContext* fctx, AVCodecContext *dec_ctx,
-                       AVCodecContext *enc_ctx, const char *filter_spec)
+                       const AVCodec *encoder, const char *filter_spec)
 {
     char args[512];
     int ret;
@@ -258,12 +235,14 @@ static int init_filter(FilteringContext* fctx, AVCodecContext *dec_ctx,
             goto end;
         }
 
-        ret = av_opt_set_bin(buffersink_ctx, "pix_fmts",
-                             (uint8_t*)&enc_ctx->pix_fmt, sizeof(enc_ctx->pix_fmt),
-                             AV_OPT_SEARCH_CHILDREN);
-        if (ret < 0) {
-            ALOGE( "Cannot set output pixel format\n");
-            goto end;
+        /* let the graph convert to a format the encoder supports */
+        if (encoder->pix_fmts) {
+            ret = av_opt_set_int_list(buffersink_ctx, "pix_fmts", encoder->pix_fmts,
+                                      AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+            if (ret < 0) {
+                ALOGE( "Cannot set output pixel format\n");
+                goto end;
+            }
         }
     } else if (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
         buffersrc = avfilter_get_by_name("abuffer");
@@ -296,28 +275,31 @@ static int init_filter(FilteringContext* fctx, AVCodecContext *dec_ctx,
             goto end;
         }
 
-        ret = av_opt_set_bin(buffersink_ctx, "sample_fmts",
-                             (uint8_t*)&enc_ctx->sample_fmt, sizeof(enc_ctx->sample_fmt),
-                             AV_OPT_SEARCH_CHILDREN);
-        if (ret < 0) {
-            ALOGE("Cannot set output sample format\n");
-            goto end;
+        if (encoder->sample_fmts) {
+            ret = av_opt_set_int_list(buffersink_ctx, "sample_fmts", encoder->sample_fmts,
+                                      AV_SAMPLE_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+            if (ret < 0) {
+                ALOGE("Cannot set output sample format\n");
+                goto end;
+            }
         }
 
-        ret = av_opt_set_bin(buffersink_ctx, "channel_layouts",
-                             (uint8_t*)&enc_ctx->channel_layout,
-                             sizeof(enc_ctx->channel_layout), AV_OPT_SEARCH_CHILDREN);
-        if (ret < 0) {
-            ALOGE("Cannot set output channel layout\n");
-            goto end;
+        if (encoder->channel_layouts) {
+            ret = av_opt_set_int_list(buffersink_ctx, "channel_layouts", encoder->channel_layouts,
+                                      0, AV_OPT_SEARCH_CHILDREN);
+            if (ret < 0) {
+                ALOGE("Cannot set output channel layout\n");
+                goto end;
+            }
         }
 
-        ret = av_opt_set_bin(buffersink_ctx, "sample_rates",
-                             (uint8_t*)&enc_ctx->sample_rate, sizeof(enc_ctx->sample_rate),
-                             AV_OPT_SEARCH_CHILDREN);
-        if (ret < 0) {
-            ALOGE("Cannot set output sample rate\n");
-            goto end;
+        if (encoder->supported_samplerates) {
+            ret = av_opt_set_int_list(buffersink_ctx, "sample_rates", encoder->supported_samplerates,
+                                      0, AV_OPT_SEARCH_CHILDREN);
+            if (ret < 0) {
+                ALOGE("Cannot set output sample rate\n");
+                goto end;
+            }
         }
     } else {
         ret = AVERROR_UNKNOWN;
@@ -351,211 +333,572 @@ static int init_filter(FilteringContext* fctx, AVCodecContext *dec_ctx,
     fctx->filter_graph = filter_graph;
     fctx->buffersrc_ctx = buffersrc_ctx;
     fctx->buffersink_ctx = buffersink_ctx;
+    filter_graph = nullptr;
 
 end:
+    avfilter_graph_free(&filter_graph);
     avfilter_inout_free(&inputs);
     avfilter_inout_free(&outputs);
 
     return ret;
 }
 
-static int init_filters()
+/**
+ * Open decoder, filter graph and encoder of one stream. The encoder takes
+ * its picture size, sample rate etc. from the output of the filter graph.
+ */
+static int open_transcoder(TranscodeContext *ctx, int stream_index, AVStream *out_stream,
+                           const StreamOptions *opts, int thread_count)
 {
-    const char *filter_spec;
-    unsigned int i;
     int ret;
-    filter_ctx = static_cast<FilteringContext *>(av_malloc_array(ifmt_ctx->nb_streams,
-                                                                 sizeof(*filter_ctx)));
-    if (!filter_ctx)
+    const AVCodec *encoder;
+    AVCodecContext *dec_ctx, *enc_ctx;
+    AVDictionary *enc_opts = nullptr;
+    const char *filter_spec = opts ? opts->filter_spec : nullptr;
+    FilteringContext *fctx = &ctx->filter_ctx[stream_index];
+
+    if ((ret = open_decoder(ctx, stream_index, thread_count)) < 0)
+        return ret;
+    dec_ctx = ctx->stream_ctx[stream_index].dec_ctx;
+
+    if (opts && opts->codec_name)
+        encoder = avcodec_find_encoder_by_name(opts->codec_name);
+    else /* keep the codec of the input by default */
+        encoder = avcodec_find_encoder(dec_ctx->codec_id);
+    if (!encoder) {
+        ALOGE("Necessary encoder not found\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (is_null_filter(filter_spec))
+        filter_spec = dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO ? "null" : "anull";
+    if ((ret = init_filter(fctx, dec_ctx, encoder, filter_spec)) < 0) {
+        ALOGE("Cannot init filter \"%s\" for stream #%u\n", filter_spec, stream_index);
+        return ret;
+    }
+
+    enc_ctx = avcodec_alloc_context3(encoder);
+    if (!enc_ctx) {
+        ALOGE("Failed to allocate the encoder context\n");
         return AVERROR(ENOMEM);
+    }
+    ctx->stream_ctx[stream_index].enc_ctx = enc_ctx;
 
-    for (i = 0; i < ifmt_ctx->nb_streams; i++) {
-        filter_ctx[i].buffersrc_ctx  = nullptr;
-        filter_ctx[i].buffersink_ctx = nullptr;
-        filter_ctx[i].filter_graph   = nullptr;
-        if (!(ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO
-              || ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO))
-            continue;
+    AVFilterContext *sink = fctx->buffersink_ctx;
+    if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        enc_ctx->width = av_buffersink_get_w(sink);
+        enc_ctx->height = av_buffersink_get_h(sink);
+        enc_ctx->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink);
+        enc_ctx->pix_fmt = (enum AVPixelFormat) av_buffersink_get_format(sink);
+        enc_ctx->time_base = av_buffersink_get_time_base(sink);
+        enc_ctx->framerate = av_buffersink_get_frame_rate(sink);
+    } else {
+        enc_ctx->sample_rate = av_buffersink_get_sample_rate(sink);
+        enc_ctx->channel_layout = av_buffersink_get_channel_layout(sink);
+        enc_ctx->channels = av_buffersink_get_channels(sink);
+        enc_ctx->sample_fmt = (enum AVSampleFormat) av_buffersink_get_format(sink);
+        enc_ctx->time_base = (AVRational){1, enc_ctx->sample_rate};
+    }
 
-        if (ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-            filter_spec = "null";
-        else
-            filter_spec = "anull";
-        ret = init_filter(&filter_ctx[i], stream_ctx[i].dec_ctx,
-                          stream_ctx[i].enc_ctx, filter_spec);
-        if (ret)
-            return ret;
+    if (ctx->ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    enc_ctx->thread_count = thread_count;
+    enc_ctx->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+    if (opts) {
+        if (opts->bit_rate > 0)
+            enc_ctx->bit_rate = opts->bit_rate;
+        if (opts->crf >= 0)
+            av_dict_set_int(&enc_opts, "crf", opts->crf, 0);
+        if (opts->preset)
+            av_dict_set(&enc_opts, "preset", opts->preset, 0);
+    }
+
+    ret = avcodec_open2(enc_ctx, encoder, &enc_opts);
+    if (ret < 0) {
+        ALOGE("Cannot open video encoder for stream #%u\n", stream_index);
+        av_dict_free(&enc_opts);
+        return ret;
+    }
+    AVDictionaryEntry *unused = nullptr;
+    while ((unused = av_dict_get(enc_opts, "", unused, AV_DICT_IGNORE_SUFFIX)))
+        ALOGE("Option %s not supported by encoder %s\n", unused->key, encoder->name);
+    av_dict_free(&enc_opts);
+
+    /* encoders with fixed frame size, e.g. aac, need the graph to cut frames for them */
+    if (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO && enc_ctx->frame_size > 0
+        && !(encoder->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+        av_buffersink_set_frame_size(sink, enc_ctx->frame_size);
 
-        filter_ctx[i].enc_pkt = av_packet_alloc();
-        filter_ctx[i].filter_frame = av_frame_alloc();
+    ret = avcodec_parameters_from_context(out_stream->codecpar, enc_ctx);
+    if (ret < 0) {
+        ALOGE("Failed to copy encoder parameters to output stream #%u\n", stream_index);
+        return ret;
     }
+
+    out_stream->time_base = enc_ctx->time_base;
     return 0;
 }
 
-static int encode_write_frame(int stream_index, int flush) {
+static int open_output_file(TranscodeContext *ctx, const char *filename,
+                            const TranscodeOptions *options)
+{
+    AVStream *out_stream;
+    AVStream *in_stream;
+    AVFormatContext *ifmt_ctx = ctx->ifmt_ctx;
+    AVFormatContext *ofmt_ctx = nullptr;
+    int thread_count = options ? options->thread_count : 0;
     int ret;
-    StreamContext *stream = &stream_ctx[stream_index];
-    AVPacket *enc_pkt = filter_ctx[stream_index].enc_pkt;
-    av_packet_unref(enc_pkt);
-    AVFrame *filter_frame = flush ? nullptr : filter_ctx[stream_index].filter_frame;
 
-    ret = avcodec_send_frame(stream->enc_ctx, filter_frame);
-
-    if (ret < 0)
-        return ret;
+    avformat_alloc_output_context2(&ofmt_ctx, nullptr, nullptr, filename);
+    if (!ofmt_ctx) {
+        ALOGE("Could not create output context\n");
+        return AVERROR_UNKNOWN;
+    }
+    ctx->ofmt_ctx = ofmt_ctx;
 
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(stream->enc_ctx, enc_pkt);
+    ctx->filter_ctx = static_cast<FilteringContext *>(av_mallocz_array(ifmt_ctx->nb_streams,
+                                                                       sizeof(*ctx->filter_ctx)));
+    if (!ctx->filter_ctx)
+        return AVERROR(ENOMEM);
 
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            return 0;
+    for (int i = 0; i < ifmt_ctx->nb_streams; i++) {
+        out_stream = avformat_new_stream(ofmt_ctx, nullptr);
+        if (!out_stream) {
+            ALOGE("Failed allocating output stream\n");
+            return AVERROR_UNKNOWN;
         }
 
-        enc_pkt->stream_index = stream_index;
-        av_packet_rescale_ts(enc_pkt, stream->enc_ctx->time_base,
-                             ofmt_ctx->streams[stream_index]->time_base);
+        in_stream = ifmt_ctx->streams[i];
+        const StreamOptions *opts = get_stream_options(options, in_stream->codecpar->codec_type);
 
-        /* mux encoded frame */
-        ret = av_interleaved_write_frame(ofmt_ctx, enc_pkt);
+        if (need_transcode(in_stream, opts, ofmt_ctx->oformat)) {
+            ret = open_transcoder(ctx, i, out_stream, opts, thread_count);
+            if (ret < 0)
+                return ret;
+        } else {
+            /* stream copy: remux packets without decoding */
+            ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+            if (ret < 0) {
+                ALOGE("Copying parameters for stream #%u failed\n", i);
+                return ret;
+            }
+            out_stream->codecpar->codec_tag = 0;
+            out_stream->time_base = in_stream->time_base;
+        }
     }
-    return ret;
-}
+    av_dump_format(ofmt_ctx, 0, filename, 1);
 
-static int filter_encode_write_frame(AVFrame *frame, int stream_index)
-{
-    int ret;
-    FilteringContext *filter_contex = &filter_ctx[stream_index];
+    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&ofmt_ctx->pb, filename, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            ALOGE("Could not open output file '%s'", filename);
+            return ret;
+        }
+    }
 
-    /* push the decoded frame into the filtergraph */
-    ret = av_buffersrc_add_frame_flags(filter_contex->buffersrc_ctx, frame, 0);
+    /* init muxer, write output file header */
+    ret = avformat_write_header(ofmt_ctx, nullptr);
     if (ret < 0) {
-        ALOGE("Error while feeding the filtergraph\n");
+        ALOGE("Error occurred when opening output file\n");
         return ret;
     }
 
-    while (1) {
-        ret = av_buffersink_get_frame(filter_contex->buffersink_ctx, filter_contex->filter_frame);
-        if (ret < 0) {
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                ret = 0;
-            break;
-        }
+    return 0;
+}
 
-        filter_contex->filter_frame->pict_type = AV_PICTURE_TYPE_NONE;
-        ret = encode_write_frame(stream_index, 0);
-        av_frame_unref(filter_contex->filter_frame);
-        if (ret < 0)
-            break;
+static void set_error(TranscodeContext *ctx, int error)
+{
+    int expected = 0;
+    if (!ctx->error.compare_exchange_strong(expected, error))
+        return;
+    /* wake up and stop every stage */
+    for (unsigned int i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        StreamContext *stream = &ctx->stream_ctx[i];
+        if (stream->packet_queue)
+            stream->packet_queue->abort();
+        if (stream->decoded_queue)
+            stream->decoded_queue->abort();
+        if (stream->filtered_queue)
+            stream->filtered_queue->abort();
     }
+    ctx->mux_queue->abort();
+}
 
-    return ret;
+static void mux_producer_done(TranscodeContext *ctx)
+{
+    if (--ctx->mux_producers == 0)
+        ctx->mux_queue->finish();
 }
 
-static int flush_encoder(int stream_index)
+static int push_packet(MediaQueue<AVPacket *> *queue, AVPacket *packet)
 {
-    if (!(stream_ctx[stream_index].enc_ctx->codec->capabilities &
-          AV_CODEC_CAP_DELAY))
-        return 0;
+    AVPacket *copy = av_packet_alloc();
+    if (!copy)
+        return AVERROR(ENOMEM);
+    av_packet_move_ref(copy, packet);
+    if (!queue->push(copy)) {
+        av_packet_free(&copy);
+        return AVERROR_EXIT;
+    }
+    return 0;
+}
 
-    return encode_write_frame(stream_index, 1);
+static int push_frame(MediaQueue<AVFrame *> *queue, AVFrame *frame)
+{
+    AVFrame *copy = av_frame_alloc();
+    if (!copy)
+        return AVERROR(ENOMEM);
+    av_frame_move_ref(copy, frame);
+    if (!queue->push(copy)) {
+        av_frame_free(&copy);
+        return AVERROR_EXIT;
+    }
+    return 0;
 }
 
-int transcode(const char *input_file, const char *output_file)
+/* read all packets, hand them to the decoders or straight to the muxer */
+static void demux_thread(TranscodeContext *ctx)
 {
     int ret;
-    AVPacket *packet = nullptr;
-    int stream_index;
-    int i;
-
-    if ((ret = open_input_file(input_file)) < 0)
-        goto end;
-    if ((ret = open_output_file(output_file)) < 0)
-        goto end;
-    if ((ret = init_filters()) < 0)
-        goto end;
-    if (!(packet = av_packet_alloc()))
-        goto end;
+    AVFormatContext *ifmt_ctx = ctx->ifmt_ctx;
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        set_error(ctx, AVERROR(ENOMEM));
+        return;
+    }
 
-    /* read all packets */
-    while (1) {
+    while (!ctx->error) {
         if ((ret = av_read_frame(ifmt_ctx, packet)) < 0)
             break;
-        stream_index = packet->stream_index;
+        int stream_index = packet->stream_index;
+        StreamContext *stream = &ctx->stream_ctx[stream_index];
 
-        if (filter_ctx && filter_ctx[stream_index].filter_graph) {
-            StreamContext *stream = &stream_ctx[stream_index];
+        if (stream->packet_queue) {
             av_packet_rescale_ts(packet,
                                  ifmt_ctx->streams[stream_index]->time_base,
-                                 stream_ctx[stream_index].dec_ctx->time_base);
-            ret = avcodec_send_packet(stream->dec_ctx, packet);
-            if (ret < 0) {
-                ALOGE("Decoding failed\n");
-                break;
-            }
-
-            while (ret >= 0) {
-                ret = avcodec_receive_frame(stream->dec_ctx, stream->dec_frame);
-                if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN))
-                    break;
-                else if (ret < 0)
-                    goto end;
-
-                stream->dec_frame->pts = stream->dec_frame->best_effort_timestamp;
-                ret = filter_encode_write_frame(stream->dec_frame, stream_index);
-                if (ret < 0)
-                    goto end;
-            }
+                                 stream->dec_ctx->time_base);
+            ret = push_packet(stream->packet_queue, packet);
         } else {
             /* remux this frame without re-encoding */
             av_packet_rescale_ts(packet,
                                  ifmt_ctx->streams[stream_index]->time_base,
-                                 ofmt_ctx->streams[stream_index]->time_base);
-
-            ret = av_interleaved_write_frame(ofmt_ctx, packet);
-            if (ret < 0)
-                goto end;
+                                 ctx->ofmt_ctx->streams[stream_index]->time_base);
+            ret = push_packet(ctx->mux_queue, packet);
         }
         av_packet_unref(packet);
+        if (ret < 0)
+            break;
     }
+    av_packet_free(&packet);
 
-    /* flush filters and encoders */
-    for (i = 0; i < ifmt_ctx->nb_streams; i++) {
-        if (!filter_ctx || !filter_ctx[i].filter_graph)
-            continue;
-        ret = filter_encode_write_frame(nullptr, i);
+    for (unsigned int i = 0; i < ifmt_ctx->nb_streams; i++) {
+        if (ctx->stream_ctx[i].packet_queue)
+            ctx->stream_ctx[i].packet_queue->finish();
+    }
+    mux_producer_done(ctx);
+}
+
+static int receive_frames(AVCodecContext *dec_ctx, AVFrame *frame, MediaQueue<AVFrame *> *queue)
+{
+    int ret;
+    while (1) {
+        ret = avcodec_receive_frame(dec_ctx, frame);
+        if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN))
+            return 0;
+        else if (ret < 0)
+            return ret;
+
+        frame->pts = frame->best_effort_timestamp;
+        if ((ret = push_frame(queue, frame)) < 0)
+            return ret;
+    }
+}
+
+static void decode_thread(TranscodeContext *ctx, int stream_index)
+{
+    int ret = 0;
+    AVPacket *packet;
+    StreamContext *stream = &ctx->stream_ctx[stream_index];
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        set_error(ctx, AVERROR(ENOMEM));
+        return;
+    }
+
+    while (stream->packet_queue->pop(packet)) {
+        ret = avcodec_send_packet(stream->dec_ctx, packet);
+        av_packet_free(&packet);
         if (ret < 0) {
-            ALOGE("Flushing filter failed\n");
-            goto end;
+            ALOGE("Decoding failed\n");
+            break;
+        }
+        if ((ret = receive_frames(stream->dec_ctx, frame, stream->decoded_queue)) < 0)
+            break;
+    }
+    /* flush decoder */
+    if (ret >= 0 && !ctx->error) {
+        avcodec_send_packet(stream->dec_ctx, nullptr);
+        ret = receive_frames(stream->dec_ctx, frame, stream->decoded_queue);
+    }
+    av_frame_free(&frame);
+    if (ret < 0)
+        set_error(ctx, ret);
+    stream->decoded_queue->finish();
+}
+
+static int pull_filtered_frames(FilteringContext *filter, AVFrame *frame, AVRational enc_time_base,
+                                MediaQueue<AVFrame *> *queue)
+{
+    AVRational time_base = av_buffersink_get_time_base(filter->buffersink_ctx);
+    int ret;
+    while (1) {
+        ret = av_buffersink_get_frame(filter->buffersink_ctx, frame);
+        if (ret < 0) {
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                ret = 0;
+            return ret;
         }
 
-        ret = flush_encoder(i);
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        if (frame->pts != AV_NOPTS_VALUE)
+            frame->pts = av_rescale_q(frame->pts, time_base, enc_time_base);
+        if ((ret = push_frame(queue, frame)) < 0)
+            return ret;
+    }
+}
+
+static void filter_thread(TranscodeContext *ctx, int stream_index)
+{
+    int ret = 0;
+    AVFrame *decoded;
+    StreamContext *stream = &ctx->stream_ctx[stream_index];
+    FilteringContext *filter = &ctx->filter_ctx[stream_index];
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        set_error(ctx, AVERROR(ENOMEM));
+        return;
+    }
+
+    while (stream->decoded_queue->pop(decoded)) {
+        /* push the decoded frame into the filtergraph */
+        ret = av_buffersrc_add_frame_flags(filter->buffersrc_ctx, decoded, 0);
+        av_frame_free(&decoded);
         if (ret < 0) {
+            ALOGE("Error while feeding the filtergraph\n");
+            break;
+        }
+        if ((ret = pull_filtered_frames(filter, frame, stream->enc_ctx->time_base, stream->filtered_queue)) < 0)
+            break;
+    }
+    /* flush filter */
+    if (ret >= 0 && !ctx->error) {
+        ret = av_buffersrc_add_frame_flags(filter->buffersrc_ctx, nullptr, 0);
+        if (ret >= 0)
+            ret = pull_filtered_frames(filter, frame, stream->enc_ctx->time_base, stream->filtered_queue);
+        if (ret < 0)
+            ALOGE("Flushing filter failed\n");
+    }
+    av_frame_free(&frame);
+    if (ret < 0)
+        set_error(ctx, ret);
+    stream->filtered_queue->finish();
+}
+
+static int receive_packets(TranscodeContext *ctx, int stream_index, AVPacket *enc_pkt)
+{
+    int ret;
+    AVCodecContext *enc_ctx = ctx->stream_ctx[stream_index].enc_ctx;
+    while (1) {
+        ret = avcodec_receive_packet(enc_ctx, enc_pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        else if (ret < 0)
+            return ret;
+
+        enc_pkt->stream_index = stream_index;
+        av_packet_rescale_ts(enc_pkt, enc_ctx->time_base,
+                             ctx->ofmt_ctx->streams[stream_index]->time_base);
+        if ((ret = push_packet(ctx->mux_queue, enc_pkt)) < 0)
+            return ret;
+    }
+}
+
+static void encode_thread(TranscodeContext *ctx, int stream_index)
+{
+    int ret = 0;
+    AVFrame *frame;
+    StreamContext *stream = &ctx->stream_ctx[stream_index];
+    AVPacket *enc_pkt = av_packet_alloc();
+    if (!enc_pkt) {
+        set_error(ctx, AVERROR(ENOMEM));
+        mux_producer_done(ctx);
+        return;
+    }
+
+    while (stream->filtered_queue->pop(frame)) {
+        ret = avcodec_send_frame(stream->enc_ctx, frame);
+        av_frame_free(&frame);
+        if (ret < 0)
+            break;
+        if ((ret = receive_packets(ctx, stream_index, enc_pkt)) < 0)
+            break;
+    }
+    /* flush encoder */
+    if (ret >= 0 && !ctx->error) {
+        ret = avcodec_send_frame(stream->enc_ctx, nullptr);
+        if (ret >= 0)
+            ret = receive_packets(ctx, stream_index, enc_pkt);
+        if (ret < 0)
             ALOGE("Flushing encoder failed\n");
-            goto end;
+    }
+    av_packet_free(&enc_pkt);
+    if (ret < 0)
+        set_error(ctx, ret);
+    mux_producer_done(ctx);
+}
+
+static void print_queue_stats(const char *stage, int stream_index, MediaQueue<AVPacket *> *packets,
+                              MediaQueue<AVFrame *> *frames)
+{
+    MediaQueueStats stats = packets ? packets->stats() : frames->stats();
+    ALOGI("stream #%d %s queue: items=%llu, depth max=%zu avg=%.1f, "
+          "producer stall=%lldms, consumer stall=%lldms\n",
+          stream_index, stage, (unsigned long long) stats.push_count,
+          stats.max_depth, stats.avg_depth,
+          (long long) (stats.push_stall_us / 1000), (long long) (stats.pop_stall_us / 1000));
+}
+
+/* a queue whose producer stalls a lot sits in front of the bottleneck stage */
+static void print_pipeline_stats(TranscodeContext *ctx, int64_t elapsed_us)
+{
+    for (unsigned int i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        StreamContext *stream = &ctx->stream_ctx[i];
+        if (!stream->packet_queue)
+            continue;
+        print_queue_stats("decode", i, stream->packet_queue, nullptr);
+        print_queue_stats("filter", i, nullptr, stream->decoded_queue);
+        print_queue_stats("encode", i, nullptr, stream->filtered_queue);
+    }
+    print_queue_stats("mux", -1, ctx->mux_queue, nullptr);
+    ALOGI("transcode cost=%lldms\n", (long long) (elapsed_us / 1000));
+}
+
+static void free_queues(StreamContext *stream)
+{
+    AVPacket *packet;
+    AVFrame *frame;
+    if (stream->packet_queue) {
+        while (stream->packet_queue->drain(packet))
+            av_packet_free(&packet);
+        delete stream->packet_queue;
+        stream->packet_queue = nullptr;
+    }
+    if (stream->decoded_queue) {
+        while (stream->decoded_queue->drain(frame))
+            av_frame_free(&frame);
+        delete stream->decoded_queue;
+        stream->decoded_queue = nullptr;
+    }
+    if (stream->filtered_queue) {
+        while (stream->filtered_queue->drain(frame))
+            av_frame_free(&frame);
+        delete stream->filtered_queue;
+        stream->filtered_queue = nullptr;
+    }
+}
+
+/**
+ * Run demux, decode, filter, encode and mux as a pipeline:
+ * one thread per stage per stream, joined by bounded queues.
+ * Muxing happens on the calling thread.
+ */
+static int run_pipeline(TranscodeContext *ctx)
+{
+    int ret = 0;
+    unsigned int i;
+    AVPacket *packet;
+    std::vector<std::thread> workers;
+    int64_t begin = av_gettime_relative();
+
+    ctx->mux_queue = new MediaQueue<AVPacket *>(MUX_QUEUE_SIZE);
+    ctx->mux_producers = 1;
+    for (i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        StreamContext *stream = &ctx->stream_ctx[i];
+        if (!ctx->filter_ctx[i].filter_graph)
+            continue;
+        stream->packet_queue   = new MediaQueue<AVPacket *>(PACKET_QUEUE_SIZE);
+        stream->decoded_queue  = new MediaQueue<AVFrame *>(FRAME_QUEUE_SIZE);
+        stream->filtered_queue = new MediaQueue<AVFrame *>(FRAME_QUEUE_SIZE);
+        ctx->mux_producers++;
+    }
+
+    for (i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        if (!ctx->stream_ctx[i].packet_queue)
+            continue;
+        workers.emplace_back(decode_thread, ctx, i);
+        workers.emplace_back(filter_thread, ctx, i);
+        workers.emplace_back(encode_thread, ctx, i);
+    }
+    workers.emplace_back(demux_thread, ctx);
+
+    /* mux encoded frame */
+    while (ctx->mux_queue->pop(packet)) {
+        ret = av_interleaved_write_frame(ctx->ofmt_ctx, packet);
+        av_packet_free(&packet);
+        if (ret < 0) {
+            set_error(ctx, ret);
+            break;
         }
     }
 
-    av_write_trailer(ofmt_ctx);
+    for (auto &worker : workers)
+        worker.join();
+    if (ctx->error)
+        ret = ctx->error;
+    else
+        ret = av_write_trailer(ctx->ofmt_ctx);
+
+    print_pipeline_stats(ctx, av_gettime_relative() - begin);
+
+    for (i = 0; i < ctx->ifmt_ctx->nb_streams; i++)
+        free_queues(&ctx->stream_ctx[i]);
+    while (ctx->mux_queue->drain(packet))
+        av_packet_free(&packet);
+    delete ctx->mux_queue;
+    ctx->mux_queue = nullptr;
+    return ret;
+}
+
+int transcode(const char *input_file, const char *output_file, const TranscodeOptions *options)
+{
+    int ret;
+    unsigned int i;
+    TranscodeContext *ctx = new TranscodeContext();
+    ctx->error = 0;
+
+    if ((ret = open_input_file(ctx, input_file)) < 0)
+        goto end;
+    if ((ret = open_output_file(ctx, output_file, options)) < 0)
+        goto end;
+
+    ret = run_pipeline(ctx);
 end:
-    av_packet_unref(packet);
-    for (i = 0; i < ifmt_ctx->nb_streams; i++) {
-        avcodec_free_context(&stream_ctx[i].dec_ctx);
-        if (ofmt_ctx && ofmt_ctx->nb_streams > i && ofmt_ctx->streams[i] && stream_ctx[i].enc_ctx)
-            avcodec_free_context(&stream_ctx[i].enc_ctx);
-        if (filter_ctx && filter_ctx[i].filter_graph) {
-            avfilter_graph_free(&filter_ctx[i].filter_graph);
-            av_packet_free(&filter_ctx[i].enc_pkt);
-            av_frame_free(&filter_ctx[i].filter_frame);
+    if (ctx->ifmt_ctx && ctx->stream_ctx && ctx->filter_ctx) {
+        for (i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+            avcodec_free_context(&ctx->stream_ctx[i].dec_ctx);
+            avcodec_free_context(&ctx->stream_ctx[i].enc_ctx);
+            if (ctx->filter_ctx && ctx->filter_ctx[i].filter_graph)
+                avfilter_graph_free(&ctx->filter_ctx[i].filter_graph);
         }
-        av_frame_free(&stream_ctx[i].dec_frame);
     }
-    if (filter_ctx)
-        av_free(filter_ctx);
-    av_free(stream_ctx);
-    avformat_close_input(&ifmt_ctx);
-    if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-        avio_closep(&ofmt_ctx->pb);
-    avformat_free_context(ofmt_ctx);
+    av_free(ctx->filter_ctx);
+    av_free(ctx->stream_ctx);
+    avformat_close_input(&ctx->ifmt_ctx);
+    if (ctx->ofmt_ctx && !(ctx->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&ctx->ofmt_ctx->pb);
+    avformat_free_context(ctx->ofmt_ctx);
+    delete ctx;
 
     if (ret < 0)
         ALOGE("Error occurred: %s\n", av_err2str(ret));
@@ -566,10 +909,57 @@ end:
 #ifdef __cplusplus
 extern "C" {
 #endif
-VIDEO_PLAYER_FUNC(int, executeTranscode, jstring inputFile, jstring outputFile) {
+static char *get_string_field(JNIEnv *env, jobject obj, jclass clazz, const char *name)
+{
+    jfieldID field = env->GetFieldID(clazz, name, "Ljava/lang/String;");
+    auto value = (jstring) env->GetObjectField(obj, field);
+    if (!value)
+        return nullptr;
+    const char *chars = env->GetStringUTFChars(value, JNI_FALSE);
+    char *copy = av_strdup(chars);
+    env->ReleaseStringUTFChars(value, chars);
+    env->DeleteLocalRef(value);
+    return copy;
+}
+
+static void read_stream_options(JNIEnv *env, jobject obj, jclass clazz, const char *prefix,
+                               StreamOptions *opts)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%sCodec", prefix);
+    opts->codec_name = get_string_field(env, obj, clazz, name);
+    snprintf(name, sizeof(name), "%sBitRate", prefix);
+    opts->bit_rate = env->GetLongField(obj, env->GetFieldID(clazz, name, "J"));
+    snprintf(name, sizeof(name), "%sCrf", prefix);
+    opts->crf = env->GetIntField(obj, env->GetFieldID(clazz, name, "I"));
+    snprintf(name, sizeof(name), "%sPreset", prefix);
+    opts->preset = get_string_field(env, obj, clazz, name);
+    snprintf(name, sizeof(name), "%sFilter", prefix);
+    opts->filter_spec = get_string_field(env, obj, clazz, name);
+}
+
+static void free_stream_options(StreamOptions *opts)
+{
+    av_freep(&opts->codec_name);
+    av_freep(&opts->preset);
+    av_freep(&opts->filter_spec);
+}
+
+VIDEO_PLAYER_FUNC(int, executeTranscode, jstring inputFile, jstring outputFile, jobject transcodeOptions) {
+    TranscodeOptions options = {};
     const char *input_file = env->GetStringUTFChars(inputFile, JNI_FALSE);
     const char *output_file = env->GetStringUTFChars(outputFile, JNI_FALSE);
-    int ret = transcode(input_file, output_file);
+    if (transcodeOptions) {
+        jclass clazz = env->GetObjectClass(transcodeOptions);
+        read_stream_options(env, transcodeOptions, clazz, "video", &options.video);
+        read_stream_options(env, transcodeOptions, clazz, "audio", &options.audio);
+        options.thread_count = env->GetIntField(transcodeOptions,
+                                                env->GetFieldID(clazz, "threadCount", "I"));
+        env->DeleteLocalRef(clazz);
+    }
+    int ret = transcode(input_file, output_file, transcodeOptions ? &options : nullptr);
+    free_stream_options(&options.video);
+    free_stream_options(&options.audio);
     env->ReleaseStringUTFChars(inputFile, input_file);
     env->ReleaseStringUTFChars(outputFile, output_file);
     return ret;
@@ -6,9 +6,13 @@
 
 #include <ffmpeg_media_retriever.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <android/log.h>
 #include <metadata_util.h>
+#include <fd_io.h>
+#include <metadata_cache.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
 
@@ -18,6 +22,10 @@
 const int TARGET_IMAGE_FORMAT = AV_PIX_FMT_RGBA;
 const int TARGET_IMAGE_CODEC = AV_CODEC_ID_PNG;
 
+// with metadata_only, enough for the headers of most containers
+#define HEADER_PROBE_SIZE       "65536"
+#define HEADER_ANALYZE_DURATION "500000"
+
 
 int is_supported_format(int codec_id, int pix_fmt) {
     if ((codec_id == AV_CODEC_ID_PNG ||
@@ -150,51 +158,142 @@ int stream_component_open(State *s, int stream_index) {
 	return SUCCESS;
 }
 
-int set_data_source_inner(State **state_ptr, const char* path) {
-    int i;
-	int audio_index = -1;
-	int video_index = -1;
-	State *state = *state_ptr;
+// stream info missing from the container headers, e.g. of raw streams or without duration
+static int need_stream_info(AVFormatContext *ic) {
+	int i;
 
-    AVDictionary *options = NULL;
-    av_dict_set(&options, "user-agent", "FFmpegMetadataRetriever", 0);
+	if (ic->duration == AV_NOPTS_VALUE) {
+		return 1;
+	}
+	for (i = 0; i < ic->nb_streams; i++) {
+		AVCodecParameters *codecPar = ic->streams[i]->codecpar;
+		if (codecPar->codec_type == AVMEDIA_TYPE_AUDIO
+			&& (codecPar->codec_id == AV_CODEC_ID_NONE || codecPar->sample_rate <= 0 || codecPar->channels <= 0)) {
+			return 1;
+		}
+		if (codecPar->codec_type == AVMEDIA_TYPE_VIDEO
+			&& (codecPar->codec_id == AV_CODEC_ID_NONE || codecPar->width <= 0 || codecPar->height <= 0)) {
+			return 1;
+		}
+	}
+	return 0;
+}
 
-    state->pFormatCtx = avformat_alloc_context();
-    if (state->offset > 0) {
-        state->pFormatCtx->skip_initial_bytes = state->offset;
-    }
+static int open_input(State *state, const char* path) {
+	int i;
+	AVDictionary *options = NULL;
 
-    if (avformat_open_input(&state->pFormatCtx, path, NULL, &options) != 0) {
+	av_dict_set(&options, "user-agent", "FFmpegMetadataRetriever", 0);
+	if (state->metadata_only) {
+		av_dict_set(&options, "probesize", HEADER_PROBE_SIZE, 0);
+		av_dict_set(&options, "analyzeduration", HEADER_ANALYZE_DURATION, 0);
+	}
+
+	state->pFormatCtx = avformat_alloc_context();
+	if (state->io_ctx) {
+		// the window of the fd is handled by the io context
+		state->pFormatCtx->pb     = state->io_ctx;
+		state->pFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+	} else if (state->offset > 0) {
+		state->pFormatCtx->skip_initial_bytes = state->offset;
+	}
+
+	if (avformat_open_input(&state->pFormatCtx, path, NULL, &options) != 0) {
 		LOGE("avformat_open_input fail...");
-    	return FAILURE;
-    }
+		av_dict_free(&options);
+		return FAILURE;
+	}
+	av_dict_free(&options);
 
-	if (avformat_find_stream_info(state->pFormatCtx, NULL) < 0) {
+	if ((!state->metadata_only || need_stream_info(state->pFormatCtx))
+		&& avformat_find_stream_info(state->pFormatCtx, NULL) < 0) {
 		LOGE("avformat_find_stream_info fail...");
-    	return FAILURE;
+		return FAILURE;
 	}
 
-    // Find the first audio and video stream
+	// Find the first audio and video stream
 	for (i = 0; i < state->pFormatCtx->nb_streams; i++) {
-		if (state->pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && video_index < 0) {
-			video_index = i;
+		AVStream *st = state->pFormatCtx->streams[i];
+		if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && state->video_stream < 0) {
+			state->video_stream = i;
+			state->video_st     = st;
 		}
 
-		if (state->pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && audio_index < 0) {
-			audio_index = i;
+		if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && state->audio_stream < 0) {
+			state->audio_stream = i;
+			state->audio_st     = st;
 		}
 
 		set_codec(state->pFormatCtx, i);
 	}
+	return SUCCESS;
+}
 
-	if (audio_index >= 0) {
-		stream_component_open(state, audio_index);
+static void open_decoders(State *state) {
+	state->decoders_opened = 1;
+	if (state->audio_stream >= 0) {
+		stream_component_open(state, state->audio_stream);
 	}
 
-	if (video_index >= 0) {
-		stream_component_open(state, video_index);
+	if (state->video_stream >= 0 && stream_component_open(state, state->video_stream) == SUCCESS) {
 		state->codecCtx->thread_count = 3; // using multi-thread to decode
 		state->codecCtx->thread_type  = FF_THREAD_FRAME; // FF_THREAD_SLICE
+	} else {
+		// no frames without a decoder, the metadata of the stream is still there
+		state->video_stream = -1;
+	}
+}
+
+// the source is opened, if served from the metadata cache so far, and its decoders
+static int open_for_frames(State *state) {
+	if (!state->pFormatCtx) {
+		if (!state->cached_metadata
+			|| open_input(state, state->source_path ? state->source_path : "") != SUCCESS) {
+			return FAILURE;
+		}
+	}
+	if (!state->decoders_opened) {
+		open_decoders(state);
+	}
+	return SUCCESS;
+}
+
+// as extract_metadata_internal looks it up: the container, then the streams
+static void put_metadata_cache(State *state, int flags) {
+	AVDictionary *metadata = NULL;
+
+	av_dict_copy(&metadata, state->pFormatCtx->metadata, 0);
+	if (state->audio_st) {
+		av_dict_copy(&metadata, state->audio_st->metadata, AV_DICT_DONT_OVERWRITE);
+	}
+	if (state->video_st) {
+		av_dict_copy(&metadata, state->video_st->metadata, AV_DICT_DONT_OVERWRITE);
+	}
+	metadata_cache_put(state->source_path, state->fd, state->offset, flags, metadata);
+	av_dict_free(&metadata);
+}
+
+int set_data_source_inner(State **state_ptr, const char* path) {
+	State *state = *state_ptr;
+	int cache_flags = state->metadata_only ? 0 : METADATA_CACHE_FULL_PROBE;
+
+    if (state->fd == -1) {
+        state->source_path = av_strdup(path);
+    }
+
+	// a known file is opened only if frames are asked for, a pipe can't be opened again
+	if (state->fd == -1 || state->io_ctx) {
+		state->cached_metadata = metadata_cache_get(state->source_path, state->fd, state->offset, cache_flags);
+		if (state->cached_metadata) {
+			return SUCCESS;
+		}
+	}
+
+	if (open_input(state, path) != SUCCESS) {
+		return FAILURE;
+	}
+	if (!state->metadata_only) {
+		open_decoders(state);
 	}
 
 	set_duration(state->pFormatCtx);
@@ -207,6 +306,7 @@ int set_data_source_inner(State **state_ptr, const char* path) {
 	set_channel_layout(state->pFormatCtx, state->audio_st);
 	set_video_resolution(state->pFormatCtx, state->video_st);
 	set_rotation(state->pFormatCtx, state->audio_st, state->video_st);
+	put_metadata_cache(state, cache_flags);
 
 	*state_ptr = state;
 	return SUCCESS;
@@ -218,9 +318,18 @@ void init_ffmpeg(State **state_ptr) {
 	if (state && state->pFormatCtx) {
 		avformat_close_input(&state->pFormatCtx);
 	}
+	if (state) {
+		fd_io_close(&state->io_ctx);
+	}
 	if (state && state->fd != -1) {
 		close(state->fd);
 	}
+	if (state) {
+		keyframe_index_close(&state->key_index);
+		av_freep(&state->source_path);
+		av_dict_free(&state->cached_metadata);
+		state->decoders_opened = 0;
+	}
 	if (!state) {
 		state = av_mallocz(sizeof(State));
 	}
@@ -263,9 +372,13 @@ int set_data_source_fd(State **state_ptr, int fd, int64_t offset, int64_t length
 	init_ffmpeg(&state);
 	state->native_window = native_window;
 	int dummy_fd = dup(fd);
-    char str[20];
-    sprintf(str, "pipe:%d", dummy_fd);
-    strcat(path, str);
+    // seekable with pread, pipe is the fallback for descriptors which are not files
+    state->io_ctx = fd_io_open(dummy_fd, offset, length, state->io_block_size, state->io_cache_blocks);
+    if (!state->io_ctx) {
+        char str[20];
+        sprintf(str, "pipe:%d", dummy_fd);
+        strcat(path, str);
+    }
     state->fd = dummy_fd;
     state->offset = offset;
 	*state_ptr = state;
@@ -277,7 +390,14 @@ const char* extract_metadata(State **state_ptr, const char* key) {
     char* value = NULL;
 	State *state = *state_ptr;
     
-	if (!state || !state->pFormatCtx) {
+	if (!state) {
+		return value;
+	}
+	if (state->cached_metadata) {
+		AVDictionaryEntry *entry = key ? av_dict_get(state->cached_metadata, key, NULL, AV_DICT_MATCH_CASE) : NULL;
+		return entry ? entry->value : value;
+	}
+	if (!state->pFormatCtx) {
 		return value;
 	}
 
@@ -496,7 +616,7 @@ int get_audio_thumbnail(State **state_ptr, AVPacket *pkt) {
 	AVFrame *frame = NULL;
 	State *state = *state_ptr;
 
-	if (!state || !state->pFormatCtx) {
+	if (!state || open_for_frames(state) != SUCCESS) {
 		return FAILURE;
 	}
 
@@ -614,6 +734,38 @@ void decode_frame(State *state, AVPacket *pkt, int *got_frame, int64_t desired_f
 	av_frame_free(&frame);
 }
 
+static KeyFrameIndex *get_key_index(State *state) {
+	// until the scan in the background is done, seeking falls back to av_seek_frame
+	if (!state->key_index) {
+		state->key_index = keyframe_index_open(state->pFormatCtx, state->video_stream,
+											   state->source_path, state->fd, state->offset,
+											   KEYFRAME_INDEX_SCAN);
+	}
+	return state->key_index;
+}
+
+/* the key frame for an option, -1 without index */
+static int find_key_entry(State *state, int64_t time, Options opt) {
+	int prev, next;
+	KeyFrameIndex *index = get_key_index(state);
+
+	if (!index) {
+		return -1;
+	}
+	prev = keyframe_index_find(index, time, AVSEEK_FLAG_BACKWARD);
+	if (opt == OPTION_CLOSEST || opt == OPTION_PREVIOUS_SYNC) {
+		return prev >= 0 ? prev : 0;
+	}
+	next = keyframe_index_find(index, time, 0);
+	if (next < 0 || prev < 0) {
+		return next >= 0 ? next : prev;
+	}
+	if (opt == OPTION_CLOSEST_SYNC && time - index->entries[prev].pts < index->entries[next].pts - time) {
+		return prev;
+	}
+	return next;
+}
+
 int get_frame_at_time(State **state_ptr, int64_t timeUs, int option, AVPacket *pkt) {
 	return get_scaled_frame_at_time(state_ptr, timeUs, option, pkt, -1, -1);
 }
@@ -626,7 +778,7 @@ int get_scaled_frame_at_time(State **state_ptr, int64_t timeUs, int option, AVPa
 	Options opt = option;
 	int64_t desired_frame_number = -1;
 
-	if (!state || !state->pFormatCtx || state->video_stream < 0) {
+	if (!state || open_for_frames(state) != SUCCESS || state->video_stream < 0) {
 		return FAILURE;
 	}
 
@@ -653,7 +805,13 @@ int get_scaled_frame_at_time(State **state_ptr, int64_t timeUs, int option, AVPa
 			flags = AVSEEK_FLAG_BACKWARD;
 		}
 
-		ret = av_seek_frame(state->pFormatCtx, stream_index, seek_time, flags);
+		int entry = find_key_entry(state, seek_time, opt);
+		if (entry >= 0) {
+			// straight to the key frame, closest decodes forward from it
+			ret = keyframe_index_seek(state->pFormatCtx, state->key_index, entry);
+		} else {
+			ret = av_seek_frame(state->pFormatCtx, stream_index, seek_time, flags);
+		}
 
 		if (ret < 0) {
 			return FAILURE;
@@ -677,6 +835,292 @@ int get_scaled_frame_at_time(State **state_ptr, int64_t timeUs, int option, AVPa
 	}
 }
 
+/* without an index, decode forward rather than seek for gaps below this */
+#define BATCH_DECODE_GAP_US 2000000
+
+typedef struct FrameTarget {
+	int64_t time;
+	int     index;
+} FrameTarget;
+
+static int compare_target(const void *a, const void *b) {
+	int64_t time_a = ((const FrameTarget *) a)->time;
+	int64_t time_b = ((const FrameTarget *) b)->time;
+	return time_a < time_b ? -1 : (time_a > time_b ? 1 : 0);
+}
+
+static int get_rotate_degree(State *state) {
+	AVDictionaryEntry *entry = av_dict_get(state->video_st->metadata, ROTATE, NULL, AV_DICT_MATCH_CASE);
+	return (entry && entry->value) ? atoi(entry->value) : 0;
+}
+
+static int64_t frame_time(AVFrame *frame) {
+	return frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+}
+
+/* timestamp of the key frame before (AVSEEK_FLAG_BACKWARD) or after time, AV_NOPTS_VALUE without index */
+static int64_t find_key_frame(State *state, int64_t time, int flags) {
+	int index;
+
+	if (state->key_index) {
+		index = keyframe_index_find(state->key_index, time, flags);
+		return index < 0 ? AV_NOPTS_VALUE : state->key_index->entries[index].pts;
+	}
+	index = av_index_search_timestamp(state->video_st, time, flags);
+	if (index < 0) {
+		return AV_NOPTS_VALUE;
+	}
+	return state->video_st->index_entries[index].timestamp;
+}
+
+static int seek_key_frame(State *state, int64_t target) {
+	if (state->key_index) {
+		int entry = keyframe_index_find(state->key_index, target, AVSEEK_FLAG_BACKWARD);
+		return keyframe_index_seek(state->pFormatCtx, state->key_index, entry >= 0 ? entry : 0);
+	}
+	return av_seek_frame(state->pFormatCtx, state->video_stream, target, AVSEEK_FLAG_BACKWARD);
+}
+
+/* the time to decode up to for an option, a key frame for the sync ones */
+static int64_t resolve_target(State *state, int64_t time, Options opt) {
+	int64_t prev, next;
+
+	if (opt == OPTION_CLOSEST) {
+		return time;
+	}
+	prev = find_key_frame(state, time, AVSEEK_FLAG_BACKWARD);
+	next = find_key_frame(state, time, 0);
+	if (prev == AV_NOPTS_VALUE || (opt == OPTION_NEXT_SYNC && next != AV_NOPTS_VALUE)) {
+		return next != AV_NOPTS_VALUE ? next : time;
+	}
+	if (opt == OPTION_CLOSEST_SYNC && next != AV_NOPTS_VALUE && next - time < time - prev) {
+		return next;
+	}
+	return prev;
+}
+
+/* next decoded video frame, draining the decoder at the end of file */
+static int read_video_frame(State *state, AVFrame *frame) {
+	AVCodecContext *dec = state->video_codec;
+	AVPacket *pkt = state->batch_pkt;
+
+	for (;;) {
+		int ret = avcodec_receive_frame(dec, frame);
+		if (ret != AVERROR(EAGAIN) || state->batch_eof) {
+			return ret;
+		}
+		if (av_read_frame(state->pFormatCtx, pkt) < 0) {
+			state->batch_eof = 1;
+			avcodec_send_packet(dec, NULL);
+			continue;
+		}
+		if (pkt->stream_index == state->video_stream) {
+			if (avcodec_send_packet(dec, pkt) < 0) {
+				LOGE("decode frame fail...");
+			}
+		}
+		av_packet_unref(pkt);
+	}
+}
+
+/* decode until batch_frame is at or after target, it stays on the last frame at the end of file */
+static int decode_to_target(State *state, int64_t target) {
+	AVFrame *frame = state->batch_frame;
+
+	while (!frame->buf[0] || frame_time(frame) < target) {
+		if (read_video_frame(state, state->batch_tmp) < 0) {
+			return frame->buf[0] ? SUCCESS : FAILURE;
+		}
+		av_frame_unref(frame);
+		av_frame_move_ref(frame, state->batch_tmp);
+		state->batch_decoded++;
+	}
+	return SUCCESS;
+}
+
+static int need_seek(State *state, int64_t target) {
+	AVFrame *frame = state->batch_frame;
+	int64_t current, key;
+
+	if (!frame->buf[0]) {
+		return 1;
+	}
+	current = frame_time(frame);
+	if (current >= target || state->batch_eof) {
+		return 0;
+	}
+	key = find_key_frame(state, target, AVSEEK_FLAG_BACKWARD);
+	if (key != AV_NOPTS_VALUE) {
+		return key > current;
+	}
+	return target - current > av_rescale_q(BATCH_DECODE_GAP_US, AV_TIME_BASE_Q, state->video_st->time_base);
+}
+
+static void rotate_rgba(const uint32_t *src, int src_width, int src_height, uint32_t *dst, int degree) {
+	int x, y;
+
+	for (y = 0; y < src_height; y++) {
+		const uint32_t *row = src + y * src_width;
+		if (degree == 90) {
+			for (x = 0; x < src_width; x++) {
+				dst[x * src_height + (src_height - 1 - y)] = row[x];
+			}
+		} else if (degree == 270) {
+			for (x = 0; x < src_width; x++) {
+				dst[(src_width - 1 - x) * src_height + y] = row[x];
+			}
+		} else {
+			uint32_t *out = dst + (src_height - 1 - y) * src_width;
+			for (x = 0; x < src_width; x++) {
+				out[src_width - 1 - x] = row[x];
+			}
+		}
+	}
+}
+
+/* scale straight into dst, going through batch_buffer only when rotating */
+static int output_rgba(State *state, AVFrame *frame, uint8_t *dst, int width, int height, int degree) {
+	int scale_width  = (degree == 90 || degree == 270) ? height : width;
+	int scale_height = (degree == 90 || degree == 270) ? width : height;
+	uint8_t *data[4] = {dst, NULL, NULL, NULL};
+	int linesize[4]  = {scale_width * 4, 0, 0, 0};
+
+	state->batch_sws_ctx = sws_getCachedContext(state->batch_sws_ctx,
+												frame->width, frame->height, frame->format,
+												scale_width, scale_height, TARGET_IMAGE_FORMAT,
+												SWS_BILINEAR, NULL, NULL, NULL);
+	if (!state->batch_sws_ctx) {
+		LOGE("scale context is null!");
+		return FAILURE;
+	}
+	if (degree == 90 || degree == 180 || degree == 270) {
+		av_fast_malloc(&state->batch_buffer, &state->batch_buffer_size, (size_t) width * height * 4);
+		if (!state->batch_buffer) {
+			state->batch_buffer_size = 0;
+			return FAILURE;
+		}
+		data[0] = state->batch_buffer;
+	}
+
+	sws_scale(state->batch_sws_ctx, (const uint8_t * const *) frame->data, frame->linesize,
+			  0, frame->height, data, linesize);
+
+	if (data[0] != dst) {
+		rotate_rgba((const uint32_t *) data[0], scale_width, scale_height, (uint32_t *) dst, degree);
+	}
+	return SUCCESS;
+}
+
+int get_frames_at_times(State **state_ptr, const int64_t *timesUs, int count, int option,
+						int width, int height, uint8_t **buffers, int64_t *frameTimesUs) {
+	int i;
+	int got = 0;
+	int degree;
+	int last_index = -1;
+	int64_t last_decoded = -1;
+	int64_t duration;
+	FrameTarget *targets;
+	AVStream *st;
+	State *state = *state_ptr;
+
+	if (!state || open_for_frames(state) != SUCCESS || state->video_stream < 0 || !state->video_codec) {
+		return FAILURE;
+	}
+	if (count <= 0 || width <= 0 || height <= 0) {
+		return FAILURE;
+	}
+	if (!state->batch_pkt) {
+		state->batch_pkt   = av_packet_alloc();
+		state->batch_frame = av_frame_alloc();
+		state->batch_tmp   = av_frame_alloc();
+		if (!state->batch_pkt || !state->batch_frame || !state->batch_tmp) {
+			return FAILURE;
+		}
+	}
+	targets = av_malloc_array(count, sizeof(FrameTarget));
+	if (!targets) {
+		return FAILURE;
+	}
+
+	st       = state->video_st;
+	duration = st->duration;
+	for (i = 0; i < count; i++) {
+		targets[i].time  = timesUs[i] < 0 ? -1 : av_rescale_q(timesUs[i], AV_TIME_BASE_Q, st->time_base);
+		targets[i].index = i;
+		if (duration > 0 && targets[i].time > duration) {
+			targets[i].time = duration;
+		}
+		frameTimesUs[i] = -1;
+	}
+	qsort(targets, count, sizeof(FrameTarget), compare_target);
+
+	degree = get_rotate_degree(state);
+	get_key_index(state);
+	// another call may have moved the demuxer, so start from a seek
+	av_frame_unref(state->batch_frame);
+
+	for (i = 0; i < count; i++) {
+		int index = targets[i].index;
+		int64_t target;
+
+		if (targets[i].time < 0) {
+			continue;
+		}
+		target = resolve_target(state, targets[i].time, option);
+
+		if (need_seek(state, target)) {
+			if (seek_key_frame(state, target) < 0) {
+				continue;
+			}
+			avcodec_flush_buffers(state->video_codec);
+			av_frame_unref(state->batch_frame);
+			state->batch_eof = 0;
+		}
+		if (decode_to_target(state, target) < 0) {
+			continue;
+		}
+
+		if (last_index >= 0 && last_decoded == state->batch_decoded) {
+			// several targets share this frame
+			memcpy(buffers[index], buffers[last_index], (size_t) width * height * 4);
+		} else if (output_rgba(state, state->batch_frame, buffers[index], width, height, degree) < 0) {
+			continue;
+		}
+		frameTimesUs[index] = av_rescale_q(frame_time(state->batch_frame), st->time_base, AV_TIME_BASE_Q);
+		last_index   = index;
+		last_decoded = state->batch_decoded;
+		got++;
+	}
+
+	av_free(targets);
+	return got;
+}
+
+int set_io_cache(State **state_ptr, int block_size, int blocks) {
+	State *state = *state_ptr;
+
+	if (!state) {
+		init_ffmpeg(&state);
+	}
+	state->io_block_size   = block_size;
+	state->io_cache_blocks = blocks;
+	*state_ptr = state;
+
+	return SUCCESS;
+}
+
+int set_metadata_only(State **state_ptr, int enable) {
+	State *state = *state_ptr;
+
+	if (!state) {
+		init_ffmpeg(&state);
+	}
+	state->metadata_only = enable;
+	*state_ptr = state;
+
+	return SUCCESS;
+}
+
 int set_native_window(State **state_ptr, ANativeWindow* native_window) {
 
 	State *state = *state_ptr;
@@ -710,6 +1154,7 @@ void release_retriever(State **state_ptr) {
         if (state->pFormatCtx) {
     		avformat_close_input(&state->pFormatCtx);
     	}
+    	fd_io_close(&state->io_ctx);
     	
     	if (state->fd != -1) {
     		close(state->fd);
@@ -749,6 +1194,17 @@ void release_retriever(State **state_ptr) {
 			avfilter_graph_free(&state->filter_graph);
 		}
 
+		av_packet_free(&state->batch_pkt);
+		av_frame_free(&state->batch_frame);
+		av_frame_free(&state->batch_tmp);
+		if (state->batch_sws_ctx) {
+			sws_freeContext(state->batch_sws_ctx);
+		}
+		av_freep(&state->batch_buffer);
+		keyframe_index_close(&state->key_index);
+		av_freep(&state->source_path);
+		av_dict_free(&state->cached_metadata);
+
     	av_freep(&state);
     }
 }
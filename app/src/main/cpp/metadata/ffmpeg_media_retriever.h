@@ -15,6 +15,7 @@
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersrc.h>
 #include <libavfilter/buffersink.h>
+#include "keyframe_index.h"
 
 typedef enum {
 	OPTION_PREVIOUS_SYNC = 0,
@@ -33,6 +34,10 @@ typedef struct State {
 	AVCodecContext  *video_codec;
 	int             fd;
 	int64_t         offset;
+	/* pread over fd, see fd_io.h */
+	AVIOContext     *io_ctx;
+	int             io_block_size;
+	int             io_cache_blocks;
 	const char      *headers;
 	AVCodecContext  *codecCtx;
 	AVCodecContext  *scaled_codecCtx;
@@ -44,6 +49,26 @@ typedef struct State {
 
 	struct SwsContext *sws_ctx;
 	struct SwsContext *scaled_sws_ctx;
+
+	/* from the container or the sidecar, looked up again by each seek until found */
+	KeyFrameIndex   *key_index;
+	char            *source_path;
+
+	/* probe the container headers only, decoders opened by the first frame call */
+	int             metadata_only;
+	int             decoders_opened;
+	/* from metadata_cache, the source is opened only if frames are asked for */
+	AVDictionary    *cached_metadata;
+
+	/* kept across get_frames_at_times calls */
+	AVPacket          *batch_pkt;
+	AVFrame           *batch_frame;
+	AVFrame           *batch_tmp;
+	struct SwsContext *batch_sws_ctx;
+	uint8_t           *batch_buffer;
+	unsigned int      batch_buffer_size;
+	int               batch_eof;
+	int64_t           batch_decoded;
 } State;
 
 struct AVDictionary {
@@ -56,7 +81,24 @@ int set_data_source_fd(State **ps, int fd, int64_t offset, int64_t length);
 const char* extract_metadata(State **ps, const char* key);
 int get_frame_at_time(State **ps, int64_t timeUs, int option, AVPacket *pkt);
 int get_scaled_frame_at_time(State **ps, int64_t timeUs, int option, AVPacket *pkt, int width, int height);
+/**
+ * Retrieve frames at many times in one forward pass, as RGBA of width*height into buffers.
+ * The times are visited in ascending order, seeking only when the next target is past
+ * the following key frame, so targets within a GOP share its decoding.
+ * @param frameTimesUs time of the frame written into each buffer, -1 if none
+ * @return number of frames retrieved, or FAILURE
+ */
+int get_frames_at_times(State **ps, const int64_t *timesUs, int count, int option,
+						int width, int height, uint8_t **buffers, int64_t *frameTimesUs);
 int get_audio_thumbnail(State **state_ptr, AVPacket *pkt);
+/**
+ * Read-ahead and cache of fd sources, before set_data_source_fd. 0 for the defaults.
+ */
+int set_io_cache(State **ps, int block_size, int blocks);
+/**
+ * Before set_data_source: skip the decoders and limit probing to the container headers.
+ */
+int set_metadata_only(State **ps, int enable);
 int set_native_window(State **ps, ANativeWindow* native_window);
 void release_retriever(State **ps);
 
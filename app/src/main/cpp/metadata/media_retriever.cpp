@@ -47,14 +47,37 @@ int MediaRetriever::getScaledFrameAtTime(int64_t timeUs, int option, AVPacket *p
 	return ::get_scaled_frame_at_time(&state, timeUs, option, pkt, width, height);
 }
 
+int MediaRetriever::getFramesAtTimes(const int64_t *timesUs, int count, int option,
+									 int width, int height, uint8_t **buffers, int64_t *frameTimesUs)
+{
+	Mutex::Autolock lock(mLock);
+	return ::get_frames_at_times(&state, timesUs, count, option, width, height, buffers, frameTimesUs);
+}
+
 int MediaRetriever::getAudioThumbnail(AVPacket *pkt)
 {
 	Mutex::Autolock lock(mLock);
 	return ::get_audio_thumbnail(&state, pkt);
 }
 
+int MediaRetriever::setIOCache(int blockSize, int blocks)
+{
+	Mutex::Autolock lock(mLock);
+	return ::set_io_cache(&state, blockSize, blocks);
+}
+
+int MediaRetriever::setMetadataOnly(bool enable)
+{
+	Mutex::Autolock lock(mLock);
+	return ::set_metadata_only(&state, enable ? 1 : 0);
+}
+
 int MediaRetriever::setNativeWindow(ANativeWindow* native_window)
 {
 	Mutex::Autolock lock(mLock);
 	return ::set_native_window(&state, native_window);
-}
\ No newline at end of file
+}
+void MediaRetriever::setMetadataCacheDir(const char* dir)
+{
+	::metadata_cache_set_dir(dir);
+}
@@ -14,6 +14,7 @@ extern "C" {
 #endif
 
 #include "ffmpeg_media_retriever.h"
+#include "metadata_cache.h"
 
 #ifdef __cplusplus
 }
@@ -30,8 +31,13 @@ public:
     const char* extractMetadata(const char* key);
     int getFrameAtTime(int64_t timeUs, int option, AVPacket *pkt);
     int getScaledFrameAtTime(int64_t timeUs, int option, AVPacket *pkt, int width, int height);
+	int getFramesAtTimes(const int64_t *timesUs, int count, int option,
+						 int width, int height, uint8_t **buffers, int64_t *frameTimesUs);
 	int getAudioThumbnail(AVPacket *pkt);
+    int setIOCache(int blockSize, int blocks);
+    int setMetadataOnly(bool enable);
     int setNativeWindow(ANativeWindow* native_window);
+    static void setMetadataCacheDir(const char* dir);
 
 private:
     Mutex mLock;
@@ -9,6 +9,7 @@
 #include "jni.h"
 
 #include <android/bitmap.h>
+#include <vector>
 #include "ffmpeg_jni_define.h"
 
 #define LOG_TAG "FFmpegMediaRetriever"
@@ -159,6 +160,37 @@ RETRIEVER_FUNC(void, native_1setDataSourceFD, jobject fileDescriptor, jlong offs
             "java/lang/IOException", "setDataSource failed");
 }
 
+RETRIEVER_FUNC(void, native_1setIOCache, jint blockSize, jint blocks)
+{
+    MediaRetriever* retriever = getRetriever(env, thiz);
+    if (retriever == nullptr) {
+        jniThrowException(env, mIllegalStateException, mNoAvailableMsg);
+        return;
+    }
+    retriever->setIOCache(blockSize, blocks);
+}
+
+RETRIEVER_FUNC(void, native_1setMetadataOnly, jboolean enable)
+{
+    MediaRetriever* retriever = getRetriever(env, thiz);
+    if (retriever == nullptr) {
+        jniThrowException(env, mIllegalStateException, mNoAvailableMsg);
+        return;
+    }
+    retriever->setMetadataOnly(enable);
+}
+
+RETRIEVER_FUNC(void, native_1setMetadataCacheDir, jstring dir)
+{
+    if (!dir) {
+        MediaRetriever::setMetadataCacheDir(nullptr);
+        return;
+    }
+    const char *cache_dir = env->GetStringUTFChars(dir, JNI_FALSE);
+    MediaRetriever::setMetadataCacheDir(cache_dir);
+    env->ReleaseStringUTFChars(dir, cache_dir);
+}
+
 RETRIEVER_FUNC(void, native_1setSurface, jobject surface)
 {
     MediaRetriever* retriever = getRetriever(env, thiz);
@@ -259,6 +291,50 @@ RETRIEVER_FUNC(jbyteArray, native_1getScaleFrameAtTime, jlong timeUs, jint optio
     return array;
 }
 
+RETRIEVER_FUNC(jlongArray, native_1getFramesAtTimes, jlongArray timesUs, jint option,
+               jint width, jint height, jobjectArray buffers)
+{
+    MediaRetriever* retriever = getRetriever(env, thiz);
+    if (retriever == nullptr) {
+        jniThrowException(env, mIllegalStateException, mNoAvailableMsg);
+        return nullptr;
+    }
+    if (!timesUs || !buffers || width <= 0 || height <= 0) {
+        jniThrowException(env, mIllegalArgException, nullptr);
+        return nullptr;
+    }
+    jsize count = env->GetArrayLength(timesUs);
+    if (env->GetArrayLength(buffers) < count) {
+        jniThrowException(env, mIllegalArgException, "Not enough buffers");
+        return nullptr;
+    }
+
+    std::vector<uint8_t*> data(count);
+    jlong frameSize = (jlong) width * height * 4;
+    for (int i = 0; i < count; i++) {
+        jobject buffer = env->GetObjectArrayElement(buffers, i);
+        data[i] = buffer ? (uint8_t*) env->GetDirectBufferAddress(buffer) : nullptr;
+        if (!data[i] || env->GetDirectBufferCapacity(buffer) < frameSize) {
+            jniThrowException(env, mIllegalArgException, "Buffer must be direct, with width*height*4 bytes");
+            return nullptr;
+        }
+        env->DeleteLocalRef(buffer);
+    }
+
+    std::vector<int64_t> times(count);
+    std::vector<int64_t> frameTimes(count);
+    env->GetLongArrayRegion(timesUs, 0, count, (jlong*) times.data());
+    if (retriever->getFramesAtTimes(times.data(), count, option, width, height,
+                                    data.data(), frameTimes.data()) < 0) {
+        return nullptr;
+    }
+    jlongArray array = env->NewLongArray(count);
+    if (array) {
+        env->SetLongArrayRegion(array, 0, count, (jlong*) frameTimes.data());
+    }
+    return array;
+}
+
 RETRIEVER_FUNC(jbyteArray, native_1getAudioThumbnail)
 {
     MediaRetriever* retriever = getRetriever(env, thiz);
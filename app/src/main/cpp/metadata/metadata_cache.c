@@ -0,0 +1,396 @@
+//
+// Persisted metadata of local files, served by the retriever without opening them.
+//
+// One file of records, each appended by a single write and checked by its checksum,
+// so that a record torn by a crash is cut off at the next append.
+//
+
+#include "metadata_cache.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libavutil/mem.h"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGE(FORMAT, ...) __android_log_print(ANDROID_LOG_ERROR, "MetadataCache", FORMAT, ##__VA_ARGS__)
+#else
+#define LOGE(FORMAT, ...) fprintf(stderr, FORMAT, ##__VA_ARGS__)
+#endif
+
+#define CACHE_MAGIC     0x3143444d // "MDC1"
+#define CACHE_VERSION   1
+#define CACHE_FILE_NAME "metadata.mdc"
+// when full, the older half of the records is dropped
+#define CACHE_MAX_SIZE  (2 * 1024 * 1024)
+// e.g. embedded lyrics, rather not cached
+#define RECORD_MAX_SIZE (64 * 1024)
+#define CACHE_NAME_SIZE 256
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+typedef struct MetadataCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+} MetadataCacheHeader;
+
+/**
+ * Followed by the name of the source and count pairs of key and value,
+ * each nul terminated, then zeros up to a multiple of 8 bytes.
+ */
+typedef struct MetadataRecord {
+    uint32_t size;     // header included
+    uint32_t checksum; // of what follows the header
+    uint64_t name_hash;
+    int64_t  file_size;
+    int64_t  file_mtime;
+    uint32_t flags;
+    uint32_t count;
+} MetadataRecord;
+
+typedef struct SourceId {
+    char    name[CACHE_NAME_SIZE];
+    int64_t size;
+    int64_t mtime;
+} SourceId;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char cache_file[PATH_MAX];
+static uint8_t *cache_map;
+static size_t cache_map_size;
+// end of the last valid record
+static size_t cache_end;
+// offsets of the records by name hash, open addressing, 0 for an empty slot
+static uint32_t *cache_table;
+static size_t cache_table_size;
+static size_t cache_records;
+
+// FNV-1a
+static uint64_t hash_bytes(const uint8_t *data, size_t size) {
+    uint64_t hash = FNV_OFFSET;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static int get_source_id(const char *path, int fd, int64_t offset, SourceId *id) {
+    struct stat st;
+
+    memset(id, 0, sizeof(SourceId));
+    if (fd >= 0) {
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return -1;
+        }
+        snprintf(id->name, sizeof(id->name), "inode:%llu:%llu:%lld",
+                 (unsigned long long) st.st_dev, (unsigned long long) st.st_ino, (long long) offset);
+    } else {
+        if (!path || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return -1;
+        }
+        snprintf(id->name, sizeof(id->name), "%s:%lld", path, (long long) offset);
+    }
+    id->size  = st.st_size;
+    id->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+static int is_valid_record(const uint8_t *data, size_t available) {
+    const MetadataRecord *record = (const MetadataRecord *) data;
+
+    if (available < sizeof(MetadataRecord) || record->size < sizeof(MetadataRecord)
+        || record->size > available || record->size % 8 != 0) {
+        return 0;
+    }
+    return (uint32_t) hash_bytes(data + sizeof(MetadataRecord), record->size - sizeof(MetadataRecord))
+           == record->checksum;
+}
+
+// with cache_lock held
+static void unmap_cache(void) {
+    if (cache_map) {
+        munmap(cache_map, cache_map_size);
+    }
+    cache_map      = NULL;
+    cache_map_size = 0;
+    cache_end      = 0;
+    av_freep(&cache_table);
+    cache_table_size = 0;
+    cache_records    = 0;
+}
+
+// with cache_lock held
+static void insert_offset(uint32_t *table, size_t table_size, uint32_t offset) {
+    size_t slot = (size_t) ((const MetadataRecord *) (cache_map + offset))->name_hash & (table_size - 1);
+    while (table[slot]) {
+        slot = (slot + 1) & (table_size - 1);
+    }
+    table[slot] = offset;
+}
+
+// with cache_lock held, the table stays at most half full
+static int add_record(size_t pos) {
+    if ((cache_records + 1) * 2 > cache_table_size) {
+        size_t size = cache_table_size ? cache_table_size * 2 : 256;
+        uint32_t *table = av_mallocz_array(size, sizeof(uint32_t));
+        size_t i;
+        if (!table) {
+            return -1;
+        }
+        for (i = 0; i < cache_table_size; i++) {
+            if (cache_table[i]) {
+                insert_offset(table, size, cache_table[i]);
+            }
+        }
+        av_free(cache_table);
+        cache_table      = table;
+        cache_table_size = size;
+    }
+    insert_offset(cache_table, cache_table_size, (uint32_t) pos);
+    cache_records++;
+    return 0;
+}
+
+// with cache_lock held, map the file as it is now and index the valid records after cache_end
+static void map_records(void) {
+    struct stat st;
+    size_t pos = cache_end;
+    void *map;
+    int fd;
+
+    fd = open(cache_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        unmap_cache();
+        return;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) cache_end) {
+        close(fd);
+        unmap_cache();
+        return;
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        unmap_cache();
+        return;
+    }
+    munmap(cache_map, cache_map_size);
+    cache_map      = map;
+    cache_map_size = (size_t) st.st_size;
+    while (pos < cache_map_size && is_valid_record(cache_map + pos, cache_map_size - pos)) {
+        if (add_record(pos) != 0) {
+            break;
+        }
+        pos += ((const MetadataRecord *) (cache_map + pos))->size;
+    }
+    cache_end = pos;
+}
+
+// with cache_lock held
+static void map_cache(void) {
+    struct stat st;
+    const MetadataCacheHeader *header;
+    void *map;
+    int fd;
+
+    unmap_cache();
+    fd = open(cache_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(MetadataCacheHeader)) {
+        close(fd);
+        return;
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    header = (const MetadataCacheHeader *) map;
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION) {
+        munmap(map, (size_t) st.st_size);
+        return;
+    }
+    cache_map      = map;
+    cache_map_size = (size_t) st.st_size;
+    cache_end      = sizeof(MetadataCacheHeader);
+    map_records();
+}
+
+void metadata_cache_set_dir(const char *dir) {
+    pthread_mutex_lock(&cache_lock);
+    unmap_cache();
+    if (dir) {
+        snprintf(cache_file, sizeof(cache_file), "%s/%s", dir, CACHE_FILE_NAME);
+        map_cache();
+    } else {
+        cache_file[0] = '\0';
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static AVDictionary *read_record(const MetadataRecord *record, const char *name) {
+    AVDictionary *metadata = NULL;
+    const char *pos = (const char *) (record + 1);
+    const char *end = (const char *) record + record->size;
+    const char *key;
+    const char *value;
+    uint32_t i;
+
+    key = memchr(pos, '\0', end - pos);
+    if (!key || strcmp(pos, name) != 0) {
+        return NULL;
+    }
+    pos = key + 1;
+    for (i = 0; i < record->count; i++) {
+        key   = pos;
+        value = memchr(key, '\0', end - key);
+        pos   = value ? memchr(value + 1, '\0', end - value - 1) : NULL;
+        if (!pos) {
+            av_dict_free(&metadata);
+            return NULL;
+        }
+        av_dict_set(&metadata, key, value + 1, 0);
+        pos++;
+    }
+    return metadata;
+}
+
+AVDictionary *metadata_cache_get(const char *path, int fd, int64_t offset, int flags) {
+    const MetadataRecord *record;
+    AVDictionary *metadata = NULL;
+    uint64_t hash;
+    size_t slot;
+    SourceId id;
+
+    if (get_source_id(path, fd, offset, &id) != 0) {
+        return NULL;
+    }
+    hash = hash_bytes((const uint8_t *) id.name, strlen(id.name));
+
+    pthread_mutex_lock(&cache_lock);
+    for (slot = hash & (cache_table_size - 1); cache_table_size && cache_table[slot];
+         slot = (slot + 1) & (cache_table_size - 1)) {
+        record = (const MetadataRecord *) (cache_map + cache_table[slot]);
+        if (record->name_hash != hash || record->file_size != id.size
+            || record->file_mtime != id.mtime || (record->flags & flags) != (uint32_t) flags) {
+            continue;
+        }
+        metadata = read_record(record, id.name);
+        if (metadata) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return metadata;
+}
+
+// with cache_lock held, the file may go on with a torn record after cache_end
+static int append_record(const MetadataRecord *record) {
+    int ok;
+    int fd = open(cache_file, O_WRONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return -1;
+    }
+    ok = ftruncate(fd, (off_t) cache_end) == 0
+         && pwrite(fd, record, record->size, (off_t) cache_end) == (ssize_t) record->size;
+    ok = close(fd) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+// with cache_lock held, keeps the newer half of the records
+static void rewrite_cache(const MetadataRecord *record) {
+    char tmp[PATH_MAX + 16];
+    MetadataCacheHeader header;
+    size_t start = sizeof(MetadataCacheHeader);
+    size_t half  = sizeof(MetadataCacheHeader) + (cache_end - sizeof(MetadataCacheHeader)) / 2;
+    FILE *fp;
+    int ok;
+
+    while (cache_map && start < half) {
+        start += ((const MetadataRecord *) (cache_map + start))->size;
+    }
+    header.magic   = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+
+    // write aside and rename, so that a crash never leaves a partial header
+    snprintf(tmp, sizeof(tmp), "%s.%d", cache_file, getpid());
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        LOGE("fail to create %s\n", tmp);
+        return;
+    }
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1
+         && (!cache_map || start >= cache_end || fwrite(cache_map + start, cache_end - start, 1, fp) == 1)
+         && fwrite(record, record->size, 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, cache_file) != 0) {
+        unlink(tmp);
+    }
+}
+
+void metadata_cache_put(const char *path, int fd, int64_t offset, int flags, const AVDictionary *metadata) {
+    const AVDictionaryEntry *entry = NULL;
+    MetadataRecord *record;
+    size_t size;
+    size_t length;
+    char *pos;
+    SourceId id;
+
+    if (!metadata || get_source_id(path, fd, offset, &id) != 0) {
+        return;
+    }
+    size = sizeof(MetadataRecord) + strlen(id.name) + 1;
+    while ((entry = av_dict_get(metadata, "", entry, AV_DICT_IGNORE_SUFFIX))) {
+        size += strlen(entry->key) + strlen(entry->value) + 2;
+    }
+    size = (size + 7) & ~(size_t) 7;
+    if (size > RECORD_MAX_SIZE || !(record = av_mallocz(size))) {
+        return;
+    }
+
+    record->size       = (uint32_t) size;
+    record->name_hash  = hash_bytes((const uint8_t *) id.name, strlen(id.name));
+    record->file_size  = id.size;
+    record->file_mtime = id.mtime;
+    record->flags      = (uint32_t) flags;
+    pos = (char *) (record + 1);
+    length = strlen(id.name) + 1;
+    memcpy(pos, id.name, length);
+    pos += length;
+    while ((entry = av_dict_get(metadata, "", entry, AV_DICT_IGNORE_SUFFIX))) {
+        length = strlen(entry->key) + 1;
+        memcpy(pos, entry->key, length);
+        pos += length;
+        length = strlen(entry->value) + 1;
+        memcpy(pos, entry->value, length);
+        pos += length;
+        record->count++;
+    }
+    record->checksum = (uint32_t) hash_bytes((const uint8_t *) (record + 1), size - sizeof(MetadataRecord));
+
+    pthread_mutex_lock(&cache_lock);
+    if (cache_file[0]) {
+        if (!cache_map || cache_end + size > CACHE_MAX_SIZE || append_record(record) != 0) {
+            rewrite_cache(record);
+            map_cache();
+        } else {
+            // only the new record is checked and indexed
+            map_records();
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    av_free(record);
+}
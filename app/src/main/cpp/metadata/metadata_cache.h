@@ -0,0 +1,43 @@
+//
+// Persisted metadata of local files, served by the retriever without opening them.
+//
+
+#ifndef METADATA_CACHE_H
+#define METADATA_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "libavutil/dict.h"
+
+/* the metadata came from a full probe, not only the container headers */
+#define METADATA_CACHE_FULL_PROBE 1
+
+/**
+ * Directory of the cache file, e.g. Context#getCacheDir(), mapped once here.
+ * NULL unmaps it, metadata is then neither looked up nor persisted.
+ */
+void metadata_cache_set_dir(const char *dir);
+
+/**
+ * Look the source up by path (or fd), size and mtime, only stat is called on it.
+ * @param path   path of the source, used when fd < 0
+ * @param fd     descriptor of the source, or -1
+ * @param offset start of the media inside the file
+ * @param flags  METADATA_CACHE_FULL_PROBE to skip entries from header-only probes
+ * @return a copy of the metadata, freed with av_dict_free, NULL if missing
+ */
+AVDictionary *metadata_cache_get(const char *path, int fd, int64_t offset, int flags);
+
+/**
+ * Append the metadata of the source to the cache file, ignored for sources which are not local files.
+ */
+void metadata_cache_put(const char *path, int fd, int64_t offset, int flags, const AVDictionary *metadata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //METADATA_CACHE_H
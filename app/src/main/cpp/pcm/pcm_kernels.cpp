@@ -0,0 +1,1012 @@
+//
+// PCM sample formats, and the kernels processing blocks of samples.
+//
+
+#include "pcm_kernels.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PCM_HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PCM_HAVE_SSE2 1
+#endif
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGI(FORMAT, ...) __android_log_print(ANDROID_LOG_INFO, "PcmKernels", FORMAT, ##__VA_ARGS__)
+#else
+#include <cstdio>
+#define LOGI(FORMAT, ...) printf(FORMAT "\n", ##__VA_ARGS__)
+#endif
+
+// float to integer: clamp first, then truncate, the same in C and SIMD
+#define S16_MIN_F (-32768.0f)
+#define S16_MAX_F 32767.0f
+#define S32_MIN_F (-2147483648.0f)
+// the largest float below 2^31
+#define S32_MAX_F 2147483520.0f
+#define S16_SCALE 32768.0f
+#define S32_SCALE 2147483648.0f
+
+// all the kernels of one instruction set, SIMD ones finish the tail with C
+struct PcmKernels {
+    const char *name;
+    void (*gain_s16)(int16_t *dst, const int16_t *src, size_t count, float gain);
+    void (*gain_f32)(float *dst, const float *src, size_t count, float gain);
+    void (*mix_s16)(int16_t *dst, const int16_t *a, const int16_t *b, size_t count);
+    void (*mix_f32)(float *dst, const float *a, const float *b, size_t count);
+    // stereo de-interleave and interleave of 16 and 32 bits samples
+    void (*split2_16)(const int16_t *src, int16_t *l, int16_t *r, size_t frames);
+    void (*merge2_16)(int16_t *dst, const int16_t *l, const int16_t *r, size_t frames);
+    void (*split2_32)(const uint32_t *src, uint32_t *l, uint32_t *r, size_t frames);
+    void (*merge2_32)(uint32_t *dst, const uint32_t *l, const uint32_t *r, size_t frames);
+    void (*s16_to_f32)(float *dst, const int16_t *src, size_t count);
+    void (*f32_to_s16)(int16_t *dst, const float *src, size_t count);
+    void (*s16_to_s32)(int32_t *dst, const int16_t *src, size_t count);
+    void (*s32_to_s16)(int16_t *dst, const int32_t *src, size_t count);
+    void (*s32_to_f32)(float *dst, const int32_t *src, size_t count);
+    void (*f32_to_s32)(int32_t *dst, const float *src, size_t count);
+    // dst[i] = src[i * 2]
+    void (*drop_odd_32)(uint32_t *dst, const uint32_t *src, size_t count);
+    float (*correlate_f32)(const float *a, const float *b, size_t count, float *energy);
+    void (*overlap_add_f32)(float *dst, const float *src, const float *window, size_t count);
+};
+
+/******************** C ********************/
+
+static inline float clampf(float v, float lo, float hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void gain_s16_c(int16_t *dst, const int16_t *src, size_t count, float gain) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (int16_t) (int32_t) clampf((float) src[i] * gain, S16_MIN_F, S16_MAX_F);
+    }
+}
+
+static void gain_f32_c(float *dst, const float *src, size_t count, float gain) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = clampf(src[i] * gain, -1.0f, 1.0f);
+    }
+}
+
+// in 64 bits, for every instruction set
+static void gain_s32_c(int32_t *dst, const int32_t *src, size_t count, float gain) {
+    for (size_t i = 0; i < count; i++) {
+        double v = (double) src[i] * gain;
+        dst[i] = v <= INT32_MIN ? INT32_MIN : (v >= INT32_MAX ? INT32_MAX : (int32_t) v);
+    }
+}
+
+static void mix_s16_c(int16_t *dst, const int16_t *a, const int16_t *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int v = a[i] + b[i];
+        dst[i] = (int16_t) (v < INT16_MIN ? INT16_MIN : (v > INT16_MAX ? INT16_MAX : v));
+    }
+}
+
+static void mix_s32_c(int32_t *dst, const int32_t *a, const int32_t *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int64_t v = (int64_t) a[i] + b[i];
+        dst[i] = (int32_t) (v < INT32_MIN ? INT32_MIN : (v > INT32_MAX ? INT32_MAX : v));
+    }
+}
+
+static void mix_f32_c(float *dst, const float *a, const float *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = a[i] + b[i];
+    }
+}
+
+template <typename T>
+static void split_c(const T *src, T *const *planes, int channels, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            planes[c][i] = src[i * channels + c];
+        }
+    }
+}
+
+template <typename T>
+static void merge_c(T *dst, const T *const *planes, int channels, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            dst[i * channels + c] = planes[c][i];
+        }
+    }
+}
+
+static void split2_16_c(const int16_t *src, int16_t *l, int16_t *r, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        l[i] = src[i * 2];
+        r[i] = src[i * 2 + 1];
+    }
+}
+
+static void merge2_16_c(int16_t *dst, const int16_t *l, const int16_t *r, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        dst[i * 2]     = l[i];
+        dst[i * 2 + 1] = r[i];
+    }
+}
+
+static void split2_32_c(const uint32_t *src, uint32_t *l, uint32_t *r, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        l[i] = src[i * 2];
+        r[i] = src[i * 2 + 1];
+    }
+}
+
+static void merge2_32_c(uint32_t *dst, const uint32_t *l, const uint32_t *r, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        dst[i * 2]     = l[i];
+        dst[i * 2 + 1] = r[i];
+    }
+}
+
+static void s16_to_f32_c(float *dst, const int16_t *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (float) src[i] * (1.0f / S16_SCALE);
+    }
+}
+
+static void f32_to_s16_c(int16_t *dst, const float *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (int16_t) (int32_t) clampf(src[i] * S16_SCALE, S16_MIN_F, S16_MAX_F);
+    }
+}
+
+static void s16_to_s32_c(int32_t *dst, const int16_t *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (int32_t) ((uint32_t) (uint16_t) src[i] << 16);
+    }
+}
+
+static void s32_to_s16_c(int16_t *dst, const int32_t *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (int16_t) (src[i] >> 16);
+    }
+}
+
+static void s32_to_f32_c(float *dst, const int32_t *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (float) src[i] * (1.0f / S32_SCALE);
+    }
+}
+
+static void f32_to_s32_c(int32_t *dst, const float *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (int32_t) clampf(src[i] * S32_SCALE, S32_MIN_F, S32_MAX_F);
+    }
+}
+
+static void drop_odd_32_c(uint32_t *dst, const uint32_t *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = src[i * 2];
+    }
+}
+
+/**
+ * Sums in 4 lanes, lane j taking i % 4 == j, then (l0 + l1) + (l2 + l3) and the tail in order:
+ * the SIMD kernels add in the very same order. Products are separate statements,
+ * so that they are not contracted into fused multiply-adds.
+ */
+static float correlate_tail_c(const float *a, const float *b, size_t count,
+                              const float *dot_lanes, const float *energy_lanes, float *energy) {
+    float dot = (dot_lanes[0] + dot_lanes[1]) + (dot_lanes[2] + dot_lanes[3]);
+    float sum = (energy_lanes[0] + energy_lanes[1]) + (energy_lanes[2] + energy_lanes[3]);
+    for (size_t i = 0; i < count; i++) {
+        float p = a[i] * b[i];
+        float e = b[i] * b[i];
+        dot += p;
+        sum += e;
+    }
+    *energy = sum;
+    return dot;
+}
+
+static float correlate_f32_c(const float *a, const float *b, size_t count, float *energy) {
+    float dot[4] = {0, 0, 0, 0};
+    float sum[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            float p = a[i + j] * b[i + j];
+            float e = b[i + j] * b[i + j];
+            dot[j] += p;
+            sum[j] += e;
+        }
+    }
+    return correlate_tail_c(a + i, b + i, count - i, dot, sum, energy);
+}
+
+static void overlap_add_f32_c(float *dst, const float *src, const float *window, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float p = src[i] * window[i];
+        dst[i] += p;
+    }
+}
+
+static const PcmKernels kernels_c = {
+        "c",
+        gain_s16_c,
+        gain_f32_c,
+        mix_s16_c,
+        mix_f32_c,
+        split2_16_c,
+        merge2_16_c,
+        split2_32_c,
+        merge2_32_c,
+        s16_to_f32_c,
+        f32_to_s16_c,
+        s16_to_s32_c,
+        s32_to_s16_c,
+        s32_to_f32_c,
+        f32_to_s32_c,
+        drop_odd_32_c,
+        correlate_f32_c,
+        overlap_add_f32_c
+};
+
+/******************** NEON ********************/
+
+#ifdef PCM_HAVE_NEON
+
+static inline int16x4_t float_to_s16_neon(float32x4_t v) {
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(S16_MIN_F)), vdupq_n_f32(S16_MAX_F));
+    return vmovn_s32(vcvtq_s32_f32(v));
+}
+
+static void gain_s16_neon(int16_t *dst, const int16_t *src, size_t count, float gain) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        float32x4_t lo = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), gain);
+        float32x4_t hi = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), gain);
+        vst1q_s16(dst + i, vcombine_s16(float_to_s16_neon(lo), float_to_s16_neon(hi)));
+    }
+    gain_s16_c(dst + i, src + i, count - i, gain);
+}
+
+static void gain_f32_neon(float *dst, const float *src, size_t count, float gain) {
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t hi = vdupq_n_f32(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t v = vmulq_n_f32(vld1q_f32(src + i), gain);
+        vst1q_f32(dst + i, vminq_f32(vmaxq_f32(v, lo), hi));
+    }
+    gain_f32_c(dst + i, src + i, count - i, gain);
+}
+
+static void mix_s16_neon(int16_t *dst, const int16_t *a, const int16_t *b, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(a + i), vld1q_s16(b + i)));
+    }
+    mix_s16_c(dst + i, a + i, b + i, count - i);
+}
+
+static void mix_f32_neon(float *dst, const float *a, const float *b, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+    }
+    mix_f32_c(dst + i, a + i, b + i, count - i);
+}
+
+static void split2_16_neon(const int16_t *src, int16_t *l, int16_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v = vld2q_s16(src + i * 2);
+        vst1q_s16(l + i, v.val[0]);
+        vst1q_s16(r + i, v.val[1]);
+    }
+    split2_16_c(src + i * 2, l + i, r + i, frames - i);
+}
+
+static void merge2_16_neon(int16_t *dst, const int16_t *l, const int16_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v;
+        v.val[0] = vld1q_s16(l + i);
+        v.val[1] = vld1q_s16(r + i);
+        vst2q_s16(dst + i * 2, v);
+    }
+    merge2_16_c(dst + i * 2, l + i, r + i, frames - i);
+}
+
+static void split2_32_neon(const uint32_t *src, uint32_t *l, uint32_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        uint32x4x2_t v = vld2q_u32(src + i * 2);
+        vst1q_u32(l + i, v.val[0]);
+        vst1q_u32(r + i, v.val[1]);
+    }
+    split2_32_c(src + i * 2, l + i, r + i, frames - i);
+}
+
+static void merge2_32_neon(uint32_t *dst, const uint32_t *l, const uint32_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        uint32x4x2_t v;
+        v.val[0] = vld1q_u32(l + i);
+        v.val[1] = vld1q_u32(r + i);
+        vst2q_u32(dst + i * 2, v);
+    }
+    merge2_32_c(dst + i * 2, l + i, r + i, frames - i);
+}
+
+static void s16_to_f32_neon(float *dst, const int16_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / S16_SCALE));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / S16_SCALE));
+    }
+    s16_to_f32_c(dst + i, src + i, count - i);
+}
+
+static void f32_to_s16_neon(int16_t *dst, const float *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x4_t lo = float_to_s16_neon(vmulq_n_f32(vld1q_f32(src + i), S16_SCALE));
+        int16x4_t hi = float_to_s16_neon(vmulq_n_f32(vld1q_f32(src + i + 4), S16_SCALE));
+        vst1q_s16(dst + i, vcombine_s16(lo, hi));
+    }
+    f32_to_s16_c(dst + i, src + i, count - i);
+}
+
+static void s16_to_s32_neon(int32_t *dst, const int16_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 16));
+        vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+    }
+    s16_to_s32_c(dst + i, src + i, count - i);
+}
+
+static void s32_to_s16_neon(int16_t *dst, const int32_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x4_t lo = vshrn_n_s32(vld1q_s32(src + i), 16);
+        int16x4_t hi = vshrn_n_s32(vld1q_s32(src + i + 4), 16);
+        vst1q_s16(dst + i, vcombine_s16(lo, hi));
+    }
+    s32_to_s16_c(dst + i, src + i, count - i);
+}
+
+static void s32_to_f32_neon(float *dst, const int32_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), 1.0f / S32_SCALE));
+    }
+    s32_to_f32_c(dst + i, src + i, count - i);
+}
+
+static void f32_to_s32_neon(int32_t *dst, const float *src, size_t count) {
+    const float32x4_t lo = vdupq_n_f32(S32_MIN_F);
+    const float32x4_t hi = vdupq_n_f32(S32_MAX_F);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t v = vmulq_n_f32(vld1q_f32(src + i), S32_SCALE);
+        vst1q_s32(dst + i, vcvtq_s32_f32(vminq_f32(vmaxq_f32(v, lo), hi)));
+    }
+    f32_to_s32_c(dst + i, src + i, count - i);
+}
+
+static void drop_odd_32_neon(uint32_t *dst, const uint32_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u32(dst + i, vld2q_u32(src + i * 2).val[0]);
+    }
+    drop_odd_32_c(dst + i, src + i * 2, count - i);
+}
+
+static float correlate_f32_neon(const float *a, const float *b, size_t count, float *energy) {
+    float32x4_t dot = vdupq_n_f32(0);
+    float32x4_t sum = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vld1q_f32(a + i);
+        float32x4_t y = vld1q_f32(b + i);
+        // not vmlaq_f32, which may be fused
+        dot = vaddq_f32(dot, vmulq_f32(x, y));
+        sum = vaddq_f32(sum, vmulq_f32(y, y));
+    }
+    float dot_lanes[4], energy_lanes[4];
+    vst1q_f32(dot_lanes, dot);
+    vst1q_f32(energy_lanes, sum);
+    return correlate_tail_c(a + i, b + i, count - i, dot_lanes, energy_lanes, energy);
+}
+
+static void overlap_add_f32_neon(float *dst, const float *src, const float *window, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t p = vmulq_f32(vld1q_f32(src + i), vld1q_f32(window + i));
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), p));
+    }
+    overlap_add_f32_c(dst + i, src + i, window + i, count - i);
+}
+
+static const PcmKernels kernels_neon = {
+        "neon",
+        gain_s16_neon,
+        gain_f32_neon,
+        mix_s16_neon,
+        mix_f32_neon,
+        split2_16_neon,
+        merge2_16_neon,
+        split2_32_neon,
+        merge2_32_neon,
+        s16_to_f32_neon,
+        f32_to_s16_neon,
+        s16_to_s32_neon,
+        s32_to_s16_neon,
+        s32_to_f32_neon,
+        f32_to_s32_neon,
+        drop_odd_32_neon,
+        correlate_f32_neon,
+        overlap_add_f32_neon
+};
+
+#endif
+
+/******************** SSE2 ********************/
+
+#ifdef PCM_HAVE_SSE2
+
+// sign extend the low or high 4 samples to 32 bits
+static inline __m128i s16_lo_to_s32(__m128i v) {
+    return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+static inline __m128i s16_hi_to_s32(__m128i v) {
+    return _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+}
+
+static inline __m128i float_to_s32_clamped(__m128 v, __m128 lo, __m128 hi) {
+    return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, lo), hi));
+}
+
+static void gain_s16_sse2(int16_t *dst, const int16_t *src, size_t count, float gain) {
+    const __m128 g  = _mm_set1_ps(gain);
+    const __m128 lo = _mm_set1_ps(S16_MIN_F);
+    const __m128 hi = _mm_set1_ps(S16_MAX_F);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(s16_lo_to_s32(v)), g);
+        __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(s16_hi_to_s32(v)), g);
+        __m128i r = _mm_packs_epi32(float_to_s32_clamped(a, lo, hi), float_to_s32_clamped(b, lo, hi));
+        _mm_storeu_si128((__m128i *) (dst + i), r);
+    }
+    gain_s16_c(dst + i, src + i, count - i, gain);
+}
+
+static void gain_f32_sse2(float *dst, const float *src, size_t count, float gain) {
+    const __m128 g  = _mm_set1_ps(gain);
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(v, lo), hi));
+    }
+    gain_f32_c(dst + i, src + i, count - i, gain);
+}
+
+static void mix_s16_sse2(int16_t *dst, const int16_t *a, const int16_t *b, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_adds_epi16(x, y));
+    }
+    mix_s16_c(dst + i, a + i, b + i, count - i);
+}
+
+static void mix_f32_sse2(float *dst, const float *a, const float *b, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    mix_f32_c(dst + i, a + i, b + i, count - i);
+}
+
+static void split2_16_sse2(const int16_t *src, int16_t *l, int16_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *) (src + i * 2));
+        __m128i x1 = _mm_loadu_si128((const __m128i *) (src + i * 2 + 8));
+        // the low halves of the 32 bits frames are left, sign extended so that packs keeps them
+        __m128i left  = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(x0, 16), 16),
+                                        _mm_srai_epi32(_mm_slli_epi32(x1, 16), 16));
+        __m128i right = _mm_packs_epi32(_mm_srai_epi32(x0, 16), _mm_srai_epi32(x1, 16));
+        _mm_storeu_si128((__m128i *) (l + i), left);
+        _mm_storeu_si128((__m128i *) (r + i), right);
+    }
+    split2_16_c(src + i * 2, l + i, r + i, frames - i);
+}
+
+static void merge2_16_sse2(int16_t *dst, const int16_t *l, const int16_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i left  = _mm_loadu_si128((const __m128i *) (l + i));
+        __m128i right = _mm_loadu_si128((const __m128i *) (r + i));
+        _mm_storeu_si128((__m128i *) (dst + i * 2), _mm_unpacklo_epi16(left, right));
+        _mm_storeu_si128((__m128i *) (dst + i * 2 + 8), _mm_unpackhi_epi16(left, right));
+    }
+    merge2_16_c(dst + i * 2, l + i, r + i, frames - i);
+}
+
+static void split2_32_sse2(const uint32_t *src, uint32_t *l, uint32_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 x0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (src + i * 2)));
+        __m128 x1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (src + i * 2 + 4)));
+        _mm_storeu_si128((__m128i *) (l + i), _mm_castps_si128(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0))));
+        _mm_storeu_si128((__m128i *) (r + i), _mm_castps_si128(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1))));
+    }
+    split2_32_c(src + i * 2, l + i, r + i, frames - i);
+}
+
+static void merge2_32_sse2(uint32_t *dst, const uint32_t *l, const uint32_t *r, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128i left  = _mm_loadu_si128((const __m128i *) (l + i));
+        __m128i right = _mm_loadu_si128((const __m128i *) (r + i));
+        _mm_storeu_si128((__m128i *) (dst + i * 2), _mm_unpacklo_epi32(left, right));
+        _mm_storeu_si128((__m128i *) (dst + i * 2 + 4), _mm_unpackhi_epi32(left, right));
+    }
+    merge2_32_c(dst + i * 2, l + i, r + i, frames - i);
+}
+
+static void s16_to_f32_sse2(float *dst, const int16_t *src, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / S16_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(s16_lo_to_s32(v)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(s16_hi_to_s32(v)), scale));
+    }
+    s16_to_f32_c(dst + i, src + i, count - i);
+}
+
+static void f32_to_s16_sse2(int16_t *dst, const float *src, size_t count) {
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    const __m128 lo = _mm_set1_ps(S16_MIN_F);
+    const __m128 hi = _mm_set1_ps(S16_MAX_F);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = float_to_s32_clamped(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo, hi);
+        __m128i b = float_to_s32_clamped(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), lo, hi);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(a, b));
+    }
+    f32_to_s16_c(dst + i, src + i, count - i);
+}
+
+static void s16_to_s32_sse2(int32_t *dst, const int16_t *src, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(zero, v));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(zero, v));
+    }
+    s16_to_s32_c(dst + i, src + i, count - i);
+}
+
+static void s32_to_s16_sse2(int16_t *dst, const int32_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (src + i)), 16);
+        __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (src + i + 4)), 16);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(a, b));
+    }
+    s32_to_s16_c(dst + i, src + i, count - i);
+}
+
+static void s32_to_f32_sse2(float *dst, const int32_t *src, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / S32_SCALE);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    s32_to_f32_c(dst + i, src + i, count - i);
+}
+
+static void f32_to_s32_sse2(int32_t *dst, const float *src, size_t count) {
+    const __m128 scale = _mm_set1_ps(S32_SCALE);
+    const __m128 lo = _mm_set1_ps(S32_MIN_F);
+    const __m128 hi = _mm_set1_ps(S32_MAX_F);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        _mm_storeu_si128((__m128i *) (dst + i), float_to_s32_clamped(v, lo, hi));
+    }
+    f32_to_s32_c(dst + i, src + i, count - i);
+}
+
+static void drop_odd_32_sse2(uint32_t *dst, const uint32_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (src + i * 2)));
+        __m128 x1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (src + i * 2 + 4)));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_castps_si128(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0))));
+    }
+    drop_odd_32_c(dst + i, src + i * 2, count - i);
+}
+
+static float correlate_f32_sse2(const float *a, const float *b, size_t count, float *energy) {
+    __m128 dot = _mm_setzero_ps();
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(a + i);
+        __m128 y = _mm_loadu_ps(b + i);
+        dot = _mm_add_ps(dot, _mm_mul_ps(x, y));
+        sum = _mm_add_ps(sum, _mm_mul_ps(y, y));
+    }
+    float dot_lanes[4], energy_lanes[4];
+    _mm_storeu_ps(dot_lanes, dot);
+    _mm_storeu_ps(energy_lanes, sum);
+    return correlate_tail_c(a + i, b + i, count - i, dot_lanes, energy_lanes, energy);
+}
+
+static void overlap_add_f32_sse2(float *dst, const float *src, const float *window, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 p = _mm_mul_ps(_mm_loadu_ps(src + i), _mm_loadu_ps(window + i));
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), p));
+    }
+    overlap_add_f32_c(dst + i, src + i, window + i, count - i);
+}
+
+static const PcmKernels kernels_sse2 = {
+        "sse2",
+        gain_s16_sse2,
+        gain_f32_sse2,
+        mix_s16_sse2,
+        mix_f32_sse2,
+        split2_16_sse2,
+        merge2_16_sse2,
+        split2_32_sse2,
+        merge2_32_sse2,
+        s16_to_f32_sse2,
+        f32_to_s16_sse2,
+        s16_to_s32_sse2,
+        s32_to_s16_sse2,
+        s32_to_f32_sse2,
+        f32_to_s32_sse2,
+        drop_odd_32_sse2,
+        correlate_f32_sse2,
+        overlap_add_f32_sse2
+};
+
+#endif
+
+static const PcmKernels *detect_kernels() {
+#if defined(PCM_HAVE_NEON)
+    return &kernels_neon;
+#elif defined(PCM_HAVE_SSE2)
+    return &kernels_sse2;
+#else
+    return &kernels_c;
+#endif
+}
+
+static const PcmKernels *simd_kernels = detect_kernels();
+static const PcmKernels *kernels = simd_kernels;
+
+const char *pcm_kernels() {
+    return kernels->name;
+}
+
+void pcm_set_simd(bool enable) {
+    kernels = enable ? simd_kernels : &kernels_c;
+}
+
+int pcm_sample_size(PcmSampleType type) {
+    return type == PCM_S16 ? 2 : 4;
+}
+
+int pcm_frame_size(const PcmFormat &format) {
+    return pcm_sample_size(format.type) * format.channels;
+}
+
+void pcm_gain(PcmSampleType type, void *dst, const void *src, size_t count, float gain) {
+    switch (type) {
+        case PCM_S16:
+            kernels->gain_s16((int16_t *) dst, (const int16_t *) src, count, gain);
+            break;
+        case PCM_S32:
+            gain_s32_c((int32_t *) dst, (const int32_t *) src, count, gain);
+            break;
+        case PCM_F32:
+            kernels->gain_f32((float *) dst, (const float *) src, count, gain);
+            break;
+    }
+}
+
+void pcm_mix(PcmSampleType type, void *dst, const void *a, const void *b, size_t count) {
+    switch (type) {
+        case PCM_S16:
+            kernels->mix_s16((int16_t *) dst, (const int16_t *) a, (const int16_t *) b, count);
+            break;
+        case PCM_S32:
+            mix_s32_c((int32_t *) dst, (const int32_t *) a, (const int32_t *) b, count);
+            break;
+        case PCM_F32:
+            kernels->mix_f32((float *) dst, (const float *) a, (const float *) b, count);
+            break;
+    }
+}
+
+void pcm_split(PcmSampleType type, void *const *planes, const void *src, int channels, size_t frames) {
+    bool wide = pcm_sample_size(type) == 4;
+    if (channels == 1) {
+        memcpy(planes[0], src, frames * pcm_sample_size(type));
+    } else if (channels == 2 && wide) {
+        kernels->split2_32((const uint32_t *) src, (uint32_t *) planes[0], (uint32_t *) planes[1], frames);
+    } else if (channels == 2) {
+        kernels->split2_16((const int16_t *) src, (int16_t *) planes[0], (int16_t *) planes[1], frames);
+    } else if (wide) {
+        split_c((const uint32_t *) src, (uint32_t *const *) planes, channels, frames);
+    } else {
+        split_c((const int16_t *) src, (int16_t *const *) planes, channels, frames);
+    }
+}
+
+void pcm_merge(PcmSampleType type, void *dst, const void *const *planes, int channels, size_t frames) {
+    bool wide = pcm_sample_size(type) == 4;
+    if (channels == 1) {
+        memcpy(dst, planes[0], frames * pcm_sample_size(type));
+    } else if (channels == 2 && wide) {
+        kernels->merge2_32((uint32_t *) dst, (const uint32_t *) planes[0], (const uint32_t *) planes[1], frames);
+    } else if (channels == 2) {
+        kernels->merge2_16((int16_t *) dst, (const int16_t *) planes[0], (const int16_t *) planes[1], frames);
+    } else if (wide) {
+        merge_c((uint32_t *) dst, (const uint32_t *const *) planes, channels, frames);
+    } else {
+        merge_c((int16_t *) dst, (const int16_t *const *) planes, channels, frames);
+    }
+}
+
+void pcm_convert_samples(PcmSampleType dst_type, void *dst, PcmSampleType src_type, const void *src, size_t count) {
+    if (dst_type == src_type) {
+        memcpy(dst, src, count * pcm_sample_size(src_type));
+        return;
+    }
+    switch (src_type * 3 + dst_type) {
+        case PCM_S16 * 3 + PCM_S32:
+            kernels->s16_to_s32((int32_t *) dst, (const int16_t *) src, count);
+            break;
+        case PCM_S16 * 3 + PCM_F32:
+            kernels->s16_to_f32((float *) dst, (const int16_t *) src, count);
+            break;
+        case PCM_S32 * 3 + PCM_S16:
+            kernels->s32_to_s16((int16_t *) dst, (const int32_t *) src, count);
+            break;
+        case PCM_S32 * 3 + PCM_F32:
+            kernels->s32_to_f32((float *) dst, (const int32_t *) src, count);
+            break;
+        case PCM_F32 * 3 + PCM_S16:
+            kernels->f32_to_s16((int16_t *) dst, (const float *) src, count);
+            break;
+        case PCM_F32 * 3 + PCM_S32:
+            kernels->f32_to_s32((int32_t *) dst, (const float *) src, count);
+            break;
+        default:
+            break;
+    }
+}
+
+// converting and (de)interleaving go through this much on the stack at a time
+#define CONVERT_SCRATCH_SIZE 16384
+
+int pcm_convert(const PcmFormat &dst_format, void *dst, const PcmFormat &src_format, const void *src, size_t frames) {
+    int channels = src_format.channels;
+    if (dst_format.channels != channels || channels <= 0)
+        return -EINVAL;
+    // planes hold the samples of a channel one after another, like an interleaved mono buffer
+    if (src_format.planar == dst_format.planar || channels == 1) {
+        pcm_convert_samples(dst_format.type, dst, src_format.type, src, frames * channels);
+        return 0;
+    }
+
+    int src_size = pcm_sample_size(src_format.type);
+    int dst_size = pcm_sample_size(dst_format.type);
+    if (src_format.type == dst_format.type) {
+        std::vector<void *> planes((size_t) channels);
+        for (int c = 0; c < channels; c++) {
+            planes[c] = (uint8_t *) (src_format.planar ? src : dst) + (size_t) c * frames * src_size;
+        }
+        if (src_format.planar) {
+            pcm_merge(src_format.type, dst, planes.data(), channels, frames);
+        } else {
+            pcm_split(src_format.type, planes.data(), src, channels, frames);
+        }
+        return 0;
+    }
+
+    // convert a chunk into the scratch, then (de)interleave it into place
+    alignas(16) uint8_t scratch[CONVERT_SCRATCH_SIZE];
+    size_t chunk = CONVERT_SCRATCH_SIZE / (channels * 4);
+    std::vector<void *> planes((size_t) channels);
+    for (size_t done = 0; done < frames; done += chunk) {
+        size_t n = frames - done < chunk ? frames - done : chunk;
+        if (src_format.planar) {
+            // planar src -> scratch planes of the dst type -> interleaved dst
+            for (int c = 0; c < channels; c++) {
+                planes[c] = scratch + (size_t) c * n * dst_size;
+                pcm_convert_samples(dst_format.type, planes[c], src_format.type,
+                                    (const uint8_t *) src + ((size_t) c * frames + done) * src_size, n);
+            }
+            pcm_merge(dst_format.type, (uint8_t *) dst + done * channels * dst_size, planes.data(), channels, n);
+        } else {
+            // interleaved src -> interleaved scratch of the dst type -> planar dst
+            pcm_convert_samples(dst_format.type, scratch, src_format.type,
+                                (const uint8_t *) src + done * channels * src_size, n * channels);
+            for (int c = 0; c < channels; c++) {
+                planes[c] = (uint8_t *) dst + ((size_t) c * frames + done) * dst_size;
+            }
+            pcm_split(dst_format.type, planes.data(), scratch, channels, n);
+        }
+    }
+    return 0;
+}
+
+void pcm_drop_odd_frames(void *dst, const void *src, int frame_size, size_t count) {
+    if (frame_size == 4) {
+        kernels->drop_odd_32((uint32_t *) dst, (const uint32_t *) src, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy((uint8_t *) dst + i * frame_size, (const uint8_t *) src + i * 2 * frame_size, (size_t) frame_size);
+    }
+}
+
+float pcm_correlate(const float *a, const float *b, size_t count, float *energy) {
+    return kernels->correlate_f32(a, b, count, energy);
+}
+
+void pcm_overlap_add(float *dst, const float *src, const float *window, size_t count) {
+    kernels->overlap_add_f32(dst, src, window, count);
+}
+
+/******************** benchmark ********************/
+
+// runs of each kernel, the fastest one counts
+#define BENCHMARK_RUNS 5
+
+template <typename Run>
+static double benchmark_gbps(size_t bytes, Run run) {
+    double best = 0;
+    for (int i = 0; i < BENCHMARK_RUNS; i++) {
+        auto begin = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+        double gbps = cost.count() > 0 ? bytes / cost.count() / 1e9 : 0;
+        if (gbps > best)
+            best = gbps;
+    }
+    return best;
+}
+
+int pcm_kernels_benchmark(PcmBenchmark *results, int max, size_t bytes) {
+    size_t count = bytes / 4 / 8 * 8;
+    if (count == 0)
+        return 0;
+    std::vector<int16_t> s16(count * 2);
+    std::vector<int32_t> s32(count);
+    std::vector<float> f32(count);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        s32[i] = (int32_t) seed;
+        f32[i] = (float) (int32_t) seed / 1073741824.0f; // [-2, 2), to hit the clamping
+        s16[i * 2]     = (int16_t) (seed >> 16);
+        s16[i * 2 + 1] = (int16_t) seed;
+    }
+    std::vector<uint8_t> out_simd(count * 8);
+    std::vector<uint8_t> out_c(count * 8);
+    void *planes_simd[2] = {out_simd.data(), out_simd.data() + count * 4};
+    void *planes_c[2]    = {out_c.data(), out_c.data() + count * 4};
+    const void *s16_in[2]    = {s16.data(), s16.data() + count};
+    const void *s32_in[2]    = {s32.data(), s32.data()};
+    const void *f32_in[2]    = {f32.data(), f32.data()};
+
+    struct Case {
+        const char *name;
+        const void *const *in;
+        size_t input; // bytes read per run
+        void (*run)(const void *const *in, void *const *out, size_t count);
+    };
+    const Case cases[] = {
+            {"gain_s16", s16_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_gain(PCM_S16, out[0], in[0], n * 2, 1.5f);
+            }},
+            {"gain_f32", f32_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_gain(PCM_F32, out[0], in[0], n, 0.8f);
+            }},
+            {"mix_s16", s16_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_mix(PCM_S16, out[0], in[0], in[1], n);
+            }},
+            {"mix_f32", f32_in, count * 8, [](const void *const *in, void *const *out, size_t n) {
+                pcm_mix(PCM_F32, out[0], in[0], in[1], n);
+            }},
+            {"split_s16x2", s16_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_split(PCM_S16, out, in[0], 2, n);
+            }},
+            {"merge_s16x2", s16_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_merge(PCM_S16, out[0], in, 2, n);
+            }},
+            {"split_f32x2", f32_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_split(PCM_F32, out, in[0], 2, n / 2);
+            }},
+            {"merge_f32x2", f32_in, count * 8, [](const void *const *in, void *const *out, size_t n) {
+                pcm_merge(PCM_F32, out[0], in, 2, n);
+            }},
+            {"s16_to_f32", s16_in, count * 2, [](const void *const *in, void *const *out, size_t n) {
+                pcm_convert_samples(PCM_F32, out[0], PCM_S16, in[0], n);
+            }},
+            {"f32_to_s16", f32_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_convert_samples(PCM_S16, out[0], PCM_F32, in[0], n);
+            }},
+            {"s16_to_s32", s16_in, count * 2, [](const void *const *in, void *const *out, size_t n) {
+                pcm_convert_samples(PCM_S32, out[0], PCM_S16, in[0], n);
+            }},
+            {"s32_to_s16", s32_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_convert_samples(PCM_S16, out[0], PCM_S32, in[0], n);
+            }},
+            {"s32_to_f32", s32_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_convert_samples(PCM_F32, out[0], PCM_S32, in[0], n);
+            }},
+            {"f32_to_s32", f32_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_convert_samples(PCM_S32, out[0], PCM_F32, in[0], n);
+            }},
+            {"drop_odd_s16x2", s16_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                pcm_drop_odd_frames(out[0], in[0], 4, n / 2);
+            }},
+            {"correlate_f32", f32_in, count * 8, [](const void *const *in, void *const *out, size_t n) {
+                // by blocks the size of a time-stretch search, like it is used
+                auto *result = (float *) out[0];
+                const auto *a = (const float *) in[0];
+                for (size_t i = 0; i + 1024 <= n; i += 1024) {
+                    result[i / 1024] = pcm_correlate(a + i, a + (n - 1024 - i), 1024, result + n / 1024 + i / 1024);
+                }
+            }},
+            {"overlap_add_f32", f32_in, count * 4, [](const void *const *in, void *const *out, size_t n) {
+                const auto *src = (const float *) in[0];
+                pcm_overlap_add((float *) out[0], src, src + n / 2, n / 2);
+            }},
+    };
+
+    const PcmKernels *current = kernels;
+    int written = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]) && written < max; i++) {
+        const Case &test = cases[i];
+        PcmBenchmark &result = results[written++];
+        result.kernel = test.name;
+        memset(out_simd.data(), 0, out_simd.size());
+        memset(out_c.data(), 0, out_c.size());
+        kernels = simd_kernels;
+        result.simd_gbps = benchmark_gbps(test.input, [&]() { test.run(test.in, planes_simd, count); });
+        kernels = &kernels_c;
+        result.c_gbps = benchmark_gbps(test.input, [&]() { test.run(test.in, planes_c, count); });
+        result.identical = out_simd == out_c;
+        LOGI("%-16s %s %6.2f GB/s, c %6.2f GB/s%s", test.name, simd_kernels->name,
+             result.simd_gbps, result.c_gbps, result.identical ? "" : ", MISMATCH");
+    }
+    kernels = current;
+    return written;
+}
@@ -0,0 +1,103 @@
+//
+// PCM sample formats, and the kernels processing blocks of samples.
+//
+
+#ifndef PCM_KERNELS_H
+#define PCM_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum PcmSampleType {
+    PCM_S16 = 0,
+    PCM_S32,
+    PCM_F32
+};
+
+struct PcmFormat {
+    PcmSampleType type;
+    int channels;
+    // one contiguous plane per channel, for buffers in memory, files are always interleaved
+    bool planar;
+};
+
+int pcm_sample_size(PcmSampleType type);
+
+/**
+ * bytes of one sample of every channel
+ */
+int pcm_frame_size(const PcmFormat &format);
+
+/**
+ * dst = src * gain, saturated to the range of integers, or [-1, 1] for float
+ * @param count samples of all channels, dst may be src
+ */
+void pcm_gain(PcmSampleType type, void *dst, const void *src, size_t count, float gain);
+
+/**
+ * dst = a + b, saturated for integers, dst may be a or b
+ */
+void pcm_mix(PcmSampleType type, void *dst, const void *a, const void *b, size_t count);
+
+/**
+ * planes[c][i] = src[i * channels + c]
+ */
+void pcm_split(PcmSampleType type, void *const *planes, const void *src, int channels, size_t frames);
+
+/**
+ * dst[i * channels + c] = planes[c][i]
+ */
+void pcm_merge(PcmSampleType type, void *dst, const void *const *planes, int channels, size_t frames);
+
+/**
+ * Convert samples between types, integers map to [-1, 1) floats. dst must not overlap src.
+ */
+void pcm_convert_samples(PcmSampleType dst_type, void *dst, PcmSampleType src_type, const void *src, size_t count);
+
+/**
+ * Convert frames between any formats of the same channels, planar buffers holding frames samples per plane.
+ * @return 0, or -EINVAL when the channels differ
+ */
+int pcm_convert(const PcmFormat &dst_format, void *dst, const PcmFormat &src_format, const void *src, size_t frames);
+
+/**
+ * dst[i] = src[i * 2], frames of frame_size bytes
+ * @param count frames written, src holds count * 2
+ */
+void pcm_drop_odd_frames(void *dst, const void *src, int frame_size, size_t count);
+
+/**
+ * Sum of a[i] * b[i], and of b[i] * b[i] into energy, added in the same order by every kernel set.
+ */
+float pcm_correlate(const float *a, const float *b, size_t count, float *energy);
+
+/**
+ * dst[i] += src[i] * window[i]
+ */
+void pcm_overlap_add(float *dst, const float *src, const float *window, size_t count);
+
+struct PcmBenchmark {
+    const char *kernel;
+    double simd_gbps; // GB of input per second
+    double c_gbps;
+    bool identical;   // the SIMD output matches the C one
+};
+
+/**
+ * Time each kernel over bytes of input, with the SIMD and the C set.
+ * @return results written
+ */
+int pcm_kernels_benchmark(PcmBenchmark *results, int max, size_t bytes);
+
+/**
+ * The kernels are picked once according to the CPU: "neon", "sse2" or "c".
+ * SIMD and C kernels give identical output.
+ */
+const char *pcm_kernels();
+
+/**
+ * Fall back to the C kernels, for comparing
+ */
+void pcm_set_simd(bool enable);
+
+#endif //PCM_KERNELS_H
@@ -2,92 +2,372 @@
 // Created by xu fulong on 2022/8/5.
 //
 
-#include <cstdio>
+#include "pcm_process.h"
+
 #include <cerrno>
-#include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGE(FORMAT, ...) __android_log_print(ANDROID_LOG_ERROR, "PcmProcess", FORMAT, ##__VA_ARGS__)
+#else
+#include <cstdio>
+#define LOGE(FORMAT, ...) fprintf(stderr, FORMAT "\n", ##__VA_ARGS__)
+#endif
+
+// bytes read or written at a time
+#define PCM_BLOCK_SIZE (1 << 20)
+
+/******************** PcmReader ********************/
+
+PcmReader::~PcmReader() {
+    close();
+}
+
+int PcmReader::open(const char *path) {
+    close();
+    m_fd = ::open(path, O_RDONLY);
+    if (m_fd < 0) {
+        int ret = -errno;
+        LOGE("open %s fail, msg=%s", path, strerror(errno));
+        return ret;
+    }
+    struct stat st = {};
+    if (fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+            m_map  = (uint8_t *) map;
+            m_size = (size_t) st.st_size;
+        }
+    }
+    return 0;
+}
+
+size_t PcmReader::read(const uint8_t **data, size_t max, size_t unit) {
+    size_t want = max / unit * unit;
+    if (want == 0)
+        want = unit;
+    if (m_map) {
+        size_t size = m_size - m_pos < want ? (m_size - m_pos) / unit * unit : want;
+        *data  = m_map + m_pos;
+        m_pos += size;
+        return size;
+    }
+    if (m_fd < 0)
+        return 0;
 
-void pcm_raise_speed(char *input_path, char *output_path)
+    // the partial frame left by the last read goes first
+    if (m_buffer.size() < want)
+        m_buffer.resize(want);
+    if (m_carry > 0)
+        memmove(m_buffer.data(), m_buffer.data() + m_carryOffset, m_carry);
+    size_t have = m_carry;
+    while (have < want && !m_eof) {
+        ssize_t n = ::read(m_fd, m_buffer.data() + have, want - have);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            m_eof = true;
+            break;
+        }
+        have += (size_t) n;
+    }
+    size_t size   = have / unit * unit;
+    m_carry       = have - size;
+    m_carryOffset = size;
+    *data = m_buffer.data();
+    return size;
+}
+
+void PcmReader::close() {
+    if (m_map) {
+        munmap(m_map, m_size);
+        m_map = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_size  = 0;
+    m_pos   = 0;
+    m_carry = 0;
+    m_carryOffset = 0;
+    m_eof = false;
+}
+
+/******************** PcmWriter ********************/
+
+PcmWriter::~PcmWriter() {
+    close();
+}
+
+int PcmWriter::open(const char *path) {
+    close();
+    m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        int ret = -errno;
+        LOGE("open %s fail, msg=%s", path, strerror(errno));
+        return ret;
+    }
+    m_buffer.resize(PCM_BLOCK_SIZE);
+    m_used  = 0;
+    m_error = 0;
+    return 0;
+}
+
+int PcmWriter::flush() {
+    size_t done = 0;
+    while (done < m_used && m_error == 0) {
+        ssize_t n = ::write(m_fd, m_buffer.data() + done, m_used - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            m_error = -errno;
+            LOGE("write fail, msg=%s", strerror(errno));
+            break;
+        }
+        done += (size_t) n;
+    }
+    m_used = 0;
+    return m_error;
+}
+
+uint8_t *PcmWriter::reserve(size_t size) {
+    if (m_used + size > m_buffer.size()) {
+        flush();
+        if (size > m_buffer.size())
+            m_buffer.resize(size);
+    }
+    return m_buffer.data() + m_used;
+}
+
+void PcmWriter::commit(size_t size) {
+    m_used += size;
+}
+
+int PcmWriter::close() {
+    if (m_fd < 0)
+        return 0;
+    flush();
+    if (::close(m_fd) < 0 && m_error == 0)
+        m_error = -errno;
+    m_fd = -1;
+    return m_error;
+}
+
+/******************** operations ********************/
+
+static bool valid_format(const PcmFormat &format) {
+    if (format.channels <= 0 || format.planar) {
+        LOGE("invalid format, channels=%d, planar=%d", format.channels, format.planar);
+        return false;
+    }
+    return true;
+}
+
+int pcm_raise_speed(const char *input_path, const char *output_path, const PcmFormat &format, int sample_rate)
+{
+    return pcm_change_speed(input_path, output_path, format, sample_rate, 2.0f);
+}
+
+int pcm_change_speed(const char *input_path, const char *output_path, const PcmFormat &format,
+                     int sample_rate, float speed)
+{
+    if (!valid_format(format))
+        return -EINVAL;
+    PcmTimeStretch stretch;
+    int ret;
+    if ((ret = stretch.init(sample_rate, format)) < 0)
+        return ret;
+    stretch.setSpeed(speed);
+    PcmReader input;
+    PcmWriter output;
+    if ((ret = input.open(input_path)) < 0 || (ret = output.open(output_path)) < 0)
+        return ret;
+
+    size_t frame_size = (size_t) pcm_frame_size(format);
+    // pulled by blocks, as the output of a block may be twice its size
+    size_t block = PCM_BLOCK_SIZE / 4 / frame_size;
+    const uint8_t *data;
+    size_t size;
+    bool end = false;
+    while (!end) {
+        size = input.read(&data, block * frame_size, frame_size);
+        if (size > 0) {
+            stretch.push(data, size / frame_size);
+        } else {
+            stretch.flush();
+            end = true;
+        }
+        size_t frames;
+        while ((frames = stretch.pull(output.reserve(block * frame_size), block)) > 0) {
+            output.commit(frames * frame_size);
+        }
+    }
+    return output.close();
+}
+
+int pcm_change_volume(const char *input_path, const char *output_path, const PcmFormat &format, float gain)
+{
+    if (!valid_format(format))
+        return -EINVAL;
+    PcmReader input;
+    PcmWriter output;
+    int ret;
+    if ((ret = input.open(input_path)) < 0 || (ret = output.open(output_path)) < 0)
+        return ret;
+
+    size_t sample_size = (size_t) pcm_sample_size(format.type);
+    const uint8_t *data;
+    size_t size;
+    while ((size = input.read(&data, PCM_BLOCK_SIZE, (size_t) pcm_frame_size(format))) > 0) {
+        pcm_gain(format.type, output.reserve(size), data, size / sample_size, gain);
+        output.commit(size);
+    }
+    return output.close();
+}
+
+int pcm_split_channel(const char *input_path, const char *const *output_paths, const PcmFormat &format)
 {
-    FILE *input = fopen(input_path, "rb+");
-    FILE *output = fopen(output_path, "wb+");
-    if (!input && !output) {
-        printf("open file fail, msg=%s\n", strerror(errno));
-        return;
-    }
-
-    int count = 0;
-    char *buf = (char*) malloc(sizeof(char) * 4);
-    while(!feof(input)) {
-        fread(buf, sizeof(char), 4, input);
-        if (count % 2 == 0) {
-            // L
-            fwrite(buf, sizeof(char), 2, output);
-            // R
-            fwrite(buf + 2, sizeof(char), 2, output);
+    if (!valid_format(format))
+        return -EINVAL;
+    int channels = format.channels;
+    PcmReader input;
+    std::vector<PcmWriter> outputs((size_t) channels);
+    int ret;
+    if ((ret = input.open(input_path)) < 0)
+        return ret;
+    for (int c = 0; c < channels; c++) {
+        if ((ret = outputs[c].open(output_paths[c])) < 0)
+            return ret;
+    }
+
+    size_t frame_size  = (size_t) pcm_frame_size(format);
+    size_t sample_size = (size_t) pcm_sample_size(format.type);
+    std::vector<void *> planes((size_t) channels);
+    const uint8_t *data;
+    size_t size;
+    while ((size = input.read(&data, PCM_BLOCK_SIZE, frame_size)) > 0) {
+        size_t frames = size / frame_size;
+        for (int c = 0; c < channels; c++) {
+            planes[c] = outputs[c].reserve(frames * sample_size);
         }
-        count++;
+        pcm_split(format.type, planes.data(), data, channels, frames);
+        for (int c = 0; c < channels; c++) {
+            outputs[c].commit(frames * sample_size);
+        }
+    }
+    for (int c = 0; c < channels; c++) {
+        int closed = outputs[c].close();
+        if (ret >= 0)
+            ret = closed;
     }
+    return ret;
+}
 
-    free(buf);
-    fclose(output);
-    fclose(input);
+int pcm_merge_channel(const char *const *input_paths, const char *output_path, const PcmFormat &format)
+{
+    if (!valid_format(format))
+        return -EINVAL;
+    int channels = format.channels;
+    std::vector<PcmReader> inputs((size_t) channels);
+    PcmWriter output;
+    int ret;
+    for (int c = 0; c < channels; c++) {
+        if ((ret = inputs[c].open(input_paths[c])) < 0)
+            return ret;
+    }
+    if ((ret = output.open(output_path)) < 0)
+        return ret;
+
+    size_t sample_size = (size_t) pcm_sample_size(format.type);
+    size_t block = PCM_BLOCK_SIZE / channels / sample_size * sample_size;
+    std::vector<const void *> planes((size_t) channels);
+    std::vector<size_t> sizes((size_t) channels);
+    std::vector<std::vector<uint8_t>> padded((size_t) channels);
+    while (true) {
+        size_t size = 0;
+        for (int c = 0; c < channels; c++) {
+            const uint8_t *data;
+            sizes[c]  = inputs[c].read(&data, block, sample_size);
+            planes[c] = data;
+            size = sizes[c] > size ? sizes[c] : size;
+        }
+        if (size == 0)
+            break;
+        // only at the end of the shorter files
+        for (int c = 0; c < channels; c++) {
+            if (sizes[c] == size)
+                continue;
+            padded[c].assign(size, 0);
+            if (sizes[c] > 0)
+                memcpy(padded[c].data(), planes[c], sizes[c]);
+            planes[c] = padded[c].data();
+        }
+        size_t frames = size / sample_size;
+        pcm_merge(format.type, output.reserve(size * channels), planes.data(), channels, frames);
+        output.commit(size * channels);
+    }
+    return output.close();
 }
 
-void pcm_change_volume(char *input_path, char *output_path)
+int pcm_mix(const char *input_a, const char *input_b, const char *output_path, const PcmFormat &format)
 {
-    FILE *input = fopen(input_path, "rb+");
-    FILE *output = fopen(output_path, "wb+");
-    if (!input && !output) {
-        printf("open file fail, msg=%s\n", strerror(errno));
-        return;
-    }
-
-    int count = 0;
-    char *buf = (char*) malloc(sizeof(char) * 4);
-    while(!feof(input)) {
-        fread(buf, sizeof(char), 4, input);
-        short *left = (short*) buf;
-        *left /= 2;
-        short *right = (short*) (buf + 2);
-        *right /= 2;
-        // L
-        fwrite(left, sizeof(short), 1, output);
-        // R
-        fwrite(right, sizeof(short), 1, output);
-        count++;
-    }
-    printf("resample count=%d\n", count);
-
-    free(buf);
-    fclose(output);
-    fclose(input);
-}
-
-void pcm_split_channel(char *input_path, char *left_path, char *right_path)
+    if (!valid_format(format))
+        return -EINVAL;
+    PcmReader a;
+    PcmReader b;
+    PcmWriter output;
+    int ret;
+    if ((ret = a.open(input_a)) < 0 || (ret = b.open(input_b)) < 0 || (ret = output.open(output_path)) < 0)
+        return ret;
+
+    size_t frame_size  = (size_t) pcm_frame_size(format);
+    size_t sample_size = (size_t) pcm_sample_size(format.type);
+    while (true) {
+        const uint8_t *data_a;
+        const uint8_t *data_b;
+        size_t size_a = a.read(&data_a, PCM_BLOCK_SIZE, frame_size);
+        size_t size_b = b.read(&data_b, PCM_BLOCK_SIZE, frame_size);
+        size_t size   = size_a > size_b ? size_a : size_b;
+        if (size == 0)
+            break;
+        size_t both = size_a < size_b ? size_a : size_b;
+        uint8_t *dst = output.reserve(size);
+        pcm_mix(format.type, dst, data_a, data_b, both / sample_size);
+        if (size > both)
+            memcpy(dst + both, (size_a > size_b ? data_a : data_b) + both, size - both);
+        output.commit(size);
+    }
+    return output.close();
+}
+
+int pcm_convert_file(const char *input_path, const PcmFormat &input_format,
+                     const char *output_path, const PcmFormat &output_format)
 {
-    FILE *input = fopen(input_path, "rb+");
-    FILE *left = fopen(left_path, "wb+");
-    FILE *right = fopen(right_path, "wb+");
-    if (!input && !left && !right) {
-        printf("open file fail, msg=%s\n", strerror(errno));
-        return;
-    }
-
-    int count = 0;
-    char *buf = (char*) malloc(sizeof(char) * 4);
-    while(!feof(input)) {
-        fread(buf, sizeof(char), 4, input);
-        // L
-        fwrite(buf, sizeof(char), 2, left);
-        // R
-        fwrite(buf+2, sizeof(char), 2, right);
-        count++;
-    }
-    printf("resample count=%d\n", count);
-
-    free(buf);
-    fclose(left);
-    fclose(right);
-    fclose(input);
-}
\ No newline at end of file
+    if (!valid_format(input_format) || !valid_format(output_format))
+        return -EINVAL;
+    if (input_format.channels != output_format.channels)
+        return -EINVAL;
+    PcmReader input;
+    PcmWriter output;
+    int ret;
+    if ((ret = input.open(input_path)) < 0 || (ret = output.open(output_path)) < 0)
+        return ret;
+
+    size_t in_frame  = (size_t) pcm_frame_size(input_format);
+    size_t out_frame = (size_t) pcm_frame_size(output_format);
+    const uint8_t *data;
+    size_t size;
+    while ((size = input.read(&data, PCM_BLOCK_SIZE, in_frame)) > 0) {
+        size_t frames = size / in_frame;
+        pcm_convert(output_format, output.reserve(frames * out_frame), input_format, data, frames);
+        output.commit(frames * out_frame);
+    }
+    return output.close();
+}
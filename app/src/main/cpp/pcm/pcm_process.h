@@ -0,0 +1,120 @@
+//
+// Processing of raw PCM files by large blocks, with the kernels of pcm_kernels.h.
+//
+
+#ifndef PCM_PROCESS_H
+#define PCM_PROCESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "pcm_kernels.h"
+#include "pcm_stretch.h"
+
+/**
+ * Reads a file by blocks of whole frames: mapped when possible, otherwise through a buffer.
+ * A partial frame at the end of the file is ignored.
+ */
+class PcmReader {
+private:
+
+    int m_fd = -1;
+    uint8_t *m_map = nullptr;
+    size_t m_size  = 0;
+    size_t m_pos   = 0;
+    // fallback when the file can't be mapped
+    std::vector<uint8_t> m_buffer;
+    size_t m_carry = 0;       // bytes of a partial frame, after m_carryOffset
+    size_t m_carryOffset = 0;
+    bool m_eof = false;
+
+public:
+
+    ~PcmReader();
+
+    int open(const char *path);
+
+    /**
+     * @param data  the next block, valid until the next call
+     * @param max   bytes at most
+     * @param unit  size of a frame, the block holds whole ones
+     * @return bytes of the block, 0 at the end of the file
+     */
+    size_t read(const uint8_t **data, size_t max, size_t unit);
+
+    void close();
+};
+
+/**
+ * Writes a file by large blocks, the kernels writing straight into the block being filled.
+ */
+class PcmWriter {
+private:
+
+    int m_fd = -1;
+    std::vector<uint8_t> m_buffer;
+    size_t m_used = 0;
+    int m_error   = 0;
+
+    int flush();
+
+public:
+
+    ~PcmWriter();
+
+    int open(const char *path);
+
+    /**
+     * Room for size bytes, to be committed once written.
+     */
+    uint8_t *reserve(size_t size);
+
+    void commit(size_t size);
+
+    /**
+     * Flush and close.
+     * @return 0, or the first error met while writing
+     */
+    int close();
+};
+
+// all the functions below return 0, or a negative errno
+
+/**
+ * Play twice as fast, the pitch kept.
+ */
+int pcm_raise_speed(const char *input_path, const char *output_path, const PcmFormat &format, int sample_rate);
+
+/**
+ * Time-stretch with PcmTimeStretch, the pitch kept.
+ * @param speed from PCM_STRETCH_MIN_SPEED to PCM_STRETCH_MAX_SPEED
+ */
+int pcm_change_speed(const char *input_path, const char *output_path, const PcmFormat &format,
+                     int sample_rate, float speed);
+
+int pcm_change_volume(const char *input_path, const char *output_path, const PcmFormat &format, float gain);
+
+/**
+ * One mono file for each channel.
+ * @param output_paths format.channels paths
+ */
+int pcm_split_channel(const char *input_path, const char *const *output_paths, const PcmFormat &format);
+
+/**
+ * Interleave mono files, the shorter ones padded with silence.
+ * @param input_paths format.channels paths
+ */
+int pcm_merge_channel(const char *const *input_paths, const char *output_path, const PcmFormat &format);
+
+/**
+ * Sum two files of the same format, the rest of the longer one is copied.
+ */
+int pcm_mix(const char *input_a, const char *input_b, const char *output_path, const PcmFormat &format);
+
+/**
+ * Change the sample type, the channels stay the same.
+ */
+int pcm_convert_file(const char *input_path, const PcmFormat &input_format,
+                     const char *output_path, const PcmFormat &output_format);
+
+#endif //PCM_PROCESS_H
@@ -0,0 +1,258 @@
+//
+// Time-stretch of PCM by WSOLA: the speed changes, the pitch stays.
+//
+
+#include "pcm_stretch.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// a window covers a few pitch periods, at 50% overlap its Hann weights sum to 1
+#define WINDOW_MS 40
+// how far a window may move from where the speed puts it
+#define SEARCH_MS 10
+// the search goes by this step, then around the best one frame at a time
+#define SEARCH_STEP 4
+
+PcmTimeStretch::PcmTimeStretch() : m_speed(1.0f) {}
+
+int PcmTimeStretch::init(int sampleRate, const PcmFormat &format) {
+    if (sampleRate <= 0 || format.channels <= 0 || format.planar)
+        return -EINVAL;
+    m_format   = format;
+    m_channels = format.channels;
+    m_hop      = sampleRate * WINDOW_MS / 1000 / 2;
+    m_window   = m_hop * 2;
+    m_search   = sampleRate * SEARCH_MS / 1000;
+    m_weights.resize((size_t) m_window * m_channels);
+    for (int i = 0; i < m_window; i++) {
+        auto weight = (float) (0.5 - 0.5 * cos(2 * M_PI * i / m_window));
+        for (int c = 0; c < m_channels; c++) {
+            m_weights[(size_t) i * m_channels + c] = weight;
+        }
+    }
+    m_overlap.resize((size_t) m_hop * m_channels);
+    reset();
+    return 0;
+}
+
+void PcmTimeStretch::setSpeed(float speed) {
+    m_speed = std::min(std::max(speed, PCM_STRETCH_MIN_SPEED), PCM_STRETCH_MAX_SPEED);
+}
+
+float PcmTimeStretch::getSpeed() const {
+    return m_speed;
+}
+
+void PcmTimeStretch::reset() {
+    m_input.clear();
+    m_mono.clear();
+    m_output.clear();
+    m_outputRead = 0;
+    m_produced   = 0;
+    m_inputBase  = 0;
+    m_inputEnd   = 0;
+    m_first   = true;
+    m_nominal = 0;
+    m_prev    = 0;
+    std::fill(m_overlap.begin(), m_overlap.end(), 0.0f);
+}
+
+void PcmTimeStretch::push(const void *data, size_t frames) {
+    if (m_channels <= 0 || frames == 0)
+        return;
+    size_t used = m_input.size();
+    m_input.resize(used + frames * m_channels);
+    pcm_convert_samples(PCM_F32, m_input.data() + used, m_format.type, data, frames * m_channels);
+
+    const float *src = m_input.data() + used;
+    size_t mono = m_mono.size();
+    m_mono.resize(mono + frames);
+    float scale = 1.0f / m_channels;
+    for (size_t i = 0; i < frames; i++) {
+        float sum = 0;
+        for (int c = 0; c < m_channels; c++) {
+            sum += src[i * m_channels + c];
+        }
+        m_mono[mono + i] = sum * scale;
+    }
+    m_inputEnd += frames;
+    process();
+}
+
+int64_t PcmTimeStretch::search(int64_t target, int64_t from, int64_t to, int64_t reference) {
+    const float *ref = m_mono.data() + (reference - m_inputBase);
+    auto score = [&](int64_t pos) {
+        float energy;
+        float dot = pcm_correlate(ref, m_mono.data() + (pos - m_inputBase), (size_t) m_hop, &energy);
+        return dot / sqrtf(energy + 1e-9f);
+    };
+    // ties, e.g. in silence, stay at the nominal position
+    int64_t best     = target;
+    float best_score = score(target);
+    for (int64_t pos = target - (target - from) / SEARCH_STEP * SEARCH_STEP; pos <= to; pos += SEARCH_STEP) {
+        float value = pos == target ? best_score : score(pos);
+        if (value > best_score) {
+            best_score = value;
+            best = pos;
+        }
+    }
+    int64_t center = best;
+    int64_t first  = std::max(from, center - SEARCH_STEP + 1);
+    int64_t last   = std::min(to, center + SEARCH_STEP - 1);
+    for (int64_t pos = first; pos <= last; pos++) {
+        if (pos == center)
+            continue;
+        float value = score(pos);
+        if (value > best_score) {
+            best_score = value;
+            best = pos;
+        }
+    }
+    m_searches++;
+    return best;
+}
+
+void PcmTimeStretch::process() {
+    size_t half = (size_t) m_hop * m_channels;
+    while (true) {
+        float speed = m_speed;
+        int64_t pos;
+        if (m_first) {
+            if (m_inputEnd - m_inputBase < m_window)
+                break;
+            pos = m_inputBase;
+        } else if (speed == 1.0f) {
+            // the natural continuation, the input comes out as it is but for rounding
+            pos = m_prev + m_hop;
+            if (pos + m_window > m_inputEnd)
+                break;
+        } else {
+            auto target = (int64_t) llround(m_nominal);
+            int64_t from = std::max(target - m_search, m_inputBase);
+            int64_t to   = target + m_search;
+            if (to + m_window > m_inputEnd || m_prev + m_window > m_inputEnd)
+                break;
+            // the window starting where the last one would go on
+            pos = search(target, from, to, m_prev + m_hop);
+        }
+
+        const float *src = m_input.data() + (pos - m_inputBase) * m_channels;
+        size_t used = m_output.size();
+        m_output.resize(used + half);
+        m_produced += m_hop;
+        float *dst = m_output.data() + used;
+        if (m_first) {
+            // as if a window before the start overlapped the first half
+            memcpy(dst, src, half * sizeof(float));
+        } else {
+            memcpy(dst, m_overlap.data(), half * sizeof(float));
+            pcm_overlap_add(dst, src, m_weights.data(), half);
+        }
+        std::fill(m_overlap.begin(), m_overlap.end(), 0.0f);
+        pcm_overlap_add(m_overlap.data(), src + half, m_weights.data() + half, half);
+
+        m_nominal = (m_first ? (double) pos : m_nominal) + m_hop * (double) speed;
+        m_prev    = pos;
+        m_first   = false;
+    }
+
+    // drop the input no window can reach any more
+    if (m_first)
+        return;
+    int64_t keep = std::min((int64_t) llround(m_nominal) - m_search, m_prev + m_hop);
+    if (keep > m_inputBase) {
+        auto drop = (size_t) std::min(keep - m_inputBase, (int64_t) m_mono.size());
+        m_input.erase(m_input.begin(), m_input.begin() + drop * m_channels);
+        m_mono.erase(m_mono.begin(), m_mono.begin() + drop);
+        m_inputBase += drop;
+    }
+}
+
+size_t PcmTimeStretch::available() const {
+    return m_channels > 0 ? m_output.size() / m_channels - m_outputRead : 0;
+}
+
+size_t PcmTimeStretch::pull(void *data, size_t max) {
+    size_t frames = std::min(max, available());
+    if (frames == 0)
+        return 0;
+    pcm_convert_samples(m_format.type, data, PCM_F32,
+                        m_output.data() + m_outputRead * m_channels, frames * m_channels);
+    m_outputRead += frames;
+    if (m_outputRead * m_channels == m_output.size()) {
+        m_output.clear();
+        m_outputRead = 0;
+    } else if (m_outputRead * m_channels * 2 > m_output.size()) {
+        m_output.erase(m_output.begin(), m_output.begin() + m_outputRead * m_channels);
+        m_outputRead = 0;
+    }
+    return frames;
+}
+
+void PcmTimeStretch::flush() {
+    if (m_channels <= 0 || m_inputEnd == 0)
+        return;
+    // the next window goes at m_produced in the output and m_nominal in the input
+    int64_t end    = m_inputEnd;
+    int64_t length = m_produced + (int64_t) llround((end - m_nominal) / m_speed);
+    size_t frames  = (size_t) (m_window + m_search);
+    std::vector<uint8_t> silence(frames * pcm_frame_size(m_format), 0);
+    while (m_first || llround(m_nominal) < end) {
+        push(silence.data(), frames);
+    }
+    m_output.insert(m_output.end(), m_overlap.begin(), m_overlap.end());
+    m_produced += m_hop;
+    std::fill(m_overlap.begin(), m_overlap.end(), 0.0f);
+
+    // cut what comes from the silence, unless already pulled
+    auto extra = (size_t) std::max(m_produced - length, (int64_t) 0);
+    extra = std::min(extra, available());
+    m_output.resize(m_output.size() - extra * m_channels);
+    m_produced -= extra;
+}
+
+int64_t PcmTimeStretch::inputPosition() const {
+    return m_first ? 0 : (int64_t) m_nominal;
+}
+
+int64_t PcmTimeStretch::searches() const {
+    return m_searches;
+}
+
+int64_t pcm_stretch_benchmark(int sampleRate, float speed, int seconds) {
+    PcmFormat format = {PCM_S16, 2, false};
+    PcmTimeStretch stretch;
+    if (seconds <= 0 || stretch.init(sampleRate, format) < 0)
+        return -EINVAL;
+    stretch.setSpeed(speed);
+
+    // two tones and some noise, pushed by blocks like decoded frames
+    size_t total = (size_t) sampleRate * seconds;
+    std::vector<int16_t> input(total * 2);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < total; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        double t = (double) i / sampleRate;
+        double v = 0.4 * sin(2 * M_PI * 220 * t) + 0.2 * sin(2 * M_PI * 1330 * t)
+                + 0.05 * ((int32_t) seed / 2147483648.0);
+        input[i * 2]     = (int16_t) (v * 32767);
+        input[i * 2 + 1] = (int16_t) (v * 0.8 * 32767);
+    }
+    const size_t block = 1024;
+    std::vector<int16_t> output(block * 2 * 4);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < total; done += block) {
+        stretch.push(input.data() + done * 2, std::min(block, total - done));
+        while (stretch.pull(output.data(), output.size() / 2) > 0) {}
+    }
+    stretch.flush();
+    while (stretch.pull(output.data(), output.size() / 2) > 0) {}
+    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+    return cost / seconds;
+}
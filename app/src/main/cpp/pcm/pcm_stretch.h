@@ -0,0 +1,111 @@
+//
+// Time-stretch of PCM by WSOLA: the speed changes, the pitch stays.
+//
+
+#ifndef PCM_STRETCH_H
+#define PCM_STRETCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "pcm_kernels.h"
+
+#define PCM_STRETCH_MIN_SPEED 0.5f
+#define PCM_STRETCH_MAX_SPEED 4.0f
+
+/**
+ * Windows of the input are overlap-added at a fixed hop, picked around the position the speed
+ * asks for where they best continue the previous one (waveform similarity overlap-add).
+ * push() and pull() are for one thread, setSpeed() may be called from any thread
+ * and applies from the next window.
+ */
+class PcmTimeStretch {
+private:
+
+    PcmFormat m_format = {PCM_S16, 0, false};
+    int m_channels = 0;
+    int m_window = 0; // frames of a window
+    int m_hop    = 0; // output frames per window, half of it
+    int m_search = 0; // frames searched on each side of the nominal position
+    std::vector<float> m_weights; // Hann, repeated for each channel
+
+    std::atomic<float> m_speed;
+
+    // input from m_inputBase, interleaved and downmixed for the search
+    std::vector<float> m_input;
+    std::vector<float> m_mono;
+    int64_t m_inputBase = 0;
+    int64_t m_inputEnd  = 0;
+
+    bool m_first = true;
+    double m_nominal = 0; // input position of the next window, as the speed goes
+    int64_t m_prev   = 0; // input position of the last window
+    std::vector<float> m_overlap; // second half of the last window, weighted
+
+    std::vector<float> m_output;
+    size_t m_outputRead = 0; // frames
+    int64_t m_produced  = 0; // frames output since reset()
+    int64_t m_searches  = 0;
+
+    int64_t search(int64_t target, int64_t from, int64_t to, int64_t reference);
+
+    void process();
+
+public:
+
+    PcmTimeStretch();
+
+    /**
+     * @param format interleaved
+     * @return 0, or -EINVAL
+     */
+    int init(int sampleRate, const PcmFormat &format);
+
+    /**
+     * Clamped to [PCM_STRETCH_MIN_SPEED, PCM_STRETCH_MAX_SPEED]
+     */
+    void setSpeed(float speed);
+
+    float getSpeed() const;
+
+    void push(const void *data, size_t frames);
+
+    /**
+     * @return frames written into data, at most max
+     */
+    size_t pull(void *data, size_t max);
+
+    /**
+     * frames ready to be pulled
+     */
+    size_t available() const;
+
+    /**
+     * End of the input: the rest is processed against silence, cut to the length the speed gives.
+     */
+    void flush();
+
+    /**
+     * Forget the input, after a seek. The speed is kept.
+     */
+    void reset();
+
+    /**
+     * input frames consumed so far, the position of what is pulled
+     */
+    int64_t inputPosition() const;
+
+    /**
+     * windows placed by searching, not at speed 1.0
+     */
+    int64_t searches() const;
+};
+
+/**
+ * Time to stretch seconds of stereo s16 tones and noise at sampleRate, pushed by blocks of 1024 frames.
+ * @return microseconds per second of input audio
+ */
+int64_t pcm_stretch_benchmark(int sampleRate, float speed, int seconds);
+
+#endif //PCM_STRETCH_H
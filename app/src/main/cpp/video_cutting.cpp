@@ -4,124 +4,768 @@
 
 #include <video_cutting.h>
 
+#include <algorithm>
+#include <cinttypes>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavutil/intreadwrite.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+#ifdef __cplusplus
+}
+#endif
+
 #ifdef __ANDROID__
 #include <android/log.h>
+#define LOGI(FORMAT, ...) __android_log_print(ANDROID_LOG_INFO, "CutVideo", FORMAT, ##__VA_ARGS__)
 #define LOGE(FORMAT, ...) __android_log_print(ANDROID_LOG_ERROR, "CutVideo", FORMAT, ##__VA_ARGS__)
 #else
 #include <stdio.h>
+#define LOGI(FORMAT, ...) printf(FORMAT, ##__VA_ARGS__)
 #define LOGE(FORMAT, ...) printf(FORMAT, ##__VA_ARGS__)
 #endif
 
-int CutVideo::open_output_file(AVFormatContext *ifmt_ctx, const char *filename)
+// packets held per stream before muxing, to move back dts which would go backwards
+#define DTS_REORDER_SIZE 8
+// quality of the re-encoded frames, close to the copied ones next to them
+#define SMART_CUT_PRESET "veryfast"
+#define SMART_CUT_CRF    "18"
+// gap between ranges worth seeking over instead of reading through
+#define SEEK_GAP_US 10000000
+
+static inline int64_t packet_time(const AVPacket *packet) {
+    return packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+}
+
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
+    for (; p + 3 <= end; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+    return end;
+}
+
+/**
+ * Replace the data of packet with head followed by body, keeping its properties.
+ */
+static int replace_data(AVPacket *packet, const uint8_t *head, int head_size,
+                        const uint8_t *body, int body_size) {
+    AVPacket *tmp = av_packet_alloc();
+    if (!tmp)
+        return AVERROR(ENOMEM);
+    int ret = av_new_packet(tmp, head_size + body_size);
+    if (ret >= 0)
+        ret = av_packet_copy_props(tmp, packet);
+    if (ret < 0) {
+        av_packet_free(&tmp);
+        return ret;
+    }
+    if (head_size > 0)
+        memcpy(tmp->data, head, (size_t) head_size);
+    memcpy(tmp->data + head_size, body, (size_t) body_size);
+    av_packet_unref(packet);
+    av_packet_move_ref(packet, tmp);
+    av_packet_free(&tmp);
+    return 0;
+}
+
+/**
+ * The encoder writes start codes, an avcC stream wants NAL units prefixed with their length.
+ */
+static int annexb_to_length_prefixed(AVPacket *packet, int nal_length_size) {
+    std::vector<uint8_t> out;
+    out.reserve((size_t) packet->size + 16);
+    const uint8_t *end = packet->data + packet->size;
+    const uint8_t *nal = find_start_code(packet->data, end);
+    while (nal < end) {
+        nal += 3;
+        const uint8_t *next = find_start_code(nal, end);
+        const uint8_t *nal_end = next;
+        // trailing zeros, or the first byte of a 4 bytes start code
+        while (nal_end > nal && nal_end[-1] == 0)
+            nal_end--;
+        size_t length = (size_t) (nal_end - nal);
+        if (length > 0) {
+            for (int i = nal_length_size - 1; i >= 0; i--)
+                out.push_back((uint8_t) (length >> (8 * i)));
+            out.insert(out.end(), nal, nal_end);
+        }
+        nal = next;
+    }
+    return replace_data(packet, nullptr, 0, out.data(), (int) out.size());
+}
+
+CutVideo::~CutVideo() {
+    release();
+}
+
+int CutVideo::open_input_file(const char *filename)
+{
+    int ret = avformat_open_input(&ifmt_ctx, filename, nullptr, nullptr);
+    if (ret < 0) {
+        LOGE("Could not open input file %s\n", filename);
+        return ret;
+    }
+    ret = avformat_find_stream_info(ifmt_ctx, nullptr);
+    if (ret < 0) {
+        LOGE("Could not find stream info of %s\n", filename);
+        return ret;
+    }
+    m_videoIndex = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    // the main video, audio and subtitles, not cover arts nor data
+    m_included.assign(ifmt_ctx->nb_streams, false);
+    for (int i = 0; i < (int) ifmt_ctx->nb_streams; i++) {
+        enum AVMediaType type = ifmt_ctx->streams[i]->codecpar->codec_type;
+        m_included[i] = type == AVMEDIA_TYPE_VIDEO ? i == m_videoIndex
+                : type == AVMEDIA_TYPE_AUDIO || type == AVMEDIA_TYPE_SUBTITLE;
+    }
+    return 0;
+}
+
+int CutVideo::open_output_file(CutOutput &output)
 {
     int ret;
-    avformat_alloc_output_context2(&ofmt_ctx, nullptr, nullptr, filename);
-    if (!ofmt_ctx) {
+    const char *filename = output.range.output.c_str();
+    output.opened = true;
+    m_stats.outputs++;
+    avformat_alloc_output_context2(&output.ofmt_ctx, nullptr, nullptr, filename);
+    if (!output.ofmt_ctx) {
         LOGE("Could not create output context\n");
         return AVERROR_UNKNOWN;
     }
 
-    dts_start_offset = new int64_t [ifmt_ctx->nb_streams];
-    memset(dts_start_offset, -1, sizeof(int64_t) * ifmt_ctx->nb_streams);
-    pts_start_offset = new int64_t [ifmt_ctx->nb_streams];
-    memset(pts_start_offset, -1, sizeof(int64_t) * ifmt_ctx->nb_streams);
-
-    for (int i = 0; i < ifmt_ctx->nb_streams; i++) {
+    for (int i = 0; i < (int) ifmt_ctx->nb_streams; i++) {
+        if (!m_included[i])
+            continue;
         AVStream* in_stream = ifmt_ctx->streams[i];
-        AVCodecParameters* codecpar = in_stream->codecpar;
-
-        const AVCodec* dec = avcodec_find_decoder(codecpar->codec_id);
-        AVStream* out_stream = avformat_new_stream(ofmt_ctx, dec);
+        AVStream* out_stream = avformat_new_stream(output.ofmt_ctx, nullptr);
         if (!out_stream) {
             LOGE("Failed allocating output stream\n");
-            ret = AVERROR_UNKNOWN;
-            return ret;
+            return AVERROR_UNKNOWN;
         }
-        avcodec_parameters_copy(out_stream->codecpar, codecpar);
+        avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+        out_stream->codecpar->codec_tag = 0;
+        out_stream->time_base = in_stream->time_base;
     }
 
-    av_dump_format(ofmt_ctx, 0, filename, 1);
-    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&ofmt_ctx->pb, filename, AVIO_FLAG_WRITE);
+    av_dump_format(output.ofmt_ctx, 0, filename, 1);
+    if (!(output.ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&output.ofmt_ctx->pb, filename, AVIO_FLAG_WRITE);
         if (ret < 0) {
             LOGE("Could not open output file %s\n", filename);
             return ret;
         }
     }
     /* init muxer, write output file header */
-    ret = avformat_write_header(ofmt_ctx, nullptr);
+    ret = avformat_write_header(output.ofmt_ctx, nullptr);
     if (ret < 0) {
         LOGE("Error occurred when opening output file\n");
         return ret;
     }
+    output.header_written = true;
 
     return 0;
 }
 
-void CutVideo:: setParam(int64_t start_time, int64_t duration) {
+int CutVideo::init_smart_cut() {
+    if (m_videoIndex < 0)
+        return AVERROR_STREAM_NOT_FOUND;
+    AVStream *stream = ifmt_ctx->streams[m_videoIndex];
+    AVCodecParameters *codecpar = stream->codecpar;
+    if (codecpar->codec_id != AV_CODEC_ID_H264)
+        return AVERROR(ENOSYS);
+    m_encodeCodec = avcodec_find_encoder_by_name("libx264");
+    const AVCodec *decodeCodec = avcodec_find_decoder(codecpar->codec_id);
+    if (!m_encodeCodec || !decodeCodec)
+        return AVERROR_ENCODER_NOT_FOUND;
+    bool supported = false;
+    for (const enum AVPixelFormat *fmt = m_encodeCodec->pix_fmts; fmt && *fmt != AV_PIX_FMT_NONE; fmt++) {
+        if (*fmt == codecpar->format)
+            supported = true;
+    }
+    if (!supported)
+        return AVERROR(ENOSYS);
+
+    m_decoder = avcodec_alloc_context3(decodeCodec);
+    if (!m_decoder)
+        return AVERROR(ENOMEM);
+    int ret = avcodec_parameters_to_context(m_decoder, codecpar);
+    if (ret < 0)
+        return ret;
+    m_decoder->pkt_timebase = stream->time_base;
+    if ((ret = avcodec_open2(m_decoder, decodeCodec, nullptr)) < 0)
+        return ret;
+    if (!(m_frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+
+    // SPS and PPS from the extradata, in the format of the packets
+    const uint8_t *extra = codecpar->extradata;
+    const uint8_t *end   = extra + codecpar->extradata_size;
+    if (codecpar->extradata_size >= 7 && extra[0] == 1) {
+        m_nalLengthSize = (extra[4] & 0x03) + 1;
+        const uint8_t *p = extra + 5;
+        for (int type = 0; type < 2 && p < end; type++) {
+            int count = type == 0 ? (*p++ & 0x1f) : *p++;
+            for (int i = 0; i < count && end - p >= 2; i++) {
+                int length = AV_RB16(p);
+                p += 2;
+                if (end - p < length)
+                    break;
+                for (int j = m_nalLengthSize - 1; j >= 0; j--)
+                    m_paramSets.push_back((uint8_t) (length >> (8 * j)));
+                m_paramSets.insert(m_paramSets.end(), p, p + length);
+                p += length;
+            }
+        }
+    } else if (codecpar->extradata_size > 0) {
+        m_nalLengthSize = 0;
+        m_paramSets.assign(extra, end);
+    }
+    return 0;
+}
+
+int CutVideo::open_encoder(const AVFrame *frame, int gop_size) {
+    AVStream *stream = ifmt_ctx->streams[m_videoIndex];
+    m_encoder = avcodec_alloc_context3(m_encodeCodec);
+    if (!m_encoder)
+        return AVERROR(ENOMEM);
+    m_encoder->width   = frame->width;
+    m_encoder->height  = frame->height;
+    m_encoder->pix_fmt = (enum AVPixelFormat) frame->format;
+    m_encoder->sample_aspect_ratio    = frame->sample_aspect_ratio;
+    m_encoder->color_range            = frame->color_range;
+    m_encoder->color_primaries        = frame->color_primaries;
+    m_encoder->color_trc              = frame->color_trc;
+    m_encoder->colorspace             = frame->colorspace;
+    m_encoder->chroma_sample_location = frame->chroma_location;
+    m_encoder->time_base = stream->time_base;
+    m_encoder->framerate = av_guess_frame_rate(ifmt_ctx, stream, nullptr);
+    m_encoder->profile   = stream->codecpar->profile & ~(FF_PROFILE_H264_CONSTRAINED | FF_PROFILE_H264_INTRA);
+    m_encoder->level     = stream->codecpar->level;
+    // a single GOP in presentation order, so that dts simply follows pts
+    m_encoder->gop_size     = gop_size + 1;
+    m_encoder->max_b_frames = 0;
+    av_opt_set(m_encoder->priv_data, "preset", SMART_CUT_PRESET, 0);
+    av_opt_set(m_encoder->priv_data, "crf", SMART_CUT_CRF, 0);
+    int ret = avcodec_open2(m_encoder, m_encodeCodec, nullptr);
+    if (ret < 0) {
+        LOGE("Could not open encoder:%s\n", m_encodeCodec->name);
+        avcodec_free_context(&m_encoder);
+    }
+    return ret;
+}
+
+void CutVideo::set_range(CutOutput &output) {
+    int64_t start  = output.range.start * 1000;
+    int64_t end    = output.range.duration > 0 ? start + output.range.duration * 1000 : INT64_MAX;
+    int64_t offset = ifmt_ctx->start_time != AV_NOPTS_VALUE ? ifmt_ctx->start_time : 0;
+    if (!m_smartCut && m_keyIndex) {
+        // nothing is re-encoded, so the cut starts at the key frame
+        int64_t pts = av_rescale_q(start + offset, AV_TIME_BASE_Q, m_keyIndex->time_base);
+        int entry = keyframe_index_find(m_keyIndex, pts, AVSEEK_FLAG_BACKWARD);
+        start = av_rescale_q(m_keyIndex->entries[entry >= 0 ? entry : 0].pts, m_keyIndex->time_base, AV_TIME_BASE_Q) - offset;
+    }
+    output.streams.assign(ifmt_ctx->nb_streams, CutStream());
+    int out_index = 0;
+    for (int i = 0; i < (int) ifmt_ctx->nb_streams; i++) {
+        if (!m_included[i])
+            continue;
+        AVRational time_base = ifmt_ctx->streams[i]->time_base;
+        CutStream &stream = output.streams[i];
+        stream.out_index = out_index++;
+        stream.start = av_rescale_q(start + offset, AV_TIME_BASE_Q, time_base);
+        stream.end   = end == INT64_MAX ? INT64_MAX : av_rescale_q(end + offset, AV_TIME_BASE_Q, time_base);
+    }
+}
+
+void CutVideo::setParam(int64_t start_time, int64_t duration) {
     m_startTime = start_time;
     m_duration  = duration;
 }
 
-AVPacket* CutVideo::copy_packet(AVFormatContext *ifmt_ctx, AVPacket *packet) {
-    auto* pkt = (AVPacket*)av_malloc(sizeof(AVPacket));
-    av_new_packet(pkt, 0);
-    if (0 == av_packet_ref(pkt, packet)) {
-        AVStream* in_stream  = ifmt_ctx->streams[pkt->stream_index];
-        AVStream* out_stream = ofmt_ctx->streams[pkt->stream_index];
-        if (pts_start_offset[pkt->stream_index] == -1) {
-            pts_start_offset[pkt->stream_index] = pkt->pts;
-            dts_start_offset[pkt->stream_index] = pkt->dts;
+int CutVideo::seek_to_start(const CutOutput &output) {
+    int64_t start  = output.range.start * 1000;
+    int64_t offset = ifmt_ctx->start_time != AV_NOPTS_VALUE ? ifmt_ctx->start_time : 0;
+    if (m_keyIndex) {
+        int64_t pts = av_rescale_q(start + offset, AV_TIME_BASE_Q, m_keyIndex->time_base);
+        int entry = keyframe_index_find(m_keyIndex, pts, AVSEEK_FLAG_BACKWARD);
+        if (keyframe_index_seek(ifmt_ctx, m_keyIndex, entry >= 0 ? entry : 0) >= 0) {
+            return 0;
         }
+    }
+    if (start <= 0)
+        return 0;
+    return av_seek_frame(ifmt_ctx, -1, start + offset, AVSEEK_FLAG_BACKWARD);
+}
+
+int CutVideo::seek_forward() {
+    CutOutput *next = nullptr;
+    for (CutOutput &output : m_outputs) {
+        if (output.opened && !output.finished)
+            return 0;
+        if (!output.finished && !next)
+            next = &output;
+    }
+    // reading through a short gap costs less than seeking
+    if (!next || m_readTime == AV_NOPTS_VALUE || next->range.start * 1000 - m_readTime < SEEK_GAP_US)
+        return 0;
+    clear_gop();
+    m_stats.seeks++;
+    m_readTime = AV_NOPTS_VALUE;
+    if (seek_to_start(*next) < 0)
+        LOGE("Could not seek to %" PRId64 "ms, reading on\n", next->range.start);
+    return 0;
+}
 
-        // convert pts and dts
-        pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base, out_stream->time_base,
-                                    static_cast<AVRounding>(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
-        pkt->dts = av_rescale_q_rnd(pkt->dts, in_stream->time_base, out_stream->time_base,
-                                    static_cast<AVRounding>(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
-        pkt->duration = av_rescale_q(pkt->duration, in_stream->time_base, out_stream->time_base);
-        pkt->pos = -1;
-        return pkt;
+int CutVideo::mux_packet(CutOutput &output, CutStream &stream, AVPacket *packet) {
+    if (packet->dts != AV_NOPTS_VALUE)
+        stream.buffer.last_dts = packet->dts;
+    int ret = av_interleaved_write_frame(output.ofmt_ctx, packet);
+    if (ret < 0) {
+        LOGE("Error to mux packet, stream_index=%d, pts=%" PRId64 ", dts=%" PRId64 "\n",
+             stream.out_index, packet->pts, packet->dts);
     }
-    return nullptr;
+    av_packet_free(&packet);
+    return ret;
 }
 
-int CutVideo::write_internal(AVFormatContext *ifmt_ctx, AVPacket *packet)
+int CutVideo::write_packet(CutOutput &output, CutStream &stream, AVPacket *packet)
 {
     int ret;
-    AVPacket *pkt = copy_packet(ifmt_ctx, packet);
-    if (pkt == nullptr) {
-        LOGE("packet is NULL\n");
-        return -1;
-    }
-    pkt->pts = pkt->pts - pts_start_offset[pkt->stream_index];
-    pkt->dts = pkt->dts - dts_start_offset[pkt->stream_index];
-//    LOGE("pts=%ld, dts=%ld, stream_index=%d", pkt->pts, pkt->dts, pkt->stream_index);
-    // write packet into file
-    //TODO:when pts < dts, it occurs error.
-    // Therefore, wo need to cache packet queue, and ascend sort by dts
-    if ((ret = av_interleaved_write_frame(ofmt_ctx, pkt)) < 0) {
-        LOGE("Error to mux packet, stream_index=%d, pts=%ld, dts=%ld\n", pkt->stream_index, pkt->pts, pkt->dts);
-    }
-    av_packet_unref(pkt);
+    if (!output.opened && (ret = open_output_file(output)) < 0) {
+        av_packet_free(&packet);
+        return ret;
+    }
+    AVStream* in_stream  = ifmt_ctx->streams[packet->stream_index];
+    AVStream* out_stream = output.ofmt_ctx->streams[stream.out_index];
+    // the same offset for pts and dts, keeping the distance between them
+    if (packet->pts != AV_NOPTS_VALUE)
+        packet->pts -= stream.start;
+    if (packet->dts != AV_NOPTS_VALUE)
+        packet->dts -= stream.start;
+    av_packet_rescale_ts(packet, in_stream->time_base, out_stream->time_base);
+    packet->stream_index = stream.out_index;
+    packet->pos = -1;
+
+    std::vector<AVPacket*> &packets = stream.buffer.packets;
+    if (packet->dts == AV_NOPTS_VALUE)
+        packet->dts = packet->pts;
+    if (packet->pts != AV_NOPTS_VALUE && packet->dts > packet->pts) {
+        packet->dts = packet->pts;
+        m_stats.timestamps_fixed++;
+    }
+    packets.push_back(packet);
+    // make room for a dts going backwards by moving back the ones held before it
+    for (size_t i = packets.size() - 1; i > 0; i--) {
+        AVPacket *prev = packets[i - 1];
+        AVPacket *cur  = packets[i];
+        if (prev->dts == AV_NOPTS_VALUE || cur->dts == AV_NOPTS_VALUE || prev->dts < cur->dts)
+            break;
+        prev->dts = cur->dts - 1;
+        m_stats.timestamps_fixed++;
+    }
+    // not below what the muxer has already got, at the cost of pts as a last resort
+    int64_t last_dts = stream.buffer.last_dts;
+    for (AVPacket *held : packets) {
+        if (held->dts == AV_NOPTS_VALUE)
+            continue;
+        if (last_dts != AV_NOPTS_VALUE && held->dts <= last_dts) {
+            held->dts = last_dts + 1;
+            if (held->pts != AV_NOPTS_VALUE && held->pts < held->dts)
+                held->pts = held->dts;
+            m_stats.timestamps_fixed++;
+        }
+        last_dts = held->dts;
+    }
+
+    ret = 0;
+    while (packets.size() > DTS_REORDER_SIZE && ret >= 0) {
+        AVPacket *first = packets.front();
+        packets.erase(packets.begin());
+        ret = mux_packet(output, stream, first);
+    }
+    return ret;
+}
+
+
+int CutVideo::flush_buffer(CutOutput &output, CutStream &stream) {
+    int ret = 0;
+    std::vector<AVPacket*> &packets = stream.buffer.packets;
+    for (size_t i = 0; i < packets.size(); i++) {
+        if (ret >= 0) {
+            ret = mux_packet(output, stream, packets[i]);
+        } else {
+            av_packet_free(&packets[i]);
+        }
+    }
+    packets.clear();
+    return ret;
+}
+
+void CutVideo::clear_gop() {
+    for (AVPacket *packet : m_gop) {
+        av_packet_free(&packet);
+    }
+    m_gop.clear();
+}
+
+int CutVideo::copy_gop(CutOutput &output, int64_t from) {
+    int ret = 0;
+    CutStream &stream = output.streams[m_videoIndex];
+    for (size_t i = 0; i < m_gop.size() && ret >= 0; i++) {
+        int64_t pts = packet_time(m_gop[i]);
+        if (pts == AV_NOPTS_VALUE || pts < from || pts >= stream.end)
+            continue;
+        AVPacket *packet = av_packet_clone(m_gop[i]);
+        if (!packet)
+            return AVERROR(ENOMEM);
+        // the re-encoded frames before replaced the SPS and PPS
+        if ((packet->flags & AV_PKT_FLAG_KEY) && output.resend_param_sets && !m_paramSets.empty()) {
+            ret = replace_data(packet, m_paramSets.data(), (int) m_paramSets.size(), packet->data, packet->size);
+            output.resend_param_sets = false;
+            if (ret < 0) {
+                av_packet_free(&packet);
+                break;
+            }
+        }
+        m_stats.packets_copied++;
+        ret = write_packet(output, stream, packet);
+    }
+    return ret;
+}
+
+int CutVideo::encode_frame(CutOutput &output, AVFrame *frame, int64_t dts_delay) {
+    int ret;
+    CutStream &stream = output.streams[m_videoIndex];
+    if (frame) {
+        int64_t pts = frame->best_effort_timestamp;
+        if (pts == AV_NOPTS_VALUE || pts < stream.start || pts >= stream.end)
+            return 0;
+        if (!m_encoder && (ret = open_encoder(frame, (int) m_gop.size())) < 0)
+            return ret;
+        frame->pts = pts;
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        m_stats.frames_encoded++;
+    } else if (!m_encoder) {
+        return 0;
+    }
+    if ((ret = avcodec_send_frame(m_encoder, frame)) < 0)
+        return ret;
+
+    AVPacket *packet = av_packet_alloc();
+    if (!packet)
+        return AVERROR(ENOMEM);
+    while ((ret = avcodec_receive_packet(m_encoder, packet)) >= 0) {
+        // as far behind pts as in the source, to join the copied GOPs without going backwards
+        packet->dts = packet->pts - dts_delay;
+        packet->stream_index = m_videoIndex;
+        if (m_nalLengthSize > 0 && (ret = annexb_to_length_prefixed(packet, m_nalLengthSize)) < 0)
+            break;
+        AVPacket *out = av_packet_alloc();
+        if (!out) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        av_packet_move_ref(out, packet);
+        if ((ret = write_packet(output, stream, out)) < 0)
+            break;
+    }
+    av_packet_free(&packet);
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+int CutVideo::reencode_gop(CutOutput &output) {
+    int ret = 0;
+    AVPacket *key = m_gop[0];
+    int64_t dts_delay = 0;
+    if (key->pts != AV_NOPTS_VALUE && key->dts != AV_NOPTS_VALUE && key->pts > key->dts)
+        dts_delay = key->pts - key->dts;
+
+    avcodec_flush_buffers(m_decoder);
+    for (size_t i = 0; i <= m_gop.size() && ret >= 0; i++) {
+        // a null packet at the end drains the decoder
+        ret = avcodec_send_packet(m_decoder, i < m_gop.size() ? m_gop[i] : nullptr);
+        if (ret < 0) {
+            LOGE("Error to decode packet of the GOP\n");
+            ret = 0;
+            continue;
+        }
+        while (ret >= 0) {
+            ret = avcodec_receive_frame(m_decoder, m_frame);
+            if (ret < 0)
+                break;
+            ret = encode_frame(output, m_frame, dts_delay);
+            av_frame_unref(m_frame);
+        }
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            ret = 0;
+    }
+    if (ret >= 0)
+        ret = encode_frame(output, nullptr, dts_delay);
+    avcodec_free_context(&m_encoder);
+    avcodec_flush_buffers(m_decoder);
+    output.resend_param_sets = true;
     return ret;
 }
 
-void CutVideo::write_output_file(AVFormatContext *ifmt_ctx, AVPacket *packet) {
-    int64_t timestamp = packet->pts * av_q2d(ifmt_ctx->streams[packet->stream_index]->time_base);
-    if (timestamp >= m_startTime && timestamp < m_startTime + m_duration) {
-        write_internal(ifmt_ctx, packet);
+int CutVideo::process_gop() {
+    if (m_gop.empty())
+        return 0;
+    int64_t min_pts = INT64_MAX;
+    int64_t max_pts = INT64_MIN;
+    bool reordered  = false;
+    for (AVPacket *packet : m_gop) {
+        int64_t pts = packet_time(packet);
+        if (pts == AV_NOPTS_VALUE)
+            continue;
+        if (pts < max_pts)
+            reordered = true;
+        min_pts = FFMIN(min_pts, pts);
+        max_pts = FFMAX(max_pts, pts);
     }
+
+    int ret = 0;
+    for (CutOutput &output : m_outputs) {
+        CutStream &stream = output.streams[m_videoIndex];
+        if (output.finished || stream.done || ret < 0)
+            continue;
+        if (max_pts == INT64_MIN || max_pts < stream.start || min_pts >= stream.end) {
+            // outside of the range
+        } else if (!m_smartCut) {
+            // keep the whole GOP of a start between key frames, rather than frames without their references
+            ret = copy_gop(output, packet_time(m_gop[0]) < stream.start ? INT64_MIN : stream.start);
+        } else if (min_pts >= stream.start && (max_pts < stream.end || !reordered)) {
+            // inside the range, or ending in it without frames referring to later ones
+            ret = copy_gop(output, stream.start);
+        } else {
+            ret = reencode_gop(output);
+        }
+    }
+    clear_gop();
+    return ret;
+}
+
+int CutVideo::write_video(AVPacket *packet) {
+    int ret;
+    bool key = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+    if (key && (ret = process_gop()) < 0)
+        return ret;
+    // not decodable before the first key frame
+    if (!key && m_gop.empty())
+        return 0;
+    if (key && packet->pts != AV_NOPTS_VALUE) {
+        bool wanted = false;
+        for (CutOutput &output : m_outputs) {
+            CutStream &stream = output.streams[m_videoIndex];
+            if (output.finished || stream.done)
+                continue;
+            if (packet->pts >= stream.end) {
+                stream.done = true;
+            } else {
+                wanted = true;
+            }
+        }
+        if (!wanted)
+            return 0;
+    }
+    AVPacket *gop_packet = av_packet_clone(packet);
+    if (!gop_packet)
+        return AVERROR(ENOMEM);
+    m_gop.push_back(gop_packet);
+    return 0;
 }
 
-void CutVideo::close_output_file() {
+int CutVideo::write_other(AVPacket *packet) {
+    int64_t pts = packet_time(packet);
+    if (pts == AV_NOPTS_VALUE)
+        return 0;
+    int ret = 0;
+    for (CutOutput &output : m_outputs) {
+        CutStream &stream = output.streams[packet->stream_index];
+        if (output.finished || stream.done || pts < stream.start)
+            continue;
+        if (pts >= stream.end) {
+            stream.done = true;
+            continue;
+        }
+        AVPacket *out = av_packet_clone(packet);
+        if (!out)
+            return AVERROR(ENOMEM);
+        m_stats.packets_copied++;
+        if ((ret = write_packet(output, stream, out)) < 0)
+            break;
+    }
+    return ret;
+}
+
+bool CutVideo::all_done(const CutOutput &output) {
+    for (int i = 0; i < (int) ifmt_ctx->nb_streams; i++) {
+        enum AVMediaType type = ifmt_ctx->streams[i]->codecpar->codec_type;
+        // subtitles may never reach the end
+        if (m_included[i] && !output.streams[i].done
+                && (type == AVMEDIA_TYPE_VIDEO || type == AVMEDIA_TYPE_AUDIO))
+            return false;
+    }
+    return true;
+}
+
+int CutVideo::finish_outputs(bool eof) {
+    int ret = 0;
+    bool finished = false;
+    for (CutOutput &output : m_outputs) {
+        if (output.finished || (!eof && !all_done(output)))
+            continue;
+        // a range past the end of the input still gets its (empty) file
+        int result = output.opened ? 0 : open_output_file(output);
+        for (CutStream &stream : output.streams) {
+            if (stream.out_index < 0)
+                continue;
+            int flushed = result >= 0 ? flush_buffer(output, stream) : 0;
+            if (result >= 0)
+                result = flushed;
+        }
+        close_output_file(output);
+        output.finished = true;
+        finished = true;
+        if (result < 0) {
+            LOGE("Error to write %s\n", output.range.output.c_str());
+            if (ret >= 0)
+                ret = result;
+        }
+    }
+    if (finished && !eof && ret >= 0)
+        ret = seek_forward();
+    return ret;
+}
+
+int CutVideo::cut(const char *input, const char *output) {
+    std::vector<CutRange> ranges;
+    ranges.push_back({m_startTime, m_duration, output});
+    return cut(input, ranges);
+}
+
+int CutVideo::cut(const char *input, const std::vector<CutRange> &ranges) {
+    int ret;
+    int64_t begin = av_gettime_relative();
+    int64_t offset;
+    bool finished;
+    AVPacket *packet = nullptr;
+    m_stats = {0, 0, 0, 0, 0, 0, 0};
+    if (ranges.empty())
+        return AVERROR(EINVAL);
+
+    m_input = input;
+    if ((ret = open_input_file(input)) < 0)
+        goto end;
+    m_smartCut = init_smart_cut() >= 0;
+    if (!m_smartCut && m_videoIndex >= 0)
+        LOGI("Cut at key frames, %s is not re-encoded\n", avcodec_get_name(ifmt_ctx->streams[m_videoIndex]->codecpar->codec_id));
+    // one pass over the file doesn't pay for a scan: only an index of the container
+    // or a sidecar is used, otherwise seek_to_start goes through av_seek_frame
+    if (m_videoIndex >= 0)
+        m_keyIndex = keyframe_index_open(ifmt_ctx, m_videoIndex, input, -1, 0, 0);
+
+    m_outputs.resize(ranges.size());
+    for (size_t i = 0; i < ranges.size(); i++) {
+        m_outputs[i].range = ranges[i];
+    }
+    std::stable_sort(m_outputs.begin(), m_outputs.end(), [](const CutOutput &a, const CutOutput &b) {
+        return a.range.start < b.range.start;
+    });
+    for (CutOutput &cutOutput : m_outputs) {
+        set_range(cutOutput);
+    }
+    if (seek_to_start(m_outputs[0]) < 0)
+        LOGE("Could not seek, reading from the start\n");
+
+    packet = av_packet_alloc();
+    if (!packet) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    offset = ifmt_ctx->start_time != AV_NOPTS_VALUE ? ifmt_ctx->start_time : 0;
+    while ((ret = av_read_frame(ifmt_ctx, packet)) >= 0) {
+        m_stats.packets_read++;
+        int index = packet->stream_index;
+        if (packet_time(packet) != AV_NOPTS_VALUE) {
+            m_readTime = av_rescale_q(packet_time(packet), ifmt_ctx->streams[index]->time_base, AV_TIME_BASE_Q) - offset;
+        }
+        if (index < (int) m_included.size() && m_included[index]) {
+            ret = index == m_videoIndex ? write_video(packet) : write_other(packet);
+        }
+        av_packet_unref(packet);
+        if (ret >= 0)
+            ret = finish_outputs(false);
+        if (ret < 0)
+            break;
+        finished = true;
+        for (CutOutput &cutOutput : m_outputs) {
+            finished = finished && cutOutput.finished;
+        }
+        if (finished)
+            break;
+    }
+    if (ret == AVERROR_EOF)
+        ret = 0;
+    if (ret >= 0 && m_videoIndex >= 0)
+        ret = process_gop();
+    if (ret >= 0)
+        ret = finish_outputs(true);
+
+end:
+    av_packet_free(&packet);
+    release();
+    m_stats.elapsed_us = av_gettime_relative() - begin;
+    LOGI("cut ret=%d, outputs=%" PRId64 ", read=%" PRId64 ", seeks=%" PRId64 ", copied=%" PRId64
+         ", encoded=%" PRId64 ", fixed=%" PRId64 ", cost=%" PRId64 "us\n",
+         ret, m_stats.outputs, m_stats.packets_read, m_stats.seeks, m_stats.packets_copied,
+         m_stats.frames_encoded, m_stats.timestamps_fixed, m_stats.elapsed_us);
+    return ret;
+}
+
+CutStats CutVideo::getStats() {
+    return m_stats;
+}
+
+void CutVideo::close_output_file(CutOutput &output) {
+    AVFormatContext *ofmt_ctx = output.ofmt_ctx;
     if (!ofmt_ctx)
         return;
-    av_write_trailer(ofmt_ctx);
+    if (output.header_written)
+        av_write_trailer(ofmt_ctx);
     if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        avio_close(ofmt_ctx->pb);
+        avio_closep(&ofmt_ctx->pb);
     }
     avformat_free_context(ofmt_ctx);
-    delete pts_start_offset;
-    delete dts_start_offset;
-}
\ No newline at end of file
+    output.ofmt_ctx = nullptr;
+    output.header_written = false;
+}
+
+void CutVideo::release() {
+    clear_gop();
+    for (CutOutput &output : m_outputs) {
+        for (CutStream &stream : output.streams) {
+            for (AVPacket *packet : stream.buffer.packets) {
+                av_packet_free(&packet);
+            }
+            stream.buffer.packets.clear();
+        }
+        close_output_file(output);
+    }
+    m_outputs.clear();
+    m_included.clear();
+    keyframe_index_close(&m_keyIndex);
+    avcodec_free_context(&m_encoder);
+    avcodec_free_context(&m_decoder);
+    av_frame_free(&m_frame);
+    if (ifmt_ctx)
+        avformat_close_input(&ifmt_ctx);
+    m_input = nullptr;
+    m_videoIndex = -1;
+    m_readTime   = AV_NOPTS_VALUE;
+    m_smartCut   = false;
+    m_nalLengthSize = 0;
+    m_paramSets.clear();
+}
@@ -5,38 +5,175 @@
 #ifndef CUT_VIDEO_H
 #define CUT_VIDEO_H
 
+#include <string>
+#include <vector>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 #include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
 #ifdef __cplusplus
 }
 #endif
+#include "keyframe_index.h"
+
+struct CutStats {
+    int64_t packets_read;
+    int64_t packets_copied;
+    int64_t frames_encoded;   // re-encoded in the partial GOPs at the edges
+    int64_t timestamps_fixed; // dts moved to keep them increasing and not after pts
+    int64_t outputs;
+    int64_t seeks;            // skipping the gaps between ranges
+    int64_t elapsed_us;
+};
+
+/**
+ * Packets of one output stream on their way to the muxer, kept in decode order.
+ * When a dts would go backwards, where re-encoded frames join copied ones,
+ * the dts of the packets still held are moved back to make room,
+ * so that no dts has to be pushed past its pts.
+ */
+struct DtsReorderBuffer {
+    std::vector<AVPacket*> packets;
+    int64_t last_dts = AV_NOPTS_VALUE; // of the last packet given to the muxer
+};
+
+struct CutStream {
+    int out_index = -1;
+    // the range in the time base of the input stream
+    int64_t start = 0;
+    int64_t end   = INT64_MAX;
+    bool done     = false;
+    DtsReorderBuffer buffer;
+};
+
+struct CutRange {
+    int64_t start;    // milliseconds from the start of the media
+    int64_t duration; // milliseconds, 0 for the rest of the file
+    std::string output;
+};
 
+/**
+ * One range written to its own file, opened when the demuxing reaches it
+ * and closed once every stream of it has passed the end.
+ */
+struct CutOutput {
+    CutRange range;
+    AVFormatContext *ofmt_ctx = nullptr;
+    bool header_written = false;
+    bool opened   = false;
+    bool finished = false;
+    // by input stream, with the timestamp offsets of this output
+    std::vector<CutStream> streams;
+    bool resend_param_sets = false;
+};
+
+/**
+ * Frame accurate cutting at nearly the speed of remuxing:
+ * seek to the key frame before the start, copy the GOPs inside the range as they are,
+ * decode and re-encode only the GOPs crossing the start or the end.
+ * Re-encoding is for H.264 with libx264, other codecs are cut at key frames.
+ * Many ranges are cut in a single pass over the input, each packet going to every output covering it.
+ */
 class CutVideo {
 private:
 
-    int64_t m_startTime = 15;
-    int64_t m_duration  = 10;
+    // milliseconds
+    int64_t m_startTime = 15000;
+    int64_t m_duration  = 10000;
 
-    int64_t *dts_start_offset;
-    int64_t *pts_start_offset;
+    const char *m_input = nullptr;
+    AVFormatContext *ifmt_ctx = nullptr;
+    // sorted by start
+    std::vector<CutOutput> m_outputs;
+    std::vector<bool> m_included;
 
-    AVFormatContext *ofmt_ctx = nullptr;
+    KeyFrameIndex *m_keyIndex = nullptr;
+    int m_videoIndex = -1;
+    // microseconds, of the last packet read
+    int64_t m_readTime = AV_NOPTS_VALUE;
+
+    // re-encoding of the partial GOPs
+    bool m_smartCut = false;
+    AVCodecContext *m_decoder = nullptr;
+    AVCodecContext *m_encoder = nullptr;
+    const AVCodec *m_encodeCodec = nullptr;
+    AVFrame *m_frame = nullptr;
+    // packets of the GOP being read, from its key frame
+    std::vector<AVPacket*> m_gop;
+    // 0 for Annex-B input, otherwise the size of the NAL length prefix of avcC
+    int m_nalLengthSize = 0;
+    // SPS and PPS of the input in its own format, sent again after a re-encoded GOP
+    std::vector<uint8_t> m_paramSets;
+
+    CutStats m_stats = {0, 0, 0, 0, 0, 0, 0};
+
+    int open_input_file(const char *filename);
+
+    int open_output_file(CutOutput &output);
+
+    int init_smart_cut();
 
-    AVPacket* copy_packet(AVFormatContext *ifmt_ctx, AVPacket *packet);
+    int open_encoder(const AVFrame *frame, int gop_size);
 
-    int write_internal(AVFormatContext *ifmt_ctx, AVPacket *packet);
+    void set_range(CutOutput &output);
+
+    /**
+     * Seek the input to the key frame at or before the start of output, instead of
+     * demuxing everything before it. The key frame index of the file is used when possible.
+     */
+    int seek_to_start(const CutOutput &output);
+
+    int seek_forward();
+
+    int write_video(AVPacket *packet);
+
+    int write_other(AVPacket *packet);
+
+    bool all_done(const CutOutput &output);
+
+    int finish_outputs(bool eof);
+
+    int process_gop();
+
+    int copy_gop(CutOutput &output, int64_t from);
+
+    int reencode_gop(CutOutput &output);
+
+    int encode_frame(CutOutput &output, AVFrame *frame, int64_t dts_delay);
+
+    int write_packet(CutOutput &output, CutStream &stream, AVPacket *packet);
+
+    int mux_packet(CutOutput &output, CutStream &stream, AVPacket *packet);
+
+    int flush_buffer(CutOutput &output, CutStream &stream);
+
+    void clear_gop();
+
+    void close_output_file(CutOutput &output);
+
+    void release();
 
 public:
 
-    int open_output_file(AVFormatContext *ifmt_ctx, const char *filename);
+    ~CutVideo();
 
+    /**
+     * @param start_time milliseconds from the start of the media
+     * @param duration   milliseconds
+     */
     void setParam(int64_t start_time, int64_t duration);
 
-    void write_output_file(AVFormatContext *ifmt_ctx, AVPacket *packet);
+    int cut(const char *input, const char *output);
+
+    /**
+     * Cut every range into its own output, reading the input once.
+     * @return 0 when all the outputs were written
+     */
+    int cut(const char *input, const std::vector<CutRange> &ranges);
 
-    void close_output_file();
+    CutStats getStats();
 };
 
 #endif //CUT_VIDEO_H
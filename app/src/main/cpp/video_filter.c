@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <android/native_window.h>
 #include <android/native_window_jni.h>
@@ -23,21 +24,71 @@
 
 #define TAG "VideoFilter"
 #define MAX_AUDIO_FRAME_SIZE (48000 * 4)
+// not in the NDK headers, taken by the surfaces which are rendered in software
+#define HAL_PIXEL_FORMAT_YV12 0x32315659
+// the conversion into RGBA is split across threads from this height
+#define SCALE_SLICE_MIN_HEIGHT 720
+#define MAX_SCALE_THREADS 4
+// filters of the table and added ones, built graphs are kept for the whole playing
+#define MAX_FILTERS 32
+#define MAX_FILTER_THREADS 4
+
+typedef struct ScaleSlice {
+    struct SwsContext *sws_ctx;
+    int y;
+    int height;
+} ScaleSlice;
+
+struct ScalePool;
+
+typedef struct ScaleWorker {
+    struct ScalePool *pool;
+    int index;
+    pthread_t thread;
+} ScaleWorker;
+
+/**
+ * Converts horizontal bands of a picture in parallel, each with its own SwsContext.
+ * The calling thread takes the first band.
+ */
+typedef struct ScalePool {
+    int count;
+    int width;
+    int height;
+    int format;
+    ScaleSlice slices[MAX_SCALE_THREADS];
+    ScaleWorker workers[MAX_SCALE_THREADS];
+    int threads;
+
+    int sync_initialized;
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    int generation;
+    int pending;
+    int exit;
+    const AVFrame *frame;
+    uint8_t *dst;
+    int dst_stride;
+} ScalePool;
 
 typedef struct VideoFilterContext {
     AVFormatContext *format_ctx;
     AVCodecContext  *audio_codec_ctx;
     AVCodecContext  *video_codec_ctx;
 
-    uint8_t *buffer;
     AVFrame *frame_src;
-    AVFrame *frame_rgb;
     uint8_t *out_buffer;
 
     ANativeWindow *native_window;
+    int window_width;
+    int window_height;
+    int window_format;
+    // the surface gave another format when asked for YV12
+    bool yv12_unsupported;
+    ScalePool scale_pool;
 
     SwrContext *audio_swr_ctx;
-    struct SwsContext *sws_ctx;
     enum AVSampleFormat out_sample_fmt;
 
     int video_stream_index;
@@ -68,7 +119,53 @@ const char* filters[] = {
         "rotate=180*PI/180"
 };
 
-int init_filters(const char *filters_descr, AVRational time_base, AVCodecContext *codecCtx,
+#define NB_BUILTIN_FILTERS ((int) (sizeof(filters) / sizeof(filters[0])))
+
+// what a graph is built for, from the decoder
+typedef struct FilterParams {
+    AVRational time_base;
+    AVRational sample_aspect_ratio;
+    int width;
+    int height;
+    int pix_fmt;
+} FilterParams;
+
+typedef struct FilterEntry {
+    char *desc;
+    // asked for by the render thread, the only ones built
+    bool requested;
+    // set by the builder thread, NULL until built
+    AVFilterGraph *graph;
+    AVFilterContext *src;
+    AVFilterContext *sink;
+    bool failed;
+    int64_t build_us;
+    // processing time of the frames, on the render thread
+    int64_t frames;
+    int64_t total_us;
+    int64_t max_us;
+} FilterEntry;
+
+/**
+ * Graphs of the filters, each built on a thread the first time it is asked for, the latest request first.
+ * Switching back to a filter only swaps the graph used by the render thread.
+ */
+typedef struct FilterCache {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t builder;
+    bool running;
+    bool exit;
+    FilterParams params;
+    int nb_threads;
+    int wanted;
+    int count;
+    FilterEntry entries[MAX_FILTERS];
+} FilterCache;
+
+static FilterCache filter_cache = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+int init_filters(const char *filters_descr, const FilterParams *params, int nb_threads,
         AVFilterGraph **graph, AVFilterContext **src, AVFilterContext **sink) {
     char args[512];
     int ret;
@@ -85,12 +182,14 @@ int init_filters(const char *filters_descr, AVRational time_base, AVCodecContext
         ret = AVERROR(ENOMEM);
         goto end;
     }
+    // slice threads of the filters supporting them, e.g. gblur and unsharp
+    filter_graph->nb_threads = nb_threads;
     /* buffer video source: the decoded frames from the decoder will be inserted here. */
     snprintf(args, sizeof(args),
              "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-             codecCtx->width, codecCtx->height, codecCtx->pix_fmt,
-             time_base.num, time_base.den,
-             codecCtx->sample_aspect_ratio.num, codecCtx->sample_aspect_ratio.den);
+             params->width, params->height, params->pix_fmt,
+             params->time_base.num, params->time_base.den,
+             params->sample_aspect_ratio.num, params->sample_aspect_ratio.den);
     ret = avfilter_graph_create_filter(&buffersrc_ctx, buffersrc, "in",
                                        args, NULL, filter_graph);
     if (ret < 0) {
@@ -132,9 +231,181 @@ int init_filters(const char *filters_descr, AVRational time_base, AVCodecContext
 end:
     avfilter_inout_free(&inputs);
     avfilter_inout_free(&outputs);
+    if (ret < 0)
+        avfilter_graph_free(&filter_graph);
     return ret;
 }
 
+static int64_t filter_time_us() {
+    return av_gettime_relative();
+}
+
+static void filter_cache_add_builtin_locked() {
+    if (filter_cache.count > 0)
+        return;
+    for (int i = 0; i < NB_BUILTIN_FILTERS; i++) {
+        filter_cache.entries[i].desc = av_strdup(filters[i]);
+    }
+    filter_cache.count = NB_BUILTIN_FILTERS;
+}
+
+/**
+ * @return the position to switch to with again(), -1 if the cache is full
+ */
+static int filter_cache_add(const char *desc) {
+    int index = -1;
+    pthread_mutex_lock(&filter_cache.mutex);
+    filter_cache_add_builtin_locked();
+    for (int i = 0; i < filter_cache.count; i++) {
+        if (!strcmp(filter_cache.entries[i].desc, desc)) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0 && filter_cache.count < MAX_FILTERS) {
+        index = filter_cache.count++;
+        filter_cache.entries[index].desc = av_strdup(desc);
+        pthread_cond_broadcast(&filter_cache.cond);
+    }
+    pthread_mutex_unlock(&filter_cache.mutex);
+    return index;
+}
+
+static void *filter_cache_build(void *arg) {
+    pthread_mutex_lock(&filter_cache.mutex);
+    while (!filter_cache.exit) {
+        // the wanted one, else another one asked for and not built yet
+        int index  = -1;
+        int wanted = filter_cache.wanted;
+        if (wanted >= 0 && wanted < filter_cache.count && filter_cache.entries[wanted].requested
+                && !filter_cache.entries[wanted].graph && !filter_cache.entries[wanted].failed) {
+            index = wanted;
+        } else {
+            for (int i = 0; i < filter_cache.count; i++) {
+                FilterEntry *entry = &filter_cache.entries[i];
+                if (entry->requested && !entry->graph && !entry->failed) {
+                    index = i;
+                    break;
+                }
+            }
+        }
+        if (index < 0) {
+            pthread_cond_wait(&filter_cache.cond, &filter_cache.mutex);
+            continue;
+        }
+        char *desc           = av_strdup(filter_cache.entries[index].desc);
+        FilterParams params  = filter_cache.params;
+        int nb_threads       = filter_cache.nb_threads;
+        pthread_mutex_unlock(&filter_cache.mutex);
+
+        AVFilterGraph *graph = NULL;
+        AVFilterContext *src = NULL;
+        AVFilterContext *sink = NULL;
+        int64_t begin = filter_time_us();
+        int ret = init_filters(desc, &params, nb_threads, &graph, &src, &sink);
+        int64_t cost = filter_time_us() - begin;
+        if (ret < 0) {
+            LOGE(TAG, "init_filter %s error=%d", desc, ret);
+        } else {
+            LOGI(TAG, "filter %s built in %lldus", desc, (long long) cost);
+        }
+        av_free(desc);
+
+        pthread_mutex_lock(&filter_cache.mutex);
+        FilterEntry *entry = &filter_cache.entries[index];
+        entry->graph    = graph;
+        entry->src      = src;
+        entry->sink     = sink;
+        entry->failed   = ret < 0;
+        entry->build_us = cost;
+        pthread_cond_broadcast(&filter_cache.cond);
+    }
+    pthread_mutex_unlock(&filter_cache.mutex);
+    return NULL;
+}
+
+static void filter_cache_stop() {
+    pthread_mutex_lock(&filter_cache.mutex);
+    bool running = filter_cache.running;
+    filter_cache.exit = true;
+    pthread_cond_broadcast(&filter_cache.cond);
+    pthread_mutex_unlock(&filter_cache.mutex);
+    if (running)
+        pthread_join(filter_cache.builder, NULL);
+
+    pthread_mutex_lock(&filter_cache.mutex);
+    filter_cache.running = false;
+    for (int i = 0; i < filter_cache.count; i++) {
+        FilterEntry *entry = &filter_cache.entries[i];
+        avfilter_graph_free(&entry->graph);
+        entry->src       = NULL;
+        entry->sink      = NULL;
+        entry->failed    = false;
+        entry->requested = false;
+    }
+    pthread_mutex_unlock(&filter_cache.mutex);
+}
+
+/**
+ * Drop the graphs built for other parameters, and start building the wanted one for these.
+ */
+static int filter_cache_start(const FilterParams *params, int wanted) {
+    filter_cache_stop();
+    pthread_mutex_lock(&filter_cache.mutex);
+    filter_cache_add_builtin_locked();
+    for (int i = 0; i < filter_cache.count; i++) {
+        FilterEntry *entry = &filter_cache.entries[i];
+        entry->build_us = 0;
+        entry->frames   = 0;
+        entry->total_us = 0;
+        entry->max_us   = 0;
+    }
+    int cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    filter_cache.params     = *params;
+    filter_cache.nb_threads = FFMAX(1, FFMIN(cpus, MAX_FILTER_THREADS));
+    filter_cache.wanted     = wanted;
+    if (wanted >= 0 && wanted < filter_cache.count)
+        filter_cache.entries[wanted].requested = true;
+    filter_cache.exit       = false;
+    filter_cache.running    = pthread_create(&filter_cache.builder, NULL, filter_cache_build, NULL) == 0;
+    pthread_mutex_unlock(&filter_cache.mutex);
+    return filter_cache.running ? 0 : -1;
+}
+
+/**
+ * O(1) once built. Otherwise the builder is asked for it first,
+ * and NULL is returned at once unless wait.
+ * @param failed set when NULL for good: unknown index, or the graph failed to build
+ */
+static FilterEntry *filter_cache_get(int index, bool wait, bool *failed) {
+    FilterEntry *entry = NULL;
+    *failed = true;
+    pthread_mutex_lock(&filter_cache.mutex);
+    if (index >= 0 && index < filter_cache.count) {
+        entry = &filter_cache.entries[index];
+        if (!entry->graph && !entry->failed) {
+            entry->requested    = true;
+            filter_cache.wanted = index;
+            pthread_cond_broadcast(&filter_cache.cond);
+            while (wait && filter_cache.running && !entry->graph && !entry->failed)
+                pthread_cond_wait(&filter_cache.cond, &filter_cache.mutex);
+        }
+        *failed = entry->failed;
+        if (!entry->graph)
+            entry = NULL;
+    }
+    pthread_mutex_unlock(&filter_cache.mutex);
+    return entry;
+}
+
+static void filter_params_of(const AVFrame *frame, AVRational time_base, FilterParams *params) {
+    params->time_base           = time_base;
+    params->sample_aspect_ratio = frame->sample_aspect_ratio;
+    params->width               = frame->width;
+    params->height              = frame->height;
+    params->pix_fmt             = frame->format;
+}
+
 //init player
 int open_input(JNIEnv *env, const char *file_name, jobject surface, VideoFilterContext *s) {
     LOGI(TAG, "open file:%s\n", file_name);
@@ -177,30 +448,12 @@ int open_input(JNIEnv *env, const char *file_name, jobject surface, VideoFilterC
         LOGE(TAG, "nativeWindow is null...");
         return -1;
     }
-    ANativeWindow_setBuffersGeometry(s->native_window, s->video_codec_ctx->width,
-                                     s->video_codec_ctx->height,WINDOW_FORMAT_RGBA_8888);
+    // the geometry follows the filtered frames, see set_window_geometry
     s->frame_src = av_frame_alloc();
-    s->frame_rgb = av_frame_alloc();
-    if (s->frame_rgb == NULL || s->frame_src == NULL) {
+    if (s->frame_src == NULL) {
         LOGE(TAG, "Couldn't allocate video frame.");
         return -1;
     }
-    int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGBA, s->video_codec_ctx->width,
-                                            s->video_codec_ctx->height,1);
-
-    s->buffer = (uint8_t *) av_malloc(numBytes * sizeof(uint8_t));
-    av_image_fill_arrays(s->frame_rgb->data, s->frame_rgb->linesize, s->buffer, AV_PIX_FMT_RGBA,
-                         s->video_codec_ctx->width, s->video_codec_ctx->height, 1);
-    s->sws_ctx = sws_getContext(s->video_codec_ctx->width,
-                                s->video_codec_ctx->height,
-                                s->video_codec_ctx->pix_fmt,
-                                s->video_codec_ctx->width,
-                                s->video_codec_ctx->height,
-                             AV_PIX_FMT_RGBA,
-                             SWS_BILINEAR,
-                             NULL,
-                             NULL,
-                             NULL);
 
     return 0;
 }
@@ -294,32 +547,230 @@ int play_audio(JNIEnv *env, AVPacket *packet, AVFrame *frame, VideoFilterContext
     return ret;
 }
 
-int render_video(AVFilterContext *buffersrc_ctx, AVFilterContext *buffersink_ctx, AVFrame *filter_frame,
-                 VideoFilterContext *s) {
-    int ret = av_buffersrc_add_frame_flags(buffersrc_ctx, s->frame_src,
+static void scale_slice(ScalePool *pool, int index) {
+    const ScaleSlice *slice = &pool->slices[index];
+    const AVFrame *frame    = pool->frame;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    const uint8_t *src[4];
+    for (int i = 0; i < 4; i++) {
+        int shift = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+        src[i] = frame->data[i] ? frame->data[i] + (slice->y >> shift) * frame->linesize[i] : NULL;
+    }
+    uint8_t *dst[4]   = {pool->dst + slice->y * pool->dst_stride, NULL, NULL, NULL};
+    int dst_stride[4] = {pool->dst_stride, 0, 0, 0};
+    sws_scale(slice->sws_ctx, src, frame->linesize, 0, slice->height, dst, dst_stride);
+}
+
+static void *scale_worker(void *arg) {
+    ScaleWorker *worker = arg;
+    ScalePool *pool     = worker->pool;
+    int generation      = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        while (!pool->exit && pool->generation == generation)
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+        if (pool->exit)
+            break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        scale_slice(pool, worker->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+static void scale_pool_release(ScalePool *pool) {
+    if (pool->threads > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->exit = 1;
+        pthread_cond_broadcast(&pool->start_cond);
+        pthread_mutex_unlock(&pool->mutex);
+        for (int i = 1; i <= pool->threads; i++) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+    }
+    if (pool->sync_initialized) {
+        pthread_mutex_destroy(&pool->mutex);
+        pthread_cond_destroy(&pool->start_cond);
+        pthread_cond_destroy(&pool->done_cond);
+    }
+    for (int i = 0; i < pool->count; i++) {
+        sws_freeContext(pool->slices[i].sws_ctx);
+    }
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * Bands of whole chroma rows, converted without scaling so that they don't depend on each other.
+ * @param max_count 1 for a single context on the rendering thread
+ */
+static int scale_pool_init(ScalePool *pool, int width, int height, int format, int max_count) {
+    int count = 1;
+    if (height >= SCALE_SLICE_MIN_HEIGHT) {
+        count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        count = FFMAX(1, FFMIN(count, FFMIN(max_count, MAX_SCALE_THREADS)));
+    }
+    int band = FFALIGN((height + count - 1) / count, 16);
+
+    memset(pool, 0, sizeof(*pool));
+    pool->width  = width;
+    pool->height = height;
+    pool->format = format;
+    if (count > 1) {
+        pthread_mutex_init(&pool->mutex, NULL);
+        pthread_cond_init(&pool->start_cond, NULL);
+        pthread_cond_init(&pool->done_cond, NULL);
+        pool->sync_initialized = 1;
+    }
+    for (int i = 0, y = 0; i < count && y < height; i++, y += band) {
+        ScaleSlice *slice = &pool->slices[i];
+        slice->y      = y;
+        slice->height = FFMIN(band, height - y);
+        slice->sws_ctx = sws_getContext(width, slice->height, format,
+                                        width, slice->height, AV_PIX_FMT_RGBA,
+                                        SWS_BILINEAR, NULL, NULL, NULL);
+        if (!slice->sws_ctx) {
+            scale_pool_release(pool);
+            return -1;
+        }
+        pool->count = i + 1;
+    }
+    if (pool->count > 1) {
+        for (int i = 1; i < pool->count; i++) {
+            pool->workers[i].pool  = pool;
+            pool->workers[i].index = i;
+            if (pthread_create(&pool->workers[i].thread, NULL, scale_worker, &pool->workers[i]) != 0) {
+                scale_pool_release(pool);
+                return -1;
+            }
+            pool->threads = i;
+        }
+    }
+    LOGI(TAG, "convert %dx%d into RGBA with %d slices", width, height, pool->count);
+    return 0;
+}
+
+static void scale_pool_run(ScalePool *pool, const AVFrame *frame, uint8_t *dst, int dst_stride) {
+    pool->frame      = frame;
+    pool->dst        = dst;
+    pool->dst_stride = dst_stride;
+    if (pool->count > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->pending = pool->count - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start_cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    scale_slice(pool, 0);
+    if (pool->count > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->pending > 0)
+            pthread_cond_wait(&pool->done_cond, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/**
+ * YV12 when the frame is YUV420P and the surface takes it: the planes are only copied.
+ * Otherwise RGBA, converted straight into the window buffer.
+ */
+static void set_window_geometry(VideoFilterContext *s, const AVFrame *frame) {
+    int format = WINDOW_FORMAT_RGBA_8888;
+    if (frame->format == AV_PIX_FMT_YUV420P && !s->yv12_unsupported)
+        format = HAL_PIXEL_FORMAT_YV12;
+    if (ANativeWindow_setBuffersGeometry(s->native_window, frame->width, frame->height, format) < 0
+            && format == HAL_PIXEL_FORMAT_YV12) {
+        s->yv12_unsupported = true;
+        format = WINDOW_FORMAT_RGBA_8888;
+        ANativeWindow_setBuffersGeometry(s->native_window, frame->width, frame->height, format);
+    }
+    s->window_width  = frame->width;
+    s->window_height = frame->height;
+    s->window_format = format;
+}
+
+static void copy_yv12(const AVFrame *frame, ANativeWindow_Buffer *buffer) {
+    // Y, then V and U of half the size, with the chroma stride aligned to 16
+    int y_stride  = buffer->stride;
+    int c_stride  = FFALIGN(y_stride / 2, 16);
+    int width     = FFMIN(frame->width, buffer->width);
+    int height    = FFMIN(frame->height, buffer->height);
+    uint8_t *dst_y = buffer->bits;
+    uint8_t *dst_v = dst_y + y_stride * buffer->height;
+    uint8_t *dst_u = dst_v + c_stride * (buffer->height / 2);
+    av_image_copy_plane(dst_y, y_stride, frame->data[0], frame->linesize[0], width, height);
+    av_image_copy_plane(dst_v, c_stride, frame->data[2], frame->linesize[2], width / 2, height / 2);
+    av_image_copy_plane(dst_u, c_stride, frame->data[1], frame->linesize[1], width / 2, height / 2);
+}
+
+static int draw_frame(VideoFilterContext *s, const AVFrame *frame) {
+    if (frame->width != s->window_width || frame->height != s->window_height)
+        set_window_geometry(s, frame);
+
+    ANativeWindow_Buffer windowBuffer;
+    if (ANativeWindow_lock(s->native_window, &windowBuffer, NULL) < 0) {
+        LOGE(TAG, "ANativeWindow_lock error");
+        return -1;
+    }
+    if (windowBuffer.format == HAL_PIXEL_FORMAT_YV12) {
+        copy_yv12(frame, &windowBuffer);
+    } else if (windowBuffer.format == WINDOW_FORMAT_RGBA_8888
+            || windowBuffer.format == WINDOW_FORMAT_RGBX_8888) {
+        if (s->window_format == HAL_PIXEL_FORMAT_YV12) {
+            // the geometry was accepted, not the format
+            s->yv12_unsupported = true;
+            s->window_format    = windowBuffer.format;
+        }
+        if (s->scale_pool.width != frame->width || s->scale_pool.height != frame->height
+                || s->scale_pool.format != frame->format) {
+            scale_pool_release(&s->scale_pool);
+            if (scale_pool_init(&s->scale_pool, frame->width, frame->height, frame->format, MAX_SCALE_THREADS) < 0
+                    && scale_pool_init(&s->scale_pool, frame->width, frame->height, frame->format, 1) < 0) {
+                LOGE(TAG, "unable to convert %dx%d of format %d", frame->width, frame->height, frame->format);
+                // not tried again until the frames change
+                s->scale_pool.width  = frame->width;
+                s->scale_pool.height = frame->height;
+                s->scale_pool.format = frame->format;
+            }
+        }
+        if (s->scale_pool.count > 0 && windowBuffer.width >= frame->width
+                && windowBuffer.height >= frame->height) {
+            // no intermediate picture: the rows are written with the stride of the window
+            scale_pool_run(&s->scale_pool, frame, windowBuffer.bits, windowBuffer.stride * 4);
+        }
+    } else {
+        // neither YV12 nor RGBA, ask for RGBA from the next frame
+        s->yv12_unsupported = true;
+        s->window_width     = 0;
+    }
+    return ANativeWindow_unlockAndPost(s->native_window);
+}
+
+int render_video(FilterEntry *filter, AVFrame *filter_frame, VideoFilterContext *s) {
+    int64_t begin = filter_time_us();
+    int ret = av_buffersrc_add_frame_flags(filter->src, s->frame_src,
                                            AV_BUFFERSRC_FLAG_KEEP_REF);
     if (ret < 0) {
         LOGE(TAG, "Error while feeding the filter_graph\n");
         return ret;
     }
     //take frame from filter graph
-    ret = av_buffersink_get_frame(buffersink_ctx, filter_frame);
+    ret = av_buffersink_get_frame(filter->sink, filter_frame);
     if (ret >= 0) {
-        // lock native window
-        ANativeWindow_Buffer windowBuffer;
-        ANativeWindow_lock(s->native_window, &windowBuffer, NULL);
-        // convert
-        sws_scale(s->sws_ctx, (uint8_t const *const *) filter_frame->data,
-                  filter_frame->linesize, 0, s->video_codec_ctx->height,
-                  s->frame_rgb->data, s->frame_rgb->linesize);
-        uint8_t *dst  = windowBuffer.bits;
-        int dstStride = windowBuffer.stride * 4;
-        uint8_t *src  = s->frame_rgb->data[0];
-        int srcStride = s->frame_rgb->linesize[0];
-        for (int h = 0; h < s->video_codec_ctx->height; h++) {
-            memcpy(dst + h * dstStride, src + h * srcStride, (size_t) srcStride);
-        }
-        ANativeWindow_unlockAndPost(s->native_window);
+        int64_t cost = filter_time_us() - begin;
+        pthread_mutex_lock(&filter_cache.mutex);
+        filter->frames++;
+        filter->total_us += cost;
+        if (cost > filter->max_us)
+            filter->max_us = cost;
+        pthread_mutex_unlock(&filter_cache.mutex);
+        draw_frame(s, filter_frame);
     }
     int64_t pts = filter_frame->pts;
     av_frame_unref(filter_frame);
@@ -337,13 +788,15 @@ int render_video(AVFilterContext *buffersrc_ctx, AVFilterContext *buffersink_ctx
 VIDEO_PLAYER_FUNC(jint, filter, jstring filePath, jobject surface, jint position) {
     int ret;
     pos = position;
-    AVFilterGraph *filter_graph;
-    AVFilterContext *buffersrc_ctx;
-    AVFilterContext *buffersink_ctx;
+    FilterEntry *filter   = NULL;
+    FilterParams params;
+    bool failed;
     AVPacket *packet      = av_packet_alloc();
     AVFrame *filter_frame = av_frame_alloc();
     const char *file_name = (*env)->GetStringUTFChars(env, filePath, JNI_FALSE);
-    VideoFilterContext *s = malloc(sizeof (VideoFilterContext));
+    VideoFilterContext *s = calloc(1, sizeof (VideoFilterContext));
+    s->video_stream_index = -1;
+    s->audio_stream_index = -1;
 
     if ((ret = open_input(env, file_name, surface, s)) < 0) {
         LOGE(TAG, "Couldn't allocate video frame.");
@@ -356,26 +809,28 @@ VIDEO_PLAYER_FUNC(jint, filter, jstring filePath, jobject surface, jint position
         goto end;
     }
 
-    //init filter
+    //init filters, built for the parameters of the first frame
     AVRational time_base = s->format_ctx->streams[s->video_stream_index]->time_base;
-    if ((ret = init_filters(filters[pos], time_base, s->video_codec_ctx,
-            &filter_graph, &buffersrc_ctx, &buffersink_ctx)) < 0) {
-        LOGE(TAG, "init_filter error, ret=%d\n", ret);
-        goto end;
-    }
+    params.time_base           = time_base;
+    params.sample_aspect_ratio = s->video_codec_ctx->sample_aspect_ratio;
+    params.width               = s->video_codec_ctx->width;
+    params.height              = s->video_codec_ctx->height;
+    params.pix_fmt             = s->video_codec_ctx->pix_fmt;
     s->start_time = av_gettime_relative();
 
     while (av_read_frame(s->format_ctx, packet) >= 0 && !release) {
-        //switch filter
-        if (again) {
-            again = 0;
-            avfilter_graph_free(&filter_graph);
-            if ((ret = init_filters(filters[pos], time_base, s->video_codec_ctx,
-                    &filter_graph, &buffersrc_ctx, &buffersink_ctx)) < 0) {
-                LOGE(TAG, "init_filter error, ret=%d\n", ret);
-                goto end;
+        //switch filter: the graph is swapped once built, until then the current one goes on
+        if (again && filter) {
+            FilterEntry *next = filter_cache_get(pos, false, &failed);
+            if (next) {
+                again  = 0;
+                filter = next;
+                LOGI(TAG, "play again,filter_descr=_=%s", filter->desc);
+            } else if (failed) {
+                // not built, and never will be: the current one goes on
+                again = 0;
+                LOGE(TAG, "filter %d unavailable, keep filter_descr=%s", pos, filter->desc);
             }
-            LOGE(TAG, "play again,filter_descr=_=%s", filters[pos]);
         }
         //is video stream or not
         if (packet->stream_index == s->video_stream_index) {
@@ -391,7 +846,19 @@ VIDEO_PLAYER_FUNC(jint, filter, jstring filePath, jobject surface, jint position
                     LOGE(TAG, "decode error=%s", av_err2str(ret));
                     goto end;
                 }
-                ret = render_video(buffersrc_ctx, buffersink_ctx, filter_frame, s);
+                if (!filter || s->frame_src->width != params.width || s->frame_src->height != params.height
+                        || s->frame_src->format != params.pix_fmt) {
+                    // first frame, or the decoder changed: the cached graphs don't fit anymore
+                    filter_params_of(s->frame_src, time_base, &params);
+                    again = 0;
+                    if (filter_cache_start(&params, pos) < 0
+                            || !(filter = filter_cache_get(pos, true, &failed))) {
+                        LOGE(TAG, "init_filter error, filter=%d\n", pos);
+                        ret = -1;
+                        goto end;
+                    }
+                }
+                ret = render_video(filter, filter_frame, s);
             }
         } else if (packet->stream_index == s->audio_stream_index) {//audio stream
             if (enable_audio) {
@@ -401,15 +868,13 @@ VIDEO_PLAYER_FUNC(jint, filter, jstring filePath, jobject surface, jint position
         av_packet_unref(packet);
     }
 end:
-    av_free(s->buffer);
     av_free(s->out_buffer);
-    sws_freeContext(s->sws_ctx);
+    scale_pool_release(&s->scale_pool);
     swr_free(&s->audio_swr_ctx);
-    avfilter_graph_free(&filter_graph);
+    filter_cache_stop();
     avcodec_free_context(&s->video_codec_ctx);
     avcodec_free_context(&s->audio_codec_ctx);
     avformat_close_input(&s->format_ctx);
-    av_frame_free(&s->frame_rgb);
     av_frame_free(&filter_frame);
     av_frame_free(&s->frame_src);
     av_packet_free(&packet);
@@ -425,6 +890,33 @@ end:
     return ret;
 }
 
+VIDEO_PLAYER_FUNC(jint, addFilter, jstring filterDesc) {
+    if (!filterDesc)
+        return -1;
+    const char *desc = (*env)->GetStringUTFChars(env, filterDesc, JNI_FALSE);
+    int index = filter_cache_add(desc);
+    (*env)->ReleaseStringUTFChars(env, filterDesc, desc);
+    return index;
+}
+
+VIDEO_PLAYER_FUNC(jlongArray, getFilterStats) {
+    pthread_mutex_lock(&filter_cache.mutex);
+    filter_cache_add_builtin_locked();
+    int count = filter_cache.count;
+    jlong values[MAX_FILTERS * 4];
+    for (int i = 0; i < count; i++) {
+        FilterEntry *entry = &filter_cache.entries[i];
+        values[i * 4]     = entry->build_us;
+        values[i * 4 + 1] = entry->frames;
+        values[i * 4 + 2] = entry->frames > 0 ? entry->total_us / entry->frames : 0;
+        values[i * 4 + 3] = entry->max_us;
+    }
+    pthread_mutex_unlock(&filter_cache.mutex);
+    jlongArray result = (*env)->NewLongArray(env, count * 4);
+    (*env)->SetLongArrayRegion(env, result, 0, count * 4, values);
+    return result;
+}
+
 VIDEO_PLAYER_FUNC(void, again, jint position) {
     again = 1;
     pos = position;
@@ -0,0 +1,473 @@
+//
+// Real FFT of a size chosen at runtime, everything computed once per size.
+//
+
+#include "fft_plan.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "fft.h"
+#include "fixed_fft.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FFT_HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FFT_HAVE_SSE2 1
+#endif
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGI(FORMAT, ...) __android_log_print(ANDROID_LOG_INFO, "FftPlan", FORMAT, ##__VA_ARGS__)
+#else
+#include <cstdio>
+#define LOGI(FORMAT, ...) printf(FORMAT "\n", ##__VA_ARGS__)
+#endif
+
+/**
+ * The butterflies of a pass over n complex points, in split re and im arrays.
+ * Products are separate statements in C so that they aren't contracted into fused
+ * multiply-adds, the SIMD kernels doing the very same operations.
+ */
+struct FftKernels {
+    const char *name;
+    // two radix-2 stages of spans span and 2 * span at once
+    void (*radix4)(float *re, float *im, int n, int span, const float *twiddles);
+    void (*radix2)(float *re, float *im, int n, int span, const float *twiddles);
+};
+
+/******************** C ********************/
+
+static void radix4_c(float *re, float *im, int n, int span, const float *twiddles) {
+    const float *w1r = twiddles;
+    const float *w1i = twiddles + span;
+    const float *w2r = twiddles + span * 2;
+    const float *w2i = twiddles + span * 3;
+    for (int base = 0; base < n; base += span * 4) {
+        for (int j = 0; j < span; j++) {
+            int i0 = base + j, i1 = i0 + span, i2 = i1 + span, i3 = i2 + span;
+            // t1 = w1 * x1, t3 = w1 * x3
+            float a = re[i1] * w1r[j], b = im[i1] * w1i[j];
+            float c = re[i1] * w1i[j], d = im[i1] * w1r[j];
+            float t1r = a - b, t1i = c + d;
+            a = re[i3] * w1r[j], b = im[i3] * w1i[j];
+            c = re[i3] * w1i[j], d = im[i3] * w1r[j];
+            float t3r = a - b, t3i = c + d;
+            float y0r = re[i0] + t1r, y0i = im[i0] + t1i;
+            float y1r = re[i0] - t1r, y1i = im[i0] - t1i;
+            float y2r = re[i2] + t3r, y2i = im[i2] + t3i;
+            float y3r = re[i2] - t3r, y3i = im[i2] - t3i;
+            // u2 = w2 * y2, u3 = w2 * y3
+            a = y2r * w2r[j], b = y2i * w2i[j];
+            c = y2r * w2i[j], d = y2i * w2r[j];
+            float u2r = a - b, u2i = c + d;
+            a = y3r * w2r[j], b = y3i * w2i[j];
+            c = y3r * w2i[j], d = y3i * w2r[j];
+            float u3r = a - b, u3i = c + d;
+            re[i0] = y0r + u2r, im[i0] = y0i + u2i;
+            re[i2] = y0r - u2r, im[i2] = y0i - u2i;
+            // y1 -+ i * u3
+            re[i1] = y1r + u3i, im[i1] = y1i - u3r;
+            re[i3] = y1r - u3i, im[i3] = y1i + u3r;
+        }
+    }
+}
+
+static void radix2_c(float *re, float *im, int n, int span, const float *twiddles) {
+    const float *wr = twiddles;
+    const float *wi = twiddles + span;
+    for (int base = 0; base < n; base += span * 2) {
+        for (int j = 0; j < span; j++) {
+            int i0 = base + j, i1 = i0 + span;
+            float a = re[i1] * wr[j], b = im[i1] * wi[j];
+            float c = re[i1] * wi[j], d = im[i1] * wr[j];
+            float tr = a - b, ti = c + d;
+            float x0r = re[i0], x0i = im[i0];
+            re[i0] = x0r + tr, im[i0] = x0i + ti;
+            re[i1] = x0r - tr, im[i1] = x0i - ti;
+        }
+    }
+}
+
+static const FftKernels kernels_c = {
+        "c",
+        radix4_c,
+        radix2_c
+};
+
+/******************** NEON ********************/
+
+#ifdef FFT_HAVE_NEON
+
+// (ar + i ai) * (br + i bi), not with vmlaq_f32 which may be fused
+#define CMUL_NEON(rr, ri, ar, ai, br, bi) \
+    float32x4_t rr = vsubq_f32(vmulq_f32(ar, br), vmulq_f32(ai, bi)); \
+    float32x4_t ri = vaddq_f32(vmulq_f32(ar, bi), vmulq_f32(ai, br))
+
+static void radix4_neon(float *re, float *im, int n, int span, const float *twiddles) {
+    if (span % 4 != 0) {
+        radix4_c(re, im, n, span, twiddles);
+        return;
+    }
+    const float *w1r = twiddles;
+    const float *w1i = twiddles + span;
+    const float *w2r = twiddles + span * 2;
+    const float *w2i = twiddles + span * 3;
+    for (int base = 0; base < n; base += span * 4) {
+        for (int j = 0; j < span; j += 4) {
+            int i0 = base + j, i1 = i0 + span, i2 = i1 + span, i3 = i2 + span;
+            float32x4_t v1r = vld1q_f32(w1r + j), v1i = vld1q_f32(w1i + j);
+            float32x4_t v2r = vld1q_f32(w2r + j), v2i = vld1q_f32(w2i + j);
+            float32x4_t x0r = vld1q_f32(re + i0), x0i = vld1q_f32(im + i0);
+            float32x4_t x1r = vld1q_f32(re + i1), x1i = vld1q_f32(im + i1);
+            float32x4_t x2r = vld1q_f32(re + i2), x2i = vld1q_f32(im + i2);
+            float32x4_t x3r = vld1q_f32(re + i3), x3i = vld1q_f32(im + i3);
+            CMUL_NEON(t1r, t1i, x1r, x1i, v1r, v1i);
+            CMUL_NEON(t3r, t3i, x3r, x3i, v1r, v1i);
+            float32x4_t y0r = vaddq_f32(x0r, t1r), y0i = vaddq_f32(x0i, t1i);
+            float32x4_t y1r = vsubq_f32(x0r, t1r), y1i = vsubq_f32(x0i, t1i);
+            float32x4_t y2r = vaddq_f32(x2r, t3r), y2i = vaddq_f32(x2i, t3i);
+            float32x4_t y3r = vsubq_f32(x2r, t3r), y3i = vsubq_f32(x2i, t3i);
+            CMUL_NEON(u2r, u2i, y2r, y2i, v2r, v2i);
+            CMUL_NEON(u3r, u3i, y3r, y3i, v2r, v2i);
+            vst1q_f32(re + i0, vaddq_f32(y0r, u2r));
+            vst1q_f32(im + i0, vaddq_f32(y0i, u2i));
+            vst1q_f32(re + i2, vsubq_f32(y0r, u2r));
+            vst1q_f32(im + i2, vsubq_f32(y0i, u2i));
+            vst1q_f32(re + i1, vaddq_f32(y1r, u3i));
+            vst1q_f32(im + i1, vsubq_f32(y1i, u3r));
+            vst1q_f32(re + i3, vsubq_f32(y1r, u3i));
+            vst1q_f32(im + i3, vaddq_f32(y1i, u3r));
+        }
+    }
+}
+
+static void radix2_neon(float *re, float *im, int n, int span, const float *twiddles) {
+    if (span % 4 != 0) {
+        radix2_c(re, im, n, span, twiddles);
+        return;
+    }
+    const float *wr = twiddles;
+    const float *wi = twiddles + span;
+    for (int base = 0; base < n; base += span * 2) {
+        for (int j = 0; j < span; j += 4) {
+            int i0 = base + j, i1 = i0 + span;
+            float32x4_t x1r = vld1q_f32(re + i1), x1i = vld1q_f32(im + i1);
+            float32x4_t vr = vld1q_f32(wr + j), vi = vld1q_f32(wi + j);
+            CMUL_NEON(tr, ti, x1r, x1i, vr, vi);
+            float32x4_t x0r = vld1q_f32(re + i0), x0i = vld1q_f32(im + i0);
+            vst1q_f32(re + i0, vaddq_f32(x0r, tr));
+            vst1q_f32(im + i0, vaddq_f32(x0i, ti));
+            vst1q_f32(re + i1, vsubq_f32(x0r, tr));
+            vst1q_f32(im + i1, vsubq_f32(x0i, ti));
+        }
+    }
+}
+
+static const FftKernels kernels_neon = {
+        "neon",
+        radix4_neon,
+        radix2_neon
+};
+
+#endif
+
+/******************** SSE2 ********************/
+
+#ifdef FFT_HAVE_SSE2
+
+#define CMUL_SSE2(rr, ri, ar, ai, br, bi) \
+    __m128 rr = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi)); \
+    __m128 ri = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))
+
+static void radix4_sse2(float *re, float *im, int n, int span, const float *twiddles) {
+    if (span % 4 != 0) {
+        radix4_c(re, im, n, span, twiddles);
+        return;
+    }
+    const float *w1r = twiddles;
+    const float *w1i = twiddles + span;
+    const float *w2r = twiddles + span * 2;
+    const float *w2i = twiddles + span * 3;
+    for (int base = 0; base < n; base += span * 4) {
+        for (int j = 0; j < span; j += 4) {
+            int i0 = base + j, i1 = i0 + span, i2 = i1 + span, i3 = i2 + span;
+            __m128 v1r = _mm_loadu_ps(w1r + j), v1i = _mm_loadu_ps(w1i + j);
+            __m128 v2r = _mm_loadu_ps(w2r + j), v2i = _mm_loadu_ps(w2i + j);
+            __m128 x0r = _mm_loadu_ps(re + i0), x0i = _mm_loadu_ps(im + i0);
+            __m128 x1r = _mm_loadu_ps(re + i1), x1i = _mm_loadu_ps(im + i1);
+            __m128 x2r = _mm_loadu_ps(re + i2), x2i = _mm_loadu_ps(im + i2);
+            __m128 x3r = _mm_loadu_ps(re + i3), x3i = _mm_loadu_ps(im + i3);
+            CMUL_SSE2(t1r, t1i, x1r, x1i, v1r, v1i);
+            CMUL_SSE2(t3r, t3i, x3r, x3i, v1r, v1i);
+            __m128 y0r = _mm_add_ps(x0r, t1r), y0i = _mm_add_ps(x0i, t1i);
+            __m128 y1r = _mm_sub_ps(x0r, t1r), y1i = _mm_sub_ps(x0i, t1i);
+            __m128 y2r = _mm_add_ps(x2r, t3r), y2i = _mm_add_ps(x2i, t3i);
+            __m128 y3r = _mm_sub_ps(x2r, t3r), y3i = _mm_sub_ps(x2i, t3i);
+            CMUL_SSE2(u2r, u2i, y2r, y2i, v2r, v2i);
+            CMUL_SSE2(u3r, u3i, y3r, y3i, v2r, v2i);
+            _mm_storeu_ps(re + i0, _mm_add_ps(y0r, u2r));
+            _mm_storeu_ps(im + i0, _mm_add_ps(y0i, u2i));
+            _mm_storeu_ps(re + i2, _mm_sub_ps(y0r, u2r));
+            _mm_storeu_ps(im + i2, _mm_sub_ps(y0i, u2i));
+            _mm_storeu_ps(re + i1, _mm_add_ps(y1r, u3i));
+            _mm_storeu_ps(im + i1, _mm_sub_ps(y1i, u3r));
+            _mm_storeu_ps(re + i3, _mm_sub_ps(y1r, u3i));
+            _mm_storeu_ps(im + i3, _mm_add_ps(y1i, u3r));
+        }
+    }
+}
+
+static void radix2_sse2(float *re, float *im, int n, int span, const float *twiddles) {
+    if (span % 4 != 0) {
+        radix2_c(re, im, n, span, twiddles);
+        return;
+    }
+    const float *wr = twiddles;
+    const float *wi = twiddles + span;
+    for (int base = 0; base < n; base += span * 2) {
+        for (int j = 0; j < span; j += 4) {
+            int i0 = base + j, i1 = i0 + span;
+            __m128 x1r = _mm_loadu_ps(re + i1), x1i = _mm_loadu_ps(im + i1);
+            __m128 vr = _mm_loadu_ps(wr + j), vi = _mm_loadu_ps(wi + j);
+            CMUL_SSE2(tr, ti, x1r, x1i, vr, vi);
+            __m128 x0r = _mm_loadu_ps(re + i0), x0i = _mm_loadu_ps(im + i0);
+            _mm_storeu_ps(re + i0, _mm_add_ps(x0r, tr));
+            _mm_storeu_ps(im + i0, _mm_add_ps(x0i, ti));
+            _mm_storeu_ps(re + i1, _mm_sub_ps(x0r, tr));
+            _mm_storeu_ps(im + i1, _mm_sub_ps(x0i, ti));
+        }
+    }
+}
+
+static const FftKernels kernels_sse2 = {
+        "sse2",
+        radix4_sse2,
+        radix2_sse2
+};
+
+#endif
+
+static const FftKernels *detect_kernels() {
+#if defined(FFT_HAVE_NEON)
+    return &kernels_neon;
+#elif defined(FFT_HAVE_SSE2)
+    return &kernels_sse2;
+#else
+    return &kernels_c;
+#endif
+}
+
+static const FftKernels *simd_kernels = detect_kernels();
+static const FftKernels *kernels = simd_kernels;
+
+const char *fft_plan_kernels() {
+    return kernels->name;
+}
+
+void fft_plan_set_simd(bool enable) {
+    kernels = enable ? simd_kernels : &kernels_c;
+}
+
+/******************** plan ********************/
+
+// forward: W_n^k = exp(-2 pi i k / n)
+static void push_twiddles(std::vector<float> &table, int n, int count) {
+    for (int k = 0; k < count; k++) {
+        table.push_back((float) cos(2 * M_PI * k / n));
+    }
+    for (int k = 0; k < count; k++) {
+        table.push_back((float) -sin(2 * M_PI * k / n));
+    }
+}
+
+FftPlan *FftPlan::create(int size, window_param *param) {
+    if (size < FFT_PLAN_MIN_SIZE || size > FFT_PLAN_MAX_SIZE || (size & (size - 1)) != 0)
+        return nullptr;
+    auto *plan   = new FftPlan();
+    plan->m_size = size;
+    plan->m_half = size / 2;
+    int half = plan->m_half;
+
+    plan->m_window.assign((size_t) size, 1.0f);
+    DEFINE_WIND_CONTEXT(wind_ctx);
+    if (param && window_init(size, param, &wind_ctx) && wind_ctx.i_buffer_size == size) {
+        memcpy(plan->m_window.data(), wind_ctx.pf_window_table, size * sizeof(float));
+    }
+    window_close(&wind_ctx);
+    double sum = 0;
+    for (float weight : plan->m_window) {
+        sum += weight;
+    }
+    plan->m_gain = (float) (sum / size);
+
+    int bits = 0;
+    while ((1 << bits) < half)
+        bits++;
+    plan->m_reverse.resize((size_t) half);
+    for (int i = 0; i < half; i++) {
+        uint32_t reversed = 0;
+        for (int b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1u) << (bits - 1 - b);
+        }
+        plan->m_reverse[i] = reversed;
+    }
+
+    int span = 1;
+    for (; span * 4 <= half; span *= 4) {
+        plan->m_passes.push_back({span, plan->m_twiddles.size()});
+        push_twiddles(plan->m_twiddles, span * 2, span);
+        push_twiddles(plan->m_twiddles, span * 4, span);
+    }
+    if (span * 2 == half) {
+        plan->m_radix2 = true;
+        plan->m_radix2Twiddles = plan->m_twiddles.size();
+        push_twiddles(plan->m_twiddles, half, span);
+    }
+
+    for (int k = 0; k < half; k++) {
+        plan->m_splitRe.push_back((float) cos(2 * M_PI * k / size));
+        plan->m_splitIm.push_back((float) -sin(2 * M_PI * k / size));
+    }
+    plan->m_re.resize((size_t) half);
+    plan->m_im.resize((size_t) half);
+    return plan;
+}
+
+int FftPlan::size() const {
+    return m_size;
+}
+
+float FftPlan::gain() const {
+    return m_gain;
+}
+
+void FftPlan::transform() {
+    for (const Pass &pass : m_passes) {
+        kernels->radix4(m_re.data(), m_im.data(), m_half, pass.span, m_twiddles.data() + pass.twiddles);
+    }
+    if (m_radix2) {
+        kernels->radix2(m_re.data(), m_im.data(), m_half, m_half / 2, m_twiddles.data() + m_radix2Twiddles);
+    }
+}
+
+void FftPlan::run(const int16_t *input, int stride, int count, float *output) {
+    // even samples into re, odd ones into im, in bit-reversed order
+    for (int k = 0; k < m_half; k++) {
+        int i = (int) m_reverse[k] * 2;
+        m_re[k] = i < count ? (float) input[i * stride] * m_window[i] : 0.0f;
+        m_im[k] = i + 1 < count ? (float) input[(i + 1) * stride] * m_window[i + 1] : 0.0f;
+    }
+    transform();
+
+    // X[k] = E[k] + W_size^k * O[k], E and O being the spectra of the even and odd samples
+    output[0] = m_re[0] + m_im[0];
+    output[1] = m_re[0] - m_im[0];
+    for (int k = 1; k < m_half; k++) {
+        float zr = m_re[k], zi = m_im[k];
+        float cr = m_re[m_half - k], ci = -m_im[m_half - k];
+        float er = (zr + cr) * 0.5f, ei = (zi + ci) * 0.5f;
+        // O = (Z[k] - conj(Z[half - k])) / 2i
+        float odr = (zi - ci) * 0.5f, odi = (cr - zr) * 0.5f;
+        float a = m_splitRe[k] * odr, b = m_splitIm[k] * odi;
+        float c = m_splitRe[k] * odi, d = m_splitIm[k] * odr;
+        output[k * 2]     = er + (a - b);
+        output[k * 2 + 1] = ei + (c + d);
+    }
+}
+
+/******************** benchmark ********************/
+
+// runs of each measure, the fastest one counts
+#define BENCHMARK_RUNS 3
+
+template <typename Run>
+static double benchmark_us(int iterations, Run run) {
+    double best = 0;
+    for (int r = 0; r < BENCHMARK_RUNS; r++) {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            run();
+        }
+        std::chrono::duration<double, std::micro> cost = std::chrono::steady_clock::now() - begin;
+        double us = cost.count() / iterations;
+        if (r == 0 || us < best)
+            best = us;
+    }
+    return best;
+}
+
+int fft_plan_benchmark(FftBenchmark *results, int max) {
+    window_param param;
+    window_get_param(&param);
+    std::vector<int16_t> input(FFT_PLAN_MAX_SIZE);
+    uint32_t seed = 1;
+    for (int16_t &sample : input) {
+        seed   = seed * 1664525u + 1013904223u;
+        sample = (int16_t) (seed >> 16);
+    }
+    std::vector<float> out_simd(FFT_PLAN_MAX_SIZE);
+    std::vector<float> out_c(FFT_PLAN_MAX_SIZE);
+    std::vector<int16_t> scratch(FFT_PLAN_MAX_SIZE);
+    std::vector<int32_t> workspace(FFT_PLAN_MAX_SIZE / 2);
+    std::vector<float> power(FFT_BUFFER_SIZE / 2 + 1);
+
+    const FftKernels *current = kernels;
+    int written = 0;
+    for (int size = FFT_PLAN_MIN_SIZE; size <= FFT_PLAN_MAX_SIZE && written < max; size *= 2) {
+        FftPlan *plan = FftPlan::create(size, &param);
+        int iterations = (1 << 22) / size;
+        FftBenchmark &result = results[written++];
+        result.size = size;
+
+        kernels = simd_kernels;
+        result.plan_us = benchmark_us(iterations, [&]() {
+            plan->run(input.data(), 1, size, out_simd.data());
+        });
+        kernels = &kernels_c;
+        result.plan_c_us = benchmark_us(iterations, [&]() {
+            plan->run(input.data(), 1, size, out_c.data());
+        });
+        result.identical = memcmp(out_simd.data(), out_c.data(), size * sizeof(float)) == 0;
+        kernels = current;
+        delete plan;
+
+        // what fft_fixed() did for each capture
+        result.fixed_us = 0;
+        if (size <= 1024) {
+            result.fixed_us = benchmark_us(iterations, [&]() {
+                DEFINE_WIND_CONTEXT(wind_ctx);
+                window_init(size, &param, &wind_ctx);
+                memcpy(scratch.data(), input.data(), size * sizeof(int16_t));
+                window_scale_in_place(scratch.data(), &wind_ctx);
+                for (int i = 0; i < size / 2; i++) {
+                    workspace[i] = (int32_t) (((uint32_t) (uint16_t) scratch[i * 2] << 16)
+                            | (uint16_t) scratch[i * 2 + 1]);
+                }
+                fixed_fft_real(size / 2, workspace.data());
+                window_close(&wind_ctx);
+            });
+        }
+        // what fft_float() did
+        result.perform_us = 0;
+        if (size == FFT_BUFFER_SIZE) {
+            result.perform_us = benchmark_us(iterations, [&]() {
+                fft_state *state = visual_fft_init();
+                DEFINE_WIND_CONTEXT(wind_ctx);
+                window_init(size, &param, &wind_ctx);
+                memcpy(scratch.data(), input.data(), size * sizeof(int16_t));
+                window_scale_in_place(scratch.data(), &wind_ctx);
+                fft_perform(scratch.data(), power.data(), state);
+                window_close(&wind_ctx);
+                fft_close(state);
+            });
+        }
+        LOGI("size %5d: %s %8.2fus, c %8.2fus, fixed %8.2fus, fft_perform %8.2fus%s", size,
+             simd_kernels->name, result.plan_us, result.plan_c_us, result.fixed_us, result.perform_us,
+             result.identical ? "" : ", MISMATCH");
+    }
+    return written;
+}
@@ -0,0 +1,95 @@
+//
+// Real FFT of a size chosen at runtime, everything computed once per size.
+//
+
+#ifndef FFT_PLAN_H
+#define FFT_PLAN_H
+
+#include <cstdint>
+#include <vector>
+
+#include "window.h"
+
+#define FFT_PLAN_MIN_SIZE 128
+#define FFT_PLAN_MAX_SIZE 8192
+
+/**
+ * Window, bit-reverse table and twiddles of one size. The size/2 points complex FFT
+ * goes by radix-4 passes (and a radix-2 one when log2 is odd), then is split into the real spectrum.
+ * Not thread safe, one transform at a time.
+ */
+class FftPlan {
+private:
+
+    struct Pass {
+        int span;
+        size_t twiddles; // offset of w1 re, w1 im, w2 re, w2 im, span each
+    };
+
+    int m_size = 0;
+    int m_half = 0;
+    std::vector<float> m_window;
+    float m_gain = 1.0f;
+    std::vector<uint32_t> m_reverse;
+    std::vector<Pass> m_passes;
+    bool m_radix2 = false;
+    size_t m_radix2Twiddles = 0;
+    std::vector<float> m_twiddles;
+    // W_size^k, to split the half size FFT into the real one
+    std::vector<float> m_splitRe;
+    std::vector<float> m_splitIm;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+
+    void transform();
+
+public:
+
+    /**
+     * @param size power of two from FFT_PLAN_MIN_SIZE to FFT_PLAN_MAX_SIZE
+     * @return nullptr if the size isn't supported
+     */
+    static FftPlan *create(int size, window_param *param);
+
+    int size() const;
+
+    /**
+     * mean of the window, |X| of a sine of amplitude A at a bin is A * size / 2 * gain
+     */
+    float gain() const;
+
+    /**
+     * Window size samples and transform them, missing samples are zeros.
+     * @param input  s16, every stride samples, count of them
+     * @param output size floats: X[0], X[size/2], then re and im of X[1] to X[size/2 - 1]
+     */
+    void run(const int16_t *input, int stride, int count, float *output);
+};
+
+struct FftBenchmark {
+    int size;
+    double plan_us;       // FftPlan with the SIMD kernels
+    double plan_c_us;     // FftPlan with the C kernels
+    double fixed_us;      // window_init and fixed_fft_real for each transform, 0 above its 1024
+    double perform_us;    // visual_fft_init, window_init and fft_perform, only at FFT_BUFFER_SIZE
+    bool identical;       // SIMD and C gave the same spectrum
+};
+
+/**
+ * Time a transform of each size, against the FFTs used before the plans.
+ * @return results written
+ */
+int fft_plan_benchmark(FftBenchmark *results, int max);
+
+/**
+ * The kernels are picked once according to the CPU: "neon", "sse2" or "c".
+ * SIMD and C kernels give identical output.
+ */
+const char *fft_plan_kernels();
+
+/**
+ * Fall back to the C kernels, for comparing
+ */
+void fft_plan_set_simd(bool enable);
+
+#endif //FFT_PLAN_H
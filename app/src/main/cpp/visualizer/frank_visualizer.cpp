@@ -4,174 +4,157 @@
 
 #include "frank_visualizer.h"
 
+#include <chrono>
+
 #include <android/log.h>
 #define LOG_TAG "frank_visualizer"
 #define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, \
                    __VA_ARGS__))
 
 
-void short_to_float_array (const short *in, float *out, int len) {
-    for (int i = 0; i < len; ++i) {
-        out [i] = (float) (in [i] / (1.0 * 0x8000)) ;
-    }
+static int plan_index(int fft_size) {
+    int index = 0;
+    while ((MIN_FFT_SIZE << index) < fft_size)
+        index++;
+    return index;
 }
 
-// float FFT algorithm
-void fft_float(filter_sys_t *p_sys) {
-    int nb_samples = p_sys->nb_samples;
+// FFT of the first channel, as int8 like the Android Visualizer gives
+int fft_transform(filter_sys_t *p_sys, const int16_t *samples) {
     int out_samples = p_sys->out_samples;
-
-    fft_state *p_state = nullptr; /* internal FFT data */
-    DEFINE_WIND_CONTEXT(wind_ctx); /* internal window data */
-
-    unsigned i;
-    float p_output[out_samples];           /* Raw FFT Result  */
-    int16_t p_buffer1[out_samples];        /* Buffer on which we perform the FFT*/
-    float *p_buffl;
-    if (p_sys->convert_to_float) {
-        float p_buff[out_samples];
-        short_to_float_array((const short *) p_sys->data, p_buff, out_samples);
-        p_buffl = p_buff;
-    } else {
-        p_buffl = (float *) (p_sys->data);
-    }
-
-    int16_t  *p_buffs;                         /* int16_t converted buffer */
-    int16_t  *p_s16_buff;                      /* int16_t converted buffer */
-
-    if (!nb_samples) {
+    int count = p_sys->nb_samples / p_sys->i_channels;
+    if (count <= 0) {
         LOGE("no samples yet...");
-        goto release;
+        return -1;
     }
+    FftPlan *plan = p_sys->plans[plan_index(out_samples)];
+    plan->run(samples, p_sys->i_channels, count, p_sys->spectrum);
 
-    /* Allocate the buffer only if the number of samples change */
-    if (nb_samples != p_sys->i_prev_nb_samples) {
-        if (p_sys->p_prev_s16_buff) delete [] (p_sys->p_prev_s16_buff);
-        p_sys->p_prev_s16_buff = new int16_t [nb_samples * p_sys->i_channels];
-        if (!p_sys->p_prev_s16_buff)
-            goto release;
-        p_sys->i_prev_nb_samples = nb_samples;
-    }
-    p_buffs = p_s16_buff = p_sys->p_prev_s16_buff;
-
-    /* Convert the buffer to int16_t */
-    for (i = nb_samples * p_sys->i_channels; i--;) {
-        union {float f; int32_t i;} u{};
-
-        u.f = *p_buffl + 384.f;
-        if (u.i > 0x43c07fff)
-            *p_buffs = 32767;
-        else if (u.i < 0x43bf8000)
-            *p_buffs = -32768;
-        else
-            *p_buffs = u.i - 0x43c00000;
-
-        p_buffl++; p_buffs++;
-    }
-    p_state = visual_fft_init();
-    if (!p_state) {
-        LOGE("unable to initialize FFT transform...");
-        goto release;
-    }
-    if (!window_init(out_samples, p_sys->wind_param, &wind_ctx)) {
-        LOGE("unable to initialize FFT window...");
-        goto release;
-    }
-    p_buffs = p_s16_buff;
-    for (i = 0 ; i < out_samples; i++) {
-        p_output[i] = 0;
-        p_buffer1[i] = *p_buffs;
-
-        p_buffs += p_sys->i_channels;
-        if (p_buffs >= &p_s16_buff[nb_samples * p_sys->i_channels])
-            p_buffs = p_s16_buff;
+    // 2/N to the amplitude, then s16 range to s8
+    float scale = 2.0f / out_samples / 256;
+    for (int i = 0; i < out_samples; ++i) {
+        float value = p_sys->spectrum[i] * scale;
+        value = value > 127 ? 127 : (value < -128 ? -128 : value);
+        p_sys->output[i] = (int8_t) value;
     }
-    window_scale_in_place (p_buffer1, &wind_ctx);
-    fft_perform (p_buffer1, p_output, p_state);
+    return 0;
+}
 
-    for (i = 0; i < out_samples; ++i) {
-        int16_t temp = p_output[i] * (2 ^ 16)
-                           / ((out_samples / 2 * 32768) ^ 2);
-        p_sys->output[i] = temp & 0xFF;
-    }
+FrankVisualizer::FrankVisualizer() {
 
-release:
-    window_close(&wind_ctx);
-    fft_close(p_state);
 }
 
-int fft_fixed_internal(uint8_t *fft, const uint8_t *waveform, int mCaptureSize) {
-    int32_t workspace[mCaptureSize >> 1];
-    int32_t nonzero = 0;
+FrankVisualizer::~FrankVisualizer() {
 
-    for (uint32_t i = 0; i < mCaptureSize; i += 2) {
-        workspace[i >> 1] =
-                ((waveform[i] ^ 0x80) << 24) | ((waveform[i + 1] ^ 0x80) << 8);
-        nonzero |= workspace[i >> 1];
-    }
+}
 
-    if (nonzero) {
-        fixed_fft_real(mCaptureSize >> 1, workspace);
-    }
+// with mFftLock held
+void FrankVisualizer::analyze(const int16_t *samples, int count) {
+    filter_sys_t *p_sys = fft_context;
+    p_sys->nb_samples = count;
+    if (fft_transform(p_sys, samples) < 0)
+        return;
+    int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    p_sys->analyzer->process(p_sys->spectrum, now_us, mSnapshot.back());
+    mSnapshot.publish();
+}
 
-    for (uint32_t i = 0; i < mCaptureSize; i += 2) {
-        short tmp = workspace[i >> 1] >> 21;
-        while (tmp > 127 || tmp < -128) tmp >>= 1;
-        fft[i] = tmp;
-        tmp = workspace[i >> 1];
-        tmp >>= 5;
-        while (tmp > 127 || tmp < -128) tmp >>= 1;
-        fft[i + 1] = tmp;
-    }
+int8_t* FrankVisualizer::fft_run(uint8_t *input_buffer, int nb_samples) {
+    // the audio thread may call, rather drop a capture than wait
+    std::unique_lock<std::mutex> lock(mFftLock, std::try_to_lock);
+    if (!lock.owns_lock() || !fft_context)
+        return nullptr;
+    analyze(reinterpret_cast<const int16_t *>(input_buffer), nb_samples / static_cast<int>(sizeof(int16_t)));
+    return fft_context->output;
+}
 
-    return 0;
+// the last out_samples of the tap, read in place unless they wrap around its ring
+void FrankVisualizer::pullTap() {
+    std::unique_lock<std::mutex> lock(mFftLock, std::try_to_lock);
+    if (!lock.owns_lock() || !fft_context || !mTap)
+        return;
+    PcmTapReader *tap = mTap.get();
+    uint64_t written = tap->written();
+    int sample_rate  = tap->sampleRate();
+    if (written == mTapWritten || sample_rate <= 0)
+        return;
+    mTapWritten = written;
+    if (sample_rate != fft_context->analyzer->config().sample_rate) {
+        SpectrumConfig config = fft_context->analyzer->config();
+        config.sample_rate = sample_rate;
+        configure(fft_context->out_samples, config);
+    }
+
+    // the older ones are let go, the window stays for the next call
+    tap->keepLast(static_cast<size_t>(fft_context->out_samples));
+    const int16_t *first;
+    const int16_t *second;
+    size_t first_count;
+    size_t count = tap->peek(&first, &first_count, &second);
+    if (count > static_cast<size_t>(fft_context->out_samples))
+        count = static_cast<size_t>(fft_context->out_samples);
+    if (first_count >= count) {
+        analyze(first, static_cast<int>(count));
+        return;
+    }
+    memcpy(fft_context->tap_samples, first, first_count * sizeof(int16_t));
+    memcpy(fft_context->tap_samples + first_count, second, (count - first_count) * sizeof(int16_t));
+    analyze(fft_context->tap_samples, static_cast<int>(count));
 }
 
-// fixed FFT algorithm
-void fft_fixed(filter_sys_t *p_sys) {
-    int nb_samples = p_sys->nb_samples;
-    int out_samples = p_sys->out_samples;
+void FrankVisualizer::setTap(const std::shared_ptr<PcmTapReader> &tap) {
+    std::lock_guard<std::mutex> lock(mFftLock);
+    if (mTap)
+        mTap->detach();
+    mTap = tap;
+    mTapWritten = 0;
+}
 
-    DEFINE_WIND_CONTEXT(wind_ctx);
-    if (!nb_samples) {
-        LOGE("no samples yet...");
-        goto release;
+// with mFftLock held, the plan created here rather than on the audio thread
+int FrankVisualizer::configure(int fft_size, const SpectrumConfig &config) {
+    if (fft_size < MIN_FFT_SIZE || fft_size > MAX_FFT_SIZE || (fft_size & (fft_size - 1)) != 0) {
+        LOGE("unsupported FFT size %d...", fft_size);
+        return -1;
     }
-
-    if (!window_init(out_samples, p_sys->wind_param, &wind_ctx)) {
-        LOGE("unable to initialize FFT window...");
-        goto release;
+    if (!fft_context)
+        return -1;
+    FftPlan *&plan = fft_context->plans[plan_index(fft_size)];
+    if (!plan) {
+        plan = FftPlan::create(fft_size, fft_context->wind_param);
+        if (!plan) {
+            LOGE("unable to create FFT plan of %d...", fft_size);
+            return -1;
+        }
+    }
+    if (fft_context->analyzer->configure(config, fft_size, plan->gain()) < 0) {
+        LOGE("invalid spectrum config, bands=%d...", config.bands);
+        return -1;
+    }
+    if (fft_context->out_samples != fft_size) {
+        fft_context->out_samples = fft_size;
+        memset(fft_context->output, 0, MAX_FFT_SIZE);
     }
-
-    window_scale_in_place ((int16_t *) p_sys->data, &wind_ctx);
-    fft_fixed_internal((uint8_t *) p_sys->output, p_sys->data, out_samples);
-
-release:
-    window_close(&wind_ctx);
+    return 0;
 }
 
-FrankVisualizer::FrankVisualizer() {
-
+int FrankVisualizer::setFftSize(int fft_size) {
+    std::lock_guard<std::mutex> lock(mFftLock);
+    if (!fft_context)
+        return -1;
+    return configure(fft_size, fft_context->analyzer->config());
 }
 
-FrankVisualizer::~FrankVisualizer() {
-
+int FrankVisualizer::setSpectrumConfig(const SpectrumConfig &config) {
+    std::lock_guard<std::mutex> lock(mFftLock);
+    if (!fft_context)
+        return -1;
+    return configure(fft_context->out_samples, config);
 }
 
-int8_t* FrankVisualizer::fft_run(uint8_t *input_buffer, int nb_samples) {
-    mFftLock.lock();
-    if (!fft_context)
-        return nullptr;
-    fft_context->nb_samples = nb_samples;
-    memcpy(fft_context->data, input_buffer, static_cast<size_t>(nb_samples));
-    filter_sys_t *p_sys = fft_context;
-#ifdef FIXED_FFT
-    fft_fixed(p_sys);
-#else
-    fft_float(p_sys);
-#endif
-    mFftLock.unlock();
-    return fft_context->output;
+const SpectrumFrame *FrankVisualizer::readSpectrum(bool *fresh) {
+    pullTap();
+    return mSnapshot.acquire(fresh);
 }
 
 int FrankVisualizer::getOutputSample() {
@@ -186,49 +169,51 @@ int8_t *FrankVisualizer::getFFTData() {
 }
 
 int FrankVisualizer::init_visualizer() {
-    fft_context = new filter_sys_t();
-    filter_sys_t *p_filter = fft_context;
+    auto *p_filter = new filter_sys_t();
 
-    p_filter->convert_to_float = false;
     p_filter->i_channels = 1;
-    p_filter->i_prev_nb_samples = 0;
-    p_filter->p_prev_s16_buff = nullptr;
-    p_filter->data = nullptr;
-    p_filter->data_size = 0;
     p_filter->nb_samples = 0;
-#ifdef FIXED_FFT
-    p_filter->out_samples = 512;
-#else
-    p_filter->out_samples = FFT_BUFFER_SIZE;
-#endif
+    p_filter->out_samples = 0;
 
     p_filter->wind_param = new window_param();
     /* Fetch the FFT window parameters */
     window_get_param(p_filter->wind_param);
-    p_filter->data_size = MAX_FFT_SIZE;
-    p_filter->data = new uint8_t[MAX_FFT_SIZE];
-    memset(p_filter->data, 0, MAX_FFT_SIZE);
-    p_filter->output = new int8_t[p_filter->out_samples];
-    memset(p_filter->output, 0, p_filter->out_samples);
-    return 0;
+    for (int i = 0; i < FFT_PLAN_COUNT; i++) {
+        p_filter->plans[i] = nullptr;
+    }
+    p_filter->spectrum = new float[MAX_FFT_SIZE];
+    p_filter->analyzer = new SpectrumAnalyzer();
+    p_filter->tap_samples = new int16_t[MAX_FFT_SIZE];
+    p_filter->output = new int8_t[MAX_FFT_SIZE];
+    memset(p_filter->output, 0, MAX_FFT_SIZE);
+
+    std::lock_guard<std::mutex> lock(mFftLock);
+    fft_context = p_filter;
+    return configure(DEFAULT_FFT_SIZE, SpectrumConfig());
 }
 
 void FrankVisualizer::release_visualizer() {
-    mFftLock.lock();
+    std::lock_guard<std::mutex> lock(mFftLock);
     filter_sys_t *p_filter = fft_context;
     if (!p_filter) return;
-    if (p_filter->p_prev_s16_buff) {
-        delete [] (p_filter->p_prev_s16_buff);
+    fft_context = nullptr;
+    if (mTap) {
+        mTap->detach();
+        mTap.reset();
     }
     if (p_filter->wind_param) {
         delete (p_filter->wind_param);
     }
-    if (p_filter->data) {
-        delete [] (p_filter->data);
+    for (int i = 0; i < FFT_PLAN_COUNT; i++) {
+        delete p_filter->plans[i];
+    }
+    if (p_filter->spectrum) {
+        delete [] (p_filter->spectrum);
     }
+    delete p_filter->analyzer;
+    delete [] p_filter->tap_samples;
     if (p_filter->output) {
         delete [] (p_filter->output);
     }
     delete p_filter;
-    mFftLock.unlock();
-}
\ No newline at end of file
+}
@@ -6,28 +6,38 @@
 #define FRANK_VISUALIZER_H
 
 #include <math.h>
+#include <memory>
 #include <mutex>
 
-#include "fft.h"
 #include "window.h"
-#include "fixed_fft.h"
+#include "fft_plan.h"
+#include "spectrum_analyzer.h"
+#include "ff_pcm_tap.h"
 
-#define MIN_FFT_SIZE 128
-#define MAX_FFT_SIZE 1024
+#define MIN_FFT_SIZE FFT_PLAN_MIN_SIZE
+#define MAX_FFT_SIZE FFT_PLAN_MAX_SIZE
+#define DEFAULT_FFT_SIZE 512
 
-#define FIXED_FFT 1
+// one for each power of two from MIN_FFT_SIZE to MAX_FFT_SIZE
+#define FFT_PLAN_COUNT 7
+
+// asked of a player tap: no decimation up to 48kHz, Nyquist above 16kHz
+#define TAP_SAMPLE_RATE 32000
+#define TAP_FRAMES (MAX_FFT_SIZE * 4)
 
 typedef struct
 {
-    bool convert_to_float;
     int i_channels;
-    int i_prev_nb_samples;
-    int16_t *p_prev_s16_buff;
 
     window_param *wind_param;
 
-    uint8_t *data;
-    int data_size;
+    // created when a size is set, then kept
+    FftPlan *plans[FFT_PLAN_COUNT];
+    float *spectrum;
+    SpectrumAnalyzer *analyzer;
+    // the last samples of the tap, when they wrap around its ring
+    int16_t *tap_samples;
+
     int nb_samples;
     int8_t *output;
     int out_samples;
@@ -41,6 +51,18 @@ private:
 
     filter_sys_t *fft_context = nullptr;
 
+    SpectrumSnapshot mSnapshot;
+
+    // guarded by mFftLock
+    std::shared_ptr<PcmTapReader> mTap;
+    uint64_t mTapWritten = 0;
+
+    int configure(int fft_size, const SpectrumConfig &config);
+
+    void analyze(const int16_t *samples, int count);
+
+    void pullTap();
+
 public:
     FrankVisualizer();
     ~FrankVisualizer();
@@ -49,8 +71,41 @@ public:
 
     int8_t* getFFTData();
 
+    /**
+     * FFT, then bands published for readSpectrum(). Never waits: skipped while
+     * the size or the config is changing.
+     * @param input_buffer s16 PCM of i_channels, only the first one is used
+     * @param nb_samples   size of input_buffer in bytes
+     * @return out_samples bytes: re of DC and Nyquist, then re and im of each bin,
+     * nullptr if skipped
+     */
     int8_t* fft_run(uint8_t *input_buffer, int nb_samples);
 
+    /**
+     * @param fft_size power of two from MIN_FFT_SIZE to MAX_FFT_SIZE, also the output size
+     * @return 0, or -1 if not supported
+     */
+    int setFftSize(int fft_size);
+
+    /**
+     * @return 0, or -1 if not valid
+     */
+    int setSpectrumConfig(const SpectrumConfig &config);
+
+    /**
+     * Take the PCM from a player tap rather than fft_run(), analyzed in readSpectrum().
+     * @param tap nullptr to detach
+     */
+    void setTap(const std::shared_ptr<PcmTapReader> &tap);
+
+    /**
+     * The latest bands, from a single thread, e.g. the render one at each vsync.
+     * With a tap, its latest samples are analyzed first.
+     * @param fresh set to whether new bands came since the last call
+     * @return valid until the next call
+     */
+    const SpectrumFrame *readSpectrum(bool *fresh);
+
     int init_visualizer();
 
     void release_visualizer();
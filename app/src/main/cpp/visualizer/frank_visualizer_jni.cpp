@@ -3,6 +3,7 @@
 //
 
 #include <jni.h>
+#include <algorithm>
 #include "frank_visualizer.h"
 
 #define VISUALIZER_FUNC(RETURN_TYPE, NAME, ...) \
@@ -17,9 +18,6 @@
 
 struct fields_t {
     jfieldID context;
-    jclass visual_class;
-    jmethodID fft_method;
-    jbyteArray data_array;
 };
 
 static fields_t fields;
@@ -43,20 +41,10 @@ FrankVisualizer *getCustomVisualizer(JNIEnv *env, jobject thiz) {
     return (FrankVisualizer *) env->GetLongField(thiz, fields.context);
 }
 
-void fft_callback(JNIEnv *jniEnv, int8_t * arg, int samples) {
-    jniEnv->SetByteArrayRegion(fields.data_array, 0, samples, arg);
-    jniEnv->CallStaticVoidMethod(fields.visual_class, fields.fft_method, fields.data_array);
-}
-
 VISUALIZER_FUNC(int, nativeInitVisualizer) {
     setCustomVisualizer(env, thiz);
     FrankVisualizer *mVisualizer = getCustomVisualizer(env, thiz);
     if (!mVisualizer) return -2;
-    jclass mVisualClass = env->FindClass(className);
-    fields.visual_class = (jclass) env->NewGlobalRef(mVisualClass);
-    fields.fft_method = env->GetStaticMethodID(fields.visual_class, "onFftCallback", "([B)V");
-    jbyteArray dataArray = env->NewByteArray(MAX_FFT_SIZE);
-    fields.data_array = (jbyteArray) env->NewGlobalRef(dataArray);
     return mVisualizer->init_visualizer();
 }
 
@@ -64,21 +52,83 @@ VISUALIZER_FUNC(int, nativeCaptureData, jobject buffer, jint size) {
     if (!buffer) return -1;
     FrankVisualizer *mVisualizer = getCustomVisualizer(env, thiz);
     if (!mVisualizer) return -2;
-    int nb_samples = size < MAX_FFT_SIZE ? size : MAX_FFT_SIZE;
-    if (nb_samples >= MIN_FFT_SIZE) {
+    // s16 samples, shorter captures are padded with zeros
+    int nb_samples = size < MAX_FFT_SIZE * 2 ? size : MAX_FFT_SIZE * 2;
+    if (nb_samples >= MIN_FFT_SIZE * 2) {
         auto *input_buffer = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
-        int8_t *output_data = mVisualizer->fft_run(input_buffer, nb_samples);
-        fft_callback(env, output_data, mVisualizer->getOutputSample());
+        // published for nativeReadSpectrum, no call back to Java
+        mVisualizer->fft_run(input_buffer, nb_samples);
     }
     return 0;
 }
 
+VISUALIZER_FUNC(int, nativeSetFftSize, jint fft_size) {
+    FrankVisualizer *mVisualizer = getCustomVisualizer(env, thiz);
+    if (!mVisualizer) return -2;
+    return mVisualizer->setFftSize(fft_size);
+}
+
+VISUALIZER_FUNC(int, nativeSetSpectrumConfig, jint sample_rate, jint bands,
+                jfloat min_freq, jfloat max_freq, jfloat min_db, jfloat max_db) {
+    FrankVisualizer *mVisualizer = getCustomVisualizer(env, thiz);
+    if (!mVisualizer) return -2;
+    SpectrumConfig config;
+    config.sample_rate = sample_rate;
+    config.bands    = bands;
+    config.min_freq = min_freq;
+    config.max_freq = max_freq;
+    config.min_db   = min_db;
+    config.max_db   = max_db;
+    return mVisualizer->setSpectrumConfig(config);
+}
+
+// bands written if new ones came since the last call, else 0
+VISUALIZER_FUNC(int, nativeReadSpectrum, jfloatArray levels, jfloatArray peaks) {
+    FrankVisualizer *mVisualizer = getCustomVisualizer(env, thiz);
+    if (!mVisualizer) return -2;
+    bool fresh;
+    const SpectrumFrame *frame = mVisualizer->readSpectrum(&fresh);
+    if (!fresh)
+        return 0;
+    int bands = frame->bands;
+    if (levels) {
+        bands = std::min(bands, (int) env->GetArrayLength(levels));
+        env->SetFloatArrayRegion(levels, 0, bands, frame->levels);
+    }
+    if (peaks) {
+        bands = std::min(bands, (int) env->GetArrayLength(peaks));
+        env->SetFloatArrayRegion(peaks, 0, bands, frame->peaks);
+    }
+    return bands;
+}
+
+// size, plan us, plan in C us, fixed_fft_real us, fft_perform us for each size
+VISUALIZER_FUNC(jdoubleArray, nativeFftBenchmark) {
+    FftBenchmark results[FFT_PLAN_COUNT];
+    int count = fft_plan_benchmark(results, FFT_PLAN_COUNT);
+    jdouble values[FFT_PLAN_COUNT * 5];
+    for (int i = 0; i < count; i++) {
+        values[i * 5]     = results[i].size;
+        values[i * 5 + 1] = results[i].plan_us;
+        values[i * 5 + 2] = results[i].plan_c_us;
+        values[i * 5 + 3] = results[i].fixed_us;
+        values[i * 5 + 4] = results[i].perform_us;
+    }
+    jdoubleArray array = env->NewDoubleArray(count * 5);
+    env->SetDoubleArrayRegion(array, 0, count * 5, values);
+    return array;
+}
+
+VISUALIZER_FUNC(void, nativeDetachPlayer) {
+    FrankVisualizer *mVisualizer = getCustomVisualizer(env, thiz);
+    if (!mVisualizer) return;
+    mVisualizer->setTap(nullptr);
+}
+
 VISUALIZER_FUNC(void, nativeReleaseVisualizer) {
     FrankVisualizer *mVisualizer = getCustomVisualizer(env, thiz);
     if (!mVisualizer) return;
     mVisualizer->release_visualizer();
     delete mVisualizer;
-    env->DeleteGlobalRef(fields.data_array);
-    env->DeleteGlobalRef(fields.visual_class);
     env->SetLongField(thiz, fields.context, 0);
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+//
+// Display-ready spectrum: log-frequency bands in dB, smoothed, with peak hold.
+//
+
+#include "spectrum_analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// longer gaps between captures, e.g. after a pause, count as this
+#define MAX_STEP_MS 100.0f
+// power of silence, keeps log10 finite
+#define MIN_POWER 1e-12f
+
+/******************** SpectrumSnapshot ********************/
+
+SpectrumSnapshot::SpectrumSnapshot() : m_middle(1) {}
+
+SpectrumFrame *SpectrumSnapshot::back() {
+    return &m_frames[m_back];
+}
+
+void SpectrumSnapshot::publish() {
+    int old = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+    m_back = old & ~FRESH;
+}
+
+const SpectrumFrame *SpectrumSnapshot::acquire(bool *fresh) {
+    *fresh = (m_middle.load(std::memory_order_relaxed) & FRESH) != 0;
+    if (*fresh) {
+        int old = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = old & ~FRESH;
+    }
+    return &m_frames[m_front];
+}
+
+/******************** SpectrumAnalyzer ********************/
+
+int SpectrumAnalyzer::configure(const SpectrumConfig &config, int fftSize, float gain) {
+    if (config.sample_rate <= 0 || config.bands <= 0 || config.bands > SPECTRUM_MAX_BANDS
+            || config.min_freq <= 0 || config.max_freq <= config.min_freq
+            || config.max_db <= config.min_db || fftSize < 4 || gain <= 0)
+        return -1;
+    if (config.bands != m_config.bands || m_levels.empty()) {
+        m_levels.assign((size_t) config.bands, 0.0f);
+        m_peaks.assign((size_t) config.bands, 0.0f);
+        m_peakAge.assign((size_t) config.bands, 0.0f);
+    }
+    m_config  = config;
+    m_fftSize = fftSize;
+    // |X| of a full scale sine is 32768 * size / 2 * gain
+    float full = 32768.0f * fftSize / 2 * gain;
+    m_norm = 1.0f / (full * full);
+
+    // log spaced edges, in bins from 1 (no DC) to size / 2 - 1
+    int last_bin = fftSize / 2 - 1;
+    float bin_hz = (float) config.sample_rate / fftSize;
+    float max_freq = std::min(config.max_freq, config.sample_rate / 2.0f);
+    float ratio = max_freq / config.min_freq;
+    m_first.resize((size_t) config.bands);
+    m_last.resize((size_t) config.bands);
+    for (int b = 0; b < config.bands; b++) {
+        float low  = config.min_freq * powf(ratio, (float) b / config.bands) / bin_hz;
+        float high = config.min_freq * powf(ratio, (float) (b + 1) / config.bands) / bin_hz;
+        int first = std::min(std::max((int) lroundf(low), 1), last_bin);
+        int last  = std::min(std::max((int) lroundf(high) - 1, first), last_bin);
+        // bands narrower than a bin share it
+        m_first[b] = first;
+        m_last[b]  = last;
+    }
+    return 0;
+}
+
+const SpectrumConfig &SpectrumAnalyzer::config() const {
+    return m_config;
+}
+
+void SpectrumAnalyzer::process(const float *spectrum, int64_t now_us, SpectrumFrame *frame) {
+    float step = m_lastUs < 0 ? 0 : std::min((now_us - m_lastUs) / 1000.0f, MAX_STEP_MS);
+    m_lastUs = now_us;
+    float attack = 1.0f - expf(-step / std::max(m_config.attack_ms, 0.001f));
+    float decay  = 1.0f - expf(-step / std::max(m_config.decay_ms, 0.001f));
+    float fall   = m_config.peak_fall * step / 1000.0f;
+    float range  = m_config.max_db - m_config.min_db;
+
+    int bands = m_config.bands;
+    for (int b = 0; b < bands; b++) {
+        // the strongest bin, a tone shows the same whatever the width of its band
+        float power = MIN_POWER;
+        for (int k = m_first[b]; k <= m_last[b]; k++) {
+            float re = spectrum[k * 2], im = spectrum[k * 2 + 1];
+            power = std::max(power, (re * re + im * im) * m_norm);
+        }
+        float db = 10.0f * log10f(power);
+        float target = std::min(std::max((db - m_config.min_db) / range, 0.0f), 1.0f);
+
+        float &level = m_levels[b];
+        level += (target - level) * (target > level ? attack : decay);
+        float &peak = m_peaks[b];
+        if (level >= peak) {
+            peak = level;
+            m_peakAge[b] = 0;
+        } else {
+            m_peakAge[b] += step;
+            if (m_peakAge[b] > m_config.hold_ms)
+                peak = std::max(peak - fall, level);
+        }
+        frame->levels[b] = level;
+        frame->peaks[b]  = peak;
+    }
+    frame->bands = bands;
+    frame->sequence = ++m_sequence;
+    frame->timestamp_us = now_us;
+}
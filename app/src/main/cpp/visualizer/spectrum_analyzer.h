@@ -0,0 +1,107 @@
+//
+// Display-ready spectrum: log-frequency bands in dB, smoothed, with peak hold.
+//
+
+#ifndef SPECTRUM_ANALYZER_H
+#define SPECTRUM_ANALYZER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#define SPECTRUM_MAX_BANDS 128
+
+struct SpectrumConfig {
+    int sample_rate   = 44100;
+    int bands         = 64;
+    float min_freq    = 40;
+    float max_freq    = 16000; // lowered to the Nyquist frequency if above
+    float min_db      = -70;   // level 0
+    float max_db      = 0;     // level 1, full scale sine
+    float attack_ms   = 10;
+    float decay_ms    = 300;
+    float hold_ms     = 500;
+    float peak_fall   = 1.0f;  // levels per second, once the hold is over
+};
+
+/**
+ * Levels and peaks of each band, from 0 to 1.
+ */
+struct SpectrumFrame {
+    int64_t sequence;
+    int64_t timestamp_us; // steady clock
+    int bands;
+    float levels[SPECTRUM_MAX_BANDS];
+    float peaks[SPECTRUM_MAX_BANDS];
+};
+
+/**
+ * Triple buffer between the thread writing frames and the one reading them:
+ * neither ever waits, the reader gets the latest complete frame.
+ * One writer and one reader.
+ */
+class SpectrumSnapshot {
+private:
+
+    static const int FRESH = 4;
+
+    SpectrumFrame m_frames[3] = {};
+    // index of the frame between the two sides, FRESH when written and not yet read
+    std::atomic<int> m_middle;
+    int m_back  = 0;
+    int m_front = 2;
+
+public:
+
+    SpectrumSnapshot();
+
+    /**
+     * The frame to write, owned by the writer until publish()
+     */
+    SpectrumFrame *back();
+
+    void publish();
+
+    /**
+     * @param fresh set to whether the frame wasn't returned before
+     * @return the latest published frame, owned by the reader until the next call
+     */
+    const SpectrumFrame *acquire(bool *fresh);
+};
+
+/**
+ * Turns the output of FftPlan into a SpectrumFrame. Not thread safe.
+ */
+class SpectrumAnalyzer {
+private:
+
+    SpectrumConfig m_config;
+    int m_fftSize = 0;
+    float m_norm  = 0; // power to full scale
+    // first and last bin of each band
+    std::vector<int> m_first;
+    std::vector<int> m_last;
+    std::vector<float> m_levels;
+    std::vector<float> m_peaks;
+    std::vector<float> m_peakAge; // ms
+    int64_t m_lastUs = -1;
+    int64_t m_sequence = 0;
+
+public:
+
+    /**
+     * @param gain coherent gain of the window, FftPlan::gain()
+     * @return 0, or -1 if the config is invalid
+     */
+    int configure(const SpectrumConfig &config, int fftSize, float gain);
+
+    const SpectrumConfig &config() const;
+
+    /**
+     * @param spectrum layout of FftPlan::run() output
+     * @param now_us   time of the capture, for the smoothing
+     */
+    void process(const float *spectrum, int64_t now_us, SpectrumFrame *frame);
+};
+
+#endif //SPECTRUM_ANALYZER_H
@@ -5,6 +5,18 @@
 #include "yuv_converter.h"
 #include <cstring>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YUV_HAVE_SSE2 1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define YUV_HAVE_AVX2 1
+#endif
+#endif
+
 // https://chromium.googlesource.com/libyuv/libyuv
 // https://mymusing.co/bt601-yuv-to-rgb-conversion-color/
 // https://www.color.org/chardata/rgb/rgb_registry.xalter
@@ -28,181 +40,576 @@
 // U = (-38 * R - 74 * G + 112 * B) >> 8 + 128
 // V = (112 * R - 94 * G - 18 * B) >> 8 + 128
 
-static void rgba_to_yuv420p(const int *argb, int8_t *yuv, int width, int height) {
-    int frameSize = width * height;
-    int index = 0;
-    int yIndex = 0;
-    int uIndex = frameSize;
-    int vIndex = frameSize * 5 / 4;
-    int R, G, B, Y, U, V;
+// YUV to RGB in 6 bits fixed point, so that the products fit in 16 bits lanes:
+// R = Y + (90 * V) >> 6
+// G = Y - (22 * U + 46 * V) >> 6
+// B = Y + (114 * U) >> 6
 
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
-            R = (argb[index] & 0xff0000) >> 16;
-            G = (argb[index] & 0xff00) >> 8;
-            B = (argb[index] & 0xff);
-
-            // RGB to YUV algorithm
-            Y = ((66 * R + 129 * G + 25 * B + 128) >> 8) + 16;
-
-            // I420(YUV420p) -> YYYYYYYY UU VV
-            yuv[yIndex++] = (int8_t) Y;
-            if (j % 2 == 0 && i % 2 == 0) {
-                U = ((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128;
-                V = ((112 * R - 94 * G - 18 * B + 128) >> 8) + 128;
-                yuv[uIndex++] = (int8_t) U;
-                yuv[vIndex++] = (int8_t) V;
-            }
-            index++;
+// all the kernels of one instruction set, SIMD ones finish the tail with C
+struct YuvKernels {
+    const char *name;
+    void (*argb_to_y)(const uint32_t *argb, uint8_t *y, int width);
+    // chroma from the even pixels of a row
+    void (*argb_to_uv)(const uint32_t *argb, uint8_t *u, uint8_t *v, int width);
+    void (*yuv_to_argb)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint32_t *argb, int width);
+    // de-interleave count pairs
+    void (*split_uv)(const uint8_t *src, uint8_t *a, uint8_t *b, int count);
+    void (*transpose8x8)(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride);
+    void (*reverse)(const uint8_t *src, uint8_t *dst, int count);
+};
+
+/******************** C ********************/
+
+static inline uint8_t clamp255(int v) {
+    return (uint8_t) (v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static void argb_to_y_c(const uint32_t *argb, uint8_t *y, int width) {
+    for (int i = 0; i < width; i++) {
+        int R = (argb[i] >> 16) & 0xff;
+        int G = (argb[i] >> 8) & 0xff;
+        int B = argb[i] & 0xff;
+        y[i] = (uint8_t) (((66 * R + 129 * G + 25 * B + 128) >> 8) + 16);
+    }
+}
+
+static void argb_to_uv_c(const uint32_t *argb, uint8_t *u, uint8_t *v, int width) {
+    for (int i = 0; i < width / 2; i++) {
+        int R = (argb[i * 2] >> 16) & 0xff;
+        int G = (argb[i * 2] >> 8) & 0xff;
+        int B = argb[i * 2] & 0xff;
+        u[i] = (uint8_t) (((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128);
+        v[i] = (uint8_t) (((112 * R - 94 * G - 18 * B + 128) >> 8) + 128);
+    }
+}
+
+static void yuv_to_argb_c(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint32_t *argb, int width) {
+    for (int i = 0; i < width; i++) {
+        int U = u[i / 2] - 128;
+        int V = v[i / 2] - 128;
+        int r = y[i] + ((90 * V) >> 6);
+        int g = y[i] - ((22 * U + 46 * V) >> 6);
+        int b = y[i] + ((114 * U) >> 6);
+        argb[i] = 0xff000000 | (clamp255(r) << 16) | (clamp255(g) << 8) | clamp255(b);
+    }
+}
+
+static void split_uv_c(const uint8_t *src, uint8_t *a, uint8_t *b, int count) {
+    for (int i = 0; i < count; i++) {
+        a[i] = src[i * 2];
+        b[i] = src[i * 2 + 1];
+    }
+}
+
+static void transpose8x8_c(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride) {
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            dst[j * dst_stride + i] = src[i * src_stride + j];
         }
     }
 }
 
-static int yuv2argb(int y, int u, int v) {
-#define max(a, b) ((a) > (b) ? (a) : (b))
+static void reverse_c(const uint8_t *src, uint8_t *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = src[count - 1 - i];
+    }
+}
+
+static const YuvKernels kernels_c = {
+        "c",
+        argb_to_y_c,
+        argb_to_uv_c,
+        yuv_to_argb_c,
+        split_uv_c,
+        transpose8x8_c,
+        reverse_c
+};
+
+/******************** NEON ********************/
 
-    int r, g, b;
+#ifdef YUV_HAVE_NEON
 
-    r = y + (int) (1.407f * u);
-    g = y - (int) (0.345f * v + 0.716f * u);
-    b = y + (int) (1.779f * v);
-    r = r > 255 ? 255 : max(r, 0);
-    g = g > 255 ? 255 : max(g, 0);
-    b = b > 255 ? 255 : max(b, 0);
-    return 0xff000000 | (r << 16) | (g << 8) | b;
+static void argb_to_y_neon(const uint32_t *argb, uint8_t *y, int width) {
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        // little endian 0xAARRGGBB: B, G, R, A
+        uint8x16x4_t px = vld4q_u8((const uint8_t *) (argb + i));
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[2]), vdup_n_u8(66));
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[2]), vdup_n_u8(66));
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), vdup_n_u8(129));
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), vdup_n_u8(129));
+        lo = vmlal_u8(lo, vget_low_u8(px.val[0]), vdup_n_u8(25));
+        hi = vmlal_u8(hi, vget_high_u8(px.val[0]), vdup_n_u8(25));
+        lo = vshrq_n_u16(vaddq_u16(lo, vdupq_n_u16(128)), 8);
+        hi = vshrq_n_u16(vaddq_u16(hi, vdupq_n_u16(128)), 8);
+        uint8x16_t out = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+        vst1q_u8(y + i, vaddq_u8(out, vdupq_n_u8(16)));
+    }
+    argb_to_y_c(argb + i, y + i, width - i);
 }
 
-static void yuv420p_to_argb(const int8_t *yuv, int *argb, int width, int height) {
-    int size = width * height;
-    int offset = size;
-    int u, v, y1, y2, y3, y4;
+static void argb_to_uv_neon(const uint32_t *argb, uint8_t *u, uint8_t *v, int width) {
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x4_t px = vld4q_u8((const uint8_t *) (argb + i));
+        // even pixels
+        int16x8_t B = vreinterpretq_s16_u16(vmovl_u8(vuzp_u8(vget_low_u8(px.val[0]), vget_high_u8(px.val[0])).val[0]));
+        int16x8_t G = vreinterpretq_s16_u16(vmovl_u8(vuzp_u8(vget_low_u8(px.val[1]), vget_high_u8(px.val[1])).val[0]));
+        int16x8_t R = vreinterpretq_s16_u16(vmovl_u8(vuzp_u8(vget_low_u8(px.val[2]), vget_high_u8(px.val[2])).val[0]));
+        int16x8_t U = vmulq_n_s16(R, -38);
+        U = vmlaq_n_s16(U, G, -74);
+        U = vmlaq_n_s16(U, B, 112);
+        U = vaddq_s16(vshrq_n_s16(vaddq_s16(U, vdupq_n_s16(128)), 8), vdupq_n_s16(128));
+        int16x8_t V = vmulq_n_s16(R, 112);
+        V = vmlaq_n_s16(V, G, -94);
+        V = vmlaq_n_s16(V, B, -18);
+        V = vaddq_s16(vshrq_n_s16(vaddq_s16(V, vdupq_n_s16(128)), 8), vdupq_n_s16(128));
+        vst1_u8(u + i / 2, vqmovun_s16(U));
+        vst1_u8(v + i / 2, vqmovun_s16(V));
+    }
+    argb_to_uv_c(argb + i, u + i / 2, v + i / 2, width - i);
+}
 
-    for (int i = 0, k = 0; i < size; i += 2, k++) {
-        y1 = yuv[i] & 0xff;
-        y2 = yuv[i + 1] & 0xff;
-        y3 = yuv[width + i] & 0xff;
-        y4 = yuv[width + i + 1] & 0xff;
+static void yuv_to_argb_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint32_t *argb, int width) {
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        uint8x16_t Y = vld1q_u8(y + i);
+        int16x8_t U = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + i / 2))), vdupq_n_s16(128));
+        int16x8_t V = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + i / 2))), vdupq_n_s16(128));
+        int16x8_t dr = vshrq_n_s16(vmulq_n_s16(V, 90), 6);
+        int16x8_t dg = vshrq_n_s16(vmlaq_n_s16(vmulq_n_s16(U, 22), V, 46), 6);
+        int16x8_t db = vshrq_n_s16(vmulq_n_s16(U, 114), 6);
+        // one chroma sample for two pixels
+        int16x8x2_t r2 = vzipq_s16(dr, dr);
+        int16x8x2_t g2 = vzipq_s16(dg, dg);
+        int16x8x2_t b2 = vzipq_s16(db, db);
+        int16x8_t y_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(Y)));
+        int16x8_t y_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(Y)));
+        uint8x16x4_t px;
+        px.val[0] = vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, b2.val[0])), vqmovun_s16(vaddq_s16(y_hi, b2.val[1])));
+        px.val[1] = vcombine_u8(vqmovun_s16(vsubq_s16(y_lo, g2.val[0])), vqmovun_s16(vsubq_s16(y_hi, g2.val[1])));
+        px.val[2] = vcombine_u8(vqmovun_s16(vaddq_s16(y_lo, r2.val[0])), vqmovun_s16(vaddq_s16(y_hi, r2.val[1])));
+        px.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8((uint8_t *) (argb + i), px);
+    }
+    yuv_to_argb_c(y + i, u + i / 2, v + i / 2, argb + i, width - i);
+}
 
-        u = yuv[offset + k] & 0xff;
-        v = yuv[offset * 5 / 4 + k] & 0xff;
-        u = u - 128;
-        v = v - 128;
+static void split_uv_neon(const uint8_t *src, uint8_t *a, uint8_t *b, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t uv = vld2q_u8(src + i * 2);
+        vst1q_u8(a + i, uv.val[0]);
+        vst1q_u8(b + i, uv.val[1]);
+    }
+    split_uv_c(src + i * 2, a + i, b + i, count - i);
+}
 
-        argb[i] = yuv2argb(y1, u, v);
-        argb[i + 1] = yuv2argb(y2, u, v);
-        argb[width + i] = yuv2argb(y3, u, v);
-        argb[width + i + 1] = yuv2argb(y4, u, v);
+static void transpose8x8_neon(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride) {
+    uint8x8x2_t t01 = vtrn_u8(vld1_u8(src), vld1_u8(src + src_stride));
+    uint8x8x2_t t23 = vtrn_u8(vld1_u8(src + 2 * src_stride), vld1_u8(src + 3 * src_stride));
+    uint8x8x2_t t45 = vtrn_u8(vld1_u8(src + 4 * src_stride), vld1_u8(src + 5 * src_stride));
+    uint8x8x2_t t67 = vtrn_u8(vld1_u8(src + 6 * src_stride), vld1_u8(src + 7 * src_stride));
+    uint16x4x2_t u02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]), vreinterpret_u16_u8(t23.val[0]));
+    uint16x4x2_t u13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]), vreinterpret_u16_u8(t23.val[1]));
+    uint16x4x2_t u46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]), vreinterpret_u16_u8(t67.val[0]));
+    uint16x4x2_t u57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]), vreinterpret_u16_u8(t67.val[1]));
+    uint32x2x2_t v04 = vtrn_u32(vreinterpret_u32_u16(u02.val[0]), vreinterpret_u32_u16(u46.val[0]));
+    uint32x2x2_t v15 = vtrn_u32(vreinterpret_u32_u16(u13.val[0]), vreinterpret_u32_u16(u57.val[0]));
+    uint32x2x2_t v26 = vtrn_u32(vreinterpret_u32_u16(u02.val[1]), vreinterpret_u32_u16(u46.val[1]));
+    uint32x2x2_t v37 = vtrn_u32(vreinterpret_u32_u16(u13.val[1]), vreinterpret_u32_u16(u57.val[1]));
+    vst1_u8(dst, vreinterpret_u8_u32(v04.val[0]));
+    vst1_u8(dst + dst_stride, vreinterpret_u8_u32(v15.val[0]));
+    vst1_u8(dst + 2 * dst_stride, vreinterpret_u8_u32(v26.val[0]));
+    vst1_u8(dst + 3 * dst_stride, vreinterpret_u8_u32(v37.val[0]));
+    vst1_u8(dst + 4 * dst_stride, vreinterpret_u8_u32(v04.val[1]));
+    vst1_u8(dst + 5 * dst_stride, vreinterpret_u8_u32(v15.val[1]));
+    vst1_u8(dst + 6 * dst_stride, vreinterpret_u8_u32(v26.val[1]));
+    vst1_u8(dst + 7 * dst_stride, vreinterpret_u8_u32(v37.val[1]));
+}
 
-        if (i != 0 && (i + 2) % width == 0)
-            i += width;
+static void reverse_neon(const uint8_t *src, uint8_t *dst, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t q = vrev64q_u8(vld1q_u8(src + count - 16 - i));
+        vst1q_u8(dst + i, vcombine_u8(vget_high_u8(q), vget_low_u8(q)));
     }
+    reverse_c(src, dst + i, count - i);
 }
 
-static void nv21_to_yuv420p(int8_t *dst, int8_t *src, int len) {
-    memcpy(dst, src, len); // y
-    for (int i = 0; i < len / 4; ++i) {
-        *(dst + len + i) = *(src + len + i * 2 + 1);  // u
-        *(dst + len * 5 / 4 + i) = *(src + len + i * 2); // v
+static const YuvKernels kernels_neon = {
+        "neon",
+        argb_to_y_neon,
+        argb_to_uv_neon,
+        yuv_to_argb_neon,
+        split_uv_neon,
+        transpose8x8_neon,
+        reverse_neon
+};
+
+#endif // YUV_HAVE_NEON
+
+/******************** SSE2 ********************/
+
+#ifdef YUV_HAVE_SSE2
+
+// B, G, R of 8 pixels as 16 bits lanes
+static inline void load_bgr_sse2(__m128i p0, __m128i p1, __m128i *B, __m128i *G, __m128i *R) {
+    const __m128i mask = _mm_set1_epi32(0xff);
+    *B = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    *G = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                         _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    *R = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                         _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+static void argb_to_y_sse2(const uint32_t *argb, uint8_t *y, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m128i B, G, R;
+        load_bgr_sse2(_mm_loadu_si128((const __m128i *) (argb + i)),
+                      _mm_loadu_si128((const __m128i *) (argb + i + 4)), &B, &G, &R);
+        // at most 56228, the 16 bits lanes are used unsigned
+        __m128i Y = _mm_add_epi16(_mm_mullo_epi16(R, _mm_set1_epi16(66)),
+                                  _mm_mullo_epi16(G, _mm_set1_epi16(129)));
+        Y = _mm_add_epi16(Y, _mm_mullo_epi16(B, _mm_set1_epi16(25)));
+        Y = _mm_srli_epi16(_mm_add_epi16(Y, _mm_set1_epi16(128)), 8);
+        Y = _mm_add_epi16(Y, _mm_set1_epi16(16));
+        _mm_storel_epi64((__m128i *) (y + i), _mm_packus_epi16(Y, Y));
     }
+    argb_to_y_c(argb + i, y + i, width - i);
 }
 
-static void nv12_to_yuv420p(int8_t *dst, int8_t *src, int len) {
-    memcpy(dst, src, len); // y
-    for (int i = 0; i < len / 4; ++i) {
-        *(dst + len + i) = *(src + len + i * 2);  // u
-        *(dst + len * 5 / 4 + i) = *(src + len + i * 2 + 1); // v
+static inline __m128i even_pixels_sse2(const uint32_t *argb) {
+    __m128 p0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) argb));
+    __m128 p1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (argb + 4)));
+    return _mm_castps_si128(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static void argb_to_uv_sse2(const uint32_t *argb, uint8_t *u, uint8_t *v, int width) {
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        __m128i B, G, R;
+        load_bgr_sse2(even_pixels_sse2(argb + i), even_pixels_sse2(argb + i + 8), &B, &G, &R);
+        __m128i U = _mm_add_epi16(_mm_mullo_epi16(R, _mm_set1_epi16(-38)),
+                                  _mm_mullo_epi16(G, _mm_set1_epi16(-74)));
+        U = _mm_add_epi16(U, _mm_mullo_epi16(B, _mm_set1_epi16(112)));
+        U = _mm_srai_epi16(_mm_add_epi16(U, _mm_set1_epi16(128)), 8);
+        U = _mm_add_epi16(U, _mm_set1_epi16(128));
+        __m128i V = _mm_add_epi16(_mm_mullo_epi16(R, _mm_set1_epi16(112)),
+                                  _mm_mullo_epi16(G, _mm_set1_epi16(-94)));
+        V = _mm_add_epi16(V, _mm_mullo_epi16(B, _mm_set1_epi16(-18)));
+        V = _mm_srai_epi16(_mm_add_epi16(V, _mm_set1_epi16(128)), 8);
+        V = _mm_add_epi16(V, _mm_set1_epi16(128));
+        _mm_storel_epi64((__m128i *) (u + i / 2), _mm_packus_epi16(U, U));
+        _mm_storel_epi64((__m128i *) (v + i / 2), _mm_packus_epi16(V, V));
     }
+    argb_to_uv_c(argb + i, u + i / 2, v + i / 2, width - i);
 }
 
-static void yuv420p_rotate90(int8_t *dst, const int8_t *src, int width, int height) {
-    int n = 0;
-    int wh = width * height;
-    int half_width = width / 2;
-    int half_height = height / 2;
-    // y
-    for (int j = 0; j < width; j++) {
-        for (int i = height - 1; i >= 0; i--) {
-            dst[n++] = src[width * i + j];
-        }
+static void yuv_to_argb_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint32_t *argb, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8((char) 0xff);
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        __m128i Y = _mm_loadu_si128((const __m128i *) (y + i));
+        __m128i U = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (u + i / 2)), zero),
+                                  _mm_set1_epi16(128));
+        __m128i V = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (v + i / 2)), zero),
+                                  _mm_set1_epi16(128));
+        __m128i dr = _mm_srai_epi16(_mm_mullo_epi16(V, _mm_set1_epi16(90)), 6);
+        __m128i dg = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(U, _mm_set1_epi16(22)),
+                                                  _mm_mullo_epi16(V, _mm_set1_epi16(46))), 6);
+        __m128i db = _mm_srai_epi16(_mm_mullo_epi16(U, _mm_set1_epi16(114)), 6);
+        __m128i y_lo = _mm_unpacklo_epi8(Y, zero);
+        __m128i y_hi = _mm_unpackhi_epi8(Y, zero);
+        // one chroma sample for two pixels
+        __m128i R = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(dr, dr)),
+                                     _mm_add_epi16(y_hi, _mm_unpackhi_epi16(dr, dr)));
+        __m128i G = _mm_packus_epi16(_mm_sub_epi16(y_lo, _mm_unpacklo_epi16(dg, dg)),
+                                     _mm_sub_epi16(y_hi, _mm_unpackhi_epi16(dg, dg)));
+        __m128i B = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(db, db)),
+                                     _mm_add_epi16(y_hi, _mm_unpackhi_epi16(db, db)));
+        __m128i bg_lo = _mm_unpacklo_epi8(B, G);
+        __m128i bg_hi = _mm_unpackhi_epi8(B, G);
+        __m128i ra_lo = _mm_unpacklo_epi8(R, alpha);
+        __m128i ra_hi = _mm_unpackhi_epi8(R, alpha);
+        _mm_storeu_si128((__m128i *) (argb + i), _mm_unpacklo_epi16(bg_lo, ra_lo));
+        _mm_storeu_si128((__m128i *) (argb + i + 4), _mm_unpackhi_epi16(bg_lo, ra_lo));
+        _mm_storeu_si128((__m128i *) (argb + i + 8), _mm_unpacklo_epi16(bg_hi, ra_hi));
+        _mm_storeu_si128((__m128i *) (argb + i + 12), _mm_unpackhi_epi16(bg_hi, ra_hi));
     }
-    // u
-    for (int i = 0; i < half_width; i++) {
-        for (int j = 1; j <= half_height; j++) {
-            dst[n++] = src[wh + ((half_height - j) * half_width + i)];
-        }
+    yuv_to_argb_c(y + i, u + i / 2, v + i / 2, argb + i, width - i);
+}
+
+static void split_uv_sse2(const uint8_t *src, uint8_t *a, uint8_t *b, int count) {
+    const __m128i mask = _mm_set1_epi16(0xff);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *) (src + i * 2));
+        __m128i x1 = _mm_loadu_si128((const __m128i *) (src + i * 2 + 16));
+        _mm_storeu_si128((__m128i *) (a + i),
+                         _mm_packus_epi16(_mm_and_si128(x0, mask), _mm_and_si128(x1, mask)));
+        _mm_storeu_si128((__m128i *) (b + i),
+                         _mm_packus_epi16(_mm_srli_epi16(x0, 8), _mm_srli_epi16(x1, 8)));
     }
-    // v
-    for (int i = 0; i < half_width; i++) {
-        for (int j = 1; j <= half_height; j++) {
-            dst[n++] = src[wh + wh / 4 + ((half_height - j) * half_width + i)];
-        }
+    split_uv_c(src + i * 2, a + i, b + i, count - i);
+}
+
+static void transpose8x8_sse2(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride) {
+    __m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) src),
+                                   _mm_loadl_epi64((const __m128i *) (src + src_stride)));
+    __m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (src + 2 * src_stride)),
+                                   _mm_loadl_epi64((const __m128i *) (src + 3 * src_stride)));
+    __m128i a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (src + 4 * src_stride)),
+                                   _mm_loadl_epi64((const __m128i *) (src + 5 * src_stride)));
+    __m128i a3 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (src + 6 * src_stride)),
+                                   _mm_loadl_epi64((const __m128i *) (src + 7 * src_stride)));
+    __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+    __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+    __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+    // every register holds two output rows
+    __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+    __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+    __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+    __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+    _mm_storel_epi64((__m128i *) dst, c0);
+    _mm_storel_epi64((__m128i *) (dst + dst_stride), _mm_srli_si128(c0, 8));
+    _mm_storel_epi64((__m128i *) (dst + 2 * dst_stride), c1);
+    _mm_storel_epi64((__m128i *) (dst + 3 * dst_stride), _mm_srli_si128(c1, 8));
+    _mm_storel_epi64((__m128i *) (dst + 4 * dst_stride), c2);
+    _mm_storel_epi64((__m128i *) (dst + 5 * dst_stride), _mm_srli_si128(c2, 8));
+    _mm_storel_epi64((__m128i *) (dst + 6 * dst_stride), c3);
+    _mm_storel_epi64((__m128i *) (dst + 7 * dst_stride), _mm_srli_si128(c3, 8));
+}
+
+static void reverse_sse2(const uint8_t *src, uint8_t *dst, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + count - 16 - i));
+        x = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128((__m128i *) (dst + i), x);
+    }
+    reverse_c(src, dst + i, count - i);
+}
+
+static const YuvKernels kernels_sse2 = {
+        "sse2",
+        argb_to_y_sse2,
+        argb_to_uv_sse2,
+        yuv_to_argb_sse2,
+        split_uv_sse2,
+        transpose8x8_sse2,
+        reverse_sse2
+};
+
+#endif // YUV_HAVE_SSE2
+
+/******************** AVX2 ********************/
+
+#ifdef YUV_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void split_uv_avx2(const uint8_t *src, uint8_t *a, uint8_t *b, int count) {
+    const __m256i mask = _mm256_set1_epi16(0xff);
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *) (src + i * 2));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *) (src + i * 2 + 32));
+        // packus works per 128 bits lane, put the quadwords back in order
+        __m256i even = _mm256_packus_epi16(_mm256_and_si256(x0, mask), _mm256_and_si256(x1, mask));
+        __m256i odd = _mm256_packus_epi16(_mm256_srli_epi16(x0, 8), _mm256_srli_epi16(x1, 8));
+        _mm256_storeu_si256((__m256i *) (a + i), _mm256_permute4x64_epi64(even, 0xD8));
+        _mm256_storeu_si256((__m256i *) (b + i), _mm256_permute4x64_epi64(odd, 0xD8));
+    }
+    split_uv_sse2(src + i * 2, a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void argb_to_y_avx2(const uint32_t *argb, uint8_t *y, int width) {
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        __m256i p0 = _mm256_loadu_si256((const __m256i *) (argb + i));
+        __m256i p1 = _mm256_loadu_si256((const __m256i *) (argb + i + 8));
+        __m256i B = _mm256_packs_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask));
+        __m256i G = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+                                       _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask));
+        __m256i R = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+                                       _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask));
+        __m256i Y = _mm256_add_epi16(_mm256_mullo_epi16(R, _mm256_set1_epi16(66)),
+                                     _mm256_mullo_epi16(G, _mm256_set1_epi16(129)));
+        Y = _mm256_add_epi16(Y, _mm256_mullo_epi16(B, _mm256_set1_epi16(25)));
+        Y = _mm256_srli_epi16(_mm256_add_epi16(Y, _mm256_set1_epi16(128)), 8);
+        Y = _mm256_add_epi16(Y, _mm256_set1_epi16(16));
+        // lanes hold pixels 0-3, 8-11 | 4-7, 12-15 after the two per lane packs
+        Y = _mm256_permute4x64_epi64(_mm256_packus_epi16(Y, Y), 0xD8);
+        __m128i out = _mm256_castsi256_si128(Y);
+        out = _mm_unpacklo_epi32(out, _mm_srli_si128(out, 8));
+        _mm_storeu_si128((__m128i *) (y + i), out);
     }
+    argb_to_y_sse2(argb + i, y + i, width - i);
 }
 
-static void yuv420p_rotate180(int8_t *dst, const int8_t *src, int width, int height) {
-    int n = 0;
-    int half_width = width / 2;
-    int half_height = height / 2;
-    // y
-    for (int j = height - 1; j >= 0; j--) {
-        for (int i = width; i > 0; i--) {
-            dst[n++] = src[width * j + i - 1];
+static const YuvKernels kernels_avx2 = {
+        "avx2",
+        argb_to_y_avx2,
+        argb_to_uv_sse2,
+        yuv_to_argb_sse2,
+        split_uv_avx2,
+        transpose8x8_sse2,
+        reverse_sse2
+};
+
+#endif // YUV_HAVE_AVX2
+
+/******************** dispatch ********************/
+
+static const YuvKernels *detect_kernels() {
+#if defined(YUV_HAVE_NEON)
+    return &kernels_neon;
+#elif defined(YUV_HAVE_AVX2)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? &kernels_avx2 : &kernels_sse2;
+#elif defined(YUV_HAVE_SSE2)
+    return &kernels_sse2;
+#else
+    return &kernels_c;
+#endif
+}
+
+static const YuvKernels *simd_kernels = detect_kernels();
+static const YuvKernels *kernels = simd_kernels;
+
+const char *yuv_converter_kernels() {
+    return kernels->name;
+}
+
+void yuv_converter_set_simd(bool enable) {
+    kernels = enable ? simd_kernels : &kernels_c;
+}
+
+/******************** planes ********************/
+
+// edge of the square tiles walked by the rotations, 64*64 bytes of source and destination stay in L1
+#define TILE_SIZE 64
+
+// dst(h*w) = transpose of src(w*h), negative strides flip rows
+static void transpose_plane(const uint8_t *src, int src_stride,
+                            uint8_t *dst, int dst_stride, int width, int height) {
+    int w8 = width & ~7;
+    int h8 = height & ~7;
+    for (int ty = 0; ty < h8; ty += TILE_SIZE) {
+        int y_end = ty + TILE_SIZE < h8 ? ty + TILE_SIZE : h8;
+        for (int tx = 0; tx < w8; tx += TILE_SIZE) {
+            int x_end = tx + TILE_SIZE < w8 ? tx + TILE_SIZE : w8;
+            for (int y = ty; y < y_end; y += 8) {
+                for (int x = tx; x < x_end; x += 8) {
+                    kernels->transpose8x8(src + y * src_stride + x, src_stride,
+                                          dst + x * dst_stride + y, dst_stride);
+                }
+            }
         }
     }
-    // u
-    int offset = width * height;
-    for (int j = half_height - 1; j >= 0; j--) {
-        for (int i = half_width; i > 0; i--) {
-            dst[n++] = src[offset + half_width * j + i - 1];
+    for (int y = 0; y < height; y++) {
+        for (int x = w8; x < width; x++) {
+            dst[x * dst_stride + y] = src[y * src_stride + x];
         }
     }
-    // v
-    offset += half_width * half_height;
-    for (int j = half_height - 1; j >= 0; j--) {
-        for (int i = half_width; i > 0; i--) {
-            dst[n++] = src[offset + half_width * j + i - 1];
+    for (int y = h8; y < height; y++) {
+        for (int x = 0; x < w8; x++) {
+            dst[x * dst_stride + y] = src[y * src_stride + x];
         }
     }
 }
 
-static void yuv420p_rotate270(int8_t *dst, const int8_t *src, int width, int height) {
+// dst[r][c] = src[h - 1 - c][r]
+static void rotate_plane90(const uint8_t *src, uint8_t *dst, int width, int height) {
+    transpose_plane(src + (height - 1) * width, -width, dst, height, width, height);
+}
 
-    for (int j = 0; j < width; j++) {
-        for (int i = 1; i <= height; i++) {
-            *dst++ = *(src + i * width - j);
-        }
+// dst[r][c] = src[c][w - 1 - r]
+static void rotate_plane270(const uint8_t *src, uint8_t *dst, int width, int height) {
+    transpose_plane(src, width, dst + (width - 1) * height, -height, width, height);
+}
+
+static void rotate_plane180(const uint8_t *src, uint8_t *dst, int width, int height) {
+    for (int j = 0; j < height; j++) {
+        kernels->reverse(src + (height - 1 - j) * width, dst + j * width, width);
     }
+}
 
-    auto *src_u = const_cast<int8_t *>(src + width * height);
-    for (int j = 0; j < width / 2; j++) {
-        for (int i = 1; i <= height / 2; i++) {
-            *dst++ = *(src_u + i * width / 2 - j);
+void rgba_to_yuv420p(const int *argb, int8_t *yuv, int width, int height) {
+    int frameSize = width * height;
+    auto *src = reinterpret_cast<const uint32_t *>(argb);
+    auto *y = reinterpret_cast<uint8_t *>(yuv);
+    uint8_t *u = y + frameSize;
+    uint8_t *v = y + frameSize * 5 / 4;
+
+    // I420(YUV420p) -> YYYYYYYY UU VV
+    for (int j = 0; j < height; j++) {
+        kernels->argb_to_y(src + j * width, y + j * width, width);
+        if (j % 2 == 0) {
+            kernels->argb_to_uv(src + j * width, u + j / 2 * (width / 2), v + j / 2 * (width / 2), width);
         }
     }
+}
 
-    auto *src_v = const_cast<int8_t *>(src + width * height * 5 / 4);
-    for (int j = 0; j < width / 2; j++) {
-        for (int i = 1; i <= height / 2; i++) {
-            *dst++ = *(src_v + i * width / 2 - j);
-        }
+void yuv420p_to_argb(const int8_t *yuv, int *argb, int width, int height) {
+    int size = width * height;
+    auto *y = reinterpret_cast<const uint8_t *>(yuv);
+    const uint8_t *u = y + size;
+    const uint8_t *v = y + size * 5 / 4;
+    auto *dst = reinterpret_cast<uint32_t *>(argb);
+
+    for (int j = 0; j < height; j++) {
+        kernels->yuv_to_argb(y + j * width, u + j / 2 * (width / 2), v + j / 2 * (width / 2),
+                             dst + j * width, width);
     }
 }
 
-static void yuv420p_rotate(int8_t *dst, int8_t *src, int width, int height, int degree) {
+void nv21_to_yuv420p(int8_t *dst, int8_t *src, int len) {
+    memcpy(dst, src, len); // y
+    auto *uv = reinterpret_cast<const uint8_t *>(src + len);
+    auto *u = reinterpret_cast<uint8_t *>(dst + len);
+    auto *v = reinterpret_cast<uint8_t *>(dst + len * 5 / 4);
+    kernels->split_uv(uv, v, u, len / 4); // vu
+}
+
+void nv12_to_yuv420p(int8_t *dst, int8_t *src, int len) {
+    memcpy(dst, src, len); // y
+    auto *uv = reinterpret_cast<const uint8_t *>(src + len);
+    auto *u = reinterpret_cast<uint8_t *>(dst + len);
+    auto *v = reinterpret_cast<uint8_t *>(dst + len * 5 / 4);
+    kernels->split_uv(uv, u, v, len / 4); // uv
+}
+
+void yuv420p_rotate(int8_t *dst, int8_t *src, int width, int height, int degree) {
+    void (*rotate_plane)(const uint8_t *, uint8_t *, int, int);
     switch(degree) {
         case 0:
             memcpy(dst, src, width * height * 3 / 2);
-            break;
+            return;
         case 90:
-            yuv420p_rotate90(dst, src, width, height);
+            rotate_plane = rotate_plane90;
             break;
         case 180:
-            yuv420p_rotate180(dst, src, width, height);
+            rotate_plane = rotate_plane180;
             break;
         case 270:
-            yuv420p_rotate270(dst, src, width, height);
+            rotate_plane = rotate_plane270;
             break;
         default:
-            break;
+            return;
     }
-}
\ No newline at end of file
+    int wh = width * height;
+    auto *s = reinterpret_cast<const uint8_t *>(src);
+    auto *d = reinterpret_cast<uint8_t *>(dst);
+    rotate_plane(s, d, width, height); // y
+    rotate_plane(s + wh, d + wh, width / 2, height / 2); // u
+    rotate_plane(s + wh * 5 / 4, d + wh * 5 / 4, width / 2, height / 2); // v
+}
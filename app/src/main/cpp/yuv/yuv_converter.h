@@ -7,11 +7,25 @@
 
 #include <cstdint>
 
-static void rgba_to_yuv420p(const int *argb, int8_t *yuv, int width, int height);
+/**
+ * convert ARGB(0xAARRGGBB, as Bitmap#getPixels) to YUV420P
+ * @param argb data of argb
+ * @param yuv data of yuv420p
+ * @param width width, even
+ * @param height height, even
+ */
+void rgba_to_yuv420p(const int *argb, int8_t *yuv, int width, int height);
 
-static void yuv420p_to_argb(const int8_t *yuv, int *argb, int width, int height);
+/**
+ * convert YUV420P to ARGB(0xAARRGGBB)
+ */
+void yuv420p_to_argb(const int8_t *yuv, int *argb, int width, int height);
 
-static void yuv420p_rotate(int8_t *dst, int8_t *src, int width, int height, int degree);
+/**
+ * rotate YUV420P clockwise
+ * @param degree 0, 90, 180 or 270, the size of dst is height*width when rotating 90 or 270
+ */
+void yuv420p_rotate(int8_t *dst, int8_t *src, int width, int height, int degree);
 
 /**
  * convert NV21 to YUV420P
@@ -19,7 +33,7 @@ static void yuv420p_rotate(int8_t *dst, int8_t *src, int width, int height, int
  * @param src data of nv21
  * @param len width*height
  */
-static void nv21_to_yuv420p(int8_t *dst, int8_t *src, int len);
+void nv21_to_yuv420p(int8_t *dst, int8_t *src, int len);
 
 /**
  * convert NV12 to YUV420P
@@ -27,6 +41,17 @@ static void nv21_to_yuv420p(int8_t *dst, int8_t *src, int len);
  * @param src data of nv12
  * @param len width*height
  */
-static void nv12_to_yuv420p(int8_t *dst, int8_t *src, int len);
+void nv12_to_yuv420p(int8_t *dst, int8_t *src, int len);
+
+/**
+ * The kernels are picked once according to the CPU: "neon", "sse2", "avx2" or "c".
+ * SIMD and C kernels give identical output.
+ */
+const char *yuv_converter_kernels();
+
+/**
+ * Fall back to the C kernels, for comparing
+ */
+void yuv_converter_set_simd(bool enable);
 
 #endif //FFMPEGANDROID_YUV_CONVERTER_H
@@ -1,11 +1,9 @@
 package com.frank.ffmpeg;
 
-import android.media.AudioFormat;
-import android.media.AudioManager;
-import android.media.AudioTrack;
+import com.frank.ffmpeg.effect.FrankVisualizer;
 
 /**
- * AudioPlayer: use AudioTrack and OpenSL ES to play audio
+ * AudioPlayer: decode with FFmpeg and play with OpenSL ES
  * Created by frank on 2018/2/1.
  */
 
@@ -14,87 +12,143 @@ public class AudioPlayer {
         System.loadLibrary("media-handle");
     }
 
+    /**
+     * Output of the device
+     */
+    public static final int OUTPUT_OPENSL = 0;
+    /**
+     * No output, paced in real time
+     */
+    public static final int OUTPUT_NULL   = 1;
+    /**
+     * Write into a wav file, as fast as decoding goes
+     */
+    public static final int OUTPUT_WAV    = 2;
+
     private long audioContext = 0;
 
-    private AudioTrack mAudioTrack;
+    private int outputType = OUTPUT_OPENSL;
+
+    private String outputPath;
+
+    private FrankVisualizer visualizer;
 
     private native long native_init();
 
-    private native void native_play(long context, String audioPath, String filter);
+    private native void native_play(long context, String audioPath, String filter,
+                                    int outputType, String outputPath);
 
     private native void native_again(long context, String filterDesc);
 
+    private native void native_set_speed(long context, float speed);
+
+    private native int native_attach_visualizer(long context, FrankVisualizer visualizer);
+
     private native long native_get_position(long context);
 
     private native long native_get_duration(long context);
 
+    private native long[] native_get_effect_stats(long context);
+
     private native void native_release(long context);
 
+    /**
+     * Select the output before playing
+     *
+     * @param type OUTPUT_OPENSL, OUTPUT_NULL or OUTPUT_WAV
+     * @param path path of the wav file, for OUTPUT_WAV
+     */
+    public void setOutput(int type, String path) {
+        outputType = type;
+        outputPath = path;
+    }
+
+    /**
+     * Block until the end of playing, or release()
+     */
     public void play(String audioPath, String filter) {
-        audioContext = native_init();
-        native_play(audioContext, audioPath, filter);
+        long context;
+        synchronized (this) {
+            // the previous player is stopped and freed
+            release();
+            context = audioContext = native_init();
+            if (visualizer != null) {
+                native_attach_visualizer(context, visualizer);
+            }
+        }
+        native_play(context, audioPath, filter, outputType, outputPath);
     }
 
-    public void again(String filterDesc) {
+    /**
+     * Change the filter while playing: when only option values change,
+     * they are applied to the running filter, otherwise it is crossfaded.
+     */
+    public synchronized void again(String filterDesc) {
         if (audioContext == 0) {
             return;
         }
         native_again(audioContext, filterDesc);
     }
 
-    public long getCurrentPosition() {
+    /**
+     * Change the speed while playing, the pitch is kept.
+     *
+     * @param speed from 0.5 to 4.0
+     */
+    public synchronized void setSpeed(float speed) {
         if (audioContext == 0) {
-            return 0;
+            return;
         }
-        return native_get_position(audioContext);
+        native_set_speed(audioContext, speed);
     }
 
-    public long getDuration() {
+    /**
+     * Feed the visualizer with what is played, natively: read its spectrum
+     * with FrankVisualizer.readSpectrum(). Kept for the next play() calls.
+     *
+     * @param visualizer initialized, null to stop
+     */
+    public synchronized void setVisualizer(FrankVisualizer visualizer) {
+        if (this.visualizer != null && this.visualizer != visualizer) {
+            this.visualizer.detachPlayer();
+        }
+        this.visualizer = visualizer;
+        if (visualizer != null && audioContext != 0) {
+            native_attach_visualizer(audioContext, visualizer);
+        }
+    }
+
+    public synchronized long getCurrentPosition() {
         if (audioContext == 0) {
             return 0;
         }
-        return native_get_duration(audioContext);
+        return native_get_position(audioContext);
     }
 
-    public void release() {
+    public synchronized long getDuration() {
         if (audioContext == 0) {
-            return;
+            return 0;
         }
-        native_release(audioContext);
-        audioContext = 0;
+        return native_get_duration(audioContext);
     }
 
-
     /**
-     * Create an AudioTrack instance for JNI calling
-     *
-     * @param sampleRate sampleRate
-     * @param channels   channel layout
-     * @return AudioTrack
+     * @return {commands, rebuilds, last build us, last swap us, max swap us}
      */
-    public AudioTrack createAudioTrack(int sampleRate, int channels) {
-        int audioFormat = AudioFormat.ENCODING_PCM_16BIT;
-        int channelConfig;
-        if (channels == 1) {
-            channelConfig = AudioFormat.CHANNEL_OUT_MONO;
-        } else if (channels == 2) {
-            channelConfig = AudioFormat.CHANNEL_OUT_STEREO;
-        } else {
-            channelConfig = AudioFormat.CHANNEL_OUT_STEREO;
+    public synchronized long[] getEffectStats() {
+        if (audioContext == 0) {
+            return null;
         }
-
-        int bufferSizeInBytes = AudioTrack.getMinBufferSize(sampleRate, channelConfig, audioFormat);
-
-        mAudioTrack = new AudioTrack(AudioManager.STREAM_MUSIC, sampleRate, channelConfig, audioFormat,
-                bufferSizeInBytes, AudioTrack.MODE_STREAM);
-        return mAudioTrack;
+        return native_get_effect_stats(audioContext);
     }
 
-    public void releaseAudioTrack() {
-        if (mAudioTrack != null) {
-            mAudioTrack.release();
-            mAudioTrack = null;
+    public synchronized void release() {
+        if (audioContext == 0) {
+            return;
         }
+        // stops playing, waits for play() to return, then frees
+        native_release(audioContext);
+        audioContext = 0;
     }
 
     private OnFFTCallback onFFTCallback;
@@ -13,4 +13,70 @@ public class CommonMediaHelper {
 
     public native int audioResample(String inputFile, String outputFile, int sampleRate);
 
+    /**
+     * Resample inputFiles[i] into outputFiles[i] on a pool of threads.
+     *
+     * @param threads 0 for one per core
+     * @return {result, samples, elapsed us} of each file,
+     * followed by the samples per second and the elapsed us of the whole batch
+     */
+    public native long[] audioResampleBatch(String[] inputFiles, String[] outputFiles, int sampleRate, int threads);
+
+    /**
+     * Persist the key frame indexes of media files into dir, e.g. Context#getCacheDir(),
+     * for fast seeking with FFmpegMediaRetriever, cutting and playing.
+     */
+    public native void setKeyFrameIndexDir(String dir);
+
+    /**
+     * Cut [start, start + duration) frame accurately: the GOPs inside are copied,
+     * only the ones across the edges are re-encoded (H.264), other codecs are cut at key frames.
+     *
+     * @param start    milliseconds
+     * @param duration milliseconds, 0 for the rest of the file
+     */
+    public native int cutVideo(String inputFile, String outputFile, long start, long duration);
+
+    /**
+     * Cut many clips in one pass over the input, instead of one cutVideo() each.
+     * Clip i is [starts[i], starts[i] + durations[i]) milliseconds, written into outputFiles[i].
+     */
+    public native int cutVideos(String inputFile, long[] starts, long[] durations, String[] outputFiles);
+
+    /**
+     * Change the speed of a raw s16 PCM file, the pitch is kept.
+     *
+     * @param speed from 0.5 to 4.0
+     */
+    public native int pcmChangeSpeed(String inputFile, String outputFile, int sampleRate, int channels, float speed);
+
+    /**
+     * Stretch seconds of generated stereo audio at speed, natively and with the atempo filter.
+     *
+     * @return {native us, atempo us} per second of audio
+     */
+    public native long[] audioSpeedBenchmark(float speed, int seconds);
+
+    /**
+     * Throughput of the PCM kernels with SIMD and in C, the names and the kernel set are logged.
+     *
+     * @param bytes input of each kernel, 0 for 16MB
+     * @return {simd GB/s, c GB/s, 1 if the outputs are identical} of each kernel
+     */
+    public native double[] pcmKernelsBenchmark(int bytes);
+
+    /**
+     * Convert NV21, e.g. of a camera preview, into the pixels of an ARGB_8888 Bitmap.
+     *
+     * @param argb holds width * height, both even
+     */
+    public native int nv21ToArgb(byte[] nv21, int[] argb, int width, int height);
+
+    /**
+     * Convert the pixels of an ARGB_8888 Bitmap into YUV420P.
+     *
+     * @param yuv holds width * height * 3 / 2, both even
+     */
+    public native int argbToYuv420p(int[] argb, byte[] yuv, int width, int height);
+
 }
@@ -0,0 +1,157 @@
+package com.frank.ffmpeg;
+
+import android.view.Surface;
+
+/**
+ * FFPlayer: demux, decode audio and video on their own threads,
+ * show the video following the audio clock.
+ */
+public class FFPlayer {
+
+    static {
+        System.loadLibrary("media-handle");
+    }
+
+    /**
+     * Output of the device
+     */
+    public static final int OUTPUT_OPENSL = 0;
+    /**
+     * No audio output, paced in real time
+     */
+    public static final int OUTPUT_NULL   = 1;
+    /**
+     * Write the audio into a wav file
+     */
+    public static final int OUTPUT_WAV    = 2;
+
+    private long playerContext = 0;
+
+    private int outputType = OUTPUT_OPENSL;
+
+    private String outputPath;
+
+    private native long native_init();
+
+    private native int native_open(long context, String path, int fd, long offset, long length,
+                                   Surface surface, int outputType, String outputPath);
+
+    private native int native_start(long context);
+
+    private native void native_pause(long context);
+
+    private native void native_resume(long context);
+
+    private native void native_seek(long context, long position);
+
+    private native long native_get_position(long context);
+
+    private native long native_get_duration(long context);
+
+    private native boolean native_is_completed(long context);
+
+    private native long[] native_get_stats(long context);
+
+    private native void native_release(long context);
+
+    /**
+     * Select the audio output before prepare()
+     *
+     * @param type OUTPUT_OPENSL, OUTPUT_NULL or OUTPUT_WAV
+     * @param path path of the wav file, for OUTPUT_WAV
+     */
+    public void setOutput(int type, String path) {
+        outputType = type;
+        outputPath = path;
+    }
+
+    /**
+     * @param surface where the video is shown, null for no video output
+     * @return 0 on success
+     */
+    public int prepare(String path, Surface surface) {
+        return prepare(path, -1, 0, 0, surface);
+    }
+
+    /**
+     * Play a window of a file descriptor, e.g. from ParcelFileDescriptor#getFd()
+     */
+    public int prepare(int fd, long offset, long length, Surface surface) {
+        return prepare(null, fd, offset, length, surface);
+    }
+
+    private int prepare(String path, int fd, long offset, long length, Surface surface) {
+        release();
+        playerContext = native_init();
+        return native_open(playerContext, path, fd, offset, length, surface, outputType, outputPath);
+    }
+
+    public void start() {
+        if (playerContext == 0) {
+            return;
+        }
+        native_start(playerContext);
+    }
+
+    public void pause() {
+        if (playerContext == 0) {
+            return;
+        }
+        native_pause(playerContext);
+    }
+
+    public void resume() {
+        if (playerContext == 0) {
+            return;
+        }
+        native_resume(playerContext);
+    }
+
+    /**
+     * @param position milliseconds, shown exactly, not from the key frame before it
+     */
+    public void seekTo(long position) {
+        if (playerContext == 0) {
+            return;
+        }
+        native_seek(playerContext, position);
+    }
+
+    public long getCurrentPosition() {
+        if (playerContext == 0) {
+            return 0;
+        }
+        return native_get_position(playerContext);
+    }
+
+    public long getDuration() {
+        if (playerContext == 0) {
+            return 0;
+        }
+        return native_get_duration(playerContext);
+    }
+
+    public boolean isCompleted() {
+        return playerContext != 0 && native_is_completed(playerContext);
+    }
+
+    /**
+     * @return {frames rendered, dropped late, dropped after decoding, audio underruns,
+     * first frame us, first frame after seek us, avg drift us, max drift us}
+     */
+    public long[] getStats() {
+        if (playerContext == 0) {
+            return null;
+        }
+        return native_get_stats(playerContext);
+    }
+
+    public void release() {
+        if (playerContext == 0) {
+            return;
+        }
+        native_release(playerContext);
+        playerContext = 0;
+    }
+
+}
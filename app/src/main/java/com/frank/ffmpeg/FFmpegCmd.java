@@ -10,6 +10,8 @@ import java.lang.annotation.Documented;
 import java.lang.annotation.Retention;
 import java.lang.annotation.RetentionPolicy;
 import java.util.List;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.atomic.AtomicInteger;
 
 import androidx.annotation.IntDef;
 
@@ -100,6 +102,51 @@ public class FFmpegCmd {
         });
     }
 
+    /**
+     * Execute independent FFmpeg commands concurrently, one session per command
+     * @param commands the list of command
+     * @param onHandleListener the callback of the whole batch, progress is the count of finished commands
+     */
+    public static void executeConcurrently(final List<String[]> commands, final OnHandleListener onHandleListener) {
+        ThreadPoolUtil.INSTANCE.executeSingleThreadPool(new Runnable() {
+            @Override
+            public void run() {
+                if (onHandleListener != null) {
+                    onHandleListener.onBegin();
+                }
+                final int total = commands.size();
+                final CountDownLatch latch = new CountDownLatch(total);
+                final AtomicInteger finished = new AtomicInteger();
+                final AtomicInteger result = new AtomicInteger();
+                for (final String[] command : commands) {
+                    ThreadPoolUtil.INSTANCE.executeMultiThreadPool(new Runnable() {
+                        @Override
+                        public void run() {
+                            FFmpegSession session = new FFmpegSession(null);
+                            int ret = session.execute(command);
+                            session.release();
+                            if (ret != 0) {
+                                result.set(ret);
+                            }
+                            if (onHandleListener != null) {
+                                onHandleListener.onProgress(finished.incrementAndGet(), total);
+                            }
+                            latch.countDown();
+                        }
+                    });
+                }
+                try {
+                    latch.await();
+                } catch (InterruptedException e) {
+                    Log.e(TAG, "executeConcurrently interrupted:" + e.toString());
+                }
+                if (onHandleListener != null) {
+                    onHandleListener.onEnd(result.get(), "");
+                }
+            }
+        });
+    }
+
     public static void cancelTask(boolean cancel) {
         cancelTaskJni(cancel ? 1 : 0);
     }
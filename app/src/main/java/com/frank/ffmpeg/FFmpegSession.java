@@ -0,0 +1,110 @@
+package com.frank.ffmpeg;
+
+import android.util.Log;
+
+import com.frank.ffmpeg.listener.OnHandleListener;
+
+/**
+ * One native FFmpeg engine, holding all the state of a command.
+ * Different sessions may execute commands concurrently on separate threads,
+ * while one session executes one command at a time.
+ */
+public class FFmpegSession {
+
+    static {
+        System.loadLibrary("media-handle");
+    }
+
+    private final static String TAG = FFmpegSession.class.getSimpleName();
+
+    private long mNativeSession;
+
+    // guards the handle against cancel(), execute() holding the session lock while running
+    private final Object mHandleLock = new Object();
+
+    private final OnHandleListener mListener;
+
+    public FFmpegSession(OnHandleListener listener) {
+        mListener = listener;
+        mNativeSession = nativeCreate();
+    }
+
+    /**
+     * Execute FFmpeg command on the calling thread
+     * @param commands the String array of command
+     * @return the result of executing, 0 means success
+     */
+    public synchronized int execute(String[] commands) {
+        if (mNativeSession == 0) {
+            return -1;
+        }
+        if (mListener != null) {
+            mListener.onBegin();
+        }
+        int result = nativeExecute(mNativeSession, commands);
+        if (mListener != null) {
+            mListener.onEnd(result, "");
+        }
+        return result;
+    }
+
+    /**
+     * Cancel the command running in this session, and exit quietly
+     */
+    public void cancel() {
+        synchronized (mHandleLock) {
+            if (mNativeSession != 0) {
+                nativeCancel(mNativeSession, 1);
+            }
+        }
+    }
+
+    /**
+     * Release the native session, waiting for the running command to exit
+     */
+    public void release() {
+        cancel();
+        synchronized (this) {
+            synchronized (mHandleLock) {
+                if (mNativeSession != 0) {
+                    nativeRelease(mNativeSession);
+                    mNativeSession = 0;
+                }
+            }
+        }
+    }
+
+    private void onProgress(int position, int duration, @FFmpegCmd.FFmpegState int state) {
+        if (mListener == null || (position > duration && duration > 0)) {
+            return;
+        }
+        if (position > 0 && duration > 0) {
+            int progress = position * 100 / duration;
+            if (progress < 100) {
+                mListener.onProgress(progress, duration);
+            }
+        } else {
+            mListener.onProgress(position, duration);
+        }
+    }
+
+    private void onMsg(String msg, int level) {
+        if (msg != null && !msg.isEmpty()) {
+            Log.e(TAG, "from native msg=" + msg);
+
+            // silence detect callback
+            if (msg.startsWith("silence") && mListener != null) {
+                mListener.onMsg(msg);
+            }
+        }
+    }
+
+    private native long nativeCreate();
+
+    private native int nativeExecute(long session, String[] commands);
+
+    private native void nativeCancel(long session, int cancel);
+
+    private native void nativeRelease(long session);
+
+}
@@ -0,0 +1,43 @@
+package com.frank.ffmpeg;
+
+/**
+ * Encoder and filter settings of {@link VideoPlayer#executeTranscode}.
+ * Fields left unset keep the codec and parameters of the input stream,
+ * and a stream with nothing to change is copied without re-encoding.
+ */
+public class TranscodeOptions {
+
+    /** the name of video encoder, such as "libx264"; "copy" forces stream copy */
+    public String videoCodec;
+
+    /** the bit rate of video in bit/s, 0 means unset */
+    public long videoBitRate;
+
+    /** constant rate factor of video, -1 means unset */
+    public int videoCrf = -1;
+
+    /** the preset of video encoder, such as "veryfast" */
+    public String videoPreset;
+
+    /** the filter graph of video, such as "scale=1280:-2" */
+    public String videoFilter;
+
+    /** the name of audio encoder, such as "aac"; "copy" forces stream copy */
+    public String audioCodec;
+
+    /** the bit rate of audio in bit/s, 0 means unset */
+    public long audioBitRate;
+
+    /** constant rate factor of audio, -1 means unset */
+    public int audioCrf = -1;
+
+    /** the preset of audio encoder */
+    public String audioPreset;
+
+    /** the filter graph of audio, such as "volume=0.5" */
+    public String audioFilter;
+
+    /** the thread count of each decoder and encoder, 0 means auto */
+    public int threadCount;
+
+}
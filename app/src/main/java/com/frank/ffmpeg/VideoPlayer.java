@@ -18,11 +18,34 @@ public class VideoPlayer {
 
     public native void again(int position);
 
+    /**
+     * Add a filter description, which can then be switched to with again()
+     *
+     * @return the position of the filter, -1 if there are too many
+     */
+    public native int addFilter(String filterDesc);
+
+    /**
+     * Four values per filter: {build us, frames, avg us per frame, max us per frame}
+     */
+    public native long[] getFilterStats();
+
     public native void release();
 
     public native void playAudio(boolean play);
 
-    public native int executeTranscode(String inputFile, String outputFile);
+    public int executeTranscode(String inputFile, String outputFile) {
+        return executeTranscode(inputFile, outputFile, null);
+    }
+
+    /**
+     * Transcode with the given encoder and filter settings,
+     * streams without anything to change are copied as-is.
+     *
+     * @param options the settings of transcoding, null means stream copy when possible
+     * @return the result of transcoding, 0 means success
+     */
+    public native int executeTranscode(String inputFile, String outputFile, TranscodeOptions options);
 
     /**
      * Create an AudioTrack instance for JNI calling
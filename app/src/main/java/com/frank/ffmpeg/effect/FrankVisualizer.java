@@ -11,43 +11,87 @@ public class FrankVisualizer {
 
     private long mNativeVisualizer;
 
-    private static OnFftDataListener mOnFftDataListener;
-
     public FrankVisualizer() {}
 
-    public void setOnFftDataListener(OnFftDataListener onFftDataListener) {
-        mOnFftDataListener = onFftDataListener;
-    }
-
     public int initVisualizer() {
         return nativeInitVisualizer();
     }
 
-    public void captureData(ByteBuffer data, int size) {
-        if (data == null || size <= 0) {
-            nativeCaptureData(data, size);
-        }
+    /**
+     * @param fftSize power of two from 128 to 8192, the size of the fft data
+     * @return 0, or negative if not supported
+     */
+    public int setFftSize(int fftSize) {
+        return nativeSetFftSize(fftSize);
     }
 
-    public void releaseVisualizer() {
-        mOnFftDataListener = null;
-        nativeReleaseVisualizer();
+    /**
+     * Bands spaced by log of frequency, levels in dB mapped from [minDb, maxDb] to [0, 1].
+     * The default is 64 bands from 40 to 16000Hz at 44100Hz, from -70 to 0 dB.
+     * @param bands at most 128
+     * @return 0, or negative if not valid
+     */
+    public int setSpectrumConfig(int sampleRate, int bands, float minFreq, float maxFreq,
+                                 float minDb, float maxDb) {
+        return nativeSetSpectrumConfig(sampleRate, bands, minFreq, maxFreq, minDb, maxDb);
+    }
+
+    /**
+     * Stop taking the pcm of the player, see AudioPlayer.setVisualizer()
+     */
+    public void detachPlayer() {
+        nativeDetachPlayer();
     }
 
-    public interface OnFftDataListener {
-        void onFftData(byte[] data);
+    /**
+     * The spectrum is computed when captured and kept natively: poll it from the
+     * render thread, e.g. in a Choreographer frame callback. Not thread safe.
+     * Attached to an AudioPlayer, its latest pcm is analyzed by this call.
+     * @param levels smoothed level of each band, from 0 to 1
+     * @param peaks  peak hold of each band, from 0 to 1, may be null
+     * @return bands written, 0 if nothing new since the last call
+     */
+    public int readSpectrum(float[] levels, float[] peaks) {
+        return nativeReadSpectrum(levels, peaks);
     }
 
-    public static void onFftCallback(byte[] data) {
-        if (mOnFftDataListener != null) {
-            mOnFftDataListener.onFftData(data);
+    /**
+     * @param data direct buffer of s16 pcm
+     * @param size size of data in bytes
+     */
+    public void captureData(ByteBuffer data, int size) {
+        if (data != null && size > 0) {
+            nativeCaptureData(data, size);
         }
     }
 
+    /**
+     * Time the fft of each size, 5 values per size: size, plan us,
+     * plan without SIMD us, fixed fft us (0 above 1024) and float fft us (only at 256).
+     */
+    public static double[] fftBenchmark() {
+        return nativeFftBenchmark();
+    }
+
+    public void releaseVisualizer() {
+        nativeReleaseVisualizer();
+    }
+
     private native int nativeInitVisualizer();
 
     private native int nativeCaptureData(ByteBuffer buffer, int size);
 
+    private native int nativeSetFftSize(int fftSize);
+
+    private native int nativeSetSpectrumConfig(int sampleRate, int bands, float minFreq, float maxFreq,
+                                               float minDb, float maxDb);
+
+    private native int nativeReadSpectrum(float[] levels, float[] peaks);
+
+    private static native double[] nativeFftBenchmark();
+
+    private native void nativeDetachPlayer();
+
     private native void nativeReleaseVisualizer();
 
 }
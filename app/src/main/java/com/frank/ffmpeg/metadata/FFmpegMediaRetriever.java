@@ -12,6 +12,7 @@ import android.util.Log;
 import java.io.FileDescriptor;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 
 /**
  *  Retrieve frame and extract metadata from an input media file.
@@ -37,6 +38,35 @@ public class FFmpegMediaRetriever {
     public void setDataSource(String path) {
         native_setDataSource(path);
     }
+
+    /**
+     * Set the read-ahead of FileDescriptor and Uri sources, before setDataSource.
+     * They are read with pread through a cache of blocks, so seeking is as cheap as for paths.
+     *
+     * @param blockSize bytes read ahead at a time, 0 for the default 64KB
+     * @param blocks    number of blocks cached, 0 for the default 16
+     */
+    public void setIOCache(int blockSize, int blocks) {
+        native_setIOCache(blockSize, blocks);
+    }
+
+    /**
+     * Only extract metadata, before setDataSource: probing is limited to the container headers
+     * and the decoders are not opened, unless frames are asked for later.
+     * Some keys need the decoders, e.g. pixel_format may be missing.
+     */
+    public void setMetadataOnly(boolean enable) {
+        native_setMetadataOnly(enable);
+    }
+
+    /**
+     * Persist the metadata of local files into dir, e.g. Context#getCacheDir().
+     * A file unchanged since, by size and modified time, is then not opened
+     * by setDataSource, its metadata is served from the cache.
+     */
+    public static void setMetadataCacheDir(String dir) {
+        native_setMetadataCacheDir(dir);
+    }
     
     /**
      * Sets the data source (FileDescriptor) to use. It is the caller's
@@ -199,6 +229,58 @@ public class FFmpegMediaRetriever {
         return getScaledFrameAtTime(timeUs, OPTION_CLOSEST_SYNC, width, height);
     }
 
+    /**
+     * Call this method after setDataSource(). Retrieve frames at many times in one pass,
+     * such as a timeline strip. The times are visited in ascending order, and targets
+     * sharing a key frame are decoded without seeking again. Frames are not encoded,
+     * raw RGBA is written into the buffers.
+     *
+     * @param timesUs The time positions where the frames will be retrieved.
+     * @param option  see {@link #getFrameAtTime(long, int)}
+     * @param width   width of the output, after rotating
+     * @param height  height of the output, after rotating
+     * @param buffers direct buffers of width*height*4 bytes, one per time
+     * @return time of the frame written into each buffer, or -1 if the frame
+     *         cannot be retrieved. Null if nothing can be retrieved.
+     */
+    public long[] getFramesAtTimes(long[] timesUs, int option, int width, int height, ByteBuffer[] buffers) {
+        if (option < OPTION_PREVIOUS_SYNC ||
+                option > OPTION_CLOSEST) {
+            throw new IllegalArgumentException("Unsupported option: " + option);
+        }
+
+        return native_getFramesAtTimes(timesUs, option, width, height, buffers);
+    }
+
+    /**
+     * Same as {@link #getFramesAtTimes(long[], int, int, int, ByteBuffer[])}, returning bitmaps.
+     *
+     * @return bitmaps in the order of timesUs, null for a frame not retrieved
+     */
+    public Bitmap[] getFramesAtTimes(long[] timesUs, int option, int width, int height) {
+        int frameSize = width * height * 4;
+        ByteBuffer pixels = ByteBuffer.allocateDirect(frameSize * timesUs.length);
+        ByteBuffer[] buffers = new ByteBuffer[timesUs.length];
+        for (int i = 0; i < timesUs.length; i++) {
+            pixels.limit((i + 1) * frameSize);
+            pixels.position(i * frameSize);
+            buffers[i] = pixels.slice();
+        }
+
+        long[] frameTimes = getFramesAtTimes(timesUs, option, width, height, buffers);
+        Bitmap[] bitmaps = new Bitmap[timesUs.length];
+        if (frameTimes == null) {
+            return bitmaps;
+        }
+        for (int i = 0; i < timesUs.length; i++) {
+            if (frameTimes[i] >= 0) {
+                bitmaps[i] = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888);
+                bitmaps[i].copyPixelsFromBuffer(buffers[i]);
+            }
+        }
+        return bitmaps;
+    }
+
     public Bitmap getAudioThumbnail() {
         byte[] picture = native_getAudioThumbnail();
         if (picture != null) {
@@ -222,12 +304,20 @@ public class FFmpegMediaRetriever {
 
     private native String native_extractMetadata(String key);
 
+    private native void native_setIOCache(int blockSize, int blocks);
+
+    private native void native_setMetadataOnly(boolean enable);
+
+    private static native void native_setMetadataCacheDir(String dir);
+
     private native void native_setSurface(Object surface);
 
     private native byte[] native_getFrameAtTime(long timeUs, int option);
 
     private native byte[] native_getScaleFrameAtTime(long timeUs, int option, int width, int height);
 
+    private native long[] native_getFramesAtTimes(long[] timesUs, int option, int width, int height, ByteBuffer[] buffers);
+
     private native byte[] native_getAudioThumbnail();
 
     private native void native_release();
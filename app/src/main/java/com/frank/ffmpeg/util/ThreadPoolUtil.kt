@@ -7,9 +7,16 @@ object ThreadPoolUtil {
 
     private val executor = Executors.newSingleThreadExecutor()
 
+    private val multiExecutor = Executors.newFixedThreadPool(Runtime.getRuntime().availableProcessors())
+
     fun executeSingleThreadPool(runnable: Runnable): ExecutorService {
         executor.submit(runnable)
         return executor
     }
 
+    fun executeMultiThreadPool(runnable: Runnable): ExecutorService {
+        multiExecutor.submit(runnable)
+        return multiExecutor
+    }
+
 }